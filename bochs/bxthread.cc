@@ -19,7 +19,12 @@
 //  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
 /////////////////////////////////////////////////////////////////////////
 
+#ifdef BXIMAGE
+#include "config.h"
+#include "misc/bxcompat.h"
+#else
 #include "bochs.h"
+#endif
 #include "bxthread.h"
 
 // Bochs multi-threading support
@@ -100,6 +105,29 @@ void BOCHSAPI_MSVCONLY bx_wait_sem(bx_thread_sem_t *thread_sem)
 #endif
 }
 
+// returns 0 if the semaphore has not been signaled within 'msec' ms
+bool BOCHSAPI_MSVCONLY bx_wait_sem_timeout(bx_thread_sem_t *thread_sem, unsigned msec)
+{
+#if defined(WIN32)
+  return (WaitForSingleObject(thread_sem->sem, msec) == WAIT_OBJECT_0);
+#else
+  struct timespec ts;
+  int ret;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += msec / 1000;
+  ts.tv_nsec += (msec % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  do {
+    ret = sem_timedwait(&thread_sem->sem, &ts);
+  } while ((ret != 0) && (errno == EINTR));
+  return (ret == 0);
+#endif
+}
+
 void BOCHSAPI_MSVCONLY bx_set_sem(bx_thread_sem_t *thread_sem)
 {
 #if defined(WIN32)
@@ -86,6 +86,7 @@ bool BOCHSAPI_MSVCONLY bx_wait_for_event(bx_thread_event_t *thread_ev);
 bool BOCHSAPI_MSVCONLY bx_create_sem(bx_thread_sem_t *thread_sem);
 void BOCHSAPI_MSVCONLY bx_destroy_sem(bx_thread_sem_t *thread_sem);
 void BOCHSAPI_MSVCONLY bx_wait_sem(bx_thread_sem_t *thread_sem);
+bool BOCHSAPI_MSVCONLY bx_wait_sem_timeout(bx_thread_sem_t *thread_sem, unsigned msec);
 void BOCHSAPI_MSVCONLY bx_set_sem(bx_thread_sem_t *thread_sem);
 
 #endif
@@ -211,6 +211,12 @@ void bx_init_std_nic_options(const char *name, bx_list_c *menu)
     "Name of the script that is executed after Bochs initializes the network interface (optional).",
     "none", BX_PATHNAME_LEN);
   path->set_ask_format("Enter new script name, or 'none': [%s] ");
+  path = new bx_param_filename_c(menu,
+    "capture",
+    "Packet capture file",
+    "Name of a pcap-ng file receiving the frames sent and received by the device (optional).",
+    "", BX_PATHNAME_LEN);
+  path->set_format("Packet capture file: %s");
   bootrom = new bx_param_filename_c(menu,
     "bootrom",
     "Boot ROM image",
@@ -1004,6 +1010,18 @@ void bx_init_options()
       "If enabled, the VGA timer is based on realtime",
       1);
 
+  new bx_param_bool_c(display,
+      "vga_render_thread",
+      "VGA render thread",
+      "If enabled, linear framebuffer modes are converted to the host format in a separate thread",
+      0);
+
+  new bx_param_bool_c(display,
+      "vga_update_damage",
+      "VGA damage driven update",
+      "If enabled, the VGA update timer follows the guest display changes and slows down while idle",
+      0);
+
   // The value 0 enables support for using vertical frequency
   bx_param_num_c *vga_update_freq = new bx_param_num_c(display,
       "vga_update_frequency",
@@ -1297,7 +1315,7 @@ void bx_init_options()
     14, 15, 11, 9
   };
 
-  #define BXP_PARAMS_PER_ATA_DEVICE 12
+  #define BXP_PARAMS_PER_ATA_DEVICE 13
 
   bx_list_c *ata_menu[BX_MAX_ATA_CHANNEL];
   bx_list_c *ata_res[BX_MAX_ATA_CHANNEL];
@@ -1467,6 +1485,17 @@ void bx_init_options()
         BX_ATA_TRANSLATION_NONE);
       translation->set_ask_format("Enter translation type: [%s]");
 
+      static const char *atadevice_cache_names[] = { "writethrough", "none", "writeback", NULL };
+
+      bx_param_enum_c *cache = new bx_param_enum_c(menu,
+        "cache",
+        "Host cache mode",
+        "Host cache mode of the image file (\"none\": flat and concat only)",
+        atadevice_cache_names,
+        BX_ATA_CACHE_WRITETHROUGH,
+        BX_ATA_CACHE_WRITETHROUGH);
+      cache->set_ask_format("Enter host cache mode: [%s]");
+
       // the master/slave menu depends on the ATA channel's enabled flag
       enabled->get_dependent_list()->add(menu);
       // the type selector depends on the ATA channel's enabled flag
@@ -1474,7 +1503,7 @@ void bx_init_options()
 
       // all items depend on the drive type
       type->set_dependent_list(menu->clone(), 0);
-      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0xfe6);
+      type->set_dependent_bitmap(BX_ATA_DEVICE_DISK, 0x1fe6);
       type->set_dependent_bitmap(BX_ATA_DEVICE_CDROM, 0x60a);
 
       type->set_handler(bx_param_handler);
@@ -2910,6 +2939,10 @@ static int parse_line_formatted(const char *context, int num_params, char *param
         SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY)->set(atol(&params[i][12]));
       } else if (!strncmp(params[i], "realtime=", 9)) {
         SIM->get_param_bool(BXPN_VGA_REALTIME)->set(atol(&params[i][9]));
+      } else if (!strncmp(params[i], "render_thread=", 14)) {
+        SIM->get_param_bool(BXPN_VGA_RENDER_THREAD)->set(atol(&params[i][14]));
+      } else if (!strncmp(params[i], "update_damage=", 14)) {
+        SIM->get_param_bool(BXPN_VGA_UPDATE_DAMAGE)->set(atol(&params[i][14]));
       } else if (!strncmp(params[i], "ddc=", 4)) {
         const char *strval = &params[i][4];
         if (strncmp(strval, "file:", 5)) {
@@ -3542,10 +3575,12 @@ int bx_write_configuration(const char *rc, int overwrite)
     }
   }
   fprintf(fp, "\n");
-  fprintf(fp, "vga: extension=%s, update_freq=%u, realtime=%u, ddc=%s",
+  fprintf(fp, "vga: extension=%s, update_freq=%u, realtime=%u, render_thread=%u, update_damage=%u, ddc=%s",
     SIM->get_param_enum(BXPN_VGA_EXTENSION)->get_selected(),
     SIM->get_param_num(BXPN_VGA_UPDATE_FREQUENCY)->get(),
     SIM->get_param_bool(BXPN_VGA_REALTIME)->get(),
+    SIM->get_param_bool(BXPN_VGA_RENDER_THREAD)->get(),
+    SIM->get_param_bool(BXPN_VGA_UPDATE_DAMAGE)->get(),
     SIM->get_param_enum(BXPN_DDC_MODE)->get_selected());
   if (SIM->get_param_enum(BXPN_DDC_MODE)->get() == BX_DDC_MODE_FILE) {
     fprintf(fp, ":%s", SIM->get_param_string(BXPN_DDC_FILE)->getptr());
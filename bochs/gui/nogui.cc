@@ -31,11 +31,26 @@
 
 #if BX_WITH_NOGUI
 #include "icon_bochs.h"
+#include "bxthread.h"
+
+#if BX_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if BX_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 class bx_nogui_gui_c : public bx_gui_c {
 public:
   bx_nogui_gui_c (void) {}
   DECLARE_GUI_VIRTUAL_METHODS()
+  DECLARE_GUI_NEW_VIRTUAL_METHODS()
+  virtual void draw_char(Bit8u ch, Bit8u fc, Bit8u bc, Bit16u xc, Bit16u yc,
+                         Bit8u fw, Bit8u fh, Bit8u fx, Bit8u fy,
+                         bool gfxcharw9, Bit8u cs, Bit8u ce, bool curs, bool font2);
+  virtual void get_capabilities(Bit16u *xres, Bit16u *yres, Bit16u *bpp);
 };
 
 // declare one instance of the gui object and call macro to insert the
@@ -54,6 +69,490 @@ IMPLEMENT_GUI_PLUGIN_CODE(nogui)
 // implementations of this interface.  -Kevin
 
 
+// Headless frame export
+//
+// With the options "shm=<file>" and/or "capture=<prefix>" the guest display
+// is rendered into a 32 bpp framebuffer (new graphics and text API) and
+// published to external tools without stopping the simulation:
+//
+// - shm: the file is mapped shared and holds a header followed by two
+//   pixel buffers. Each flush() with changes copies the changed regions of
+//   this and the previous frame into the buffer not published last, then
+//   makes it the current one. A buffer carries the number of its frame in
+//   'seq', which is 0 while the buffer is updated. Readers take 'current',
+//   read 'seq', copy the data and accept it if 'seq' is still the same.
+//   The rectangle list describes the changes against the previous frame;
+//   it is not valid if frames were skipped or NOGUI_SHM_FULL is set.
+// - capture: every n-th frame ("capture_interval=n") is queued and written
+//   as <prefix>NNNNNNNN.png by a background thread. If the thread cannot
+//   keep up, frames are dropped instead of delaying the simulation.
+
+#define NOGUI_SHM_MAGIC     "BXSHMFB1"
+#define NOGUI_SHM_VERSION   1
+#define NOGUI_SHM_MAX_RECTS 64
+#define NOGUI_SHM_FULL      0x01 // all pixels of the frame have changed
+#define NOGUI_SHM_ALIGN     4096
+
+#define NOGUI_CAPTURE_SLOTS 4
+
+typedef struct {
+  Bit16u x, y, w, h;
+} nogui_rect_t;
+
+typedef struct {
+  Bit32u seq;         // frame stored in this buffer, 0 while updating
+  Bit32u width;
+  Bit32u height;
+  Bit32u pitch;       // bytes per line of the pixel data
+  Bit32u guest_bpp;   // colour depth of the guest video mode
+  Bit32u textmode;
+  Bit32u flags;
+  Bit32u nrects;
+  Bit32u data_offset; // offset of the pixel data (B,G,R,X) in the file
+  Bit32u reserved[7];
+  nogui_rect_t rect[NOGUI_SHM_MAX_RECTS];
+  Bit32u palette[256]; // 0x00RRGGBB
+} nogui_shm_buffer_t;
+
+typedef struct {
+  char magic[8];
+  Bit32u version;
+  Bit32u header_size;
+  Bit32u buffer_size;
+  Bit32u max_xres;
+  Bit32u max_yres;
+  Bit32u active;      // 0 after the simulation has ended
+  Bit32u current;     // buffer holding the latest frame
+  Bit32u frame;       // number of the latest frame
+  Bit32u reserved[6];
+  nogui_shm_buffer_t buffer[2];
+} nogui_shm_header_t;
+
+static bool nogui_export = 0;
+static Bit32u *nogui_fb = NULL;  // host framebuffer, 0x00RRGGBB pixels
+static unsigned nogui_pitch;     // in bytes
+static Bit32u nogui_palette[256];
+static bool nogui_palette_changed;
+static Bit32u nogui_frame = 0;   // number of the last frame with changes
+
+// regions changed since the last flush()
+static nogui_rect_t nogui_dirty[NOGUI_SHM_MAX_RECTS];
+static unsigned nogui_ndirty = 0;
+static bool nogui_dirty_full = 0;
+
+static struct {
+  nogui_shm_header_t *hdr;
+  size_t size;
+  // changes of the frame published last, needed to update the other buffer
+  nogui_rect_t prev[NOGUI_SHM_MAX_RECTS];
+  unsigned nprev;
+  bool prev_full;
+} nogui_shm;
+
+static struct {
+  BX_MUTEX(mutex);
+  bx_thread_sem_t sem;
+  BX_THREAD_VAR(thread_var);
+  bool enabled;
+  bool running;
+  bool stop;
+  char prefix[BX_PATHNAME_LEN];
+  unsigned interval;
+  unsigned head, count;
+  struct {
+    Bit32u *data;
+    unsigned size;
+    unsigned width, height;
+  } slot[NOGUI_CAPTURE_SLOTS];
+  Bit32u frames;
+  Bit64u written, dropped;
+} nogui_capture;
+
+static void nogui_add_dirty(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  nogui_rect_t *r;
+
+  if (nogui_dirty_full || (w == 0) || (h == 0))
+    return;
+  // tiles and characters arrive line by line, so merging with the last
+  // rectangle (and the line above it) keeps the list short
+  if (nogui_ndirty > 0) {
+    r = &nogui_dirty[nogui_ndirty - 1];
+    if ((r->y == y) && (r->h == h) && ((unsigned)(r->x + r->w) == x)) {
+      r->w += w;
+      if (nogui_ndirty > 1) {
+        nogui_rect_t *p = r - 1;
+        if ((p->x == r->x) && (p->w == r->w) && ((unsigned)(p->y + p->h) == r->y)) {
+          p->h += r->h;
+          nogui_ndirty--;
+        }
+      }
+      return;
+    }
+    if ((r->x == x) && (r->w == w) && ((unsigned)(r->y + r->h) == y)) {
+      r->h += h;
+      return;
+    }
+  }
+  if (nogui_ndirty == NOGUI_SHM_MAX_RECTS) {
+    nogui_dirty_full = 1;
+    return;
+  }
+  r = &nogui_dirty[nogui_ndirty++];
+  r->x = x;
+  r->y = y;
+  r->w = w;
+  r->h = h;
+}
+
+#if BX_HAVE_SYS_MMAN_H
+
+static BX_CPP_INLINE void nogui_store_release(Bit32u *ptr, Bit32u val)
+{
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static void nogui_copy_rect(Bit8u *dst, unsigned dst_pitch, unsigned x, unsigned y,
+                            unsigned w, unsigned h)
+{
+  Bit8u *src = (Bit8u *)nogui_fb + y * nogui_pitch + x * 4;
+
+  dst += y * dst_pitch + x * 4;
+  while (h--) {
+    memcpy(dst, src, w * 4);
+    src += nogui_pitch;
+    dst += dst_pitch;
+  }
+}
+
+static bool nogui_shm_create(const char *path, unsigned max_xres, unsigned max_yres)
+{
+  nogui_shm_header_t *hdr;
+  size_t hdr_size, buf_size;
+  void *ptr;
+  int fd;
+
+  hdr_size = (sizeof(nogui_shm_header_t) + NOGUI_SHM_ALIGN - 1) & ~(NOGUI_SHM_ALIGN - 1);
+  buf_size = ((size_t)max_xres * max_yres * 4 + NOGUI_SHM_ALIGN - 1) & ~(NOGUI_SHM_ALIGN - 1);
+  nogui_shm.size = hdr_size + 2 * buf_size;
+  // readers may still have an old file mapped, don't truncate it under them
+  unlink(path);
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    BX_ERROR(("could not create frame export file '%s'", path));
+    return 0;
+  }
+  if (ftruncate(fd, nogui_shm.size) < 0) {
+    BX_ERROR(("could not resize frame export file '%s'", path));
+    close(fd);
+    return 0;
+  }
+  ptr = mmap(NULL, nogui_shm.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    BX_ERROR(("could not map frame export file '%s'", path));
+    return 0;
+  }
+  hdr = (nogui_shm_header_t *)ptr;
+  hdr->version = NOGUI_SHM_VERSION;
+  hdr->header_size = (Bit32u)hdr_size;
+  hdr->buffer_size = (Bit32u)buf_size;
+  hdr->max_xres = max_xres;
+  hdr->max_yres = max_yres;
+  hdr->current = 1;
+  for (int i = 0; i < 2; i++) {
+    hdr->buffer[i].data_offset = (Bit32u)(hdr_size + i * buf_size);
+  }
+  hdr->active = 1;
+  memcpy(hdr->magic, NOGUI_SHM_MAGIC, 8);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  nogui_shm.hdr = hdr;
+  nogui_shm.nprev = 0;
+  nogui_shm.prev_full = 1;
+  BX_INFO(("exporting frames to '%s'", path));
+  return 1;
+}
+
+static void nogui_shm_publish(unsigned width, unsigned height, unsigned bpp, bool textmode)
+{
+  nogui_shm_header_t *hdr = nogui_shm.hdr;
+  Bit32u idx = hdr->current ^ 1;
+  nogui_shm_buffer_t *buf = &hdr->buffer[idx];
+  Bit8u *data = (Bit8u *)hdr + buf->data_offset;
+  unsigned i, pitch = width * 4;
+  bool full;
+
+  nogui_store_release(&buf->seq, 0);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  // the buffer holds the frame before the previous one
+  full = nogui_dirty_full || nogui_shm.prev_full ||
+         (buf->width != width) || (buf->height != height);
+  buf->width = width;
+  buf->height = height;
+  buf->pitch = pitch;
+  buf->guest_bpp = bpp;
+  buf->textmode = textmode;
+  if (full) {
+    nogui_copy_rect(data, pitch, 0, 0, buf->width, buf->height);
+  } else {
+    for (i = 0; i < nogui_shm.nprev; i++) {
+      nogui_copy_rect(data, pitch, nogui_shm.prev[i].x, nogui_shm.prev[i].y,
+                      nogui_shm.prev[i].w, nogui_shm.prev[i].h);
+    }
+    for (i = 0; i < nogui_ndirty; i++) {
+      nogui_copy_rect(data, pitch, nogui_dirty[i].x, nogui_dirty[i].y,
+                      nogui_dirty[i].w, nogui_dirty[i].h);
+    }
+  }
+  if (nogui_dirty_full) {
+    buf->flags = NOGUI_SHM_FULL;
+    buf->nrects = 0;
+  } else {
+    buf->flags = 0;
+    buf->nrects = nogui_ndirty;
+    memcpy(buf->rect, nogui_dirty, nogui_ndirty * sizeof(nogui_rect_t));
+  }
+  memcpy(buf->palette, nogui_palette, sizeof(nogui_palette));
+  nogui_store_release(&buf->seq, nogui_frame);
+  nogui_store_release(&hdr->current, idx);
+  nogui_store_release(&hdr->frame, nogui_frame);
+  memcpy(nogui_shm.prev, nogui_dirty, nogui_ndirty * sizeof(nogui_rect_t));
+  nogui_shm.nprev = nogui_ndirty;
+  nogui_shm.prev_full = nogui_dirty_full;
+}
+
+static void nogui_shm_close(void)
+{
+  nogui_store_release(&nogui_shm.hdr->active, 0);
+  munmap(nogui_shm.hdr, nogui_shm.size);
+  nogui_shm.hdr = NULL;
+  BX_INFO(("exported %u frames", nogui_frame));
+}
+
+#else
+
+static bool nogui_shm_create(const char *path, unsigned max_xres, unsigned max_yres)
+{
+  BX_ERROR(("shared memory frame export not supported on this platform"));
+  return 0;
+}
+
+static void nogui_shm_publish(unsigned width, unsigned height, unsigned bpp, bool textmode) {}
+static void nogui_shm_close(void) {}
+
+#endif
+
+#if BX_HAVE_ZLIB
+static void nogui_png_chunk(FILE *fp, const char *type, const Bit8u *data, Bit32u len)
+{
+  Bit8u buf[8];
+  uLong crc;
+
+  buf[0] = (Bit8u)(len >> 24);
+  buf[1] = (Bit8u)(len >> 16);
+  buf[2] = (Bit8u)(len >> 8);
+  buf[3] = (Bit8u)len;
+  memcpy(&buf[4], type, 4);
+  crc = crc32(0, &buf[4], 4);
+  fwrite(buf, 1, 8, fp);
+  if (len > 0) {
+    // crc32() with a NULL buffer returns the initial value
+    crc = crc32(crc, data, len);
+    fwrite(data, 1, len, fp);
+  }
+  buf[0] = (Bit8u)(crc >> 24);
+  buf[1] = (Bit8u)(crc >> 16);
+  buf[2] = (Bit8u)(crc >> 8);
+  buf[3] = (Bit8u)crc;
+  fwrite(buf, 1, 4, fp);
+}
+
+// Write the frame as 24 bpp PNG. The lines use the 'Sub' filter, which turns
+// areas of one colour into runs of zeros for the fast deflate level.
+static bool nogui_write_png(const char *fname, const Bit32u *data,
+                            unsigned width, unsigned height)
+{
+  static const Bit8u signature[8] = {0x89, 'P', 'N', 'G', 0x0d, 0x0a, 0x1a, 0x0a};
+  Bit8u ihdr[13];
+  uLong rawlen = (uLong)height * (width * 3 + 1);
+  uLongf zlen = compressBound(rawlen);
+  Bit8u *raw, *zbuf, *ptr;
+  unsigned x, y;
+  Bit32u pix, last;
+  FILE *fp;
+  bool ret = 0;
+
+  raw = new Bit8u[rawlen];
+  zbuf = new Bit8u[zlen];
+  ptr = raw;
+  for (y = 0; y < height; y++) {
+    *ptr++ = 1;
+    last = 0;
+    for (x = 0; x < width; x++) {
+      pix = *data++;
+      *ptr++ = (Bit8u)((pix >> 16) - (last >> 16));
+      *ptr++ = (Bit8u)((pix >> 8) - (last >> 8));
+      *ptr++ = (Bit8u)(pix - last);
+      last = pix;
+    }
+  }
+  if (compress2(zbuf, &zlen, raw, rawlen, Z_BEST_SPEED) == Z_OK) {
+    fp = fopen(fname, "wb");
+    if (fp != NULL) {
+      ihdr[0] = (Bit8u)(width >> 24);
+      ihdr[1] = (Bit8u)(width >> 16);
+      ihdr[2] = (Bit8u)(width >> 8);
+      ihdr[3] = (Bit8u)width;
+      ihdr[4] = (Bit8u)(height >> 24);
+      ihdr[5] = (Bit8u)(height >> 16);
+      ihdr[6] = (Bit8u)(height >> 8);
+      ihdr[7] = (Bit8u)height;
+      ihdr[8] = 8;  // bit depth
+      ihdr[9] = 2;  // truecolour
+      ihdr[10] = 0; // deflate
+      ihdr[11] = 0; // adaptive filtering
+      ihdr[12] = 0; // no interlace
+      fwrite(signature, 1, 8, fp);
+      nogui_png_chunk(fp, "IHDR", ihdr, 13);
+      nogui_png_chunk(fp, "IDAT", zbuf, (Bit32u)zlen);
+      nogui_png_chunk(fp, "IEND", NULL, 0);
+      ret = (ferror(fp) == 0);
+      fclose(fp);
+    }
+  }
+  delete [] raw;
+  delete [] zbuf;
+  return ret;
+}
+
+BX_THREAD_FUNC(nogui_capture_thread, indata)
+{
+  char fname[BX_PATHNAME_LEN + 16];
+  unsigned n, slot;
+  bool stop;
+
+  while (1) {
+    BX_LOCK(nogui_capture.mutex);
+    stop = nogui_capture.stop;
+    n = nogui_capture.count;
+    slot = nogui_capture.head;
+    BX_UNLOCK(nogui_capture.mutex);
+    if (n == 0) {
+      // the queue is drained before the thread stops
+      if (stop) break;
+      bx_wait_sem(&nogui_capture.sem);
+      continue;
+    }
+    sprintf(fname, "%s%08u.png", nogui_capture.prefix, nogui_capture.frames);
+    if (nogui_write_png(fname, nogui_capture.slot[slot].data,
+                        nogui_capture.slot[slot].width,
+                        nogui_capture.slot[slot].height)) {
+      nogui_capture.frames++;
+    } else {
+      BX_ERROR(("could not write capture file '%s'", fname));
+    }
+    BX_LOCK(nogui_capture.mutex);
+    nogui_capture.head = (nogui_capture.head + 1) % NOGUI_CAPTURE_SLOTS;
+    nogui_capture.count--;
+    nogui_capture.written++;
+    BX_UNLOCK(nogui_capture.mutex);
+  }
+  BX_LOCK(nogui_capture.mutex);
+  nogui_capture.running = 0;
+  BX_UNLOCK(nogui_capture.mutex);
+  BX_THREAD_EXIT;
+}
+#endif
+
+static bool nogui_capture_start(const char *prefix)
+{
+#if BX_HAVE_ZLIB
+  memset(nogui_capture.slot, 0, sizeof(nogui_capture.slot));
+  strncpy(nogui_capture.prefix, prefix, BX_PATHNAME_LEN - 1);
+  nogui_capture.prefix[BX_PATHNAME_LEN - 1] = 0;
+  BX_INIT_MUTEX(nogui_capture.mutex);
+  bx_create_sem(&nogui_capture.sem);
+  nogui_capture.head = 0;
+  nogui_capture.count = 0;
+  nogui_capture.frames = 0;
+  nogui_capture.written = 0;
+  nogui_capture.dropped = 0;
+  nogui_capture.stop = 0;
+  nogui_capture.running = 1;
+  nogui_capture.enabled = 1;
+  BX_THREAD_CREATE(nogui_capture_thread, NULL, nogui_capture.thread_var);
+  BX_INFO(("capturing frames to '%s*.png'", prefix));
+  return 1;
+#else
+  BX_ERROR(("frame capture requires zlib support"));
+  return 0;
+#endif
+}
+
+// Called from flush(): queue a copy of the current frame for the capture
+// thread. The slot behind the queued ones is not touched by the thread.
+static void nogui_capture_frame(unsigned width, unsigned height)
+{
+  unsigned size = width * height, slot, y;
+  Bit32u *dst;
+  Bit8u *src;
+
+  BX_LOCK(nogui_capture.mutex);
+  slot = (nogui_capture.head + nogui_capture.count) % NOGUI_CAPTURE_SLOTS;
+  if (nogui_capture.count == NOGUI_CAPTURE_SLOTS) {
+    nogui_capture.dropped++;
+    slot = NOGUI_CAPTURE_SLOTS;
+  }
+  BX_UNLOCK(nogui_capture.mutex);
+  if (slot == NOGUI_CAPTURE_SLOTS)
+    return;
+  if (nogui_capture.slot[slot].size < size) {
+    delete [] nogui_capture.slot[slot].data;
+    nogui_capture.slot[slot].data = new Bit32u[size];
+    nogui_capture.slot[slot].size = size;
+  }
+  dst = nogui_capture.slot[slot].data;
+  src = (Bit8u *)nogui_fb;
+  for (y = 0; y < height; y++) {
+    memcpy(dst, src, width * 4);
+    dst += width;
+    src += nogui_pitch;
+  }
+  nogui_capture.slot[slot].width = width;
+  nogui_capture.slot[slot].height = height;
+  BX_LOCK(nogui_capture.mutex);
+  nogui_capture.count++;
+  BX_UNLOCK(nogui_capture.mutex);
+  bx_set_sem(&nogui_capture.sem);
+}
+
+static void nogui_capture_stop(void)
+{
+  unsigned i;
+
+  BX_LOCK(nogui_capture.mutex);
+  nogui_capture.stop = 1;
+  nogui_capture.enabled = 0;
+  BX_UNLOCK(nogui_capture.mutex);
+  bx_set_sem(&nogui_capture.sem);
+  BX_THREAD_JOIN(nogui_capture.thread_var);
+  while (1) {
+    BX_LOCK(nogui_capture.mutex);
+    bool running = nogui_capture.running;
+    BX_UNLOCK(nogui_capture.mutex);
+    if (!running) break;
+    BX_MSLEEP(1);
+  }
+  bx_destroy_sem(&nogui_capture.sem);
+  for (i = 0; i < NOGUI_CAPTURE_SLOTS; i++) {
+    delete [] nogui_capture.slot[i].data;
+    nogui_capture.slot[i].data = NULL;
+  }
+  BX_INFO(("captured " FMT_LL "u frames, " FMT_LL "u dropped",
+           nogui_capture.written, nogui_capture.dropped));
+}
+
+
 
 // ::SPECIFIC_INIT()
 //
@@ -70,9 +569,10 @@ IMPLEMENT_GUI_PLUGIN_CODE(nogui)
 
 void bx_nogui_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
 {
+  const char *shm_path = NULL, *capture_prefix = NULL;
+  int i;
+
   put("NOGUI");
-  UNUSED(argc);
-  UNUSED(argv);
   UNUSED(headerbar_y);
 
   UNUSED(bochs_icon_bits);  // global variable
@@ -80,6 +580,36 @@ void bx_nogui_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
   if (SIM->get_param_bool(BXPN_PRIVATE_COLORMAP)->get()) {
     BX_INFO(("private_colormap option ignored."));
   }
+
+  nogui_capture.interval = 1;
+  for (i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "shm=", 4)) {
+      shm_path = &argv[i][4];
+    } else if (!strncmp(argv[i], "capture=", 8)) {
+      capture_prefix = &argv[i][8];
+    } else if (!strncmp(argv[i], "capture_interval=", 17)) {
+      nogui_capture.interval = atoi(&argv[i][17]);
+      if (nogui_capture.interval < 1) nogui_capture.interval = 1;
+    } else {
+      BX_ERROR(("Unknown nogui option '%s' ignored", argv[i]));
+    }
+  }
+  if ((shm_path != NULL) && (shm_path[0] != 0)) {
+    nogui_export = nogui_shm_create(shm_path, max_xres, max_yres);
+  }
+  if ((capture_prefix != NULL) && (capture_prefix[0] != 0)) {
+    if (nogui_capture_start(capture_prefix)) {
+      nogui_export = 1;
+    }
+  }
+  if (nogui_export) {
+    nogui_pitch = max_xres * 4;
+    nogui_fb = new Bit32u[max_xres * max_yres];
+    memset(nogui_fb, 0, nogui_pitch * max_yres);
+    nogui_dirty_full = 1;
+    new_gfx_api = 1;
+    new_text_api = 1;
+  }
 }
 
 
@@ -101,6 +631,23 @@ void bx_nogui_gui_c::handle_events(void)
 
 void bx_nogui_gui_c::flush(void)
 {
+  if (!nogui_export)
+    return;
+  if ((nogui_ndirty == 0) && !nogui_dirty_full && !nogui_palette_changed)
+    return;
+  // 0 marks a buffer being updated
+  if (++nogui_frame == 0) nogui_frame = 1;
+  if (nogui_shm.hdr != NULL) {
+    nogui_shm_publish(guest_xres, guest_yres, guest_bpp, guest_textmode);
+  }
+  if (nogui_capture.enabled) {
+    if ((nogui_frame % nogui_capture.interval) == 0) {
+      nogui_capture_frame(guest_xres, guest_yres);
+    }
+  }
+  nogui_ndirty = 0;
+  nogui_dirty_full = 0;
+  nogui_palette_changed = 0;
 }
 
 
@@ -111,6 +658,10 @@ void bx_nogui_gui_c::flush(void)
 
 void bx_nogui_gui_c::clear_screen(void)
 {
+  if (nogui_export) {
+    memset(nogui_fb, 0, nogui_pitch * max_yres);
+    nogui_dirty_full = 1;
+  }
 }
 
 
@@ -180,11 +731,11 @@ int bx_nogui_gui_c::set_clipboard_text(char *text_snapshot, Bit32u len)
 
 bool bx_nogui_gui_c::palette_change(Bit8u index, Bit8u red, Bit8u green, Bit8u blue)
 {
-  UNUSED(index);
-  UNUSED(red);
-  UNUSED(green);
-  UNUSED(blue);
-  return(0);
+  if (!nogui_export)
+    return(0);
+  nogui_palette[index] = (red << 16) | (green << 8) | blue;
+  nogui_palette_changed = 1;
+  return(1);
 }
 
 
@@ -205,9 +756,24 @@ bool bx_nogui_gui_c::palette_change(Bit8u index, Bit8u red, Bit8u green, Bit8u b
 
 void bx_nogui_gui_c::graphics_tile_update(Bit8u *tile, unsigned x0, unsigned y0)
 {
-  UNUSED(tile);
-  UNUSED(x0);
-  UNUSED(y0);
+  Bit32u *buf;
+  unsigned w, h, x;
+
+  if (!nogui_export || (x0 >= guest_xres) || (y0 >= guest_yres))
+    return;
+  w = x_tilesize;
+  h = y_tilesize;
+  if ((x0 + w) > guest_xres) w = guest_xres - x0;
+  if ((y0 + h) > guest_yres) h = guest_yres - y0;
+  nogui_add_dirty(x0, y0, w, h);
+  buf = nogui_fb + y0 * max_xres + x0;
+  do {
+    for (x = 0; x < w; x++) {
+      buf[x] = nogui_palette[tile[x]];
+    }
+    tile += x_tilesize;
+    buf += max_xres;
+  } while (--h);
 }
 
 
@@ -225,11 +791,17 @@ void bx_nogui_gui_c::graphics_tile_update(Bit8u *tile, unsigned x0, unsigned y0)
 
 void bx_nogui_gui_c::dimension_update(unsigned x, unsigned y, unsigned fheight, unsigned fwidth, unsigned bpp)
 {
+  if (nogui_export && ((x > max_xres) || (y > max_yres))) {
+    BX_PANIC(("dimension_update(): resolution of out of display bounds"));
+    return;
+  }
   guest_textmode = (fheight > 0);
+  guest_fwidth = fwidth;
+  guest_fheight = fheight;
   guest_xres = x;
   guest_yres = y;
   guest_bpp = bpp;
-  UNUSED(fwidth);
+  nogui_dirty_full = 1;
 }
 
 
@@ -313,7 +885,19 @@ void bx_nogui_gui_c::replace_bitmap(unsigned hbar_id, unsigned bmap_id)
 
 void bx_nogui_gui_c::exit(void)
 {
-  BX_INFO(("bx_nogui_gui_c::exit() not implemented yet."));
+  if (!nogui_export) {
+    BX_INFO(("bx_nogui_gui_c::exit() not implemented yet."));
+    return;
+  }
+  if (nogui_capture.enabled) {
+    nogui_capture_stop();
+  }
+  if (nogui_shm.hdr != NULL) {
+    nogui_shm_close();
+  }
+  delete [] nogui_fb;
+  nogui_fb = NULL;
+  nogui_export = 0;
 }
 
 
@@ -328,4 +912,123 @@ void bx_nogui_gui_c::mouse_enabled_changed_specific(bool val)
 {
 }
 
+
+// Frame export: new graphics and text API
+
+void bx_nogui_gui_c::draw_char(Bit8u ch, Bit8u fc, Bit8u bc, Bit16u xc, Bit16u yc,
+                               Bit8u fw, Bit8u fh, Bit8u fx, Bit8u fy,
+                               bool gfxcharw9, Bit8u cs, Bit8u ce, bool curs, bool font2)
+{
+  Bit32u *buf, fgcolor, bgcolor;
+  Bit16u font_row, mask;
+  Bit8u *font_ptr, fontpixels;
+  bool dwidth;
+
+  if (!nogui_export)
+    return;
+  nogui_add_dirty(xc, yc, fw, fh);
+  buf = nogui_fb + yc * max_xres + xc;
+  fgcolor = nogui_palette[fc];
+  bgcolor = nogui_palette[bc];
+  dwidth = (guest_fwidth > 9);
+  if (font2) {
+    font_ptr = &vga_charmap[1][(ch << 5) + fy];
+  } else {
+    font_ptr = &vga_charmap[0][(ch << 5) + fy];
+  }
+  do {
+    font_row = *font_ptr++;
+    if (gfxcharw9) {
+      font_row = (font_row << 1) | (font_row & 0x01);
+    } else {
+      font_row <<= 1;
+    }
+    if (fx > 0) {
+      font_row <<= fx;
+    }
+    fontpixels = fw;
+    if (curs && (fy >= cs) && (fy <= ce))
+      mask = 0x100;
+    else
+      mask = 0x00;
+    do {
+      if ((font_row & 0x100) == mask)
+        *buf = bgcolor;
+      else
+        *buf = fgcolor;
+      buf++;
+      if (!dwidth || (fontpixels & 1)) font_row <<= 1;
+    } while (--fontpixels);
+    buf += (max_xres - fw);
+    fy++;
+  } while (--fh);
+}
+
+bx_svga_tileinfo_t *bx_nogui_gui_c::graphics_tile_info(bx_svga_tileinfo_t *info)
+{
+  if (!nogui_export)
+    return bx_gui_c::graphics_tile_info(info);
+
+  info->bpp = 32;
+  info->pitch = nogui_pitch;
+  info->red_shift = 24;
+  info->green_shift = 16;
+  info->blue_shift = 8;
+  info->red_mask = 0xff0000;
+  info->green_mask = 0x00ff00;
+  info->blue_mask = 0x0000ff;
+  info->is_indexed = 0;
+#ifdef BX_LITTLE_ENDIAN
+  info->is_little_endian = 1;
+#else
+  info->is_little_endian = 0;
+#endif
+  return info;
+}
+
+Bit8u *bx_nogui_gui_c::graphics_tile_get(unsigned x0, unsigned y0, unsigned *w, unsigned *h)
+{
+  if (!nogui_export)
+    return bx_gui_c::graphics_tile_get(x0, y0, w, h);
+
+  if (x0+x_tilesize > guest_xres) {
+    *w = guest_xres - x0;
+  } else {
+    *w = x_tilesize;
+  }
+
+  if (y0+y_tilesize > guest_yres) {
+    *h = guest_yres - y0;
+  } else {
+    *h = y_tilesize;
+  }
+
+  return (Bit8u *)nogui_fb + y0 * nogui_pitch + x0 * 4;
+}
+
+void bx_nogui_gui_c::graphics_tile_update_in_place(unsigned x0, unsigned y0,
+                                                   unsigned w, unsigned h)
+{
+  if (!nogui_export) {
+    bx_gui_c::graphics_tile_update_in_place(x0, y0, w, h);
+    return;
+  }
+  if ((x0 >= guest_xres) || (y0 >= guest_yres))
+    return;
+  if ((x0 + w) > guest_xres) w = guest_xres - x0;
+  if ((y0 + h) > guest_yres) h = guest_yres - y0;
+  nogui_add_dirty(x0, y0, w, h);
+}
+
+void bx_nogui_gui_c::get_capabilities(Bit16u *xres, Bit16u *yres, Bit16u *bpp)
+{
+  if (!nogui_export) {
+    bx_gui_c::get_capabilities(xres, yres, bpp);
+    return;
+  }
+  *xres = max_xres;
+  *yres = max_yres;
+  *bpp = 32;
+}
+
 #endif /* if BX_WITH_NOGUI */
@@ -26,7 +26,6 @@
 // RFB still to do :
 // - properly handle SetPixelFormat, including big/little-endian flag
 // - depth > 8bpp support
-// - optional compression support
 
 
 // Define BX_PLUGGABLE in files that can be compiled into plugins.  For
@@ -47,6 +46,9 @@
 #include "rfbkeys.h"
 
 #include "bxthread.h"
+#if BX_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 
 class bx_rfb_gui_c : public bx_gui_c {
@@ -176,6 +178,58 @@ static SOCKET sGlobal;
 static Bit32u clientEncodingsCount = 0;
 static Bit32u *clientEncodings = NULL;
 
+// Framebuffer updates are sent by a separate thread. flush() copies the
+// changed part of rfbScreen into rfbSender.screen and adds the region to a
+// small queue. When the client has requested an update, the sender thread
+// takes the queued regions, compares them with its copy of the client
+// framebuffer and sends the changed parts only, using the best encoding
+// supported by the client. The simulation never waits for the socket.
+#define RFB_UPDATE_QUEUE_SIZE 32
+#define RFB_HEXTILE_SIZE      16
+
+typedef struct {
+  unsigned x, y, w, h;
+} rfbUpdateRect;
+
+static struct {
+  BX_MUTEX(mutex);
+  bx_thread_sem_t sem;
+  BX_THREAD_VAR(thread_var);
+  bool enabled;
+  bool running;
+  bool stop;
+  bool request;     // client is waiting for an update
+  bool full;        // send the whole framebuffer
+  bool resize;      // framebuffer size changed
+  SOCKET sock;
+  char *screen;     // rfbScreen as of the last flush()
+  unsigned xdim, ydim;
+  rfbUpdateRect queue[RFB_UPDATE_QUEUE_SIZE];
+  unsigned qcount;
+  Bit32u encoding;
+  bool copyrect;
+  bool desktopsize;
+} rfbSender;
+
+// private data of the sender thread
+static struct {
+  Bit8u *screen;    // snapshot of the regions to send
+  Bit8u *client;    // framebuffer contents as known by the client
+  Bit32u *hash[2];  // row hashes for the scroll detection
+  unsigned xdim, ydim;
+  Bit8u *buf;       // framebuffer update message
+  unsigned len, size;
+  bool bg_valid, fg_valid;
+  Bit8u bg, fg;     // current hextile colours
+#if BX_HAVE_ZLIB
+  Bit8u *zbuf;      // ZRLE data before compression
+  unsigned zsize;
+  z_stream zs;
+  bool zs_init;
+#endif
+  Bit64u updates, bytes;
+} rfbEnc;
+
 #ifdef BX_RFB_WIN32
 bool StopWinsock();
 #endif
@@ -189,7 +243,11 @@ void DrawChar(int x, int y, int width, int height, int fontx, int fonty,
               char *bmap, char fg, char bg, bool gfxchar);
 void UpdateScreen(unsigned char *newBits, int x, int y, int width, int height,
         bool update_client);
-void SendUpdate(int x, int y, int width, int height, Bit32u encoding);
+void rfbQueueUpdate(unsigned x0, unsigned y0, unsigned w, unsigned h);
+void rfbResizeSender(void);
+void rfbStartSender(SOCKET sClient);
+void rfbStopSender(void);
+void rfbSelectEncoding(void);
 void rfbSetUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h);
 void rfbAddUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h);
 void rfbSetStatusText(int element, const char *text, bool active, Bit8u color = 0);
@@ -265,6 +323,11 @@ void bx_rfb_gui_c::specific_init(int argc, char **argv, unsigned headerbar_y)
   rfbScreen = new char[rfbWindowX * rfbWindowY];
   memset(&rfbPalette, 0, sizeof(rfbPalette));
 
+  memset(&rfbSender, 0, sizeof(rfbSender));
+  memset(&rfbEnc, 0, sizeof(rfbEnc));
+  BX_INIT_MUTEX(rfbSender.mutex);
+  rfbResizeSender();
+
   rfbSetUpdateRegion(rfbWindowX, rfbWindowY, 0, 0);
 
   clientEncodingsCount=0;
@@ -343,8 +406,8 @@ void bx_rfb_gui_c::handle_events(void)
 void bx_rfb_gui_c::flush(void)
 {
   if (rfbUpdateRegion.updated) {
-    SendUpdate(rfbUpdateRegion.x, rfbUpdateRegion.y, rfbUpdateRegion.width,
-               rfbUpdateRegion.height, rfbEncodingRaw);
+    rfbQueueUpdate(rfbUpdateRegion.x, rfbUpdateRegion.y, rfbUpdateRegion.width,
+                   rfbUpdateRegion.height);
     rfbSetUpdateRegion(rfbWindowX, rfbWindowY, 0, 0);
   }
 }
@@ -458,7 +521,7 @@ void bx_rfb_gui_c::dimension_update(unsigned x, unsigned y, unsigned fheight, un
       rfbWindowY = rfbDimensionY + rfbHeaderbarY + rfbStatusbarY;
       delete [] rfbScreen;
       rfbScreen = new char[rfbWindowX * rfbWindowY];
-      SendUpdate(0, 0, rfbWindowX, rfbWindowY, rfbEncodingDesktopSize);
+      rfbResizeSender();
       bx_gui->show_headerbar();
       rfbSetUpdateRegion(0, 0, rfbWindowX, rfbWindowY);
     } else {
@@ -466,7 +529,6 @@ void bx_rfb_gui_c::dimension_update(unsigned x, unsigned y, unsigned fheight, un
         BX_PANIC(("dimension_update(): RFB doesn't support graphics mode %dx%d", x, y));
       }
       clear_screen();
-      SendUpdate(0, rfbHeaderbarY, rfbDimensionX, rfbDimensionY, rfbEncodingRaw);
       rfbDimensionX = x;
       rfbDimensionY = y;
     }
@@ -571,6 +633,11 @@ void bx_rfb_gui_c::exit(void)
 #ifdef BX_RFB_WIN32
   StopWinsock();
 #endif
+  BX_LOCK(rfbSender.mutex);
+  rfbSender.stop = 1;
+  delete [] rfbSender.screen;
+  rfbSender.screen = NULL;
+  BX_UNLOCK(rfbSender.mutex);
   delete [] rfbScreen;
   for(i = 0; i < rfbBitmapCount; i++) {
     free(rfbBitmaps[i].bmap);
@@ -1189,6 +1256,7 @@ BX_THREAD_FUNC(rfbServerThreadInit, indata)
         sClient = accept(sServer, (struct sockaddr *)&sai, (socklen_t*)&sai_size);
         if(sClient != INVALID_SOCKET) {
             HandleRfbClient(sClient);
+            rfbStopSender();
             sGlobal = INVALID_SOCKET;
             close(sClient);
         } else {
@@ -1272,6 +1340,7 @@ void HandleRfbClient(SOCKET sClient)
 
   client_connected = 1;
   sGlobal = sClient;
+  rfbStartSender(sClient);
   while (keep_alive) {
     U8 msgType;
     int n;
@@ -1371,6 +1440,7 @@ void HandleRfbClient(SOCKET sClient)
             }
             if (!found) BX_INFO(("%08x Unknown", clientEncodings[i]));
           }
+          rfbSelectEncoding();
           break;
         }
       case rfbFramebufferUpdateRequest:
@@ -1378,15 +1448,15 @@ void HandleRfbClient(SOCKET sClient)
           rfbFramebufferUpdateRequestMessage fur;
 
           ReadExact(sClient, (char *)&fur, sizeof(rfbFramebufferUpdateRequestMessage));
-          if(!fur.incremental) {
-            rfbSetUpdateRegion(0, 0, rfbWindowX, rfbWindowY);
-          } //else {
-          //    if(fur.x < rfbUpdateRegion.x) rfbUpdateRegion.x = fur.x;
-          //    if(fur.y < rfbUpdateRegion.x) rfbUpdateRegion.y = fur.y;
-          //    if(((fur.x + fur.w) - rfbUpdateRegion.x) > rfbUpdateRegion.width) rfbUpdateRegion.width = ((fur.x + fur.w) - rfbUpdateRegion.x);
-          //    if(((fur.y + fur.h) - rfbUpdateRegion.y) > rfbUpdateRegion.height) rfbUpdateRegion.height = ((fur.y + fur.h) - rfbUpdateRegion.y);
-          //}
-          //rfbUpdateRegion.updated = 1;
+          // the requested area is ignored, the sender always checks the
+          // whole framebuffer
+          BX_LOCK(rfbSender.mutex);
+          rfbSender.request = 1;
+          if (!fur.incremental) {
+            rfbSender.full = 1;
+          }
+          BX_UNLOCK(rfbSender.mutex);
+          bx_set_sem(&rfbSender.sem);
           break;
         }
       case rfbKeyEvent:
@@ -1564,57 +1634,10 @@ void UpdateScreen(unsigned char *newBits, int x, int y, int width, int height,
     y++;
   }
   if (update_client) {
-    if(sGlobal == INVALID_SOCKET) return;
-    rfbFramebufferUpdateMessage fum;
-    rfbFramebufferUpdateRectHeader furh;
-    fum.messageType = rfbFramebufferUpdate;
-    fum.numberOfRectangles = htons(1);
-    WriteExact(sGlobal, (char *)&fum, rfbFramebufferUpdateMessageSize);
-    furh.r.xPosition = htons(x0);
-    furh.r.yPosition = htons(y0);
-    furh.r.width = htons((short)width);
-    furh.r.height = htons((short)height);
-    furh.r.encodingType = htonl(rfbEncodingRaw);
-    WriteExact(sGlobal, (char *)&furh, rfbFramebufferUpdateRectHeaderSize);
-    WriteExact(sGlobal, (char *)newBits, width * height);
+    rfbAddUpdateRegion(x0, y0, width, height);
   }
 }
 
-void SendUpdate(int x, int y, int width, int height, Bit32u encoding)
-{
-    char *newBits;
-
-    if(x < 0 || y < 0 || (x + width) > (int)rfbWindowX || (y + height) > (int)rfbWindowY) {
-        BX_ERROR(("Dimensions out of bounds.  x=%i y=%i w=%i h=%i", x, y, width, height));
-    }
-    if(sGlobal != INVALID_SOCKET) {
-        rfbFramebufferUpdateMessage fum;
-        rfbFramebufferUpdateRectHeader furh;
-
-        fum.messageType = rfbFramebufferUpdate;
-        fum.numberOfRectangles = htons(1);
-
-        furh.r.xPosition = htons(x);
-        furh.r.yPosition = htons(y);
-        furh.r.width = htons((short)width);
-        furh.r.height = htons((short)height);
-        furh.r.encodingType = htonl(encoding);
-
-        WriteExact(sGlobal, (char *)&fum, rfbFramebufferUpdateMessageSize);
-        WriteExact(sGlobal, (char *)&furh, rfbFramebufferUpdateRectHeaderSize);
-
-        if (encoding == rfbEncodingRaw) {
-          newBits = new char[width * height];
-          for(int i = 0; i < height; i++) {
-            memcpy(&newBits[i * width], &rfbScreen[y * rfbWindowX + x], width);
-            y++;
-          }
-          WriteExact(sGlobal, (char *)newBits, width * height);
-          delete [] newBits;
-        }
-    }
-}
-
 void rfbSetUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h)
 {
   rfbUpdateRegion.x = x0;
@@ -1659,6 +1682,774 @@ void rfbAddUpdateRegion(unsigned x0, unsigned y0, unsigned w, unsigned h)
   }
 }
 
+// Asynchronous update sender
+
+static void rfbUnionRect(rfbUpdateRect *r, unsigned x0, unsigned y0, unsigned w, unsigned h)
+{
+  unsigned x1 = BX_MAX(r->x + r->w, x0 + w);
+  unsigned y1 = BX_MAX(r->y + r->h, y0 + h);
+
+  r->x = BX_MIN(r->x, x0);
+  r->y = BX_MIN(r->y, y0);
+  r->w = x1 - r->x;
+  r->h = y1 - r->y;
+}
+
+void rfbQueueUpdate(unsigned x0, unsigned y0, unsigned w, unsigned h)
+{
+  rfbUpdateRect *r;
+  unsigned i, best = 0;
+  Bit64u growth, best_growth = 0;
+
+  if ((x0 >= rfbWindowX) || (y0 >= rfbWindowY))
+    return;
+  if ((x0 + w) > rfbWindowX) {
+    w = rfbWindowX - x0;
+  }
+  if ((y0 + h) > rfbWindowY) {
+    h = rfbWindowY - y0;
+  }
+  BX_LOCK(rfbSender.mutex);
+  if (rfbSender.screen != NULL) {
+    for (i = 0; i < h; i++) {
+      memcpy(&rfbSender.screen[(y0 + i) * rfbWindowX + x0],
+             &rfbScreen[(y0 + i) * rfbWindowX + x0], w);
+    }
+  }
+  if (rfbSender.enabled && !rfbSender.full) {
+    // merge with an overlapping region or, if the queue is full, with the
+    // one that grows least
+    for (i = 0; i < rfbSender.qcount; i++) {
+      r = &rfbSender.queue[i];
+      if ((x0 <= (r->x + r->w)) && (r->x <= (x0 + w)) &&
+          (y0 <= (r->y + r->h)) && (r->y <= (y0 + h))) {
+        rfbUnionRect(r, x0, y0, w, h);
+        break;
+      }
+    }
+    if (i == rfbSender.qcount) {
+      if (rfbSender.qcount < RFB_UPDATE_QUEUE_SIZE) {
+        r = &rfbSender.queue[rfbSender.qcount++];
+        r->x = x0;
+        r->y = y0;
+        r->w = w;
+        r->h = h;
+      } else {
+        for (i = 0; i < rfbSender.qcount; i++) {
+          rfbUpdateRect u = rfbSender.queue[i];
+          rfbUnionRect(&u, x0, y0, w, h);
+          growth = (Bit64u)u.w * u.h - (Bit64u)rfbSender.queue[i].w * rfbSender.queue[i].h;
+          if ((i == 0) || (growth < best_growth)) {
+            best = i;
+            best_growth = growth;
+          }
+        }
+        rfbUnionRect(&rfbSender.queue[best], x0, y0, w, h);
+      }
+    }
+    if (rfbSender.request) {
+      bx_set_sem(&rfbSender.sem);
+    }
+  }
+  BX_UNLOCK(rfbSender.mutex);
+}
+
+void rfbResizeSender(void)
+{
+  BX_LOCK(rfbSender.mutex);
+  delete [] rfbSender.screen;
+  rfbSender.screen = new char[rfbWindowX * rfbWindowY];
+  memset(rfbSender.screen, 0, rfbWindowX * rfbWindowY);
+  rfbSender.xdim = rfbWindowX;
+  rfbSender.ydim = rfbWindowY;
+  rfbSender.qcount = 0;
+  rfbSender.full = 1;
+  rfbSender.resize = 1;
+  BX_UNLOCK(rfbSender.mutex);
+}
+
+void rfbSelectEncoding(void)
+{
+  Bit32u i, encoding = rfbEncodingRaw;
+  bool found = 0, copyrect = 0;
+  const char *name = "Raw";
+
+  // use the first encoding of the client's list that we support
+  for (i = 0; i < clientEncodingsCount; i++) {
+    switch (clientEncodings[i]) {
+      case rfbEncodingCopyRect:
+        copyrect = 1;
+        break;
+#if BX_HAVE_ZLIB
+      case rfbEncodingZRLE:
+#endif
+      case rfbEncodingHextile:
+      case rfbEncodingRaw:
+        if (!found) {
+          encoding = clientEncodings[i];
+          found = 1;
+        }
+        break;
+    }
+  }
+  for (i = 0; i < rfbEncodingsCount; i++) {
+    if (rfbEncodings[i].id == encoding) {
+      name = rfbEncodings[i].name;
+      break;
+    }
+  }
+  BX_INFO(("using %s encoding%s", name, copyrect ? " and CopyRect" : ""));
+  BX_LOCK(rfbSender.mutex);
+  rfbSender.encoding = encoding;
+  rfbSender.copyrect = copyrect;
+  rfbSender.desktopsize = desktop_resizable;
+  BX_UNLOCK(rfbSender.mutex);
+}
+
+// message buffer helpers (sender thread)
+
+static Bit8u *rfbEncReserve(unsigned len)
+{
+  if ((rfbEnc.len + len) > rfbEnc.size) {
+    unsigned size = (rfbEnc.size > 0) ? rfbEnc.size : 0x10000;
+    while (size < (rfbEnc.len + len)) size <<= 1;
+    Bit8u *buf = new Bit8u[size];
+    if (rfbEnc.len > 0) {
+      memcpy(buf, rfbEnc.buf, rfbEnc.len);
+    }
+    delete [] rfbEnc.buf;
+    rfbEnc.buf = buf;
+    rfbEnc.size = size;
+  }
+  return rfbEnc.buf + rfbEnc.len;
+}
+
+static void rfbEncWrite(const void *data, unsigned len)
+{
+  memcpy(rfbEncReserve(len), data, len);
+  rfbEnc.len += len;
+}
+
+static BX_CPP_INLINE void rfbEncPut8(Bit8u value)
+{
+  *rfbEncReserve(1) = value;
+  rfbEnc.len++;
+}
+
+static void rfbEncRectHeader(unsigned x, unsigned y, unsigned w, unsigned h, Bit32u encoding)
+{
+  rfbFramebufferUpdateRectHeader furh;
+
+  furh.r.xPosition = htons(x);
+  furh.r.yPosition = htons(y);
+  furh.r.width = htons((short)w);
+  furh.r.height = htons((short)h);
+  furh.r.encodingType = htonl(encoding);
+  rfbEncWrite(&furh, rfbFramebufferUpdateRectHeaderSize);
+}
+
+static void rfbEncRaw(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  rfbEncRectHeader(x, y, w, h, rfbEncodingRaw);
+  for (unsigned i = 0; i < h; i++) {
+    rfbEncWrite(&rfbEnc.screen[(y + i) * rfbEnc.xdim + x], w);
+  }
+}
+
+// Hextile: 16x16 tiles, solid tiles and tiles with few colours are sent as
+// background plus subrectangles, the background and foreground colours are
+// only sent if they differ from the previous tile.
+static void rfbEncHextileTile(const Bit8u *tile, unsigned tw, unsigned th)
+{
+  Bit16u count[256];
+  Bit8u colors[RFB_HEXTILE_SIZE * RFB_HEXTILE_SIZE];
+  Bit8u subrects[3 * 255];
+  bool done[RFB_HEXTILE_SIZE * RFB_HEXTILE_SIZE];
+  unsigned i, j, k, n = 0, ncolors = 0, len = 0, size, sw, sh, vw, vh, a, b;
+  Bit8u bg, fg = 0, c, subenc;
+  bool mono;
+
+  memset(count, 0, sizeof(count));
+  memset(colors, 0, sizeof(colors));
+  for (i = 0; i < (tw * th); i++) {
+    if (count[tile[i]]++ == 0) colors[ncolors++] = tile[i];
+  }
+  bg = colors[0];
+  for (i = 1; i < ncolors; i++) {
+    if (count[colors[i]] > count[bg]) bg = colors[i];
+  }
+  if (ncolors == 1) {
+    if (!rfbEnc.bg_valid || (bg != rfbEnc.bg)) {
+      rfbEncPut8(rfbHextileBackgroundSpecified);
+      rfbEncPut8(bg);
+      rfbEnc.bg = bg;
+      rfbEnc.bg_valid = 1;
+    } else {
+      rfbEncPut8(0);
+    }
+    return;
+  }
+  mono = (ncolors == 2);
+  if (mono) {
+    fg = (colors[0] == bg) ? colors[1] : colors[0];
+  }
+  for (i = 0; i < (tw * th); i++) {
+    done[i] = (tile[i] == bg);
+  }
+  for (j = 0; (j < th) && (n <= 255); j++) {
+    for (i = 0; i < tw; i++) {
+      k = j * tw + i;
+      if (done[k]) continue;
+      c = tile[k];
+      // try growing right first and down first, keep the larger one
+      for (sw = 1; ((i + sw) < tw) && !done[k + sw] && (tile[k + sw] == c); sw++);
+      for (sh = 1; (j + sh) < th; sh++) {
+        for (a = 0; a < sw; a++) {
+          b = k + sh * tw + a;
+          if (done[b] || (tile[b] != c)) break;
+        }
+        if (a < sw) break;
+      }
+      for (vh = 1; ((j + vh) < th) && !done[k + vh * tw] && (tile[k + vh * tw] == c); vh++);
+      for (vw = 1; (i + vw) < tw; vw++) {
+        for (a = 0; a < vh; a++) {
+          b = k + a * tw + vw;
+          if (done[b] || (tile[b] != c)) break;
+        }
+        if (a < vh) break;
+      }
+      if ((vw * vh) > (sw * sh)) {
+        sw = vw;
+        sh = vh;
+      }
+      for (a = 0; a < sh; a++) {
+        memset(&done[k + a * tw], 1, sw);
+      }
+      if (++n > 255) break;
+      if (!mono) subrects[len++] = c;
+      subrects[len++] = rfbHextilePackXY(i, j);
+      subrects[len++] = rfbHextilePackWH(sw, sh);
+    }
+  }
+  subenc = rfbHextileAnySubrects;
+  size = 2 + len;
+  if (!rfbEnc.bg_valid || (bg != rfbEnc.bg)) {
+    subenc |= rfbHextileBackgroundSpecified;
+    size++;
+  }
+  if (!mono) {
+    subenc |= rfbHextileSubrectsColoured;
+  } else if (!rfbEnc.fg_valid || (fg != rfbEnc.fg)) {
+    subenc |= rfbHextileForegroundSpecified;
+    size++;
+  }
+  if ((n > 255) || (size > (1 + tw * th))) {
+    rfbEncPut8(rfbHextileRaw);
+    rfbEncWrite(tile, tw * th);
+    // colours of the next tile must be specified again
+    rfbEnc.bg_valid = 0;
+    rfbEnc.fg_valid = 0;
+    return;
+  }
+  rfbEncPut8(subenc);
+  if (subenc & rfbHextileBackgroundSpecified) {
+    rfbEncPut8(bg);
+    rfbEnc.bg = bg;
+    rfbEnc.bg_valid = 1;
+  }
+  if (subenc & rfbHextileForegroundSpecified) {
+    rfbEncPut8(fg);
+    rfbEnc.fg = fg;
+    rfbEnc.fg_valid = 1;
+  }
+  rfbEncPut8((Bit8u)n);
+  rfbEncWrite(subrects, len);
+  if (!mono) {
+    rfbEnc.fg_valid = 0;
+  }
+}
+
+static void rfbEncHextile(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u tile[RFB_HEXTILE_SIZE * RFB_HEXTILE_SIZE];
+  unsigned tx, ty, tw, th, i;
+
+  rfbEncRectHeader(x, y, w, h, rfbEncodingHextile);
+  rfbEnc.bg_valid = 0;
+  rfbEnc.fg_valid = 0;
+  for (ty = y; ty < (y + h); ty += RFB_HEXTILE_SIZE) {
+    th = BX_MIN(RFB_HEXTILE_SIZE, y + h - ty);
+    for (tx = x; tx < (x + w); tx += RFB_HEXTILE_SIZE) {
+      tw = BX_MIN(RFB_HEXTILE_SIZE, x + w - tx);
+      for (i = 0; i < th; i++) {
+        memcpy(&tile[i * tw], &rfbEnc.screen[(ty + i) * rfbEnc.xdim + tx], tw);
+      }
+      rfbEncHextileTile(tile, tw, th);
+    }
+  }
+}
+
+#if BX_HAVE_ZLIB
+static BX_CPP_INLINE unsigned rfbZRLERunLength(Bit8u *out, unsigned len)
+{
+  unsigned n = 0;
+
+  len--;
+  while (len >= 255) {
+    out[n++] = 255;
+    len -= 255;
+  }
+  out[n++] = (Bit8u)len;
+  return n;
+}
+
+// ZRLE: 64x64 tiles sent raw, solid, as packed palette indices or run
+// length encoded (plain or with palette), whatever is smallest. The tiles
+// of all rectangles are compressed with one zlib stream per connection.
+static unsigned rfbEncZRLETile(Bit8u *out, const Bit8u *tile, unsigned tw, unsigned th)
+{
+  Bit8u index[256], palette[128];
+  bool used[256];
+  unsigned i, j, k, n = tw * th, ncolors = 0, rle = 0, prle, packed, best, bpp, len = 0;
+  int mode = 0;
+
+  memset(used, 0, sizeof(used));
+  for (i = 0; (i < n) && (ncolors <= 127); i++) {
+    if (!used[tile[i]]) {
+      used[tile[i]] = 1;
+      index[tile[i]] = ncolors;
+      palette[ncolors++] = tile[i];
+    }
+  }
+  if (ncolors == 1) {
+    out[0] = 1;
+    out[1] = tile[0];
+    return 2;
+  }
+  prle = ncolors;
+  for (i = 0; i < n; i = j) {
+    for (j = i + 1; (j < n) && (tile[j] == tile[i]); j++);
+    k = (j - i - 1) / 255 + 1;
+    rle += 1 + k;
+    prle += (j - i == 1) ? 1 : 1 + k;
+  }
+  best = n;
+  if (rle < best) {
+    best = rle;
+    mode = 128;
+  }
+  if ((ncolors <= 127) && (prle < best)) {
+    best = prle;
+    mode = 128 + ncolors;
+  }
+  if (ncolors <= 16) {
+    bpp = (ncolors <= 2) ? 1 : (ncolors <= 4) ? 2 : 4;
+    packed = ncolors + th * ((tw * bpp + 7) / 8);
+    if (packed < best) {
+      best = packed;
+      mode = ncolors;
+    }
+  }
+  out[len++] = (Bit8u)mode;
+  if (mode == 0) {
+    memcpy(&out[len], tile, n);
+    len += n;
+  } else if (mode < 128) {
+    memcpy(&out[len], palette, ncolors);
+    len += ncolors;
+    bpp = (ncolors <= 2) ? 1 : (ncolors <= 4) ? 2 : 4;
+    for (j = 0; j < th; j++) {
+      unsigned bits = 0, acc = 0;
+      for (i = 0; i < tw; i++) {
+        acc = (acc << bpp) | index[tile[j * tw + i]];
+        bits += bpp;
+        if (bits == 8) {
+          out[len++] = (Bit8u)acc;
+          acc = bits = 0;
+        }
+      }
+      if (bits > 0) {
+        out[len++] = (Bit8u)(acc << (8 - bits));
+      }
+    }
+  } else {
+    if (mode > 128) {
+      memcpy(&out[len], palette, ncolors);
+      len += ncolors;
+    }
+    for (i = 0; i < n; i = j) {
+      for (j = i + 1; (j < n) && (tile[j] == tile[i]); j++);
+      if (mode == 128) {
+        out[len++] = tile[i];
+        len += rfbZRLERunLength(&out[len], j - i);
+      } else if ((j - i) == 1) {
+        out[len++] = index[tile[i]];
+      } else {
+        out[len++] = index[tile[i]] | 0x80;
+        len += rfbZRLERunLength(&out[len], j - i);
+      }
+    }
+  }
+  return len;
+}
+
+static void rfbEncZRLE(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u tile[rfbZRLETileWidth * rfbZRLETileHeight];
+  unsigned tx, ty, tw, th, i, zlen = 0, lenpos, avail;
+  Bit32u len;
+
+  rfbEncRectHeader(x, y, w, h, rfbEncodingZRLE);
+  // worst case is raw tiles
+  i = w * h + ((w + rfbZRLETileWidth - 1) / rfbZRLETileWidth) *
+      ((h + rfbZRLETileHeight - 1) / rfbZRLETileHeight);
+  if (i > rfbEnc.zsize) {
+    delete [] rfbEnc.zbuf;
+    rfbEnc.zbuf = new Bit8u[i];
+    rfbEnc.zsize = i;
+  }
+  for (ty = y; ty < (y + h); ty += rfbZRLETileHeight) {
+    th = BX_MIN(rfbZRLETileHeight, y + h - ty);
+    for (tx = x; tx < (x + w); tx += rfbZRLETileWidth) {
+      tw = BX_MIN(rfbZRLETileWidth, x + w - tx);
+      for (i = 0; i < th; i++) {
+        memcpy(&tile[i * tw], &rfbEnc.screen[(ty + i) * rfbEnc.xdim + tx], tw);
+      }
+      zlen += rfbEncZRLETile(&rfbEnc.zbuf[zlen], tile, tw, th);
+    }
+  }
+  lenpos = rfbEnc.len;
+  rfbEncReserve(4);
+  rfbEnc.len += 4;
+  rfbEnc.zs.next_in = rfbEnc.zbuf;
+  rfbEnc.zs.avail_in = zlen;
+  do {
+    avail = zlen / 2 + 1024;
+    rfbEnc.zs.next_out = rfbEncReserve(avail);
+    rfbEnc.zs.avail_out = avail;
+    deflate(&rfbEnc.zs, Z_SYNC_FLUSH);
+    rfbEnc.len += avail - rfbEnc.zs.avail_out;
+  } while ((rfbEnc.zs.avail_in > 0) || (rfbEnc.zs.avail_out == 0));
+  len = htonl(rfbEnc.len - lenpos - 4);
+  memcpy(&rfbEnc.buf[lenpos], &len, 4);
+}
+#endif
+
+// send one rectangle of the snapshot and update the client copy
+static void rfbEncRect(unsigned x, unsigned y, unsigned w, unsigned h, Bit32u encoding)
+{
+  switch (encoding) {
+    case rfbEncodingHextile:
+      rfbEncHextile(x, y, w, h);
+      break;
+#if BX_HAVE_ZLIB
+    case rfbEncodingZRLE:
+      if (rfbEnc.zs_init) {
+        rfbEncZRLE(x, y, w, h);
+      } else {
+        rfbEncRaw(x, y, w, h);
+      }
+      break;
+#endif
+    default:
+      rfbEncRaw(x, y, w, h);
+  }
+  for (unsigned i = 0; i < h; i++) {
+    memcpy(&rfbEnc.client[(y + i) * rfbEnc.xdim + x],
+           &rfbEnc.screen[(y + i) * rfbEnc.xdim + x], w);
+  }
+}
+
+// Split a queued region into bands and send the part of each band that
+// differs from the client copy. Returns the number of rectangles sent.
+static unsigned rfbEncChanged(const rfbUpdateRect *r, Bit32u encoding)
+{
+  unsigned band, y, yend, i, left, right, x0, x1, y0, y1, n = 0;
+  const Bit8u *s, *c;
+
+  band = (encoding == rfbEncodingZRLE) ? rfbZRLETileHeight : RFB_HEXTILE_SIZE;
+  for (y = r->y; y < (r->y + r->h); y += band) {
+    yend = BX_MIN(y + band, r->y + r->h);
+    x0 = r->x + r->w;
+    x1 = r->x;
+    y0 = yend;
+    y1 = y;
+    for (i = y; i < yend; i++) {
+      s = &rfbEnc.screen[i * rfbEnc.xdim];
+      c = &rfbEnc.client[i * rfbEnc.xdim];
+      left = r->x;
+      right = r->x + r->w;
+      while ((left < right) && (s[left] == c[left])) left++;
+      if (left == right) continue;
+      while (s[right - 1] == c[right - 1]) right--;
+      if (left < x0) x0 = left;
+      if (right > x1) x1 = right;
+      if (i < y0) y0 = i;
+      y1 = i + 1;
+    }
+    if (y1 > y0) {
+      rfbEncRect(x0, y0, x1 - x0, y1 - y0, encoding);
+      n++;
+    }
+  }
+  return n;
+}
+
+static Bit32u rfbRowHash(const Bit8u *row, unsigned len)
+{
+  Bit32u hash = 0x811c9dc5;
+
+  for (unsigned i = 0; i < len; i++) {
+    hash = (hash ^ row[i]) * 0x01000193;
+  }
+  return hash;
+}
+
+// Look for a vertically scrolled area in a queued region and send it as
+// CopyRect from the client's own framebuffer. Returns the number of
+// rectangles sent.
+static unsigned rfbEncCopyRect(const rfbUpdateRect *r)
+{
+  Bit32u *nh = rfbEnc.hash[0], *oh = rfbEnc.hash[1];
+  int dy, cand_dy[16];
+  unsigned cand_votes[16], ncand = 0, best, i, j, k, step, start = 0, len = 0, run;
+  unsigned pitch = rfbEnc.xdim, changed;
+  rfbCopyRect cr;
+
+  if ((r->w < 32) || (r->h < 32))
+    return 0;
+  for (i = 0; i < rfbEnc.ydim; i++) {
+    oh[i] = rfbRowHash(&rfbEnc.client[i * pitch + r->x], r->w);
+  }
+  for (i = r->y; i < (r->y + r->h); i++) {
+    nh[i] = rfbRowHash(&rfbEnc.screen[i * pitch + r->x], r->w);
+  }
+  // let some changed, non-uniform rows vote for the scroll distance
+  step = r->h / 16;
+  for (i = r->y; i < (r->y + r->h); i += step) {
+    const Bit8u *row = &rfbEnc.screen[i * pitch + r->x];
+    if (nh[i] == oh[i]) continue;
+    for (k = 1; (k < r->w) && (row[k] == row[0]); k++);
+    if (k == r->w) continue;
+    for (j = 0; j < rfbEnc.ydim; j++) {
+      if ((j == i) || (oh[j] != nh[i])) continue;
+      dy = (int)j - (int)i;
+      for (k = 0; (k < ncand) && (cand_dy[k] != dy); k++);
+      if (k == ncand) {
+        if (ncand == 16) continue;
+        cand_dy[ncand] = dy;
+        cand_votes[ncand++] = 0;
+      }
+      cand_votes[k]++;
+    }
+  }
+  if (ncand == 0)
+    return 0;
+  best = 0;
+  for (k = 1; k < ncand; k++) {
+    if (cand_votes[k] > cand_votes[best]) best = k;
+  }
+  if (cand_votes[best] < 2)
+    return 0;
+  dy = cand_dy[best];
+  // longest run of rows found in the client framebuffer at distance dy
+  run = 0;
+  for (i = r->y; i <= (r->y + r->h); i++) {
+    j = i + dy;
+    if ((i < (r->y + r->h)) && (j < rfbEnc.ydim) && (nh[i] == oh[j]) &&
+        !memcmp(&rfbEnc.screen[i * pitch + r->x], &rfbEnc.client[j * pitch + r->x], r->w)) {
+      run++;
+    } else {
+      if (run > len) {
+        start = i - run;
+        len = run;
+      }
+      run = 0;
+    }
+  }
+  if (len < 16)
+    return 0;
+  // not worth it if most rows did not change at all
+  for (changed = 0, i = start; i < (start + len); i++) {
+    if (nh[i] != oh[i]) changed++;
+  }
+  if ((changed * 2) < len)
+    return 0;
+  rfbEncRectHeader(r->x, start, r->w, len, rfbEncodingCopyRect);
+  cr.srcXPosition = htons(r->x);
+  cr.srcYPosition = htons(start + dy);
+  rfbEncWrite(&cr, rfbCopyRectSize);
+  if (dy > 0) {
+    for (i = start; i < (start + len); i++) {
+      memcpy(&rfbEnc.client[i * pitch + r->x], &rfbEnc.client[(i + dy) * pitch + r->x], r->w);
+    }
+  } else {
+    for (i = start + len; i-- > start;) {
+      memcpy(&rfbEnc.client[i * pitch + r->x], &rfbEnc.client[(i + dy) * pitch + r->x], r->w);
+    }
+  }
+  return 1;
+}
+
+static void rfbSenderLoop(void)
+{
+  rfbUpdateRect rects[RFB_UPDATE_QUEUE_SIZE];
+  rfbFramebufferUpdateMessage fum;
+  unsigned i, j, count, n;
+  bool full, resize, copyrect;
+  Bit32u encoding;
+
+  while (1) {
+    bx_wait_sem(&rfbSender.sem);
+    BX_LOCK(rfbSender.mutex);
+    if (rfbSender.stop || (rfbSender.screen == NULL)) {
+      BX_UNLOCK(rfbSender.mutex);
+      break;
+    }
+    if (!rfbSender.request || (!rfbSender.full && (rfbSender.qcount == 0))) {
+      BX_UNLOCK(rfbSender.mutex);
+      continue;
+    }
+    if ((rfbSender.xdim != rfbEnc.xdim) || (rfbSender.ydim != rfbEnc.ydim)) {
+      delete [] rfbEnc.screen;
+      delete [] rfbEnc.client;
+      delete [] rfbEnc.hash[0];
+      delete [] rfbEnc.hash[1];
+      rfbEnc.xdim = rfbSender.xdim;
+      rfbEnc.ydim = rfbSender.ydim;
+      rfbEnc.screen = new Bit8u[rfbEnc.xdim * rfbEnc.ydim];
+      rfbEnc.client = new Bit8u[rfbEnc.xdim * rfbEnc.ydim];
+      rfbEnc.hash[0] = new Bit32u[rfbEnc.ydim];
+      rfbEnc.hash[1] = new Bit32u[rfbEnc.ydim];
+      rfbSender.full = 1;
+    }
+    full = rfbSender.full;
+    resize = rfbSender.resize && rfbSender.desktopsize;
+    count = 0;
+    if (full) {
+      memcpy(rfbEnc.screen, rfbSender.screen, rfbEnc.xdim * rfbEnc.ydim);
+    } else {
+      for (i = 0; i < rfbSender.qcount; i++) {
+        rects[count] = rfbSender.queue[i];
+        for (j = 0; j < rects[count].h; j++) {
+          memcpy(&rfbEnc.screen[(rects[count].y + j) * rfbEnc.xdim + rects[count].x],
+                 &rfbSender.screen[(rects[count].y + j) * rfbEnc.xdim + rects[count].x],
+                 rects[count].w);
+        }
+        count++;
+      }
+    }
+    rfbSender.qcount = 0;
+    rfbSender.request = 0;
+    rfbSender.full = 0;
+    rfbSender.resize = 0;
+    encoding = rfbSender.encoding;
+    copyrect = rfbSender.copyrect;
+    BX_UNLOCK(rfbSender.mutex);
+
+    rfbEnc.len = 0;
+    rfbEncReserve(rfbFramebufferUpdateMessageSize);
+    rfbEnc.len = rfbFramebufferUpdateMessageSize;
+    n = 0;
+    if (resize) {
+      rfbEncRectHeader(0, 0, rfbEnc.xdim, rfbEnc.ydim, rfbEncodingDesktopSize);
+      n++;
+    }
+    if (full) {
+      rfbEncRect(0, 0, rfbEnc.xdim, rfbEnc.ydim, encoding);
+      n++;
+    } else {
+      for (i = 0; i < count; i++) {
+        if (copyrect) {
+          n += rfbEncCopyRect(&rects[i]);
+        }
+        n += rfbEncChanged(&rects[i], encoding);
+      }
+    }
+    if (n == 0) {
+      // nothing changed, keep the request pending
+      BX_LOCK(rfbSender.mutex);
+      rfbSender.request = 1;
+      BX_UNLOCK(rfbSender.mutex);
+      continue;
+    }
+    fum.messageType = rfbFramebufferUpdate;
+    fum.padding = 0;
+    fum.numberOfRectangles = htons(n);
+    memcpy(rfbEnc.buf, &fum, rfbFramebufferUpdateMessageSize);
+    if (WriteExact(rfbSender.sock, (char *)rfbEnc.buf, rfbEnc.len) <= 0) {
+      BX_ERROR(("could not send framebuffer update."));
+      break;
+    }
+    rfbEnc.updates++;
+    rfbEnc.bytes += rfbEnc.len;
+  }
+}
+
+BX_THREAD_FUNC(rfbSenderThread, indata)
+{
+#if BX_HAVE_ZLIB
+  memset(&rfbEnc.zs, 0, sizeof(rfbEnc.zs));
+  rfbEnc.zs_init = (deflateInit(&rfbEnc.zs, Z_DEFAULT_COMPRESSION) == Z_OK);
+  if (!rfbEnc.zs_init) {
+    BX_ERROR(("could not initialize zlib stream."));
+  }
+#endif
+  rfbSenderLoop();
+#if BX_HAVE_ZLIB
+  if (rfbEnc.zs_init) {
+    deflateEnd(&rfbEnc.zs);
+    rfbEnc.zs_init = 0;
+  }
+#endif
+  BX_LOCK(rfbSender.mutex);
+  rfbSender.running = 0;
+  BX_UNLOCK(rfbSender.mutex);
+  BX_THREAD_EXIT;
+}
+
+void rfbStartSender(SOCKET sClient)
+{
+  bx_create_sem(&rfbSender.sem);
+  BX_LOCK(rfbSender.mutex);
+  rfbSender.sock = sClient;
+  rfbSender.stop = 0;
+  rfbSender.request = 0;
+  rfbSender.full = 1;
+  rfbSender.resize = 0;
+  rfbSender.qcount = 0;
+  rfbSender.encoding = rfbEncodingRaw;
+  rfbSender.copyrect = 0;
+  rfbSender.desktopsize = 0;
+  rfbSender.enabled = 1;
+  rfbSender.running = 1;
+  BX_UNLOCK(rfbSender.mutex);
+  rfbEnc.updates = 0;
+  rfbEnc.bytes = 0;
+  BX_THREAD_CREATE(rfbSenderThread, NULL, rfbSender.thread_var);
+}
+
+void rfbStopSender(void)
+{
+  if (!rfbSender.enabled)
+    return;
+  BX_LOCK(rfbSender.mutex);
+  rfbSender.stop = 1;
+  rfbSender.enabled = 0;
+  BX_UNLOCK(rfbSender.mutex);
+  bx_set_sem(&rfbSender.sem);
+  BX_THREAD_JOIN(rfbSender.thread_var);
+  while (1) {
+    BX_LOCK(rfbSender.mutex);
+    bool running = rfbSender.running;
+    BX_UNLOCK(rfbSender.mutex);
+    if (!running) break;
+    BX_MSLEEP(1);
+  }
+  bx_destroy_sem(&rfbSender.sem);
+  BX_INFO(("sent " FMT_LL "u updates, " FMT_LL "u bytes", rfbEnc.updates, rfbEnc.bytes));
+}
+
 void rfbSetStatusText(int element, const char *text, bool active, Bit8u color)
 {
   char *newBits;
@@ -364,6 +364,9 @@ typedef struct {
 #define rfbHextileExtractW(byte) (((byte) >> 4) + 1)
 #define rfbHextileExtractH(byte) (((byte) & 0xf) + 1)
 
+#define rfbZRLETileWidth  64
+#define rfbZRLETileHeight 64
+
 
 typedef struct {
 	U8  messageType;
@@ -523,6 +523,12 @@ enum {
 };
 #define BX_ATA_TRANSLATION_LAST  BX_ATA_TRANSLATION_AUTO
 
+enum {
+  BX_ATA_CACHE_WRITETHROUGH,
+  BX_ATA_CACHE_NONE,
+  BX_ATA_CACHE_WRITEBACK
+};
+
 enum {
   BX_CLOCK_SYNC_NONE,
   BX_CLOCK_SYNC_REALTIME,
@@ -1443,7 +1443,8 @@ bool bx_devices_c::register_pci_handlers(bx_pci_device_c *dev,
 }
 
 bool bx_devices_c::pci_set_base_mem(void *this_ptr, memory_handler_t f1, memory_handler_t f2,
-                                       Bit32u *addr, Bit8u *pci_conf, unsigned size)
+                                    memory_direct_access_handler_t f3, Bit32u *addr,
+                                    Bit8u *pci_conf, unsigned size)
 {
   Bit32u oldbase = *addr, newbase;
   Bit32u mask = ~(size - 1);
@@ -1462,7 +1463,11 @@ bool bx_devices_c::pci_set_base_mem(void *this_ptr, memory_handler_t f1, memory_
       DEV_unregister_memory_handlers(this_ptr, oldbase, oldbase + size - 1);
     }
     if (newbase > 0) {
-      DEV_register_memory_handlers(this_ptr, f1, f2, newbase, newbase + size - 1);
+      DEV_register_memory_handlers_da(this_ptr, f1, f2, f3, newbase, newbase + size - 1);
+    }
+    if (f3 != NULL) {
+      // drop host pointers to the old location cached in the TLBs
+      bx_pc_system.MemoryMappingChanged();
     }
     *addr = newbase;
     return true;
@@ -1539,13 +1544,14 @@ void bx_pci_device_c::init_bar_io(Bit8u num, Bit16u size, bx_read_handler_t rh,
 }
 
 void bx_pci_device_c::init_bar_mem(Bit8u num, Bit32u size, memory_handler_t rh,
-                                   memory_handler_t wh)
+                                   memory_handler_t wh, memory_direct_access_handler_t dah)
 {
   if (num < 6) {
     pci_bar[num].type = BX_PCI_BAR_TYPE_MEM;
     pci_bar[num].size = size;
     pci_bar[num].mem.rh = rh;
     pci_bar[num].mem.wh = wh;
+    pci_bar[num].mem.dah = dah;
   }
 }
 
@@ -1559,7 +1565,7 @@ void bx_pci_device_c::after_restore_pci_state(memory_handler_t mem_read_handler)
   for (int i = 0; i < 6; i++) {
     if (pci_bar[i].type == BX_PCI_BAR_TYPE_MEM) {
       if (DEV_pci_set_base_mem(this, pci_bar[i].mem.rh, pci_bar[i].mem.wh,
-                           &pci_bar[i].addr, &pci_conf[0x10 + i * 4],
+                           pci_bar[i].mem.dah, &pci_bar[i].addr, &pci_conf[0x10 + i * 4],
                            pci_bar[i].size)) {
         BX_INFO(("BAR #%d: mem base address = 0x%08x", i, pci_bar[i].addr));
         pci_bar_change_notify();
@@ -1574,7 +1580,7 @@ void bx_pci_device_c::after_restore_pci_state(memory_handler_t mem_read_handler)
     }
   }
   if (pci_rom_size > 0) {
-    if (DEV_pci_set_base_mem(this, mem_read_handler, NULL, &pci_rom_address,
+    if (DEV_pci_set_base_mem(this, mem_read_handler, NULL, NULL, &pci_rom_address,
                              &pci_conf[0x30], pci_rom_size)) {
       BX_INFO(("new ROM address: 0x%08x", pci_rom_address));
     }
@@ -1679,7 +1685,7 @@ void bx_pci_device_c::pci_write_handler_common(Bit8u address, Bit32u value, unsi
           }
         } else {
           if (DEV_pci_set_base_mem(this, pci_bar[bnum].mem.rh, pci_bar[bnum].mem.wh,
-                                   &pci_bar[bnum].addr, &pci_conf[0x10 + bnum * 4],
+                                   pci_bar[bnum].mem.dah, &pci_bar[bnum].addr, &pci_conf[0x10 + bnum * 4],
                                    pci_bar[bnum].size)) {
             BX_INFO(("BAR #%d: mem base address = 0x%08x", bnum, pci_bar[bnum].addr));
             pci_bar_change_notify();
@@ -1697,7 +1703,7 @@ void bx_pci_device_c::pci_write_handler_common(Bit8u address, Bit32u value, unsi
       pci_conf[address+i] = value8;
     }
     if (rom_change) {
-      if (DEV_pci_set_base_mem(this, pci_rom_read_handler, NULL,
+      if (DEV_pci_set_base_mem(this, pci_rom_read_handler, NULL, NULL,
                                &pci_rom_address, &pci_conf[0x30],
                                pci_rom_size)) {
         BX_INFO(("new ROM address = 0x%08x", pci_rom_address));
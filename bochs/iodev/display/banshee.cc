@@ -2456,6 +2456,62 @@ Bit32u bx_banshee_c::blt_yuv_conversion(Bit8u *ptr, Bit16u xc, Bit16u yc,
   return value;
 }
 
+// The fast paths below build one row of source pixels in blt_row and pass
+// it to the ROP handler in a single call. They are used if the result only
+// depends on the source and destination, i.e. without per pixel colorkey
+// checks or transparency and for left to right blits only.
+
+// replicate the first 'period' bytes of the row up to 'len' bytes
+void bx_banshee_c::blt_repeat_row(Bit8u *row, int len, int period)
+{
+  int filled = period, n;
+
+  while (filled < len) {
+    n = ((len - filled) < filled) ? (len - filled) : filled;
+    memcpy(row + filled, row, n);
+    filled += n;
+  }
+}
+
+// expand 'count' monochrome pixels starting at bit 'smask' of 'src' to
+// foreground / background colors
+void bx_banshee_c::blt_expand_mono_row(Bit8u *row, const Bit8u *src, Bit8u smask,
+                                       int count, Bit8u pxsize)
+{
+  while (count-- > 0) {
+    if (*src & smask) {
+      memcpy(row, BLT.fgcolor, pxsize);
+    } else {
+      memcpy(row, BLT.bgcolor, pxsize);
+    }
+    row += pxsize;
+    smask >>= 1;
+    if (smask == 0) {
+      src++;
+      smask = 0x80;
+    }
+  }
+}
+
+// check if the source and destination areas of a screen to screen blt
+// overlap (the fast paths read a source row before writing the destination)
+bool bx_banshee_c::blt_overlap(const Bit8u *dst, int dbytes, int dpitch,
+                               const Bit8u *src, int sbytes, int spitch, int h)
+{
+  const Bit8u *dst0 = dst, *dst1 = dst + (h - 1) * dpitch;
+  const Bit8u *src0 = src, *src1 = src + (h - 1) * spitch;
+
+  if (dpitch < 0) {
+    dst0 = dst1;
+    dst1 = dst;
+  }
+  if (spitch < 0) {
+    src0 = src1;
+    src1 = src;
+  }
+  return ((src0 < (dst1 + dbytes)) && (dst0 < (src1 + sbytes)));
+}
+
 void bx_banshee_c::blt_rectangle_fill()
 {
   Bit32u dpitch = BLT.dst_pitch;
@@ -2476,16 +2532,22 @@ void bx_banshee_c::blt_rectangle_fill()
   }
   BX_LOCK(render_mutex);
   dst_ptr = &v->fbi.ram[BLT.dst_base + dy * dpitch + dx * dpxsize];
-  for (y = 0; y < h; y++) {
-    dst_ptr1 = dst_ptr;
-    for (x = 0; x < w; x++) {
-      if (colorkey_en & 2) {
-        rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+  if (((colorkey_en & 2) == 0) && !BLT.x_dir) {
+    memcpy(blt_row, BLT.fgcolor, dpxsize);
+    blt_repeat_row(blt_row, w * dpxsize, dpxsize);
+    BLT.rop_fn[0](dst_ptr, blt_row, dpitch, 0, w * dpxsize, h);
+  } else {
+    for (y = 0; y < h; y++) {
+      dst_ptr1 = dst_ptr;
+      for (x = 0; x < w; x++) {
+        if (colorkey_en & 2) {
+          rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+        }
+        BLT.rop_fn[rop](dst_ptr1, BLT.fgcolor, dpitch, dpxsize, dpxsize, 1);
+        dst_ptr1 += dpxsize;
       }
-      BLT.rop_fn[rop](dst_ptr1, BLT.fgcolor, dpitch, dpxsize, dpxsize, 1);
-      dst_ptr1 += dpxsize;
+      dst_ptr += dpitch;
     }
-    dst_ptr += dpitch;
   }
   blt_complete();
   BX_UNLOCK(render_mutex);
@@ -2502,8 +2564,8 @@ void bx_banshee_c::blt_pattern_fill_mono()
   Bit8u rop = 0;
   Bit8u *color;
   int dx, dy, w, h, x, y;
-  Bit8u mask;
-  bool set;
+  Bit8u mask, patline[2];
+  bool set, fast;
 
   dx = BLT.dst_x;
   dy = BLT.dst_y;
@@ -2516,6 +2578,7 @@ void bx_banshee_c::blt_pattern_fill_mono()
   }
   BX_LOCK(render_mutex);
   dst_ptr = &v->fbi.ram[BLT.dst_base + dy * dpitch + dx * dpxsize];
+  fast = ((colorkey_en & 2) == 0) && !BLT.transp && !BLT.x_dir;
   for (y = dy; y < (dy + h); y++) {
     dst_ptr1 = dst_ptr;
     if (!patrow0) {
@@ -2523,21 +2586,28 @@ void bx_banshee_c::blt_pattern_fill_mono()
     } else {
       pat_ptr1 = pat_ptr;
     }
-    for (x = dx; x < (dx + w); x++) {
-      mask = 0x80 >> ((x + BLT.patsx) & 7);
-      set = (*pat_ptr1 & mask) > 0;
-      if (set) {
-        color = &BLT.fgcolor[0];
-      } else {
-        color = &BLT.bgcolor[0];
-      }
-      if ((set) || !BLT.transp) {
-        if (colorkey_en & 2) {
-          rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+    if (fast) {
+      patline[0] = patline[1] = *pat_ptr1;
+      blt_expand_mono_row(blt_row, patline, 0x80 >> ((dx + BLT.patsx) & 7), 8, dpxsize);
+      blt_repeat_row(blt_row, w * dpxsize, 8 * dpxsize);
+      BLT.rop_fn[0](dst_ptr1, blt_row, dpitch, 0, w * dpxsize, 1);
+    } else {
+      for (x = dx; x < (dx + w); x++) {
+        mask = 0x80 >> ((x + BLT.patsx) & 7);
+        set = (*pat_ptr1 & mask) > 0;
+        if (set) {
+          color = &BLT.fgcolor[0];
+        } else {
+          color = &BLT.bgcolor[0];
+        }
+        if ((set) || !BLT.transp) {
+          if (colorkey_en & 2) {
+            rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+          }
+          BLT.rop_fn[rop](dst_ptr1, color, dpitch, dpxsize, dpxsize, 1);
         }
-        BLT.rop_fn[rop](dst_ptr1, color, dpitch, dpxsize, dpxsize, 1);
+        dst_ptr1 += dpxsize;
       }
-      dst_ptr1 += dpxsize;
     }
     dst_ptr += dpitch;
   }
@@ -2555,6 +2625,7 @@ void bx_banshee_c::blt_pattern_fill_color()
   Bit8u colorkey_en = BLT.reg[blt_commandExtra] & 3;
   Bit8u rop = 0;
   int dx, dy, w, h, x, y;
+  bool fast;
 
   dx = BLT.dst_x;
   dy = BLT.dst_y;
@@ -2567,6 +2638,7 @@ void bx_banshee_c::blt_pattern_fill_color()
   }
   BX_LOCK(render_mutex);
   dst_ptr = &v->fbi.ram[BLT.dst_base + dy * dpitch + dx * dpxsize];
+  fast = ((colorkey_en & 2) == 0) && !BLT.x_dir;
   for (y = dy; y < (dy + h); y++) {
     dst_ptr1 = dst_ptr;
     if (!patrow0) {
@@ -2574,13 +2646,21 @@ void bx_banshee_c::blt_pattern_fill_color()
     } else {
       pat_ptr1 = pat_ptr;
     }
-    for (x = dx; x < (dx + w); x++) {
-      pat_ptr2 = pat_ptr1 + ((x + BLT.patsx) & 7) * dpxsize;
-      if (colorkey_en & 2) {
-        rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+    if (fast) {
+      x = (dx + BLT.patsx) & 7;
+      memcpy(blt_row, pat_ptr1 + x * dpxsize, (8 - x) * dpxsize);
+      memcpy(blt_row + (8 - x) * dpxsize, pat_ptr1, x * dpxsize);
+      blt_repeat_row(blt_row, w * dpxsize, 8 * dpxsize);
+      BLT.rop_fn[0](dst_ptr1, blt_row, dpitch, 0, w * dpxsize, 1);
+    } else {
+      for (x = dx; x < (dx + w); x++) {
+        pat_ptr2 = pat_ptr1 + ((x + BLT.patsx) & 7) * dpxsize;
+        if (colorkey_en & 2) {
+          rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+        }
+        BLT.rop_fn[rop](dst_ptr1, pat_ptr2, dpitch, dpxsize, dpxsize, 1);
+        dst_ptr1 += dpxsize;
       }
-      BLT.rop_fn[rop](dst_ptr1, pat_ptr2, dpitch, dpxsize, dpxsize, 1);
-      dst_ptr1 += dpxsize;
     }
     dst_ptr += dpitch;
   }
@@ -2640,7 +2720,19 @@ void bx_banshee_c::blt_screen_to_screen()
     spitch *= -1;
     dpitch *= -1;
   }
-  if ((BLT.src_fmt == 0) && (pxpack == 1)) {
+  if ((BLT.src_fmt == 0) && (pxpack == 1) &&
+      ((colorkey_en & 2) == 0) && !BLT.transp && !BLT.x_dir &&
+      !blt_overlap(dst_ptr, w * dpxsize, dpitch, src_ptr + sy * abs(spitch) + sx / 8,
+                   ((sx & 7) + w + 7) >> 3, spitch, h)) {
+    src_ptr += (sy * abs(spitch) + sx / 8);
+    nrows = h;
+    do {
+      blt_expand_mono_row(blt_row, src_ptr, 0x80 >> (sx & 7), w, dpxsize);
+      BLT.rop_fn[0](dst_ptr, blt_row, dpitch, 0, w * dpxsize, 1);
+      src_ptr += spitch;
+      dst_ptr += dpitch;
+    } while (--nrows);
+  } else if ((BLT.src_fmt == 0) && (pxpack == 1)) {
     src_ptr += (sy * abs(spitch) + sx / 8);
     nrows = h;
     do {
@@ -2692,6 +2784,28 @@ void bx_banshee_c::blt_screen_to_screen()
       src_ptr += spitch;
       dst_ptr += dpitch;
     } while (--nrows);
+  } else if (BLT.src_fmt == 3 && BLT.dst_fmt == 5 && !BLT.x_dir &&
+             !blt_overlap(dst_ptr, w * 4, dpitch, src_ptr + sy * abs(spitch) + sx * 2,
+                          w * 2, spitch, h)) {
+    src_ptr += (sy * abs(spitch) + sx * spxsize);
+    nrows = h;
+    do {
+      src_ptr1 = src_ptr;
+      dst_ptr1 = blt_row;
+      for (x = 0; x < w; x++) {
+#ifdef BX_LITTLE_ENDIAN
+        memcpy(dst_ptr1, &v->fbi.pen[*(Bit16u*)src_ptr1], 4);
+#else
+        Bit32u color32 = bx_bswap32(v->fbi.pen[bx_bswap16(*(Bit16u*)src_ptr1)]);
+        memcpy(dst_ptr1, &color32, 4);
+#endif
+        src_ptr1 += 2;
+        dst_ptr1 += 4;
+      }
+      BLT.rop_fn[0](dst_ptr, blt_row, dpitch, 0, w * 4, 1);
+      src_ptr += spitch;
+      dst_ptr += dpitch;
+    } while (--nrows);
   } else if (BLT.src_fmt == 3 && BLT.dst_fmt == 5) {
     src_ptr += (sy * abs(spitch) + sx * spxsize);
     nrows = h;
@@ -2923,9 +3037,9 @@ void bx_banshee_c::blt_host_to_screen()
   Bit8u spxsize = 0, r = 0, g = 0, b = 0;
   Bit8u scolor[4];
   Bit8u *color;
-  int nrows, x, y, w, h, xs;
+  int nrows, x, y, w, h, xs, x0, x1;
   Bit8u smask = 0;
-  bool set;
+  bool set, fast;
 
   w = BLT.dst_w;
   h = BLT.dst_h;
@@ -2946,6 +3060,21 @@ void bx_banshee_c::blt_host_to_screen()
   y = BLT.dst_y;
   xs = BLT.h2s_pxstart;
   dst_ptr = &v->fbi.ram[BLT.dst_base + y * dpitch + BLT.dst_x * dpxsize];
+  // mono expansion or copy without format conversion, clipped per row
+  if (srcfmt == 0) {
+    fast = ((colorkey_en & 2) == 0) && !BLT.transp;
+  } else {
+    fast = (colorkey_en == 0) && (srcfmt == BLT.dst_fmt) && (spxsize == dpxsize);
+  }
+  fast &= !BLT.x_dir;
+  x0 = BLT.dst_x;
+  if (x0 < BLT.clipx0[BLT.clip_sel]) {
+    x0 = BLT.clipx0[BLT.clip_sel];
+  }
+  x1 = BLT.dst_x + w;
+  if (x1 > BLT.clipx1[BLT.clip_sel]) {
+    x1 = BLT.clipx1[BLT.clip_sel];
+  }
   nrows = h;
   do {
     if (srcfmt == 0) {
@@ -2955,70 +3084,86 @@ void bx_banshee_c::blt_host_to_screen()
       src_ptr1 = src_ptr + xs;
     }
     dst_ptr1 = dst_ptr;
-    for (x = BLT.dst_x; x < (BLT.dst_x + w); x++) {
-      if (blt_clip_check(x, y)) {
+    if (fast) {
+      if ((x0 < x1) && (y >= BLT.clipy0[BLT.clip_sel]) && (y < BLT.clipy1[BLT.clip_sel])) {
+        x = x0 - BLT.dst_x;
         if (srcfmt == 0) {
-          set = (*src_ptr1 & smask) > 0;
-          if (set) {
-            color = &BLT.fgcolor[0];
-          } else {
-            color = &BLT.bgcolor[0];
-          }
-          if (set || !BLT.transp) {
-            if (colorkey_en & 2) {
-              rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
-            }
-            BLT.rop_fn[rop](dst_ptr1, color, dpitch, dpxsize, dpxsize, 1);
-          }
+          x += (xs & 7);
+          blt_expand_mono_row(blt_row, src_ptr + (xs >> 3) + (x >> 3), 0x80 >> (x & 7),
+                              x1 - x0, dpxsize);
+          src_ptr1 = blt_row;
         } else {
-          if (colorkey_en & 1) {
-            rop = blt_colorkey_check(src_ptr1, spxsize, 0);
-          }
-          if (BLT.dst_fmt != srcfmt) {
-            if ((srcfmt == 4) || (srcfmt == 5)) {
-              b = src_ptr1[0];
-              g = src_ptr1[1];
-              r = src_ptr1[2];
-            } else if (srcfmt == 3) {
-              b = src_ptr1[0] << 3;
-              g = ((src_ptr1[1] & 0x07) << 5) | ((src_ptr1[0] & 0xe0) >> 3);
-              r = src_ptr1[1] & 0xf8;
+          src_ptr1 += x * spxsize;
+        }
+        BLT.rop_fn[0](dst_ptr1 + (x0 - BLT.dst_x) * dpxsize, src_ptr1, dpitch, 0,
+                      (x1 - x0) * dpxsize, 1);
+      }
+    } else {
+      for (x = BLT.dst_x; x < (BLT.dst_x + w); x++) {
+        if (blt_clip_check(x, y)) {
+          if (srcfmt == 0) {
+            set = (*src_ptr1 & smask) > 0;
+            if (set) {
+              color = &BLT.fgcolor[0];
+            } else {
+              color = &BLT.bgcolor[0];
             }
-            if (dpxsize == 2) {
-              scolor[0] = (b >> 3) | ((g & 0x1c) << 3);
-              scolor[1] = (g >> 5) | (r & 0xf8);
+            if (set || !BLT.transp) {
               if (colorkey_en & 2) {
-                rop |= blt_colorkey_check(dst_ptr1, dpxsize, 1);
+                rop = blt_colorkey_check(dst_ptr1, dpxsize, 1);
+              }
+              BLT.rop_fn[rop](dst_ptr1, color, dpitch, dpxsize, dpxsize, 1);
+            }
+          } else {
+            if (colorkey_en & 1) {
+              rop = blt_colorkey_check(src_ptr1, spxsize, 0);
+            }
+            if (BLT.dst_fmt != srcfmt) {
+              if ((srcfmt == 4) || (srcfmt == 5)) {
+                b = src_ptr1[0];
+                g = src_ptr1[1];
+                r = src_ptr1[2];
+              } else if (srcfmt == 3) {
+                b = src_ptr1[0] << 3;
+                g = ((src_ptr1[1] & 0x07) << 5) | ((src_ptr1[0] & 0xe0) >> 3);
+                r = src_ptr1[1] & 0xf8;
+              }
+              if (dpxsize == 2) {
+                scolor[0] = (b >> 3) | ((g & 0x1c) << 3);
+                scolor[1] = (g >> 5) | (r & 0xf8);
+                if (colorkey_en & 2) {
+                  rop |= blt_colorkey_check(dst_ptr1, dpxsize, 1);
+                }
+                BLT.rop_fn[rop](dst_ptr1, scolor, dpitch, dpxsize, dpxsize, 1);
+              } else if ((dpxsize == 3) || (dpxsize == 4)) {
+                scolor[0] = b;
+                scolor[1] = g;
+                scolor[2] = r;
+                scolor[3] = 0;
+                if (colorkey_en & 2) {
+                  rop |= blt_colorkey_check(dst_ptr1, dpxsize, 1);
+                }
+                BLT.rop_fn[rop](dst_ptr1, scolor, dpitch, dpxsize, dpxsize, 1);
               }
-              BLT.rop_fn[rop](dst_ptr1, scolor, dpitch, dpxsize, dpxsize, 1);
-            } else if ((dpxsize == 3) || (dpxsize == 4)) {
-              scolor[0] = b;
-              scolor[1] = g;
-              scolor[2] = r;
-              scolor[3] = 0;
+            } else {
               if (colorkey_en & 2) {
                 rop |= blt_colorkey_check(dst_ptr1, dpxsize, 1);
               }
-              BLT.rop_fn[rop](dst_ptr1, scolor, dpitch, dpxsize, dpxsize, 1);
-            }
-          } else {
-            if (colorkey_en & 2) {
-              rop |= blt_colorkey_check(dst_ptr1, dpxsize, 1);
+              BLT.rop_fn[rop](dst_ptr1, src_ptr1, dpitch, dpxsize, dpxsize, 1);
             }
-            BLT.rop_fn[rop](dst_ptr1, src_ptr1, dpitch, dpxsize, dpxsize, 1);
           }
         }
-      }
-      if (srcfmt == 0) {
-        smask >>= 1;
-        if (smask == 0) {
-          src_ptr1++;
-          smask = 0x80;
+        if (srcfmt == 0) {
+          smask >>= 1;
+          if (smask == 0) {
+            src_ptr1++;
+            smask = 0x80;
+          }
+        } else {
+          src_ptr1 += spxsize;
         }
-      } else {
-        src_ptr1 += spxsize;
+        dst_ptr1 += dpxsize;
       }
-      dst_ptr1 += dpxsize;
     }
     src_ptr += spitch;
     if (pxpack == 0) {
@@ -3639,6 +3784,7 @@ void bx_voodoo_vga_c::after_restore_state(void)
 void bx_voodoo_vga_c::redraw_area(unsigned x0, unsigned y0, unsigned width,
                                   unsigned height)
 {
+  damage_notify();
   if (v->banshee.io[io_vidProcCfg] & 0x01) {
     theVoodooDevice->redraw_area(x0, y0, width, height);
   } else {
@@ -3864,6 +4010,7 @@ void bx_voodoo_vga_c::mem_write(bx_phy_address addr, Bit8u value)
   Bit32u offset, start, end, pitch;
   unsigned xti, yti;
 
+  damage_notify();
   if (chain4) {
     offset = (((v->banshee.io[io_vgaInit1] & 0x3ff) << 15) + (addr & 0x1ffff)) & v->fbi.mask;
     v->fbi.ram[offset] = value;
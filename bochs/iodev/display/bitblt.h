@@ -26,80 +26,191 @@ typedef void (*bx_bitblt_rop_t)(
     int dstpitch,int srcpitch,
     int bltwidth,int bltheight);
 
-#define IMPLEMENT_FORWARD_BITBLT(name,opline) \
+#ifdef BX_USE_BINARY_ROP
+
+// The binary ROPs process the rows in blocks of 16 (SSE2) or 8 bytes. The
+// result is the same as with the byte loop as long as a block doesn't read
+// source bytes written by the same block, so the blocks are only used if
+// source and destination are at least one block apart in the direction of
+// the copy. For the same reason the plain copy only uses memmove() if the
+// source and destination parts of the row don't overlap the wrong way.
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define BX_BITBLT_SSE2 1
+#include <emmintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BX_BITBLT_SSE2 1
+#include <emmintrin.h>
+#else
+#define BX_BITBLT_SSE2 0
+#endif
+
+BX_CPP_INLINE Bit8u bx_rop_not(Bit8u a) { return (Bit8u)~a; }
+BX_CPP_INLINE Bit8u bx_rop_and(Bit8u a, Bit8u b) { return a & b; }
+BX_CPP_INLINE Bit8u bx_rop_or(Bit8u a, Bit8u b) { return a | b; }
+BX_CPP_INLINE Bit8u bx_rop_xor(Bit8u a, Bit8u b) { return a ^ b; }
+
+#if BX_BITBLT_SSE2
+#define BX_BITBLT_BLOCK 16
+typedef __m128i bx_bitblt_block_t;
+
+BX_CPP_INLINE bx_bitblt_block_t bx_bitblt_load(const Bit8u *p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+BX_CPP_INLINE void bx_bitblt_store(Bit8u *p, bx_bitblt_block_t v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+BX_CPP_INLINE __m128i bx_rop_not(__m128i a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+BX_CPP_INLINE __m128i bx_rop_and(__m128i a, __m128i b) { return _mm_and_si128(a, b); }
+BX_CPP_INLINE __m128i bx_rop_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+BX_CPP_INLINE __m128i bx_rop_xor(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+#else
+#define BX_BITBLT_BLOCK 8
+typedef Bit64u bx_bitblt_block_t;
+
+BX_CPP_INLINE bx_bitblt_block_t bx_bitblt_load(const Bit8u *p)
+{
+  Bit64u v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+BX_CPP_INLINE void bx_bitblt_store(Bit8u *p, bx_bitblt_block_t v)
+{
+  memcpy(p, &v, 8);
+}
+
+BX_CPP_INLINE Bit64u bx_rop_not(Bit64u a) { return ~a; }
+BX_CPP_INLINE Bit64u bx_rop_and(Bit64u a, Bit64u b) { return a & b; }
+BX_CPP_INLINE Bit64u bx_rop_or(Bit64u a, Bit64u b) { return a | b; }
+BX_CPP_INLINE Bit64u bx_rop_xor(Bit64u a, Bit64u b) { return a ^ b; }
+#endif
+
+// distance of the destination from the source in bytes
+BX_CPP_INLINE Bit64s bx_bitblt_distance(const Bit8u *dst, const Bit8u *src)
+{
+  return (Bit64s)((bx_ptr_equiv_t)dst - (bx_ptr_equiv_t)src);
+}
+
+// The ROP 'expr' combines the source S and destination D. Forward blits
+// start at the lowest address of each row, backward blits at the highest.
+#define IMPLEMENT_BITBLT(name,expr) \
+  template <class T> static BX_CPP_INLINE T bitblt_op_##name(T S, T D) \
+  { \
+    return (expr); \
+  } \
   static void bitblt_rop_fwd_##name( \
     Bit8u *dst,const Bit8u *src, \
     int dstpitch,int srcpitch, \
     int bltwidth,int bltheight) \
   { \
     int x,y; \
-    dstpitch -= bltwidth; \
-    srcpitch -= bltwidth; \
     for (y = 0; y < bltheight; y++) { \
-      for (x = 0; x < bltwidth; x++) { \
-        opline; \
-        dst++; \
-        src++; \
+      Bit64s d = bx_bitblt_distance(dst, src); \
+      x = 0; \
+      if ((d <= 0) || (d >= BX_BITBLT_BLOCK)) { \
+        for (; x <= bltwidth - BX_BITBLT_BLOCK; x += BX_BITBLT_BLOCK) { \
+          bx_bitblt_store(dst + x, bitblt_op_##name(bx_bitblt_load(src + x), \
+                                                    bx_bitblt_load(dst + x))); \
+        } \
+      } \
+      for (; x < bltwidth; x++) { \
+        dst[x] = bitblt_op_##name(src[x], dst[x]); \
       } \
       dst += dstpitch; \
       src += srcpitch; \
     } \
-  }
-
-#define IMPLEMENT_BACKWARD_BITBLT(name,opline) \
+  } \
   static void bitblt_rop_bkwd_##name( \
     Bit8u *dst,const Bit8u *src, \
     int dstpitch,int srcpitch, \
     int bltwidth,int bltheight) \
   { \
     int x,y; \
-    dstpitch += bltwidth; \
-    srcpitch += bltwidth; \
     for (y = 0; y < bltheight; y++) { \
-      for (x = 0; x < bltwidth; x++) { \
-        opline; \
-        dst--; \
-        src--; \
+      Bit64s d = bx_bitblt_distance(dst, src); \
+      x = 0; \
+      if ((d >= 0) || (d <= -BX_BITBLT_BLOCK)) { \
+        for (; x <= bltwidth - BX_BITBLT_BLOCK; x += BX_BITBLT_BLOCK) { \
+          Bit8u *dp = dst - x - (BX_BITBLT_BLOCK - 1); \
+          const Bit8u *sp = src - x - (BX_BITBLT_BLOCK - 1); \
+          bx_bitblt_store(dp, bitblt_op_##name(bx_bitblt_load(sp), bx_bitblt_load(dp))); \
+        } \
+      } \
+      for (; x < bltwidth; x++) { \
+        *(dst - x) = bitblt_op_##name(*(src - x), *(dst - x)); \
       } \
       dst += dstpitch; \
       src += srcpitch; \
     } \
   }
 
-#ifdef BX_USE_BINARY_ROP
-IMPLEMENT_FORWARD_BITBLT(0, *dst = 0)
-IMPLEMENT_FORWARD_BITBLT(src_and_dst, *dst = (*src) & (*dst))
-IMPLEMENT_FORWARD_BITBLT(nop, (void)0)
-IMPLEMENT_FORWARD_BITBLT(src_and_notdst, *dst = (*src) & (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(notdst, *dst = ~(*dst))
-IMPLEMENT_FORWARD_BITBLT(src, *dst = *src)
-IMPLEMENT_FORWARD_BITBLT(1, *dst = 0xff)
-IMPLEMENT_FORWARD_BITBLT(notsrc_and_dst, *dst = (~(*src)) & (*dst))
-IMPLEMENT_FORWARD_BITBLT(src_xor_dst, *dst = (*src) ^ (*dst))
-IMPLEMENT_FORWARD_BITBLT(src_or_dst, *dst = (*src) | (*dst))
-IMPLEMENT_FORWARD_BITBLT(notsrc_or_notdst, *dst = (~(*src)) | (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(src_notxor_dst, *dst = ~((*src) ^ (*dst)))
-IMPLEMENT_FORWARD_BITBLT(src_or_notdst, *dst = (*src) | (~(*dst)))
-IMPLEMENT_FORWARD_BITBLT(notsrc, *dst = (~(*src)))
-IMPLEMENT_FORWARD_BITBLT(notsrc_or_dst, *dst = (~(*src)) | (*dst))
-IMPLEMENT_FORWARD_BITBLT(notsrc_and_notdst, *dst = (~(*src)) & (~(*dst)))
-
-IMPLEMENT_BACKWARD_BITBLT(0, *dst = 0)
-IMPLEMENT_BACKWARD_BITBLT(src_and_dst, *dst = (*src) & (*dst))
-IMPLEMENT_BACKWARD_BITBLT(nop, (void)0)
-IMPLEMENT_BACKWARD_BITBLT(src_and_notdst, *dst = (*src) & (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(notdst, *dst = ~(*dst))
-IMPLEMENT_BACKWARD_BITBLT(src, *dst = *src)
-IMPLEMENT_BACKWARD_BITBLT(1, *dst = 0xff)
-IMPLEMENT_BACKWARD_BITBLT(notsrc_and_dst, *dst = (~(*src)) & (*dst))
-IMPLEMENT_BACKWARD_BITBLT(src_xor_dst, *dst = (*src) ^ (*dst))
-IMPLEMENT_BACKWARD_BITBLT(src_or_dst, *dst = (*src) | (*dst))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_or_notdst, *dst = (~(*src)) | (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(src_notxor_dst, *dst = ~((*src) ^ (*dst)))
-IMPLEMENT_BACKWARD_BITBLT(src_or_notdst, *dst = (*src) | (~(*dst)))
-IMPLEMENT_BACKWARD_BITBLT(notsrc, *dst = (~(*src)))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_or_dst, *dst = (~(*src)) | (*dst))
-IMPLEMENT_BACKWARD_BITBLT(notsrc_and_notdst, *dst = (~(*src)) & (~(*dst)))
+IMPLEMENT_BITBLT(0, bx_rop_xor(D, D))
+IMPLEMENT_BITBLT(src_and_dst, bx_rop_and(S, D))
+IMPLEMENT_BITBLT(src_and_notdst, bx_rop_and(S, bx_rop_not(D)))
+IMPLEMENT_BITBLT(notdst, bx_rop_not(D))
+IMPLEMENT_BITBLT(1, bx_rop_not(bx_rop_xor(D, D)))
+IMPLEMENT_BITBLT(notsrc_and_dst, bx_rop_and(bx_rop_not(S), D))
+IMPLEMENT_BITBLT(src_xor_dst, bx_rop_xor(S, D))
+IMPLEMENT_BITBLT(src_or_dst, bx_rop_or(S, D))
+IMPLEMENT_BITBLT(notsrc_or_notdst, bx_rop_or(bx_rop_not(S), bx_rop_not(D)))
+IMPLEMENT_BITBLT(src_notxor_dst, bx_rop_not(bx_rop_xor(S, D)))
+IMPLEMENT_BITBLT(src_or_notdst, bx_rop_or(S, bx_rop_not(D)))
+IMPLEMENT_BITBLT(notsrc, bx_rop_not(S))
+IMPLEMENT_BITBLT(notsrc_or_dst, bx_rop_or(bx_rop_not(S), D))
+IMPLEMENT_BITBLT(notsrc_and_notdst, bx_rop_and(bx_rop_not(S), bx_rop_not(D)))
+
+static void bitblt_rop_fwd_nop(Bit8u *dst, const Bit8u *src, int dstpitch, int srcpitch,
+                               int bltwidth, int bltheight)
+{
+}
+
+static void bitblt_rop_bkwd_nop(Bit8u *dst, const Bit8u *src, int dstpitch, int srcpitch,
+                                int bltwidth, int bltheight)
+{
+}
+
+// plain copy: memmove() handles any overlap within a row like the forward
+// (backward) byte loop does, unless the destination starts inside the
+// source part of the row (ends inside it for backward blits)
+static void bitblt_rop_fwd_src(Bit8u *dst, const Bit8u *src, int dstpitch, int srcpitch,
+                               int bltwidth, int bltheight)
+{
+  for (int y = 0; y < bltheight; y++) {
+    Bit64s d = bx_bitblt_distance(dst, src);
+    if ((d <= 0) || (d >= bltwidth)) {
+      memmove(dst, src, bltwidth);
+    } else {
+      for (int x = 0; x < bltwidth; x++) {
+        dst[x] = src[x];
+      }
+    }
+    dst += dstpitch;
+    src += srcpitch;
+  }
+}
+
+static void bitblt_rop_bkwd_src(Bit8u *dst, const Bit8u *src, int dstpitch, int srcpitch,
+                                int bltwidth, int bltheight)
+{
+  for (int y = 0; y < bltheight; y++) {
+    Bit64s d = bx_bitblt_distance(dst, src);
+    if ((d >= 0) || (d <= -bltwidth)) {
+      memmove(dst - bltwidth + 1, src - bltwidth + 1, bltwidth);
+    } else {
+      for (int x = 0; x < bltwidth; x++) {
+        *(dst - x) = *(src - x);
+      }
+    }
+    dst += dstpitch;
+    src += srcpitch;
+  }
+}
 #endif
 
 #ifdef BX_USE_TERNARY_ROP
@@ -286,6 +286,7 @@ void bx_svga_cirrus_c::svga_init_members()
   BX_CIRRUS_THIS hidden_dac.data = 0x00;
 
   BX_CIRRUS_THIS svga_unlock_special = 0;
+  BX_CIRRUS_THIS svga_lfb_direct = 0;
   BX_CIRRUS_THIS svga_needs_update_tile = 1;
   BX_CIRRUS_THIS svga_needs_update_dispentire = 1;
   BX_CIRRUS_THIS svga_needs_update_mode = 0;
@@ -308,7 +309,7 @@ void bx_svga_cirrus_c::svga_init_members()
 
   // memory allocation.
   if (BX_CIRRUS_THIS s.memory == NULL)
-    BX_CIRRUS_THIS s.memory = new Bit8u[CIRRUS_VIDEO_MEMORY_BYTES];
+    BX_CIRRUS_THIS alloc_memory(CIRRUS_VIDEO_MEMORY_BYTES);
 
   // set some registers.
 
@@ -428,6 +429,8 @@ void bx_svga_cirrus_c::after_restore_state(void)
     BX_CIRRUS_THIS svga_needs_update_mode = 1;
     BX_CIRRUS_THIS update();
   }
+  BX_CIRRUS_THIS lfb_dirty_reset();
+  BX_CIRRUS_THIS svga_lfb_direct_check();
 }
 
 void bx_svga_cirrus_c::redraw_area(unsigned x0, unsigned y0, unsigned width,
@@ -435,6 +438,7 @@ void bx_svga_cirrus_c::redraw_area(unsigned x0, unsigned y0, unsigned width,
 {
   unsigned xti, yti, xt0, xt1, yt0, yt1;
 
+  BX_CIRRUS_THIS damage_notify();
   if ((BX_CIRRUS_THIS sequencer.reg[0x07] & 0x01) == CIRRUS_SR7_BPP_VGA) {
     BX_CIRRUS_THIS bx_vgacore_c::redraw_area(x0,y0,width,height);
     return;
@@ -775,8 +779,27 @@ bool bx_svga_cirrus_c::cirrus_mem_write_handler(bx_phy_address addr, unsigned le
 }
 #endif
 
+#if BX_SUPPORT_PCI
+Bit8u *bx_svga_cirrus_c::cirrus_mem_da_handler(bx_phy_address addr, unsigned rw, void *param)
+{
+  if (BX_CIRRUS_THIS svga_lfb_direct == 0)
+    return NULL;
+  // byte swapping apertures (4 MB each, relative to the BAR)
+  Bit32u swap = (Bit32u)((addr - BX_CIRRUS_THIS pci_bar[0].addr) >> 22);
+  if ((swap == 1) || (swap == 2))
+    return NULL;
+  Bit32u offset = addr & BX_CIRRUS_THIS memsize_mask;
+  // page with the memory-mapped BitBLT registers
+  if ((BX_CIRRUS_THIS svga_lfb_direct == 2) &&
+      (offset >= ((BX_CIRRUS_THIS s.memsize - 256) & ~0xfff)))
+    return NULL;
+  return BX_CIRRUS_THIS lfb_direct_page(offset, rw);
+}
+#endif
+
 void bx_svga_cirrus_c::mem_write(bx_phy_address addr, Bit8u value)
 {
+  BX_CIRRUS_THIS damage_notify();
 #if BX_SUPPORT_PCI
   if (BX_CIRRUS_THIS pci_enabled) {
     unsigned x, y;
@@ -1385,6 +1408,7 @@ void bx_svga_cirrus_c::svga_write(Bit32u address, Bit32u value, unsigned io_len)
     BX_PANIC(("SVGA write: io_len != 1"));
   }
 
+  BX_CIRRUS_THIS damage_notify();
   switch (address) {
     case 0x03b4: /* VGA: CRTC Index Register (monochrome emulation modes) */
     case 0x03d4: /* VGA: CRTC Index Register (color emulation modes) */
@@ -1405,6 +1429,7 @@ void bx_svga_cirrus_c::svga_write(Bit32u address, Bit32u value, unsigned io_len)
       if ((BX_CIRRUS_THIS sequencer.index == 0x06) ||
           (BX_CIRRUS_THIS is_unlocked())) {
         BX_CIRRUS_THIS svga_write_sequencer(address,BX_CIRRUS_THIS sequencer.index,value);
+        BX_CIRRUS_THIS svga_lfb_direct_check();
         return;
       }
       break;
@@ -1439,6 +1464,7 @@ void bx_svga_cirrus_c::svga_write(Bit32u address, Bit32u value, unsigned io_len)
     case 0x03cf: /* VGA: Graphics Controller Registers */
       if (BX_CIRRUS_THIS is_unlocked()) {
         BX_CIRRUS_THIS svga_write_control(address,BX_CIRRUS_THIS control.index,value);
+        BX_CIRRUS_THIS svga_lfb_direct_check();
         return;
       }
       break;
@@ -1725,7 +1751,22 @@ void bx_svga_cirrus_c::update(void)
     BX_CIRRUS_THIS svga_needs_update_dispentire = 0;
   }
 
-  if (!BX_CIRRUS_THIS svga_needs_update_tile) {
+  // tiles written through the direct LFB mapping (displayed memory only)
+  if (BX_CIRRUS_THIS svga_dispbpp != 4) {
+    Bit32u dirty_start = (Bit32u)(BX_CIRRUS_THIS disp_ptr - BX_CIRRUS_THIS s.memory);
+    Bit32u dirty_end = dirty_start + BX_CIRRUS_THIS svga_pitch * height;
+    if (dirty_end > BX_CIRRUS_THIS s.memsize) {
+      dirty_end = BX_CIRRUS_THIS s.memsize;
+    }
+    if (BX_CIRRUS_THIS lfb_dirty_scan(dirty_start, dirty_end, BX_CIRRUS_THIS svga_pitch,
+                                      (BX_CIRRUS_THIS svga_bpp + 1) >> 3,
+                                      BX_CIRRUS_THIS svga_double_width,
+                                      BX_CIRRUS_THIS s.y_doublescan)) {
+      BX_CIRRUS_THIS svga_needs_update_tile = 1;
+    }
+  }
+
+  if (!BX_CIRRUS_THIS svga_needs_update_tile && !BX_CIRRUS_THIS render_pending()) {
     return;
   }
   BX_CIRRUS_THIS svga_needs_update_tile = 0;
@@ -1739,6 +1780,25 @@ void bx_svga_cirrus_c::update(void)
   Bit8u * tile_ptr, * tile_ptr2;
   bx_svga_tileinfo_t info;
 
+  if ((BX_CIRRUS_THIS svga_dispbpp != 4) && !BX_CIRRUS_THIS s.y_doublescan &&
+      !BX_CIRRUS_THIS svga_double_width) {
+    switch (BX_CIRRUS_THIS svga_dispbpp) {
+      case 8:
+        hp = BX_CIRRUS_THIS s.attribute_ctrl.horiz_pel_panning & 0x07;
+        break;
+      case 15:
+      case 16:
+        hp = (BX_CIRRUS_THIS s.attribute_ctrl.horiz_pel_panning & 0x01) << 1;
+        break;
+      default:
+        hp = 0;
+    }
+    if (BX_CIRRUS_THIS render_linear_fb(BX_CIRRUS_THIS disp_ptr + hp, width, height,
+                                        pitch, BX_CIRRUS_THIS svga_dispbpp, 6)) {
+      return;
+    }
+  }
+
   if (bx_gui->graphics_tile_info_common(&info)) {
     if (info.snapshot_mode) {
       vid_ptr = BX_CIRRUS_THIS disp_ptr;
@@ -3014,7 +3074,7 @@ void bx_svga_cirrus_c::svga_init_pcihandlers(void)
     (PCI_MAP_MEM | PCI_MAP_MEMFLAGS_32BIT);
 
   BX_CIRRUS_THIS init_bar_mem(0, 0x2000000, cirrus_mem_read_handler,
-                              cirrus_mem_write_handler);
+                              cirrus_mem_write_handler, cirrus_mem_da_handler);
   BX_CIRRUS_THIS init_bar_mem(1, CIRRUS_PNPMMIO_SIZE, cirrus_mem_read_handler,
                               cirrus_mem_write_handler);
   BX_CIRRUS_THIS pci_rom_address = 0;
@@ -3088,6 +3148,29 @@ void bx_svga_cirrus_c::svga_reset_bitblt(void)
   BX_CIRRUS_THIS bitblt.memdst_ptr = NULL;
   BX_CIRRUS_THIS bitblt.memdst_endptr = NULL;
   BX_CIRRUS_THIS bitblt.memdst_needed = 0;
+  svga_lfb_direct_check();
+}
+
+// The guest may access the linear framebuffer directly as long as the host
+// memory has the same layout and the access has no side effects. The access
+// is revoked by flushing the TLBs when this state changes.
+void bx_svga_cirrus_c::svga_lfb_direct_check(void)
+{
+  Bit8u direct = 0;
+
+  if (BX_CIRRUS_THIS pci_enabled &&
+      ((BX_CIRRUS_THIS sequencer.reg[0x07] & 0x01) != CIRRUS_SR7_BPP_VGA) &&
+      ((BX_CIRRUS_THIS control.reg[0x0b] & 0x06) == 0) &&
+      (BX_CIRRUS_THIS bitblt.memsrc_needed <= 0) &&
+      (BX_CIRRUS_THIS bitblt.memdst_needed <= 0)) {
+    direct = ((BX_CIRRUS_THIS sequencer.reg[0x17] & 0x44) == 0x44) ? 2 : 1;
+  }
+  if (direct != BX_CIRRUS_THIS svga_lfb_direct) {
+    if (BX_CIRRUS_THIS svga_lfb_direct != 0) {
+      bx_pc_system.MemoryMappingChanged();
+    }
+    BX_CIRRUS_THIS svga_lfb_direct = direct;
+  }
 }
 
 void bx_svga_cirrus_c::svga_bitblt()
@@ -3273,6 +3356,8 @@ void bx_svga_cirrus_c::svga_setup_bitblt_cputovideo(Bit32u dstaddr,Bit32u srcadd
         BX_CIRRUS_THIS bitblt.srcpitch * BX_CIRRUS_THIS bitblt.bltheight;
   }
   BX_CIRRUS_THIS bitblt.memsrc_endptr += BX_CIRRUS_THIS bitblt.srcpitch;
+  // the source data is written to the LFB
+  svga_lfb_direct_check();
 }
 
 void bx_svga_cirrus_c::svga_setup_bitblt_videotocpu(Bit32u dstaddr,Bit32u srcaddr)
@@ -3510,10 +3595,11 @@ void bx_svga_cirrus_c::svga_patterncopy()
 {
   Bit8u color[4];
   Bit8u work_colorexp[256];
+  Bit8u work_row[8192];
   Bit8u *src, *dst;
   Bit8u *srcc, *src2;
   Bit32u dstaddr;
-  int x, y, pattern_x, pattern_y, srcskipleft;
+  int x, y, pattern_x, pattern_y, srcskipleft, rowbytes;
   int patternbytes = 8 * BX_CIRRUS_THIS bitblt.pixelwidth;
   int pattern_pitch = patternbytes;
   int bltbytes = BX_CIRRUS_THIS bitblt.bltwidth;
@@ -3581,6 +3667,26 @@ void bx_svga_cirrus_c::svga_patterncopy()
   for (y = 0; y < BX_CIRRUS_THIS bitblt.bltheight; y++) {
     srcc = src + pattern_y * pattern_pitch;
     dstaddr = (BX_CIRRUS_THIS bitblt.dstaddr + pattern_x) & BX_CIRRUS_THIS memsize_mask;
+    rowbytes = bltbytes - pattern_x;
+    if (rowbytes > 0) {
+      rowbytes = ((rowbytes + BX_CIRRUS_THIS bitblt.pixelwidth - 1) /
+                  BX_CIRRUS_THIS bitblt.pixelwidth) * BX_CIRRUS_THIS bitblt.pixelwidth;
+    }
+    dst = BX_CIRRUS_THIS s.memory + dstaddr;
+    // expand the pattern line and pass the whole row to the ROP if it
+    // doesn't wrap around and doesn't overwrite the pattern
+    if ((rowbytes > 0) && (rowbytes <= (int)sizeof(work_row)) &&
+        ((dstaddr + rowbytes) <= BX_CIRRUS_THIS s.memsize) &&
+        (((dst + rowbytes) <= src) || (dst >= (src + 8 * pattern_pitch)))) {
+      for (x = pattern_x; x < bltbytes; x += BX_CIRRUS_THIS bitblt.pixelwidth) {
+        memcpy(&work_row[x - pattern_x], srcc + (x % patternbytes),
+               BX_CIRRUS_THIS bitblt.pixelwidth);
+      }
+      (*BX_CIRRUS_THIS bitblt.rop_handler)(dst, work_row, 0, 0, rowbytes, 1);
+      pattern_y = (pattern_y + 1) & 7;
+      BX_CIRRUS_THIS bitblt.dstaddr += BX_CIRRUS_THIS bitblt.dstpitch;
+      continue;
+    }
     for (x = pattern_x; x < bltbytes; x += BX_CIRRUS_THIS bitblt.pixelwidth) {
       src2 = srcc + (x % patternbytes);
       dst = BX_CIRRUS_THIS s.memory + dstaddr;
@@ -83,6 +83,9 @@ public:
 
 protected:
   virtual void update(void);
+  virtual void render_overlay(unsigned xc, unsigned yc, bx_svga_tileinfo_t *info) {
+    draw_hardware_cursor(xc, yc, info);
+  }
 
 private:
   static Bit32u svga_read_handler(void *this_ptr, Bit32u address, unsigned io_len);
@@ -120,6 +123,7 @@ private:
   BX_CIRRUS_SMF void  svga_mmio_blt_write(Bit32u address,Bit8u value);
 
   BX_CIRRUS_SMF void  svga_reset_bitblt(void);
+  BX_CIRRUS_SMF void  svga_lfb_direct_check(void);
   BX_CIRRUS_SMF void  svga_bitblt();
 
   BX_CIRRUS_SMF void  svga_colorexpand(Bit8u *dst,const Bit8u *src,int count,int pixelwidth);
@@ -197,6 +201,7 @@ private:
   bool svga_needs_update_dispentire;
   bool svga_needs_update_mode;
   bool svga_double_width;
+  Bit8u svga_lfb_direct; // 0 = vetoed, 1 = direct LFB access, 2 = same with MMIO page
 
   unsigned svga_xres;
   unsigned svga_yres;
@@ -260,6 +265,7 @@ private:
 
   BX_CIRRUS_SMF bool cirrus_mem_read_handler(bx_phy_address addr, unsigned len, void *data, void *param);
   BX_CIRRUS_SMF bool cirrus_mem_write_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+  BX_CIRRUS_SMF Bit8u *cirrus_mem_da_handler(bx_phy_address addr, unsigned rw, void *param);
 #endif
 };
 
@@ -96,12 +96,12 @@ bool bx_vga_c::init_vga_extension(void)
     BX_VGA_THIS s.memsize = atoi(SIM->get_param_enum(BXPN_VBE_MEMSIZE)->get_selected()) << 20;
     if (!BX_VGA_THIS pci_enabled) {
       BX_VGA_THIS vbe.base_address = VBE_DISPI_LFB_PHYSICAL_ADDRESS;
-      DEV_register_memory_handlers(theVga, mem_read_handler, mem_write_handler,
-                                   BX_VGA_THIS vbe.base_address,
-                                   BX_VGA_THIS vbe.base_address + BX_VGA_THIS s.memsize - 1);
+      DEV_register_memory_handlers_da(theVga, mem_read_handler, mem_write_handler,
+                                      mem_da_handler, BX_VGA_THIS vbe.base_address,
+                                      BX_VGA_THIS vbe.base_address + BX_VGA_THIS s.memsize - 1);
     }
     if (BX_VGA_THIS s.memory == NULL)
-      BX_VGA_THIS s.memory = new Bit8u[BX_VGA_THIS s.memsize];
+      BX_VGA_THIS alloc_memory(BX_VGA_THIS s.memsize);
     memset(BX_VGA_THIS s.memory, 0, BX_VGA_THIS s.memsize);
     BX_VGA_THIS vbe.cur_dispi=VBE_DISPI_ID0;
     BX_VGA_THIS vbe.xres=640;
@@ -143,7 +143,7 @@ bool bx_vga_c::init_vga_extension(void)
     if (BX_VGA_THIS vbe_present) {
       BX_VGA_THIS pci_conf[0x10] = 0x08;
       BX_VGA_THIS init_bar_mem(0, BX_VGA_THIS s.memsize,
-                               mem_read_handler, mem_write_handler);
+                               mem_read_handler, mem_write_handler, mem_da_handler);
     }
     BX_VGA_THIS pci_rom_address = 0;
     BX_VGA_THIS pci_rom_read_handler = mem_read_handler;
@@ -301,8 +301,17 @@ void bx_vga_c::update(void)
   unsigned iHeight, iWidth;
 
   if (BX_VGA_THIS vbe.enabled) {
+    // tiles written through the direct LFB mapping
+    if ((BX_VGA_THIS vbe.bpp != VBE_DISPI_BPP_4) &&
+        BX_VGA_THIS lfb_dirty_scan(BX_VGA_THIS vbe.virtual_start,
+                                   BX_VGA_THIS vbe.virtual_start + BX_VGA_THIS vbe.visible_screen_size,
+                                   BX_VGA_THIS vbe.line_offset, BX_VGA_THIS vbe.bpp_multiplier, 0, 0)) {
+      BX_VGA_THIS s.vga_mem_updated = 1;
+    }
+
     /* no screen update necessary */
-    if ((BX_VGA_THIS s.vga_mem_updated==0) && BX_VGA_THIS s.graphics_ctrl.graphics_alpha)
+    if ((BX_VGA_THIS s.vga_mem_updated==0) && BX_VGA_THIS s.graphics_ctrl.graphics_alpha &&
+        !BX_VGA_THIS render_pending())
       return;
 
     /* skip screen update when vga/video is disabled or the sequencer is in reset mode */
@@ -333,6 +342,13 @@ void bx_vga_c::update(void)
       pitch = BX_VGA_THIS vbe.line_offset;
       Bit8u *disp_ptr = &BX_VGA_THIS s.memory[BX_VGA_THIS vbe.virtual_start];
 
+      if (BX_VGA_THIS render_linear_fb(disp_ptr, iWidth, iHeight, pitch,
+                                       BX_VGA_THIS vbe.bpp, dac_size)) {
+        BX_VGA_THIS s.last_xres = iWidth;
+        BX_VGA_THIS s.last_yres = iHeight;
+        BX_VGA_THIS s.vga_mem_updated = 0;
+        return;
+      }
       if (bx_gui->graphics_tile_info_common(&info)) {
         if (info.snapshot_mode) {
           vid_ptr = disp_ptr;
@@ -670,6 +686,16 @@ Bit8u bx_vga_c::mem_read(bx_phy_address addr)
   return bx_vgacore_c::mem_read(addr);
 }
 
+// Direct access to the VBE linear framebuffer. The host memory is only handed
+// out if it has the same layout as seen by the guest (no 4bpp planar mode).
+Bit8u *bx_vga_c::mem_da_handler(bx_phy_address addr, unsigned rw, void *param)
+{
+  if (!theVga->vbe.enabled || (theVga->vbe.bpp == VBE_DISPI_BPP_4) ||
+      (addr < theVga->vbe.base_address))
+    return NULL;
+  return theVga->lfb_direct_page((Bit32u)(addr - theVga->vbe.base_address), rw);
+}
+
 bool bx_vga_c::mem_write_handler(bx_phy_address addr, unsigned len, void *data, void *param)
 {
   Bit8u *data_ptr;
@@ -694,6 +720,7 @@ void bx_vga_c::mem_write(bx_phy_address addr, Bit8u value)
 {
   // if in a vbe enabled mode, write to the vbe_memory
   if ((BX_VGA_THIS vbe.enabled) && (BX_VGA_THIS vbe.bpp != VBE_DISPI_BPP_4)) {
+    BX_VGA_THIS damage_notify();
     vbe_mem_write(addr, value);
     return;
   } else if ((BX_VGA_THIS vbe.base_address != 0) && (addr >= BX_VGA_THIS vbe.base_address)) {
@@ -713,6 +740,7 @@ void bx_vga_c::redraw_area(unsigned x0, unsigned y0, unsigned width, unsigned he
   unsigned xti, yti, xt0, xt1, yt0, yt1, xmax, ymax;
 
   if (BX_VGA_THIS vbe.enabled) {
+    BX_VGA_THIS damage_notify();
     BX_VGA_THIS s.vga_mem_updated = 1;
     xmax = BX_VGA_THIS vbe.xres;
     ymax = BX_VGA_THIS vbe.yres;
@@ -944,6 +972,7 @@ Bit32u bx_vga_c::vbe_write(Bit32u address, Bit32u value, unsigned io_len)
     // data register
     // FIXME: maybe do some 'sanity' checks on received data?
     case VBE_DISPI_IOPORT_DATA:
+      BX_VGA_THIS damage_notify();
       switch (BX_VGA_THIS vbe.curindex)
       {
         case VBE_DISPI_INDEX_ID: // Display Interface ID check
@@ -1071,6 +1100,8 @@ Bit32u bx_vga_c::vbe_write(Bit32u address, Bit32u value, unsigned io_len)
 
         case VBE_DISPI_INDEX_ENABLE: // enable video
         {
+          bool lfb_change = (((value & VBE_DISPI_ENABLED) != 0) != BX_VGA_THIS vbe.enabled);
+
           if ((value & VBE_DISPI_ENABLED) && !BX_VGA_THIS vbe.enabled)
           {
             unsigned depth=0;
@@ -1145,6 +1176,11 @@ Bit32u bx_vga_c::vbe_write(Bit32u address, Bit32u value, unsigned io_len)
             BX_VGA_THIS s.vgamem_mask = 0x3ffff;
           }
           BX_VGA_THIS vbe.enabled = ((value & VBE_DISPI_ENABLED) != 0);
+          if (lfb_change) {
+            // direct LFB access depends on the VBE mode
+            BX_VGA_THIS lfb_dirty_reset();
+            bx_pc_system.MemoryMappingChanged();
+          }
           BX_VGA_THIS vbe.get_capabilities = ((value & VBE_DISPI_GETCAPS) != 0);
           if (BX_VGA_THIS vbe.get_capabilities) {
             bx_gui->get_capabilities(&max_xres, &max_yres, &max_bpp);
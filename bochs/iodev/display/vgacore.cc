@@ -69,14 +69,22 @@ const Bit8u ccdat[16][4] = {
 bx_vgacore_c::bx_vgacore_c()
 {
   memset(&s, 0, sizeof(s));
+  memset(&rthread, 0, sizeof(rthread));
+  memset(&damage, 0, sizeof(damage));
+  memset(&lfb, 0, sizeof(lfb));
   update_timer_id = BX_NULL_TIMER_HANDLE;
   vga_vtimer_id = BX_NULL_TIMER_HANDLE;
 }
 
 bx_vgacore_c::~bx_vgacore_c()
 {
+  render_thread_stop();
+  if (lfb.dirty != NULL) {
+    delete [] lfb.dirty;
+    delete [] lfb.list;
+  }
   if (s.memory != NULL) {
-    delete [] s.memory;
+    delete [] s.memory_alloc;
     s.memory = NULL;
   }
   if (s.text_buffer != NULL) {
@@ -106,7 +114,7 @@ void bx_vgacore_c::init(void)
     // VGA memory not yet initialized
     BX_VGA_THIS s.memsize = 0x40000;
     if (BX_VGA_THIS s.memory == NULL)
-      BX_VGA_THIS s.memory = new Bit8u[BX_VGA_THIS s.memsize];
+      BX_VGA_THIS alloc_memory(BX_VGA_THIS s.memsize);
     memset(BX_VGA_THIS s.memory, 0, BX_VGA_THIS s.memsize);
     BX_INFO(("Standard VGA adapter initialized"));
   }
@@ -125,6 +133,16 @@ void bx_vgacore_c::init(void)
   if (!BX_VGA_THIS pci_enabled) {
     BX_MEM(0)->load_ROM(SIM->get_param_string(BXPN_VGA_ROM_PATH)->getptr(), 0xc0000, 1);
   }
+
+  BX_VGA_THIS damage.enabled = SIM->get_param_bool(BXPN_VGA_UPDATE_DAMAGE)->get();
+  if (BX_VGA_THIS damage.enabled) {
+    BX_INFO(("damage driven update scheduling enabled"));
+  }
+  bx_list_c *stats = new bx_list_c(SIM->get_statistics_root(), "vga", "VGA display updates");
+  new bx_shadow_num_c(stats, "frames", &BX_VGA_THIS damage.frames);
+  new bx_shadow_num_c(stats, "dirtyTiles", &BX_VGA_THIS damage.dirty_tiles);
+  new bx_shadow_num_c(stats, "fps", &BX_VGA_THIS damage.fps);
+  new bx_shadow_num_c(stats, "lfbDirtyPages", &BX_VGA_THIS lfb.pages);
 }
 
 void bx_vgacore_c::init_standard_vga(void)
@@ -265,6 +283,9 @@ void bx_vgacore_c::init_systemtimer(void)
   BX_VGA_THIS set_update_timer(update_interval);
   BX_INFO(("VSYNC using %s mode", BX_VGA_THIS vsync_realtime ? "realtime":"standard"));
   BX_VGA_THIS start_vertical_timer();
+  if (SIM->get_param_bool(BXPN_VGA_RENDER_THREAD)->get() && !BX_VGA_THIS rthread.enabled) {
+    BX_VGA_THIS render_thread_start();
+  }
 }
 
 void bx_vgacore_c::vgacore_register_state(bx_list_c *parent)
@@ -374,6 +395,7 @@ void bx_vgacore_c::after_restore_state(void)
                                   BX_VGA_THIS s.pel.data[i].blue  << BX_VGA_THIS s.dac_shift);
   }
   BX_VGA_THIS calculate_retrace_timing();
+  BX_VGA_THIS lfb_dirty_reset();
   BX_VGA_THIS s.text_buffer_update = true;
   if (!BX_VGA_THIS s.vga_override) {
     BX_VGA_THIS s.last_xres = BX_VGA_THIS s.max_xres;
@@ -783,6 +805,8 @@ void bx_vgacore_c::write(Bit32u address, Bit32u value, unsigned io_len, bool no_
   bool prev_video_enabled, prev_line_graphics, prev_int_pal_size, prev_graphics_alpha;
   bool needs_update = 0;
 
+  BX_VGA_THIS damage_notify();
+
   if (!no_log)
     switch (io_len) {
       case 1:
@@ -1324,6 +1348,11 @@ void bx_vgacore_c::update(void)
   static bool cs_visible = 0;
   bool cs_toggle = 0;
 
+  if (BX_VGA_THIS render_pending()) {
+    BX_VGA_THIS render_thread_flush();
+  }
+  BX_VGA_THIS damage.blink = !BX_VGA_THIS s.graphics_ctrl.graphics_alpha ||
+                             BX_VGA_THIS s.attribute_ctrl.mode_ctrl.blink_intensity;
   cs_counter--;
   /* no screen update necessary */
   if ((BX_VGA_THIS s.vga_mem_updated == 0) && (cs_counter > 0))
@@ -1814,6 +1843,7 @@ void bx_vgacore_c::mem_write(bx_phy_address addr, Bit8u value)
   unsigned start_addr;
   Bit8u sequ_map_mask = BX_VGA_THIS s.sequencer.map_mask & 0x0f;
 
+  BX_VGA_THIS damage_notify();
   if (addr >= 0xA0000) {
     switch (BX_VGA_THIS s.graphics_ctrl.memory_mapping) {
       case 1: // 0xA0000 .. 0xAFFFF
@@ -2341,6 +2371,7 @@ void bx_vgacore_c::vga_redraw_area(unsigned x0, unsigned y0, unsigned width,
   if (width == 0 || height == 0) {
     return;
   }
+  BX_VGA_THIS damage_notify();
 #if BX_SUPPORT_PCI
   if (BX_VGA_THIS s.vga_override && (BX_VGA_THIS s.nvgadev != NULL)) {
     BX_VGA_THIS s.nvgadev->redraw_area(x0, y0, width, height);
@@ -2354,6 +2385,7 @@ void bx_vgacore_c::redraw_area(unsigned x0, unsigned y0, unsigned width, unsigne
 {
   unsigned xti, yti, xt0, xt1, yt0, yt1, xmax, ymax;
 
+  BX_VGA_THIS damage_notify();
   BX_VGA_THIS s.vga_mem_updated |= 0x07;
 
   if (BX_VGA_THIS s.graphics_ctrl.graphics_alpha) {
@@ -2405,6 +2437,14 @@ void bx_vgacore_c::refresh_display(void *this_ptr, bool redraw)
 void bx_vgacore_c::vga_timer_handler(void *this_ptr)
 {
   bx_vgacore_c *vgadev = (bx_vgacore_c *) this_ptr;
+  bool changed = vgadev->damage.seen || vgadev->render_pending();
+  unsigned dirty = 0;
+
+  vgadev->damage.seen = 0;
+  vgadev->damage.blink = 0;
+  if (changed) {
+    dirty = vgadev->damage_count_tiles();
+  }
 #if BX_SUPPORT_PCI
   if (vgadev->s.vga_override && (vgadev->s.nvgadev != NULL)) {
     vgadev->s.nvgadev->update();
@@ -2415,6 +2455,14 @@ void bx_vgacore_c::vga_timer_handler(void *this_ptr)
     vgadev->update();
   }
   bx_gui->flush();
+  if (changed) {
+    // tiles drawn by this update
+    unsigned left = vgadev->damage_count_tiles();
+    if (dirty > left) {
+      vgadev->damage.dirty_tiles += (dirty - left);
+    }
+  }
+  vgadev->damage_schedule(changed);
 }
 
 void bx_vgacore_c::vertical_timer_handler(void *this_ptr)
@@ -2431,6 +2479,7 @@ void bx_vgacore_c::vertical_timer(void)
     Bit16u prev_start_addr = BX_VGA_THIS s.CRTC.start_addr;
     BX_VGA_THIS s.CRTC.start_addr = (BX_VGA_THIS s.CRTC.reg[0x0c] << 8) | BX_VGA_THIS s.CRTC.reg[0x0d];
     if (BX_VGA_THIS s.CRTC.start_addr != prev_start_addr) {
+      BX_VGA_THIS damage_notify();
       if (BX_VGA_THIS s.graphics_ctrl.graphics_alpha) {
         BX_VGA_THIS vga_redraw_area(0, 0, BX_VGA_THIS s.last_xres, BX_VGA_THIS s.last_yres);
       } else {
@@ -2460,6 +2509,9 @@ void bx_vgacore_c::set_update_timer(Bit32u usec)
   if (usec != BX_VGA_THIS vga_update_interval) {
     BX_INFO(("Setting VGA update interval to %d (%.1f Hz)", usec, 1000000.0 / (float)usec));
     bx_virt_timer.activate_timer(BX_VGA_THIS update_timer_id, usec, 1);
+    BX_VGA_THIS damage.idle = 0;
+    BX_VGA_THIS damage.kicked = 0;
+    BX_VGA_THIS damage.quiet = 0;
     // VGA text mode cursor blink frequency 1.875 Hz
     if (usec < 266666) {
       BX_VGA_THIS s.blink_counter = 266666 / (unsigned)usec;
@@ -2478,6 +2530,475 @@ void bx_vgacore_c::start_vertical_timer(void)
   bx_virt_timer.activate_timer(BX_VGA_THIS vga_vtimer_id, vtimer_interval[0], 0);
 }
 
+// Damage driven update scheduling and display statistics
+
+void bx_vgacore_c::damage_kick(void)
+{
+  // first change after a quiet period: update soon, but give the guest
+  // the chance to finish a burst of writes first
+  Bit32u usec = BX_VGA_DAMAGE_DELAY;
+  if (usec > BX_VGA_THIS vga_update_interval) {
+    usec = BX_VGA_THIS vga_update_interval;
+  }
+  BX_VGA_THIS damage.idle = 0;
+  BX_VGA_THIS damage.kicked = 1;
+  BX_VGA_THIS damage.quiet = 0;
+  BX_VGA_THIS s.blink_counter = BX_VGA_THIS damage.blink_counter;
+  bx_virt_timer.activate_timer(BX_VGA_THIS update_timer_id, usec, 1);
+}
+
+void bx_vgacore_c::damage_schedule(bool changed)
+{
+  Bit64u now = bx_virt_timer.time_usec(BX_VGA_THIS update_realtime);
+
+  if (changed) {
+    BX_VGA_THIS damage.frames++;
+    BX_VGA_THIS damage.fps_frames++;
+  }
+  if ((now - BX_VGA_THIS damage.fps_start) >= 1000000) {
+    BX_VGA_THIS damage.fps = (BX_VGA_THIS damage.fps_frames * 1000000) /
+                             (now - BX_VGA_THIS damage.fps_start);
+    BX_VGA_THIS damage.fps_frames = 0;
+    BX_VGA_THIS damage.fps_start = now;
+  }
+  if (!BX_VGA_THIS damage.enabled)
+    return;
+
+  if (BX_VGA_THIS damage.kicked) {
+    // back to the regular interval after the update triggered by a change
+    BX_VGA_THIS damage.kicked = 0;
+    bx_virt_timer.activate_timer(BX_VGA_THIS update_timer_id,
+                                 BX_VGA_THIS vga_update_interval, 1);
+  }
+  if (changed) {
+    BX_VGA_THIS damage.quiet = 0;
+  } else if (!BX_VGA_THIS damage.idle &&
+             (++BX_VGA_THIS damage.quiet >= BX_VGA_DAMAGE_QUIET_TICKS)) {
+    // nothing changed for a while: slow down until the next change. In text
+    // mode the timer still has to run at the cursor blink rate.
+    Bit32u usec = BX_VGA_DAMAGE_IDLE;
+    BX_VGA_THIS damage.blink_counter = BX_VGA_THIS s.blink_counter;
+    if (BX_VGA_THIS damage.blink) {
+      usec = BX_VGA_DAMAGE_IDLE_TEXT;
+      BX_VGA_THIS s.blink_counter = 1;
+    }
+    if (usec > BX_VGA_THIS vga_update_interval) {
+      BX_VGA_THIS damage.idle = 1;
+      bx_virt_timer.activate_timer(BX_VGA_THIS update_timer_id, usec, 1);
+    } else {
+      BX_VGA_THIS s.blink_counter = BX_VGA_THIS damage.blink_counter;
+    }
+  }
+}
+
+unsigned bx_vgacore_c::damage_count_tiles(void)
+{
+  unsigned i, count = 0, ntiles;
+
+#if BX_SUPPORT_PCI
+  // the tiles of the override device are not visible here
+  if (BX_VGA_THIS s.vga_override)
+    return 0;
+#endif
+  if (BX_VGA_THIS s.vga_tile_updated == NULL)
+    return 0;
+  ntiles = BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles;
+  for (i = 0; i < ntiles; i++) {
+    count += BX_VGA_THIS s.vga_tile_updated[i];
+  }
+  return count;
+}
+
+// Direct access to the linear framebuffer
+
+// The TLB entries of the CPU combine the host page address with the offset
+// into the page, so the video memory has to start at a 4K boundary.
+void bx_vgacore_c::alloc_memory(Bit32u size)
+{
+  BX_VGA_THIS s.memory_alloc = new Bit8u[size + 0xfff];
+  BX_VGA_THIS s.memory = (Bit8u*)(((bx_ptr_equiv_t)BX_VGA_THIS s.memory_alloc + 0xfff) &
+                                  ~((bx_ptr_equiv_t)0xfff));
+}
+
+Bit8u *bx_vgacore_c::lfb_direct_page(Bit32u offset, unsigned rw)
+{
+  Bit32u page = offset >> 12;
+
+  if (offset >= BX_VGA_THIS s.memsize)
+    return NULL;
+  if (BX_VGA_THIS lfb.dirty == NULL) {
+    BX_VGA_THIS lfb.npages = BX_VGA_THIS s.memsize >> 12;
+    BX_VGA_THIS lfb.dirty = new Bit8u[BX_VGA_THIS lfb.npages];
+    BX_VGA_THIS lfb.list = new Bit32u[BX_VGA_THIS lfb.npages];
+    memset(BX_VGA_THIS lfb.dirty, 0, BX_VGA_THIS lfb.npages);
+    BX_VGA_THIS lfb.count = 0;
+  }
+  if ((rw == BX_WRITE) || (rw == BX_RW)) {
+    if (!BX_VGA_THIS lfb.dirty[page]) {
+      BX_VGA_THIS lfb.dirty[page] = 1;
+      BX_VGA_THIS lfb.list[BX_VGA_THIS lfb.count++] = page;
+    }
+    BX_VGA_THIS damage_notify();
+  }
+  return BX_VGA_THIS s.memory + (page << 12);
+}
+
+// Mark the tiles covered by the dirty pages within the visible area
+// (video memory offsets 'start' to 'end'). Returns true if a page was dirty.
+bool bx_vgacore_c::lfb_dirty_scan(Bit32u start, Bit32u end, unsigned pitch, unsigned pixbytes,
+                                  bool xdouble, bool ydouble)
+{
+  Bit32u i, page, pstart, pend;
+  unsigned x0, x1, y0, y1, xt, yt;
+
+  if (BX_VGA_THIS lfb.count == 0)
+    return false;
+  for (i = 0; i < BX_VGA_THIS lfb.count; i++) {
+    page = BX_VGA_THIS lfb.list[i];
+    BX_VGA_THIS lfb.dirty[page] = 0;
+    pstart = page << 12;
+    pend = pstart + 0xfff;
+    if ((pend < start) || (pstart >= end) || (pitch == 0) || (pixbytes == 0))
+      continue;
+    if (pstart < start) pstart = start;
+    if (pend >= end) pend = end - 1;
+    pstart -= start;
+    pend -= start;
+    y0 = pstart / pitch;
+    y1 = pend / pitch;
+    if (y0 == y1) {
+      x0 = (pstart % pitch) / pixbytes;
+      x1 = (pend % pitch) / pixbytes;
+    } else {
+      x0 = 0;
+      x1 = (pitch - 1) / pixbytes;
+    }
+    if (xdouble) {
+      x0 <<= 1;
+      x1 = (x1 << 1) + 1;
+    }
+    if (ydouble) {
+      y0 <<= 1;
+      y1 = (y1 << 1) + 1;
+    }
+    for (yt = y0 / Y_TILESIZE; yt <= y1 / Y_TILESIZE; yt++) {
+      for (xt = x0 / X_TILESIZE; xt <= x1 / X_TILESIZE; xt++) {
+        SET_TILE_UPDATED(BX_VGA_THIS, xt, yt, 1);
+      }
+    }
+  }
+  BX_VGA_THIS lfb.pages += BX_VGA_THIS lfb.count;
+  BX_VGA_THIS lfb.count = 0;
+  // write access to the pages has to fault in again
+  bx_pc_system.MemoryMappingChanged();
+  return true;
+}
+
+void bx_vgacore_c::lfb_dirty_reset(void)
+{
+  for (Bit32u i = 0; i < BX_VGA_THIS lfb.count; i++) {
+    BX_VGA_THIS lfb.dirty[BX_VGA_THIS lfb.list[i]] = 0;
+  }
+  BX_VGA_THIS lfb.count = 0;
+}
+
+// Render thread for the linear framebuffer modes
+
+void bx_vgacore_c::render_thread_start(void)
+{
+  BX_INIT_MUTEX(BX_VGA_THIS rthread_mutex);
+  if (!bx_create_sem(&BX_VGA_THIS rthread_sem)) {
+    BX_ERROR(("render thread: failed to create semaphore"));
+    BX_FINI_MUTEX(BX_VGA_THIS rthread_mutex);
+    return;
+  }
+  BX_VGA_THIS rthread.stop = 0;
+  BX_VGA_THIS rthread.running = 1;
+  BX_VGA_THIS rthread.enabled = 1;
+  BX_THREAD_CREATE(render_thread_func, this, BX_VGA_THIS rthread_var);
+  BX_INFO(("render thread started"));
+}
+
+void bx_vgacore_c::render_thread_stop(void)
+{
+  if (!BX_VGA_THIS rthread.enabled)
+    return;
+  BX_LOCK(BX_VGA_THIS rthread_mutex);
+  BX_VGA_THIS rthread.stop = 1;
+  BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+  bx_set_sem(&BX_VGA_THIS rthread_sem);
+  BX_THREAD_JOIN(BX_VGA_THIS rthread_var);
+  while (1) {
+    BX_LOCK(BX_VGA_THIS rthread_mutex);
+    bool running = BX_VGA_THIS rthread.running;
+    BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+    if (!running) break;
+    BX_MSLEEP(1);
+  }
+  bx_destroy_sem(&BX_VGA_THIS rthread_sem);
+  BX_FINI_MUTEX(BX_VGA_THIS rthread_mutex);
+  BX_VGA_THIS rthread.enabled = 0;
+  BX_INFO(("render thread: " FMT_LL "u frames, " FMT_LL "u updates skipped",
+           BX_VGA_THIS rthread.frames, BX_VGA_THIS rthread.dropped));
+  delete [] BX_VGA_THIS rthread.snapshot;
+  delete [] BX_VGA_THIS rthread.output;
+  delete [] BX_VGA_THIS rthread.tiles;
+  BX_VGA_THIS rthread.snapshot = NULL;
+  BX_VGA_THIS rthread.output = NULL;
+  BX_VGA_THIS rthread.tiles = NULL;
+}
+
+BX_THREAD_FUNC(bx_vgacore_c::render_thread_func, indata)
+{
+  ((bx_vgacore_c*)indata)->render_thread();
+  BX_THREAD_EXIT;
+}
+
+void bx_vgacore_c::render_thread(void)
+{
+  bool stop;
+
+  while (1) {
+    bx_wait_sem(&BX_VGA_THIS rthread_sem);
+    BX_LOCK(BX_VGA_THIS rthread_mutex);
+    stop = BX_VGA_THIS rthread.stop;
+    BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+    if (stop) break;
+    BX_VGA_THIS render_convert();
+    BX_LOCK(BX_VGA_THIS rthread_mutex);
+    BX_VGA_THIS rthread.busy = 0;
+    BX_VGA_THIS rthread.ready = 1;
+    BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+  }
+  BX_LOCK(BX_VGA_THIS rthread_mutex);
+  BX_VGA_THIS rthread.running = 0;
+  BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+}
+
+// Render thread: convert the tiles of the snapshot to the host format
+void bx_vgacore_c::render_convert(void)
+{
+  const bx_svga_tileinfo_t *info = &BX_VGA_THIS rthread.info;
+  unsigned width = BX_VGA_THIS rthread.width;
+  unsigned height = BX_VGA_THIS rthread.height;
+  unsigned spp = (BX_VGA_THIS rthread.bpp + 1) >> 3;
+  unsigned dpp = (info->bpp + 1) >> 3;
+  unsigned xc, yc, xti, yti, r, c, w, h;
+  int i;
+  Bit8u *vid_ptr, *tile_ptr;
+  Bit32u colour;
+
+  for (yc = 0, yti = 0; yti < BX_VGA_THIS rthread.ytiles; yc += Y_TILESIZE, yti++) {
+    for (xc = 0, xti = 0; xti < BX_VGA_THIS rthread.xtiles; xc += X_TILESIZE, xti++) {
+      if (!BX_VGA_THIS rthread.tiles[yti * BX_VGA_THIS rthread.xtiles + xti])
+        continue;
+      w = ((xc + X_TILESIZE) <= width) ? X_TILESIZE : (width - xc);
+      h = ((yc + Y_TILESIZE) <= height) ? Y_TILESIZE : (height - yc);
+      for (r = 0; r < h; r++) {
+        vid_ptr = BX_VGA_THIS rthread.snapshot + ((yc + r) * width + xc) * spp;
+        tile_ptr = BX_VGA_THIS rthread.output + ((yc + r) * width + xc) * dpp;
+        for (c = 0; c < w; c++) {
+          switch (BX_VGA_THIS rthread.bpp) {
+            case 8:
+              colour = BX_VGA_THIS rthread.palette[vid_ptr[0]];
+              break;
+            case 15:
+              colour = vid_ptr[0] | (vid_ptr[1] << 8);
+              colour = MAKE_COLOUR(
+                colour & 0x001f, 5, info->blue_shift, info->blue_mask,
+                colour & 0x03e0, 10, info->green_shift, info->green_mask,
+                colour & 0x7c00, 15, info->red_shift, info->red_mask);
+              break;
+            case 16:
+              colour = vid_ptr[0] | (vid_ptr[1] << 8);
+              colour = MAKE_COLOUR(
+                colour & 0x001f, 5, info->blue_shift, info->blue_mask,
+                colour & 0x07e0, 11, info->green_shift, info->green_mask,
+                colour & 0xf800, 16, info->red_shift, info->red_mask);
+              break;
+            default: // 24 and 32 bpp
+              colour = MAKE_COLOUR(
+                vid_ptr[2], 8, info->red_shift, info->red_mask,
+                vid_ptr[1], 8, info->green_shift, info->green_mask,
+                vid_ptr[0], 8, info->blue_shift, info->blue_mask);
+              break;
+          }
+          vid_ptr += spp;
+          if (info->is_little_endian) {
+            for (i=0; i<info->bpp; i+=8) {
+              *(tile_ptr++) = (Bit8u)(colour >> i);
+            }
+          } else {
+            for (i=info->bpp-8; i>-8; i-=8) {
+              *(tile_ptr++) = (Bit8u)(colour >> i);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Pass the tiles converted by the render thread to the gui. The frame is
+// dropped if the display mode or format has changed in the meantime, its
+// tiles are marked for update again in that case.
+void bx_vgacore_c::render_publish(unsigned width, unsigned height, unsigned bpp)
+{
+  bx_svga_tileinfo_t info;
+  unsigned dpp = (BX_VGA_THIS rthread.info.bpp + 1) >> 3;
+  unsigned xc, yc, xti, yti, r, w, h;
+  Bit8u *src_ptr, *tile_ptr;
+  bool valid;
+
+  bx_gui->graphics_tile_info_common(&info);
+  valid = (width == BX_VGA_THIS rthread.width) && (height == BX_VGA_THIS rthread.height) &&
+          (bpp == BX_VGA_THIS rthread.bpp) && (info.bpp == BX_VGA_THIS rthread.info.bpp) &&
+          (info.red_mask == BX_VGA_THIS rthread.info.red_mask) &&
+          (info.green_mask == BX_VGA_THIS rthread.info.green_mask) &&
+          (info.blue_mask == BX_VGA_THIS rthread.info.blue_mask);
+  for (yc = 0, yti = 0; yti < BX_VGA_THIS rthread.ytiles; yc += Y_TILESIZE, yti++) {
+    for (xc = 0, xti = 0; xti < BX_VGA_THIS rthread.xtiles; xc += X_TILESIZE, xti++) {
+      if (!BX_VGA_THIS rthread.tiles[yti * BX_VGA_THIS rthread.xtiles + xti])
+        continue;
+      if (!valid) {
+        SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 1);
+        continue;
+      }
+      tile_ptr = bx_gui->graphics_tile_get(xc, yc, &w, &h);
+      if ((xc + w) > width) w = width - xc;
+      if ((yc + h) > height) h = height - yc;
+      src_ptr = BX_VGA_THIS rthread.output + (yc * width + xc) * dpp;
+      for (r = 0; r < h; r++) {
+        memcpy(tile_ptr, src_ptr, w * dpp);
+        src_ptr += width * dpp;
+        tile_ptr += info.pitch;
+      }
+      BX_VGA_THIS render_overlay(xc, yc, &info);
+      bx_gui->graphics_tile_update_in_place(xc, yc, w, h);
+    }
+  }
+  if (valid) {
+    BX_VGA_THIS rthread.frames++;
+  }
+}
+
+// Wait for the render thread and drop its frame before the display is
+// updated directly. The tiles of the frame are marked for update again.
+void bx_vgacore_c::render_thread_flush(void)
+{
+  bool busy;
+  unsigned xti, yti;
+
+  if (!BX_VGA_THIS rthread.enabled)
+    return;
+  while (1) {
+    BX_LOCK(BX_VGA_THIS rthread_mutex);
+    busy = BX_VGA_THIS rthread.busy;
+    BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+    if (!busy) break;
+    BX_MSLEEP(1);
+  }
+  if (BX_VGA_THIS rthread.ready) {
+    for (yti = 0; yti < BX_VGA_THIS rthread.ytiles; yti++) {
+      for (xti = 0; xti < BX_VGA_THIS rthread.xtiles; xti++) {
+        if (BX_VGA_THIS rthread.tiles[yti * BX_VGA_THIS rthread.xtiles + xti]) {
+          SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 1);
+        }
+      }
+    }
+    BX_VGA_THIS rthread.ready = 0;
+  }
+  BX_VGA_THIS rthread.pending = 0;
+}
+
+// Update the display of a linear framebuffer mode using the render thread.
+// The frame converted since the last call is passed to the gui, then the
+// changed tiles are copied and handed to the thread. If the thread is still
+// busy, the update is skipped and the tiles remain marked. Returns 0 if the
+// caller has to update the display directly (render thread disabled,
+// snapshot mode, indexed host display or unsupported format).
+bool bx_vgacore_c::render_linear_fb(const Bit8u *disp_ptr, unsigned width, unsigned height,
+                                    unsigned pitch, unsigned bpp, Bit8u dac_size)
+{
+  bx_svga_tileinfo_t info;
+  unsigned spp, xc, yc, xti, yti, r, w, h, i;
+  bool busy, ready, changed = 0;
+  Bit8u *snap_ptr;
+
+  if (!BX_VGA_THIS rthread.enabled)
+    return 0;
+  if ((bpp != 8) && (bpp != 15) && (bpp != 16) && (bpp != 24) && (bpp != 32)) {
+    BX_VGA_THIS render_thread_flush();
+    return 0;
+  }
+  if (!bx_gui->graphics_tile_info_common(&info) || info.snapshot_mode || info.is_indexed ||
+      (width > BX_VGA_THIS s.max_xres) || (height > BX_VGA_THIS s.max_yres)) {
+    BX_VGA_THIS render_thread_flush();
+    return 0;
+  }
+  BX_LOCK(BX_VGA_THIS rthread_mutex);
+  busy = BX_VGA_THIS rthread.busy;
+  ready = BX_VGA_THIS rthread.ready;
+  BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+  if (busy) {
+    BX_VGA_THIS rthread.dropped++;
+    return 1;
+  }
+  if (ready) {
+    BX_VGA_THIS render_publish(width, height, bpp);
+    BX_VGA_THIS rthread.ready = 0;
+  }
+  if (BX_VGA_THIS rthread.snapshot == NULL) {
+    BX_VGA_THIS rthread.snapshot = new Bit8u[BX_VGA_THIS s.max_xres * BX_VGA_THIS s.max_yres * 4];
+    BX_VGA_THIS rthread.output = new Bit8u[BX_VGA_THIS s.max_xres * BX_VGA_THIS s.max_yres * 4];
+    BX_VGA_THIS rthread.tiles = new bool[BX_VGA_THIS s.num_x_tiles * BX_VGA_THIS s.num_y_tiles];
+  }
+
+  // copy the changed tiles
+  spp = (bpp + 1) >> 3;
+  BX_VGA_THIS rthread.xtiles = (width + X_TILESIZE - 1) / X_TILESIZE;
+  BX_VGA_THIS rthread.ytiles = (height + Y_TILESIZE - 1) / Y_TILESIZE;
+  for (yc = 0, yti = 0; yti < BX_VGA_THIS rthread.ytiles; yc += Y_TILESIZE, yti++) {
+    for (xc = 0, xti = 0; xti < BX_VGA_THIS rthread.xtiles; xc += X_TILESIZE, xti++) {
+      i = yti * BX_VGA_THIS rthread.xtiles + xti;
+      BX_VGA_THIS rthread.tiles[i] = GET_TILE_UPDATED(xti, yti);
+      if (!BX_VGA_THIS rthread.tiles[i])
+        continue;
+      w = ((xc + X_TILESIZE) <= width) ? X_TILESIZE : (width - xc);
+      h = ((yc + Y_TILESIZE) <= height) ? Y_TILESIZE : (height - yc);
+      snap_ptr = BX_VGA_THIS rthread.snapshot + (yc * width + xc) * spp;
+      for (r = 0; r < h; r++) {
+        memcpy(snap_ptr, disp_ptr + (yc + r) * pitch + xc * spp, w * spp);
+        snap_ptr += width * spp;
+      }
+      SET_TILE_UPDATED(BX_VGA_THIS, xti, yti, 0);
+      changed = 1;
+    }
+  }
+  BX_VGA_THIS rthread.pending = changed;
+  if (!changed)
+    return 1;
+
+  // the palette is converted here, the thread must not access the DAC state
+  if (bpp == 8) {
+    for (i = 0; i < 256; i++) {
+      BX_VGA_THIS rthread.palette[i] = MAKE_COLOUR(
+        BX_VGA_THIS s.pel.data[i].red, dac_size, info.red_shift, info.red_mask,
+        BX_VGA_THIS s.pel.data[i].green, dac_size, info.green_shift, info.green_mask,
+        BX_VGA_THIS s.pel.data[i].blue, dac_size, info.blue_shift, info.blue_mask);
+    }
+  }
+  BX_VGA_THIS rthread.width = width;
+  BX_VGA_THIS rthread.height = height;
+  BX_VGA_THIS rthread.bpp = bpp;
+  BX_VGA_THIS rthread.info = info;
+  BX_LOCK(BX_VGA_THIS rthread_mutex);
+  BX_VGA_THIS rthread.busy = 1;
+  BX_UNLOCK(BX_VGA_THIS rthread_mutex);
+  bx_set_sem(&BX_VGA_THIS rthread_sem);
+  return 1;
+}
+
 #undef LOG_THIS
 #define LOG_THIS vgadev->
 
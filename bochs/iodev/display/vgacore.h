@@ -23,6 +23,8 @@
 #ifndef BX_IODEV_VGACORE_H
 #define BX_IODEV_VGACORE_H
 
+#include "bxthread.h"
+
 // Make colour
 #define MAKE_COLOUR(red, red_shiftfrom, red_shiftto, red_mask, \
                     green, green_shiftfrom, green_shiftto, green_mask, \
@@ -45,6 +47,14 @@
 #define X_TILESIZE 16
 #define Y_TILESIZE 24
 
+// damage driven update scheduling (vga: update_damage=1): delay of the first
+// update after a quiet period (usec), number of updates without changes before
+// the timer slows down and the update interval while idle (usec)
+#define BX_VGA_DAMAGE_DELAY       5000
+#define BX_VGA_DAMAGE_QUIET_TICKS 4
+#define BX_VGA_DAMAGE_IDLE        1000000
+#define BX_VGA_DAMAGE_IDLE_TEXT   266666
+
 // Only reference the array if the tile numbers are within the bounds
 // of the array.  If out of bounds, do nothing.
 #define SET_TILE_UPDATED(thisp, xtile, ytile, value)                          \
@@ -114,6 +124,11 @@ public:
   static void    vertical_timer_handler(void *);
   virtual void   vertical_timer(void);
   static Bit64s  vga_param_handler(bx_param_c *param, bool set, Bit64s val);
+  // called for all guest changes of the display contents
+  void           damage_notify(void) {
+    damage.seen = 1;
+    if (damage.idle) damage_kick();
+  }
 
 protected:
   void init_standard_vga(void);
@@ -133,6 +148,18 @@ protected:
   void calculate_retrace_timing(void);
   bool skip_update(void);
   void update_charmap(void);
+  // render thread for linear framebuffer modes (vga: render_thread=1)
+  bool render_linear_fb(const Bit8u *disp_ptr, unsigned width, unsigned height,
+                        unsigned pitch, unsigned bpp, Bit8u dac_size);
+  void render_thread_flush(void);
+  bool render_pending(void) {return rthread.pending;}
+  virtual void render_overlay(unsigned xc, unsigned yc, bx_svga_tileinfo_t *info) {}
+  // direct guest access to the linear framebuffer (memory_direct_access_handler_t)
+  void alloc_memory(Bit32u size);
+  Bit8u *lfb_direct_page(Bit32u offset, unsigned rw);
+  bool lfb_dirty_scan(Bit32u start, Bit32u end, unsigned pitch, unsigned pixbytes,
+                      bool xdouble, bool ydouble);
+  void lfb_dirty_reset(void);
 
   struct {
     struct {
@@ -237,6 +264,7 @@ protected:
     unsigned blink_counter;
     bool  *vga_tile_updated;
     Bit8u *memory;
+    Bit8u *memory_alloc;
     Bit32u memsize;
     Bit32u vgamem_mask;
     bool  text_buffer_update;
@@ -293,6 +321,78 @@ protected:
   // vga config
   bx_param_enum_c *vga_ext;
   bool pci_enabled;
+
+private:
+  void render_thread_start(void);
+  void render_thread_stop(void);
+  static BX_THREAD_FUNC(render_thread_func, indata);
+  void render_thread(void);
+  void render_convert(void);
+  void render_publish(unsigned width, unsigned height, unsigned bpp);
+  void damage_kick(void);
+  void damage_schedule(bool changed);
+  unsigned damage_count_tiles(void);
+
+  // frame passed to the render thread: the changed tiles of the guest
+  // framebuffer are copied to 'snapshot' and converted to 'output' in the
+  // host format. 'busy' and 'ready' are protected by the mutex, the other
+  // fields belong to the render thread while 'busy' is set. 'pending' tells
+  // the update code to call render_linear_fb() even without guest changes.
+  struct {
+    bool enabled;
+    bool running;
+    bool stop;
+    bool busy;
+    bool ready;
+    bool pending;
+    unsigned width;
+    unsigned height;
+    unsigned bpp;
+    unsigned xtiles;
+    unsigned ytiles;
+    bx_svga_tileinfo_t info;
+    Bit32u palette[256];
+    Bit8u *snapshot;
+    Bit8u *output;
+    bool *tiles;
+    Bit64u frames;
+    Bit64u dropped;
+  } rthread;
+  BX_MUTEX(rthread_mutex);
+  bx_thread_sem_t rthread_sem;
+  BX_THREAD_VAR(rthread_var);
+
+  // update scheduling state and display statistics. 'seen' is set by
+  // damage_notify() and cleared on each update, 'blink' tells that the last
+  // update used the standard VGA code with cursor / attribute blinking.
+  // 'idle' is only set with the 'update_damage' option while the timer runs
+  // at the idle interval.
+  struct {
+    bool enabled;
+    bool idle;
+    bool kicked;
+    bool seen;
+    bool blink;
+    unsigned quiet;
+    unsigned blink_counter;
+    Bit64u frames;
+    Bit64u dirty_tiles;
+    Bit64u fps;
+    Bit64u fps_frames;
+    Bit64u fps_start;
+  } damage;
+
+  // 4K pages of the video memory written through a host pointer handed out
+  // by lfb_direct_page(). A page is marked when the CPU fills a TLB entry for
+  // writing, lfb_dirty_scan() converts the pages to tiles and flushes the
+  // TLBs, so that the next write to a page faults in (and marks it) again.
+  struct {
+    Bit8u *dirty;
+    Bit32u *list;
+    Bit32u npages;
+    Bit32u count;
+    Bit64u pages;
+  } lfb;
 };
 
 #endif
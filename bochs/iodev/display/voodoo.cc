@@ -112,6 +112,13 @@ void voodoo_init_options(void)
     "Selects the Voodoo model to emulate.",
     voodoo_model_list,
     VOODOO_1, VOODOO_1);
+  bx_param_num_c *threads = new bx_param_num_c(menu,
+    "threads",
+    "Rendering threads",
+    "Number of threads rendering the scanlines of 3D primitives",
+    1, WORK_MAX_THREADS,
+    1);
+  threads->set_options(threads->USE_SPIN_CONTROL);
   enabled->set_dependent_list(menu->clone());
 }
 
@@ -262,6 +269,7 @@ bx_voodoo_base_c::~bx_voodoo_base_c()
     bx_set_sem(&fifo_not_full);
     bx_set_sem(&vertical_sem);
     BX_THREAD_JOIN(fifo_thread_var);
+    raster_stop_threads();
     BX_FINI_MUTEX(fifo_mutex);
     BX_FINI_MUTEX(render_mutex);
     if (s.model >= VOODOO_2) {
@@ -526,6 +534,7 @@ void bx_voodoo_base_c::start_fifo_thread(void)
   bx_set_sem(&fifo_not_full);
   BX_THREAD_CREATE(fifo_thread, this, fifo_thread_var);
   bx_create_sem(&vertical_sem);
+  raster_start_threads(SIM->get_param_num("threads", SIM->get_param(BXPN_VOODOO))->get());
 }
 
 void bx_voodoo_base_c::refresh_display(void *this_ptr, bool redraw)
@@ -689,6 +698,9 @@ void bx_voodoo_base_c::vertical_timer(void)
   }
 
   if (v->fbi.video_changed || v->fbi.clut_dirty) {
+    if (theVoodooVga != NULL) {
+      theVoodooVga->damage_notify();
+    }
     // TODO: use tile-based update mechanism
     if (v->fbi.clut_dirty || (s.model < VOODOO_BANSHEE) || v->banshee.overlay.redraw) {
       redraw_area(0, 0, s.vdraw.width, s.vdraw.height);
@@ -181,12 +181,17 @@ private:
   void   blt_host_to_screen_pattern(void);
   void   blt_line(bool pline);
   void   blt_polygon_fill(bool force);
+  bool   blt_overlap(const Bit8u *dst, int dbytes, int dpitch, const Bit8u *src, int sbytes, int spitch, int h);
+  void   blt_repeat_row(Bit8u *row, int len, int period);
+  void   blt_expand_mono_row(Bit8u *row, const Bit8u *src, Bit8u smask, int count, Bit8u pxsize);
 
   Bit32u get_overlay_pixel(unsigned x, unsigned y, Bit8u bpp);
   bool   chromakey_check(Bit32u color, Bit8u bpp);
 
   bx_ddc_c ddc;
   bool     is_agp;
+  // one row of source pixels for the 2D engine fast paths (max. 8191 pixels)
+  Bit8u    blt_row[0x8000];
 };
 
 class bx_voodoo_vga_c : public bx_vgacore_c {
@@ -1442,6 +1442,7 @@ static const Bit8u dither_matrix_2x2[16] =
 
 typedef struct _voodoo_state voodoo_state;
 typedef struct _poly_extra_data poly_extra_data;
+typedef struct _raster_info raster_info;
 
 typedef Bit32u rgb_t;
 
@@ -1685,9 +1686,28 @@ struct _dac_state
 };
 
 
+typedef void (*voodoo_raster_func)(int tmus, void *destbase, Bit32s y, const poly_extent *extent, const void *extradata, int threadid);
+
+struct _raster_info
+{
+  raster_info * next;           /* pointer to next entry with the same hash */
+  voodoo_raster_func callback;  /* callback pointer */
+  bool          is_generic;     /* true if this is one of the generic rasterizers */
+  Bit32u        hits;           /* how many hits (pixels) we've used this for */
+  Bit32u        polys;          /* how many polys we've used this for */
+  Bit32u        eff_color_path; /* effective fbzColorPath value */
+  Bit32u        eff_alpha_mode; /* effective alphamode value */
+  Bit32u        eff_fog_mode;   /* effective fogmode value */
+  Bit32u        eff_fbz_mode;   /* effective fbzmode value */
+  Bit32u        eff_tex_mode_0; /* effective textureMode value for TMU #0 */
+  Bit32u        eff_tex_mode_1; /* effective textureMode value for TMU #1 */
+};
+
+
 struct _poly_extra_data
 {
   voodoo_state* state;        /* pointer back to the voodoo state */
+  raster_info*  info;         /* pointer to rasterizer information */
 
   Bit16s        ax, ay;       /* vertex A x,y (12.4) */
   Bit32s        startr, startg, startb, starta; /* starting R,G,B,A (12.12) */
@@ -1872,6 +1892,10 @@ struct _voodoo_state
 
   stats_block *   thread_stats; /* per-thread statistics */
 
+  raster_info *   raster_hash[RASTER_HASH_SIZE]; /* hash table of rasterizers */
+  raster_info     rasterizer[MAX_RASTERIZERS]; /* array of rasterizers */
+  int             next_rasterizer; /* next rasterizer index */
+
   Bit32u      last_status_pc;   /* PC of last status description (for logging) */
   Bit32u      last_status_value; /* value of last status read (for logging) */
 
@@ -2250,6 +2274,27 @@ BX_CPP_INLINE Bit32u normalize_tex_mode(Bit32u eff_tex_mode)
 }
 
 
+BX_CPP_INLINE Bit32u compute_raster_hash(const raster_info *info)
+{
+  Bit32u hash;
+
+  /* make a hash */
+  hash = info->eff_color_path;
+  hash = (hash << 1) | (hash >> 31);
+  hash ^= info->eff_fbz_mode;
+  hash = (hash << 1) | (hash >> 31);
+  hash ^= info->eff_alpha_mode;
+  hash = (hash << 1) | (hash >> 31);
+  hash ^= info->eff_fog_mode;
+  hash = (hash << 1) | (hash >> 31);
+  hash ^= info->eff_tex_mode_0;
+  hash = (hash << 1) | (hash >> 31);
+  hash ^= info->eff_tex_mode_1;
+
+  return hash % RASTER_HASH_SIZE;
+}
+
+
 /*************************************
  *
  *  Dithering macros
@@ -2589,6 +2634,215 @@ while (0)
  *
  *************************************/
 
+/* RGB part of the alpha blend, the caller clamps the result */
+BX_CPP_INLINE void alpha_blend_rgb(Bit32u alphamode, Bit32s &rr, Bit32s &gg, Bit32s &bb,
+                                   int sa, int da, int dr, int dg, int db,
+                                   int prefogr, int prefogg, int prefogb)
+{
+#if BX_VOODOO_SSE2
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i full = _mm_set1_epi16(0x100);
+  __m128i src = _mm_setr_epi16(rr, gg, bb, 0, 0, 0, 0, 0);
+  __m128i dst = _mm_setr_epi16(dr, dg, db, 0, 0, 0, 0, 0);
+  __m128i sf, df;
+  Bit32u result;
+  int ta;
+
+  /* source factor */
+  switch (ALPHAMODE_SRCRGBBLEND(alphamode))
+  {
+    default:  /* reserved */
+    case 0:   /* AZERO */
+      sf = _mm_setzero_si128();
+      break;
+    case 1:   /* ASRC_ALPHA */
+      sf = _mm_set1_epi16(sa + 1);
+      break;
+    case 2:   /* A_COLOR */
+      sf = _mm_add_epi16(dst, one);
+      break;
+    case 3:   /* ADST_ALPHA */
+      sf = _mm_set1_epi16(da + 1);
+      break;
+    case 4:   /* AONE */
+      sf = full;
+      break;
+    case 5:   /* AOMSRC_ALPHA */
+      sf = _mm_set1_epi16(0x100 - sa);
+      break;
+    case 6:   /* AOM_COLOR */
+      sf = _mm_sub_epi16(full, dst);
+      break;
+    case 7:   /* AOMDST_ALPHA */
+      sf = _mm_set1_epi16(0x100 - da);
+      break;
+    case 15:  /* ASATURATE */
+      ta = (sa < (0x100 - da)) ? sa : (0x100 - da);
+      sf = _mm_set1_epi16(ta + 1);
+      break;
+  }
+
+  /* dest factor */
+  switch (ALPHAMODE_DSTRGBBLEND(alphamode))
+  {
+    default:  /* reserved */
+    case 0:   /* AZERO */
+      df = _mm_setzero_si128();
+      break;
+    case 1:   /* ASRC_ALPHA */
+      df = _mm_set1_epi16(sa + 1);
+      break;
+    case 2:   /* A_COLOR */
+      df = _mm_add_epi16(src, one);
+      break;
+    case 3:   /* ADST_ALPHA */
+      df = _mm_set1_epi16(da + 1);
+      break;
+    case 4:   /* AONE */
+      df = full;
+      break;
+    case 5:   /* AOMSRC_ALPHA */
+      df = _mm_set1_epi16(0x100 - sa);
+      break;
+    case 6:   /* AOM_COLOR */
+      df = _mm_sub_epi16(full, src);
+      break;
+    case 7:   /* AOMDST_ALPHA */
+      df = _mm_set1_epi16(0x100 - da);
+      break;
+    case 15:  /* A_COLORBEFOREFOG */
+      df = _mm_add_epi16(_mm_setr_epi16(prefogr, prefogg, prefogb, 0, 0, 0, 0, 0), one);
+      break;
+  }
+
+  /* colors are 0..255 and factors 0..256, so the products fit into */
+  /* unsigned 16 bit and the sum is clamped by the final pack */
+  src = _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(src, sf), 8),
+                      _mm_srli_epi16(_mm_mullo_epi16(dst, df), 8));
+  result = _mm_cvtsi128_si32(_mm_packus_epi16(src, src));
+  rr = result & 0xff;
+  gg = (result >> 8) & 0xff;
+  bb = (result >> 16) & 0xff;
+#else
+  int sr = rr;
+  int sg = gg;
+  int sb = bb;
+  int ta;
+
+  /* compute source portion */
+  switch (ALPHAMODE_SRCRGBBLEND(alphamode))
+  {
+    default:  /* reserved */
+    case 0:   /* AZERO */
+      rr = gg = bb = 0;
+      break;
+
+    case 1:   /* ASRC_ALPHA */
+      rr = (sr * (sa + 1)) >> 8;
+      gg = (sg * (sa + 1)) >> 8;
+      bb = (sb * (sa + 1)) >> 8;
+      break;
+
+    case 2:   /* A_COLOR */
+      rr = (sr * (dr + 1)) >> 8;
+      gg = (sg * (dg + 1)) >> 8;
+      bb = (sb * (db + 1)) >> 8;
+      break;
+
+    case 3:   /* ADST_ALPHA */
+      rr = (sr * (da + 1)) >> 8;
+      gg = (sg * (da + 1)) >> 8;
+      bb = (sb * (da + 1)) >> 8;
+      break;
+
+    case 4:   /* AONE */
+      break;
+
+    case 5:   /* AOMSRC_ALPHA */
+      rr = (sr * (0x100 - sa)) >> 8;
+      gg = (sg * (0x100 - sa)) >> 8;
+      bb = (sb * (0x100 - sa)) >> 8;
+      break;
+
+    case 6:   /* AOM_COLOR */
+      rr = (sr * (0x100 - dr)) >> 8;
+      gg = (sg * (0x100 - dg)) >> 8;
+      bb = (sb * (0x100 - db)) >> 8;
+      break;
+
+    case 7:   /* AOMDST_ALPHA */
+      rr = (sr * (0x100 - da)) >> 8;
+      gg = (sg * (0x100 - da)) >> 8;
+      bb = (sb * (0x100 - da)) >> 8;
+      break;
+
+    case 15:  /* ASATURATE */
+      ta = (sa < (0x100 - da)) ? sa : (0x100 - da);
+      rr = (sr * (ta + 1)) >> 8;
+      gg = (sg * (ta + 1)) >> 8;
+      bb = (sb * (ta + 1)) >> 8;
+      break;
+  }
+
+  /* add in dest portion */
+  switch (ALPHAMODE_DSTRGBBLEND(alphamode))
+  {
+    default:  /* reserved */
+    case 0:   /* AZERO */
+      break;
+
+    case 1:   /* ASRC_ALPHA */
+      rr += (dr * (sa + 1)) >> 8;
+      gg += (dg * (sa + 1)) >> 8;
+      bb += (db * (sa + 1)) >> 8;
+      break;
+
+    case 2:   /* A_COLOR */
+      rr += (dr * (sr + 1)) >> 8;
+      gg += (dg * (sg + 1)) >> 8;
+      bb += (db * (sb + 1)) >> 8;
+      break;
+
+    case 3:   /* ADST_ALPHA */
+      rr += (dr * (da + 1)) >> 8;
+      gg += (dg * (da + 1)) >> 8;
+      bb += (db * (da + 1)) >> 8;
+      break;
+
+    case 4:   /* AONE */
+      rr += dr;
+      gg += dg;
+      bb += db;
+      break;
+
+    case 5:   /* AOMSRC_ALPHA */
+      rr += (dr * (0x100 - sa)) >> 8;
+      gg += (dg * (0x100 - sa)) >> 8;
+      bb += (db * (0x100 - sa)) >> 8;
+      break;
+
+    case 6:   /* AOM_COLOR */
+      rr += (dr * (0x100 - sr)) >> 8;
+      gg += (dg * (0x100 - sg)) >> 8;
+      bb += (db * (0x100 - sb)) >> 8;
+      break;
+
+    case 7:   /* AOMDST_ALPHA */
+      rr += (dr * (0x100 - da)) >> 8;
+      gg += (dg * (0x100 - da)) >> 8;
+      bb += (db * (0x100 - da)) >> 8;
+      break;
+
+    case 15:  /* A_COLORBEFOREFOG */
+      rr += (dr * (prefogr + 1)) >> 8;
+      gg += (dg * (prefogg + 1)) >> 8;
+      bb += (db * (prefogb + 1)) >> 8;
+      break;
+  }
+#endif
+}
+
+
 #define APPLY_ALPHA_BLEND(FBZMODE, ALPHAMODE, XX, DITHER, RR, GG, BB, AA)        \
 do                                                                               \
 {                                                                                \
@@ -2599,11 +2853,7 @@ do
     int dg = (dpix >> 3) & 0xfc;                                                 \
     int db = (dpix << 3) & 0xf8;                                                 \
     int da = FBZMODE_ENABLE_ALPHA_PLANES(FBZMODE) ? depth[XX] : 0xff;            \
-    int sr = (RR);                                                               \
-    int sg = (GG);                                                               \
-    int sb = (BB);                                                               \
     int sa = (AA);                                                               \
-    int ta;                                                                      \
                                                                                  \
     /* apply dither subtraction */                                               \
     if (FBZMODE_ALPHA_DITHER_SUBTRACT(FBZMODE))                                  \
@@ -2617,116 +2867,9 @@ do
       db = ((db << 1) + 15 - dith) >> 1;                                         \
     }                                                                            \
                                                                                  \
-    /* compute source portion */                                                 \
-    switch (ALPHAMODE_SRCRGBBLEND(ALPHAMODE))                                    \
-    {                                                                            \
-      default:  /* reserved */                                                   \
-      case 0:   /* AZERO */                                                      \
-        (RR) = (GG) = (BB) = 0;                                                  \
-        break;                                                                   \
-                                                                                 \
-      case 1:   /* ASRC_ALPHA */                                                 \
-        (RR) = (sr * (sa + 1)) >> 8;                                             \
-        (GG) = (sg * (sa + 1)) >> 8;                                             \
-        (BB) = (sb * (sa + 1)) >> 8;                                             \
-        break;                                                                   \
-                                                                                 \
-      case 2:   /* A_COLOR */                                                    \
-        (RR) = (sr * (dr + 1)) >> 8;                                             \
-        (GG) = (sg * (dg + 1)) >> 8;                                             \
-        (BB) = (sb * (db + 1)) >> 8;                                             \
-        break;                                                                   \
-                                                                                 \
-      case 3:   /* ADST_ALPHA */                                                 \
-        (RR) = (sr * (da + 1)) >> 8;                                             \
-        (GG) = (sg * (da + 1)) >> 8;                                             \
-        (BB) = (sb * (da + 1)) >> 8;                                             \
-        break;                                                                   \
-                                                                                 \
-      case 4:   /* AONE */                                                       \
-        break;                                                                   \
-                                                                                 \
-      case 5:   /* AOMSRC_ALPHA */                                               \
-        (RR) = (sr * (0x100 - sa)) >> 8;                                         \
-        (GG) = (sg * (0x100 - sa)) >> 8;                                         \
-        (BB) = (sb * (0x100 - sa)) >> 8;                                         \
-        break;                                                                   \
-                                                                                 \
-      case 6:   /* AOM_COLOR */                                                  \
-        (RR) = (sr * (0x100 - dr)) >> 8;                                         \
-        (GG) = (sg * (0x100 - dg)) >> 8;                                         \
-        (BB) = (sb * (0x100 - db)) >> 8;                                         \
-        break;                                                                   \
-                                                                                 \
-      case 7:   /* AOMDST_ALPHA */                                               \
-        (RR) = (sr * (0x100 - da)) >> 8;                                         \
-        (GG) = (sg * (0x100 - da)) >> 8;                                         \
-        (BB) = (sb * (0x100 - da)) >> 8;                                         \
-        break;                                                                   \
-                                                                                 \
-      case 15:  /* ASATURATE */                                                  \
-        ta = (sa < (0x100 - da)) ? sa : (0x100 - da);                            \
-        (RR) = (sr * (ta + 1)) >> 8;                                             \
-        (GG) = (sg * (ta + 1)) >> 8;                                             \
-        (BB) = (sb * (ta + 1)) >> 8;                                             \
-        break;                                                                   \
-    }                                                                            \
-                                                                                 \
-    /* add in dest portion */                                                    \
-    switch (ALPHAMODE_DSTRGBBLEND(ALPHAMODE))                                    \
-    {                                                                            \
-      default:  /* reserved */                                                   \
-      case 0:   /* AZERO */                                                      \
-        break;                                                                   \
-                                                                                 \
-      case 1:   /* ASRC_ALPHA */                                                 \
-        (RR) += (dr * (sa + 1)) >> 8;                                            \
-        (GG) += (dg * (sa + 1)) >> 8;                                            \
-        (BB) += (db * (sa + 1)) >> 8;                                            \
-        break;                                                                   \
-                                                                                 \
-      case 2:   /* A_COLOR */                                                    \
-        (RR) += (dr * (sr + 1)) >> 8;                                            \
-        (GG) += (dg * (sg + 1)) >> 8;                                            \
-        (BB) += (db * (sb + 1)) >> 8;                                            \
-        break;                                                                   \
-                                                                                 \
-      case 3:   /* ADST_ALPHA */                                                 \
-        (RR) += (dr * (da + 1)) >> 8;                                            \
-        (GG) += (dg * (da + 1)) >> 8;                                            \
-        (BB) += (db * (da + 1)) >> 8;                                            \
-        break;                                                                   \
-                                                                                 \
-      case 4:   /* AONE */                                                       \
-        (RR) += dr;                                                              \
-        (GG) += dg;                                                              \
-        (BB) += db;                                                              \
-        break;                                                                   \
-                                                                                 \
-      case 5:   /* AOMSRC_ALPHA */                                               \
-        (RR) += (dr * (0x100 - sa)) >> 8;                                        \
-        (GG) += (dg * (0x100 - sa)) >> 8;                                        \
-        (BB) += (db * (0x100 - sa)) >> 8;                                        \
-        break;                                                                   \
-                                                                                 \
-      case 6:   /* AOM_COLOR */                                                  \
-        (RR) += (dr * (0x100 - sr)) >> 8;                                        \
-        (GG) += (dg * (0x100 - sg)) >> 8;                                        \
-        (BB) += (db * (0x100 - sb)) >> 8;                                        \
-        break;                                                                   \
-                                                                                 \
-      case 7:   /* AOMDST_ALPHA */                                               \
-        (RR) += (dr * (0x100 - da)) >> 8;                                        \
-        (GG) += (dg * (0x100 - da)) >> 8;                                        \
-        (BB) += (db * (0x100 - da)) >> 8;                                        \
-        break;                                                                   \
-                                                                                 \
-      case 15:  /* A_COLORBEFOREFOG */                                           \
-        (RR) += (dr * (prefogr + 1)) >> 8;                                       \
-        (GG) += (dg * (prefogg + 1)) >> 8;                                       \
-        (BB) += (db * (prefogb + 1)) >> 8;                                       \
-        break;                                                                   \
-    }                                                                            \
+    /* blend the colors */                                                       \
+    alpha_blend_rgb(ALPHAMODE, (RR), (GG), (BB), sa, da, dr, dg, db,             \
+                    prefogr, prefogg, prefogb);                                  \
                                                                                  \
     /* blend the source alpha */                                                 \
     (AA) = 0;                                                                    \
@@ -80,7 +80,20 @@ static Bit8u dither2_lookup[256*16*2];
 Bit32u voodoo_reciplog[(2 << RECIPLOG_LOOKUP_BITS) + 2];
 
 
-void raster_function(int tmus, void *destbase, Bit32s y, const poly_extent *extent, const void *extradata, int threadid) {
+/*************************************
+ *
+ *  Rasterizers
+ *
+ *************************************/
+
+/* The rasterizer is compiled once as generic version reading the pipeline */
+/* state from the registers and once for each entry of the predefined */
+/* rasterizer table below, with the effective register values as template */
+/* parameters. This lets the compiler drop all pipeline stages and mode */
+/* decoding not needed for that state. */
+
+template <bool GENERIC, Bit32u FBZCP, Bit32u ALPHAMODE, Bit32u FOGMODE, Bit32u FBZMODE, Bit32u TEXMODE0, Bit32u TEXMODE1>
+void raster_function_tmpl(int tmus_generic, void *destbase, Bit32s y, const poly_extent *extent, const void *extradata, int threadid) {
 	const poly_extra_data *extra = (const poly_extra_data *) extradata;
 	voodoo_state *v = extra->state;
 	stats_block *stats = &v->thread_stats[threadid];
@@ -98,12 +111,14 @@ void raster_function(int tmus, void *destbase, Bit32s y, const poly_extent *exte
 	Bit32s scry;
 	Bit32s x;
 
-	Bit32u fbzcolorpath= v->reg[fbzColorPath].u;
-	Bit32u fbzmode= v->reg[fbzMode].u;
-	Bit32u alphamode= v->reg[alphaMode].u;
-	Bit32u fogmode= v->reg[fogMode].u;
-	Bit32u texmode0= (tmus==0? 0 : v->tmu[0].reg[textureMode].u);
-	Bit32u texmode1= (tmus<=1? 0 : v->tmu[1].reg[textureMode].u);
+	/* an unused TMU has the effective texture mode 0xffffffff */
+	const int tmus = GENERIC ? tmus_generic : (TEXMODE0 == 0xffffffff) ? 0 : (TEXMODE1 == 0xffffffff) ? 1 : 2;
+	const Bit32u fbzcolorpath = GENERIC ? v->reg[fbzColorPath].u : FBZCP;
+	const Bit32u fbzmode = GENERIC ? v->reg[fbzMode].u : FBZMODE;
+	const Bit32u alphamode = GENERIC ? v->reg[alphaMode].u : ALPHAMODE;
+	const Bit32u fogmode = GENERIC ? v->reg[fogMode].u : FOGMODE;
+	const Bit32u texmode0 = GENERIC ? (tmus==0? 0 : v->tmu[0].reg[textureMode].u) : TEXMODE0;
+	const Bit32u texmode1 = GENERIC ? (tmus<=1? 0 : v->tmu[1].reg[textureMode].u) : TEXMODE1;
 
 	/* determine the screen Y */
 	scry = y;
@@ -225,6 +240,186 @@ void raster_function(int tmus, void *destbase, Bit32s y, const poly_extent *exte
 	}
 }
 
+/* generic rasterizer, used for all states without a predefined entry */
+#define raster_generic raster_function_tmpl<true, 0, 0, 0, 0, 0, 0>
+
+/* Predefined rasterizers for pipeline states commonly used by Glide */
+/* applications. The values are the effective register values as returned */
+/* by the normalize_xxx() functions, unused TMUs have the texture mode */
+/* 0xffffffff. Set LOG_RASTERIZERS to get the states used by an application */
+/* and the number of pixels drawn with them. */
+#define RASTERIZER_ENTRY(fbzcp, alphamode, fogmode, fbzmode, texmode0, texmode1) \
+  { NULL, raster_function_tmpl<false, fbzcp, alphamode, fogmode, fbzmode, texmode0, texmode1>, \
+    false, 0, 0, fbzcp, alphamode, fogmode, fbzmode, texmode0, texmode1 },
+
+static const raster_info predef_raster_table[] =
+{
+  /* fbzColorPath alphaMode fogMode fbzMode texMode0 texMode1 */
+  /* Gouraud shaded, flat shaded */
+  RASTERIZER_ENTRY( 0x0142610A, 0x00000000, 0x00000000, 0x00000301, 0xFFFFFFFF, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x0142610A, 0x00000000, 0x00000000, 0x00000731, 0xFFFFFFFF, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x0142610A, 0x00000000, 0x00000000, 0x00000739, 0xFFFFFFFF, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x0142610A, 0x00005110, 0x00000000, 0x00000301, 0xFFFFFFFF, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x0142610A, 0x00005110, 0x00000000, 0x00000339, 0xFFFFFFFF, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x0142611A, 0x00000000, 0x00000000, 0x00000301, 0xFFFFFFFF, 0xFFFFFFFF )
+  /* one TMU, texture modulated with iterated color */
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000000, 0x00000301, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000000, 0x00000731, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000000, 0x00000739, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000000, 0x00000739, 0x0C26100F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000001, 0x00000739, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00005110, 0x00000000, 0x00000339, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00482405, 0x00000009, 0x00000000, 0x00000739, 0x0C261A0F, 0xFFFFFFFF )
+  /* one TMU, texture decal */
+  RASTERIZER_ENTRY( 0x00000035, 0x00000000, 0x00000000, 0x00000301, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00000035, 0x00000000, 0x00000000, 0x00000739, 0x0C261A0F, 0xFFFFFFFF )
+  RASTERIZER_ENTRY( 0x00000035, 0x00000009, 0x00000000, 0x00000301, 0x0C261A0F, 0xFFFFFFFF )
+  /* two TMUs, TMU0 texture multiplied with TMU1 texture (light maps) */
+  RASTERIZER_ENTRY( 0x00482405, 0x00000000, 0x00000000, 0x00000739, 0x04824A0F, 0x0C261A0F )
+  RASTERIZER_ENTRY( 0x00000035, 0x00000000, 0x00000000, 0x00000739, 0x04824A0F, 0x0C261A0F )
+  /* end of table: no callback */
+  { NULL, NULL, false, 0, 0, 0, 0, 0, 0, 0, 0 }
+};
+
+
+raster_info *add_rasterizer(voodoo_state *v, const raster_info *cinfo)
+{
+  raster_info *info = &v->rasterizer[v->next_rasterizer++];
+  int hash = compute_raster_hash(cinfo);
+
+  /* make a copy of the info */
+  *info = *cinfo;
+
+  /* fill in the data */
+  info->hits = 0;
+  info->polys = 0;
+
+  /* hook us into the hash table */
+  info->next = v->raster_hash[hash];
+  v->raster_hash[hash] = info;
+
+  if (LOG_RASTERIZERS)
+    BX_DEBUG(("Adding rasterizer @ %p : %08X %08X %08X %08X %08X %08X (hash=%d)",
+            info->callback,
+            info->eff_color_path, info->eff_alpha_mode, info->eff_fog_mode, info->eff_fbz_mode,
+            info->eff_tex_mode_0, info->eff_tex_mode_1, hash));
+
+  return info;
+}
+
+
+void init_rasterizers(voodoo_state *v)
+{
+  const raster_info *info;
+
+  memset(v->raster_hash, 0, sizeof(v->raster_hash));
+  v->next_rasterizer = 0;
+
+  /* add all predefined rasterizers */
+  for (info = predef_raster_table; info->callback; info++)
+    add_rasterizer(v, info);
+}
+
+
+raster_info *find_rasterizer(voodoo_state *v, int texcount)
+{
+  static raster_info generic_info;
+  raster_info *info, *prev = NULL;
+  raster_info curinfo;
+  Bit32u hash;
+
+  /* TMU1 disabled by its LOD range doesn't contribute to the texel */
+  if (texcount >= 2 && v->tmu[1].lodmin >= (8 << 8))
+    texcount = 1;
+
+  /* build an info struct with all the parameters */
+  curinfo.eff_color_path = normalize_color_path(v->reg[fbzColorPath].u);
+  curinfo.eff_alpha_mode = normalize_alpha_mode(v->reg[alphaMode].u);
+  curinfo.eff_fog_mode = normalize_fog_mode(v->reg[fogMode].u);
+  curinfo.eff_fbz_mode = normalize_fbz_mode(v->reg[fbzMode].u);
+  curinfo.eff_tex_mode_0 = (texcount >= 1) ? normalize_tex_mode(v->tmu[0].reg[textureMode].u) : 0xffffffff;
+  curinfo.eff_tex_mode_1 = (texcount >= 2) ? normalize_tex_mode(v->tmu[1].reg[textureMode].u) : 0xffffffff;
+
+  /* compute the hash */
+  hash = compute_raster_hash(&curinfo);
+
+  /* find the appropriate hash entry */
+  for (info = v->raster_hash[hash]; info; prev = info, info = info->next)
+    if (info->eff_color_path == curinfo.eff_color_path &&
+        info->eff_alpha_mode == curinfo.eff_alpha_mode &&
+        info->eff_fog_mode == curinfo.eff_fog_mode &&
+        info->eff_fbz_mode == curinfo.eff_fbz_mode &&
+        info->eff_tex_mode_0 == curinfo.eff_tex_mode_0 &&
+        info->eff_tex_mode_1 == curinfo.eff_tex_mode_1)
+    {
+      /* got it, move us to the head of the list */
+      if (prev)
+      {
+        prev->next = info->next;
+        info->next = v->raster_hash[hash];
+        v->raster_hash[hash] = info;
+      }
+
+      /* return the result */
+      return info;
+    }
+
+  /* generate a new one using the generic entry */
+  curinfo.callback = raster_generic;
+  curinfo.is_generic = true;
+  curinfo.next = NULL;
+
+  /* the table is full, keep using the generic rasterizer without statistics */
+  if (v->next_rasterizer >= MAX_RASTERIZERS)
+  {
+    generic_info = curinfo;
+    return &generic_info;
+  }
+
+  return add_rasterizer(v, &curinfo);
+}
+
+
+void dump_rasterizer_stats(voodoo_state *v)
+{
+  raster_info *cur, *best;
+  int hash;
+
+  BX_INFO(("----"));
+
+  /* loop until we've displayed everything */
+  while (1)
+  {
+    best = NULL;
+
+    /* find the highest entry */
+    for (hash = 0; hash < RASTER_HASH_SIZE; hash++)
+      for (cur = v->raster_hash[hash]; cur; cur = cur->next)
+        if (cur->hits != 0 && cur->polys != 0 && (best == NULL || cur->hits > best->hits))
+          best = cur;
+
+    /* if we're done, we're done */
+    if (best == NULL)
+      break;
+
+    /* print it */
+    BX_INFO(("%s RASTERIZER_ENTRY( 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X, 0x%08X ) /* %8d %10d */",
+      best->is_generic ? "   " : "// ",
+      best->eff_color_path,
+      best->eff_alpha_mode,
+      best->eff_fog_mode,
+      best->eff_fbz_mode,
+      best->eff_tex_mode_0,
+      best->eff_tex_mode_1,
+      best->polys,
+      best->hits));
+
+    /* reset */
+    best->hits = best->polys = 0;
+  }
+}
+
+
 /*************************************
  *
  *  NCC table management
@@ -477,15 +672,227 @@ BX_CPP_INLINE Bit32s round_coordinate(float value)
   return result + (value - (float)result > 0.5f);
 }
 
-Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount, int paramcount, const poly_vertex *v1, const poly_vertex *v2, const poly_vertex *v3, poly_extra_data *extra)
+/*************************************
+ *
+ *  Multi-threaded rasterization
+ *
+ *************************************/
+
+/* The scanlines of a primitive are split into bands of a few lines that are */
+/* picked up by a pool of worker threads and the thread issuing the primitive, */
+/* similar to the MAME poly manager. Each thread has its own statistics block */
+/* in v->thread_stats[]. The issuing thread waits until all bands are done, */
+/* so the register state stays valid and overlapping primitives are still */
+/* drawn in order. */
+
+#define RASTER_BAND_SCANLINES  8
+
+typedef Bit32s (*raster_band_func)(const void *param, Bit32s starty, Bit32s stopy, int threadid);
+
+static struct {
+  unsigned numthreads;      /* number of threads including the issuing one */
+  bool keep_alive;
+  raster_band_func func;    /* band renderer and parameters of the primitive */
+  const void *param;
+  Bit32s nexty;             /* first scanline of the next unassigned band */
+  Bit32s stopy;             /* end of the scanline range */
+  Bit32s pixels[WORK_MAX_THREADS];
+  int threadid[WORK_MAX_THREADS];
+  bool running[WORK_MAX_THREADS];
+  bx_thread_sem_t start[WORK_MAX_THREADS];
+  bx_thread_sem_t done;
+} raster_pool;
+
+static BX_THREAD_VAR(raster_thread_var[WORK_MAX_THREADS]);
+/* protects the primitive currently rendered by the pool */
+static BX_MUTEX(raster_job_mutex);
+/* protects the band assignment */
+static BX_MUTEX(raster_band_mutex);
+
+static void raster_work(int threadid)
+{
+  Bit32s starty, stopy, pixels = 0;
+
+  while (1) {
+    BX_LOCK(raster_band_mutex);
+    starty = raster_pool.nexty;
+    if (starty < raster_pool.stopy)
+      raster_pool.nexty += RASTER_BAND_SCANLINES;
+    BX_UNLOCK(raster_band_mutex);
+    if (starty >= raster_pool.stopy)
+      break;
+    stopy = MIN(starty + RASTER_BAND_SCANLINES, raster_pool.stopy);
+    pixels += raster_pool.func(raster_pool.param, starty, stopy, threadid);
+  }
+  raster_pool.pixels[threadid] = pixels;
+}
+
+static BX_THREAD_FUNC(raster_thread, indata)
 {
+  int threadid = *(int*)indata;
+
+  while (1) {
+    bx_wait_sem(&raster_pool.start[threadid]);
+    if (!raster_pool.keep_alive)
+      break;
+    raster_work(threadid);
+    bx_set_sem(&raster_pool.done);
+  }
+  raster_pool.running[threadid] = 0;
+  BX_THREAD_EXIT;
+}
+
+void raster_start_threads(unsigned count)
+{
+  unsigned i;
+
+  if (count < 1)
+    count = 1;
+  else if (count > WORK_MAX_THREADS)
+    count = WORK_MAX_THREADS;
+  raster_pool.numthreads = count;
+  if (count == 1)
+    return;
+  BX_INIT_MUTEX(raster_job_mutex);
+  BX_INIT_MUTEX(raster_band_mutex);
+  bx_create_sem(&raster_pool.done);
+  raster_pool.keep_alive = 1;
+  for (i = 1; i < count; i++) {
+    raster_pool.threadid[i] = i;
+    raster_pool.running[i] = 1;
+    bx_create_sem(&raster_pool.start[i]);
+    BX_THREAD_CREATE(raster_thread, &raster_pool.threadid[i], raster_thread_var[i]);
+  }
+  BX_INFO(("using %d threads for rendering", count));
+}
+
+void raster_stop_threads(void)
+{
+  unsigned i;
+
+  if (!raster_pool.keep_alive)
+    return;
+  raster_pool.keep_alive = 0;
+  for (i = 1; i < raster_pool.numthreads; i++) {
+    bx_set_sem(&raster_pool.start[i]);
+    BX_THREAD_JOIN(raster_thread_var[i]);
+    while (raster_pool.running[i]) {
+      BX_MSLEEP(1);
+    }
+    bx_destroy_sem(&raster_pool.start[i]);
+  }
+  bx_destroy_sem(&raster_pool.done);
+  BX_FINI_MUTEX(raster_band_mutex);
+  BX_FINI_MUTEX(raster_job_mutex);
+  raster_pool.numthreads = 1;
+}
+
+Bit32u raster_dispatch(raster_band_func func, const void *param, Bit32s starty, Bit32s stopy)
+{
+  unsigned i, workers;
+  Bit32u pixels;
+
+  /* one band per thread at least, and no scanline may be visited twice */
+  /* if the Y origin transformation wraps around */
+  if ((raster_pool.numthreads <= 1) || ((Bit32u)(stopy - starty) > (Bit32u)v->fbi.clip_mask + 1))
+    return func(param, starty, stopy, 0);
+  workers = (stopy - starty - 1) / RASTER_BAND_SCANLINES;
+  if (workers >= raster_pool.numthreads)
+    workers = raster_pool.numthreads - 1;
+  if (workers == 0)
+    return func(param, starty, stopy, 0);
+
+  BX_LOCK(raster_job_mutex);
+  raster_pool.func = func;
+  raster_pool.param = param;
+  raster_pool.nexty = starty;
+  raster_pool.stopy = stopy;
+  for (i = 1; i <= workers; i++)
+    bx_set_sem(&raster_pool.start[i]);
+  raster_work(0);
+  pixels = raster_pool.pixels[0];
+  for (i = 1; i <= workers; i++)
+    bx_wait_sem(&raster_pool.done);
+  for (i = 1; i <= workers; i++)
+    pixels += raster_pool.pixels[i];
+  BX_UNLOCK(raster_job_mutex);
+  return pixels;
+}
+
+/* parameters of a triangle passed to the band renderer */
+typedef struct {
+  void *dest;
+  const rectangle *cliprect;
+  int texcount;
+  const poly_vertex *v1, *v2, *v3;
   float dxdy_v1v2, dxdy_v1v3, dxdy_v2v3;
+  const poly_extra_data *extra;
+} raster_triangle_param;
+
+static Bit32s raster_triangle_band(const void *param, Bit32s starty, Bit32s stopy, int threadid)
+{
+  const raster_triangle_param *tri = (const raster_triangle_param *)param;
+  const poly_vertex *v1 = tri->v1, *v2 = tri->v2;
+  const rectangle *cliprect = tri->cliprect;
+  Bit32s curscan;
+  Bit32s pixels = 0;
+
+  /* compute the X extents for each scanline */
+  poly_extent extent;
+  for (curscan = starty; curscan < stopy; curscan++)
+  {
+    float fully = (float)curscan + 0.5f;
+    float startx = v1->x + (fully - v1->y) * tri->dxdy_v1v3;
+    float stopx;
+    Bit32s istartx, istopx;
+
+    /* compute the ending X based on which part of the triangle we're in */
+    if (fully < v2->y)
+      stopx = v1->x + (fully - v1->y) * tri->dxdy_v1v2;
+    else
+      stopx = v2->x + (fully - v2->y) * tri->dxdy_v2v3;
+
+    /* clamp to full pixels */
+    istartx = round_coordinate(startx);
+    istopx = round_coordinate(stopx);
+
+    /* force start < stop */
+    if (istartx > istopx)
+    {
+      Bit32s temp = istartx;
+      istartx = istopx;
+      istopx = temp;
+    }
+
+    /* apply left/right clipping */
+    if (cliprect != NULL)
+    {
+      if (istartx < cliprect->min_x)
+        istartx = cliprect->min_x;
+      if (istopx > cliprect->max_x)
+        istopx = cliprect->max_x + 1;
+    }
+
+    /* set the extent and update the total pixel count */
+    if (istartx >= istopx)
+      istartx = istopx = 0;
+    extent.startx = istartx;
+    extent.stopx = istopx;
+    tri->extra->info->callback(tri->texcount, tri->dest, curscan, &extent, tri->extra, threadid);
+
+    pixels += istopx - istartx;
+  }
+
+  return pixels;
+}
+
+Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount, int paramcount, const poly_vertex *v1, const poly_vertex *v2, const poly_vertex *v3, poly_extra_data *extra)
+{
+  raster_triangle_param tri;
   const poly_vertex *tv;
-  Bit32s curscan, scaninc=1;
 
   Bit32s v1yclip, v3yclip;
   Bit32s v1y, v3y;
-  Bit32s pixels = 0;
 
   /* first sort by Y */
   if (v2->y < v1->y)
@@ -523,60 +930,22 @@ Bit32u poly_render_triangle(void *dest, const rectangle *cliprect, int texcount,
     return 0;
 
   /* compute the slopes for each portion of the triangle */
-  dxdy_v1v2 = (v2->y == v1->y) ? 0.0f : (v2->x - v1->x) / (v2->y - v1->y);
-  dxdy_v1v3 = (v3->y == v1->y) ? 0.0f : (v3->x - v1->x) / (v3->y - v1->y);
-  dxdy_v2v3 = (v3->y == v2->y) ? 0.0f : (v3->x - v2->x) / (v3->y - v2->y);
-
-  /* compute the X extents for each scanline */
-  poly_extent extent;
-  int extnum=0;
-  for (curscan = v1yclip; curscan < v3yclip; curscan += scaninc)
-  {
-    {
-      float fully = (float)(curscan + extnum) + 0.5f;
-      float startx = v1->x + (fully - v1->y) * dxdy_v1v3;
-      float stopx;
-      Bit32s istartx, istopx;
-
-      /* compute the ending X based on which part of the triangle we're in */
-      if (fully < v2->y)
-        stopx = v1->x + (fully - v1->y) * dxdy_v1v2;
-      else
-        stopx = v2->x + (fully - v2->y) * dxdy_v2v3;
-
-      /* clamp to full pixels */
-      istartx = round_coordinate(startx);
-      istopx = round_coordinate(stopx);
-
-      /* force start < stop */
-      if (istartx > istopx)
-      {
-        Bit32s temp = istartx;
-        istartx = istopx;
-        istopx = temp;
-      }
-
-      /* apply left/right clipping */
-      if (cliprect != NULL)
-      {
-        if (istartx < cliprect->min_x)
-          istartx = cliprect->min_x;
-        if (istopx > cliprect->max_x)
-          istopx = cliprect->max_x + 1;
-      }
-
-      /* set the extent and update the total pixel count */
-      if (istartx >= istopx)
-        istartx = istopx = 0;
-      extent.startx = istartx;
-      extent.stopx = istopx;
-      raster_function(texcount,dest,curscan,&extent,extra,0);
-
-      pixels += istopx - istartx;
-    }
-  }
-
-  return pixels;
+  tri.dxdy_v1v2 = (v2->y == v1->y) ? 0.0f : (v2->x - v1->x) / (v2->y - v1->y);
+  tri.dxdy_v1v3 = (v3->y == v1->y) ? 0.0f : (v3->x - v1->x) / (v3->y - v1->y);
+  tri.dxdy_v2v3 = (v3->y == v2->y) ? 0.0f : (v3->x - v2->x) / (v3->y - v2->y);
+
+  tri.dest = dest;
+  tri.cliprect = cliprect;
+  tri.texcount = texcount;
+  tri.v1 = v1;
+  tri.v2 = v2;
+  tri.v3 = v3;
+  tri.extra = extra;
+
+  /* render the scanlines, the rotating stipple pattern is updated per pixel */
+  if (FBZMODE_ENABLE_STIPPLE(v->reg[fbzMode].u) && !FBZMODE_STIPPLE_PATTERN(v->reg[fbzMode].u))
+    return raster_triangle_band(&tri, v1yclip, v3yclip, 0);
+  return raster_dispatch(raster_triangle_band, &tri, v1yclip, v3yclip);
 }
 
 Bit32s triangle_create_work_item(Bit16u *drawbuf, int texcount)
@@ -648,9 +1017,16 @@ Bit32s triangle_create_work_item(Bit16u *drawbuf, int texcount)
     }
   }
 
+  /* find a rasterizer that matches our current state */
+  extra.info = find_rasterizer(v, texcount);
+
   /* farm the rasterization out to other threads */
   retval = poly_render_triangle(drawbuf, NULL, texcount, 0, &vert[0], &vert[1], &vert[2], &extra);
 
+  /* update the rasterizer statistics */
+  extra.info->polys++;
+  extra.info->hits += retval;
+
   return retval;
 }
 
@@ -962,11 +1338,58 @@ static void raster_fastfill(void *destbase, Bit32s y, const poly_extent *extent,
 }
 
 
+/* parameters of a custom primitive passed to the band renderer */
+typedef struct {
+  void *dest;
+  const rectangle *cliprect;
+  int startscanline;
+  const poly_extent *extents;
+  const poly_extra_data *extra;
+} raster_custom_param;
+
+static Bit32s raster_custom_band(const void *param, Bit32s starty, Bit32s stopy, int threadid)
+{
+  const raster_custom_param *custom = (const raster_custom_param *)param;
+  const rectangle *cliprect = custom->cliprect;
+  Bit32s curscan;
+  Bit32s pixels = 0;
+
+  /* iterate over extents */
+  for (curscan = starty; curscan < stopy; curscan++)
+  {
+    const poly_extent *extent = &custom->extents[curscan - custom->startscanline];
+    Bit32s istartx = extent->startx, istopx = extent->stopx;
+
+    /* force start < stop */
+    if (istartx > istopx)
+    {
+      Bit32s temp = istartx;
+      istartx = istopx;
+      istopx = temp;
+    }
+
+    /* apply left/right clipping */
+    if (cliprect != NULL)
+    {
+      if (istartx < cliprect->min_x)
+        istartx = cliprect->min_x;
+      if (istopx > cliprect->max_x)
+        istopx = cliprect->max_x + 1;
+    }
+
+    /* set the extent and update the total pixel count */
+    raster_fastfill(custom->dest, curscan, extent, custom->extra, threadid);
+    if (istartx < istopx)
+      pixels += istopx - istartx;
+  }
+
+  return pixels;
+}
+
 Bit32u poly_render_triangle_custom(void *dest, const rectangle *cliprect, int startscanline, int numscanlines, const poly_extent *extents, poly_extra_data *extra)
 {
-  Bit32s curscan, scaninc;
+  raster_custom_param custom;
   Bit32s v1yclip, v3yclip;
-  Bit32s pixels = 0;
 
   /* clip coordinates */
   if (cliprect != NULL)
@@ -982,47 +1405,14 @@ Bit32u poly_render_triangle_custom(void *dest, const rectangle *cliprect, int st
   if (v3yclip - v1yclip <= 0)
     return 0;
 
-  /* compute the X extents for each scanline */
-  for (curscan = v1yclip; curscan < v3yclip; curscan += scaninc)
-  {
-    int extnum=0;
-
-    /* determine how much to advance to hit the next bucket */
-    scaninc = 1;
-
-    /* iterate over extents */
-    {
-      const poly_extent *extent = &extents[(curscan + extnum) - startscanline];
-      Bit32s istartx = extent->startx, istopx = extent->stopx;
-
-      /* force start < stop */
-      if (istartx > istopx)
-      {
-        Bit32s temp = istartx;
-        istartx = istopx;
-        istopx = temp;
-      }
-
-      /* apply left/right clipping */
-      if (cliprect != NULL)
-      {
-        if (istartx < cliprect->min_x)
-          istartx = cliprect->min_x;
-        if (istopx > cliprect->max_x)
-          istopx = cliprect->max_x + 1;
-      }
-
-      /* set the extent and update the total pixel count */
-      raster_fastfill(dest,curscan,extent,extra,0);
-      if (istartx < istopx)
-        pixels += istopx - istartx;
-    }
-  }
-#if KEEP_STATISTICS
-  poly->unit_max = MAX(poly->unit_max, poly->unit_next);
-#endif
+  custom.dest = dest;
+  custom.cliprect = cliprect;
+  custom.startscanline = startscanline;
+  custom.extents = extents;
+  custom.extra = extra;
 
-  return pixels;
+  /* render the scanlines */
+  return raster_dispatch(raster_custom_band, &custom, v1yclip, v3yclip);
 }
 
 Bit32s fastfill(voodoo_state *v)
@@ -1107,6 +1497,10 @@ void swap_buffers(voodoo_state *v)
   /* force a partial update */
   v->fbi.video_changed = 1;
 
+  /* dump the rasterizer statistics of the last frame */
+  if (LOG_RASTERIZERS)
+    dump_rasterizer_stats(v);
+
   /* keep a history of swap intervals */
   count = v->fbi.vblank_count;
   if (count > 15)
@@ -4089,6 +4483,9 @@ void voodoo_init(Bit8u _type)
 
   v->thread_stats = new stats_block[16];
 
+  /* set up the rasterizer hash table */
+  init_rasterizers(v);
+
   soft_reset(v);
 }
 
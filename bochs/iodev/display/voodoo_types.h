@@ -4,6 +4,19 @@
 
 #include <math.h>
 
+/* SSE2 is part of the x86-64 baseline, so the vector versions of the */
+/* pixel pipeline helpers are selected at compile time */
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define BX_VOODOO_SSE2 1
+#include <emmintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BX_VOODOO_SSE2 1
+#include <emmintrin.h>
+#else
+#define BX_VOODOO_SSE2 0
+#endif
+
 /***************************************************************************
     TYPE DEFINITIONS
 ***************************************************************************/
@@ -230,6 +243,20 @@ BX_CPP_INLINE Bit32s _mul_32x32_shift(Bit32s a, Bit32s b, Bit8s shift)
 
 BX_CPP_INLINE rgb_t rgba_bilinear_filter(rgb_t rgb00, rgb_t rgb01, rgb_t rgb10, rgb_t rgb11, Bit8u u, Bit8u v)
 {
+#if BX_VOODOO_SSE2
+  /* both rows at once with one channel per 16 bit lane, the scaled */
+  /* difference is computed as the high half of (2 * diff) * (128 * u), */
+  /* which gives the same rounding as the scalar code */
+  const __m128i zero = _mm_setzero_si128();
+  __m128i c0 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(rgb00), _mm_cvtsi32_si128(rgb10)), zero);
+  __m128i c1 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(rgb01), _mm_cvtsi32_si128(rgb11)), zero);
+
+  c0 = _mm_add_epi16(c0, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c1, c0), 1), _mm_set1_epi16(u << 7)));
+  c1 = _mm_unpackhi_epi64(c0, c0);
+  c0 = _mm_add_epi16(c0, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c1, c0), 1), _mm_set1_epi16(v << 7)));
+
+  return _mm_cvtsi128_si32(_mm_packus_epi16(c0, c0));
+#else
   Bit32u ag0, ag1, rb0, rb1;
 
   rb0 = (rgb00 & 0x00ff00ff) + ((((rgb01 & 0x00ff00ff) - (rgb00 & 0x00ff00ff)) * u) >> 8);
@@ -245,6 +272,7 @@ BX_CPP_INLINE rgb_t rgba_bilinear_filter(rgb_t rgb00, rgb_t rgb01, rgb_t rgb10,
   ag0 = (ag0 & 0x00ff00ff) + ((((ag1 & 0x00ff00ff) - (ag0 & 0x00ff00ff)) * v) >> 8);
 
   return ((ag0 << 8) & 0xff00ff00) | (rb0 & 0x00ff00ff);
+#endif
 }
 
 typedef struct _poly_vertex poly_vertex;
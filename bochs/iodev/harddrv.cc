@@ -155,7 +155,7 @@ bx_hard_drive_c::~bx_hard_drive_c()
         channels[channel].drives[device].cdrom.cd = NULL;
       }
       if (channels[channel].drives[device].controller.buffer != NULL) {
-        delete [] channels[channel].drives[device].controller.buffer;
+        bx_free_image_buffer(channels[channel].drives[device].controller.buffer);
       }
       char ata_name[20];
       sprintf(ata_name, "ata.%d.%s", channel, (device==0)?"master":"slave");
@@ -279,6 +279,8 @@ void bx_hard_drive_c::init(void)
       // If not present
       BX_HD_THIS channels[channel].drives[device].device_type  = IDE_NONE;
       BX_HD_THIS channels[channel].drives[device].identify_set = 0;
+      BX_HD_THIS channels[channel].drives[device].has_write_cache = 0;
+      BX_HD_THIS channels[channel].drives[device].write_cache = 0;
       if (SIM->get_param_enum("type", base)->get() == BX_ATA_DEVICE_NONE) continue;
 
       // Make model string
@@ -313,13 +315,28 @@ void bx_hard_drive_c::init(void)
           // it's safe to return here on failure
           return;
         }
+        if (SIM->get_param_enum("cache", base)->get() == BX_ATA_CACHE_WRITEBACK) {
+          channels[channel].drives[device].hdimage =
+            DEV_hdimage_init_wbcache(channels[channel].drives[device].hdimage);
+          BX_HD_THIS channels[channel].drives[device].has_write_cache = 1;
+          BX_HD_THIS channels[channel].drives[device].write_cache = 1;
+        }
         BX_HD_THIS channels[channel].drives[device].hdimage->cylinders = cyl;
         BX_HD_THIS channels[channel].drives[device].hdimage->heads = heads;
         BX_HD_THIS channels[channel].drives[device].hdimage->spt = spt;
         BX_HD_THIS channels[channel].drives[device].hdimage->sect_size = sect_size;
 
         /* open hard drive image file */
-        if ((BX_HD_THIS channels[channel].drives[device].hdimage->open(SIM->get_param_string("path", base)->getptr())) < 0) {
+        int open_flags = O_RDWR;
+        if (SIM->get_param_enum("cache", base)->get() == BX_ATA_CACHE_NONE) {
+          if ((HDIMAGE_OPEN_DIRECT != 0) &&
+              (!strcmp(image_mode, "flat") || !strcmp(image_mode, "concat"))) {
+            open_flags |= HDIMAGE_OPEN_DIRECT;
+          } else {
+            BX_ERROR(("ata%d-%d: cache mode 'none' not supported for '%s' mode", channel, device, image_mode));
+          }
+        }
+        if ((BX_HD_THIS channels[channel].drives[device].hdimage->open(SIM->get_param_string("path", base)->getptr(), open_flags)) < 0) {
           BX_PANIC(("ata%d-%d: could not open hard drive image file '%s'", channel, device, SIM->get_param_string("path", base)->getptr()));
           return;
         }
@@ -432,7 +449,7 @@ void bx_hard_drive_c::init(void)
       }
       if (SIM->get_param_enum("type", base)->get() != BX_ATA_DEVICE_NONE) {
         BX_HD_THIS channels[channel].drives[device].controller.buffer =
-          new Bit8u[BX_HD_THIS channels[channel].drives[device].controller.buffer_total_size + 4];
+          bx_alloc_image_buffer(BX_HD_THIS channels[channel].drives[device].controller.buffer_total_size + 4);
         // register timer for HD/CD seek emulation
         if (BX_DRIVE(channel,device).seek_timer_index == BX_NULL_TIMER_HANDLE) {
           BX_DRIVE(channel,device).seek_timer_index =
@@ -589,6 +606,9 @@ void bx_hard_drive_c::register_state(void)
         if (channels[i].drives[j].hdimage != NULL) {
           channels[i].drives[j].hdimage->register_state(drive);
         }
+        if (BX_DRIVE_IS_HD(i, j)) {
+          BXRS_PARAM_BOOL(drive, write_cache, BX_HD_THIS channels[i].drives[j].write_cache);
+        }
         if (BX_DRIVE_IS_CD(i, j)) {
           bx_list_c *cdrom = new bx_list_c(drive, "cdrom");
           BXRS_PARAM_BOOL(cdrom, locked, BX_HD_THIS channels[i].drives[j].cdrom.locked);
@@ -1194,6 +1214,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
         case 0xC5: // WRITE MULTIPLE SECTORS
         case 0x34: // WRITE SECTORS EXT
         case 0x39: // WRITE MULTIPLE EXT
+        case 0xCE: // WRITE MULTIPLE FUA EXT
           if (controller->buffer_index >= controller->buffer_size)
             BX_PANIC(("IO write(0x%04x): buffer_index >= %d", address, controller->buffer_size));
 
@@ -1231,7 +1252,8 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
             if (ide_write_sector(channel, controller->buffer,
                                  controller->buffer_size)) {
               if ((controller->current_command == 0xC5) ||
-                  (controller->current_command == 0x39)) {
+                  (controller->current_command == 0x39) ||
+                  (controller->current_command == 0xCE)) {
                 if (controller->num_sectors > controller->multiple_sectors) {
                   controller->buffer_size = controller->multiple_sectors * sect_size;
                 } else {
@@ -1259,6 +1281,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
                 controller->status.err = 0;
                 controller->status.corrected_data = 0;
                 BX_SELECTED_DRIVE(channel).curr_lsector = BX_SELECTED_DRIVE(channel).next_lsector;
+                write_completed(channel);
               }
               raise_interrupt(channel);
             }
@@ -2086,6 +2109,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 
         case 0x34: // WRITE SECTORS EXT
         case 0x39: // WRITE MULTIPLE EXT
+        case 0xCE: // WRITE MULTIPLE FUA EXT
           lba48 = 1;
         case 0x30: // WRITE SECTORS, with retries
         case 0xC5: // WRITE MULTIPLE SECTORS
@@ -2104,7 +2128,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
             break;
           }
           lba48_transform(controller, lba48);
-          if ((value == 0xC5) || (value ==0x39)) {
+          if ((value == 0xC5) || (value == 0x39) || (value == 0xCE)) {
             if (controller->multiple_sectors == 0) {
               command_aborted(channel, value);
               break;
@@ -2268,6 +2292,26 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
 
             case 0x02: // Enable and
             case 0x82: //  Disable write cache.
+              if (BX_SELECTED_IS_HD(channel)) {
+                if (!BX_SELECTED_DRIVE(channel).has_write_cache) {
+                  command_aborted(channel, value);
+                  break;
+                }
+                BX_SELECTED_DRIVE(channel).write_cache = (controller->features == 0x02);
+                BX_INFO(("ata%d-%d: write cache %s", channel, BX_SLAVE_SELECTED(channel),
+                         BX_SELECTED_DRIVE(channel).write_cache ? "enabled" : "disabled"));
+                if (!BX_SELECTED_DRIVE(channel).write_cache &&
+                    (BX_SELECTED_DRIVE(channel).hdimage->sync() < 0)) {
+                  command_aborted(channel, value);
+                  break;
+                }
+                BX_SELECTED_DRIVE(channel).identify_set = 0;
+              }
+              controller->status.drive_ready = 1;
+              controller->status.seek_complete = 1;
+              raise_interrupt(channel);
+              break;
+
             case 0xAA: // Enable and
             case 0x55: //  Disable look-ahead cache.
             case 0xCC: // Enable and
@@ -2421,11 +2465,26 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           }
           break;
 
-        // power management & flush cache stubs
-        case 0xE0: // STANDBY NOW
-        case 0xE1: // IDLE IMMEDIATE
         case 0xE7: // FLUSH CACHE
         case 0xEA: // FLUSH CACHE EXT
+          // also without cache=writeback: images with deferred metadata
+          // (growing, undoable, vmware4, ...) write it back here
+          if (BX_SELECTED_IS_HD(channel) &&
+              (BX_SELECTED_DRIVE(channel).hdimage->sync() < 0)) {
+            BX_ERROR(("ata%d-%d: FLUSH CACHE failed", channel, BX_SLAVE_SELECTED(channel)));
+            command_aborted(channel, value);
+            break;
+          }
+          controller->status.busy = 0;
+          controller->status.drive_ready = 1;
+          controller->status.write_fault = 0;
+          controller->status.drq = 0;
+          raise_interrupt(channel);
+          break;
+
+        // power management stubs
+        case 0xE0: // STANDBY NOW
+        case 0xE1: // IDLE IMMEDIATE
           controller->status.busy = 0;
           controller->status.drive_ready = 1;
           controller->status.write_fault = 0;
@@ -2489,6 +2548,7 @@ void bx_hard_drive_c::write(Bit32u address, Bit32u value, unsigned io_len)
           break;
 
         case 0x35: // WRITE DMA EXT
+        case 0x3D: // WRITE DMA FUA EXT
           lba48 = 1;
         case 0xCA: // WRITE DMA
           if (BX_SELECTED_IS_HD(channel) && BX_HD_THIS bmdma_present()) {
@@ -3063,7 +3123,10 @@ void bx_hard_drive_c::identify_drive(Bit8u channel)
   //           2 supports removable media feature set
   //           1 supports securite mode feature set
   //           0 support SMART feature set
-  BX_SELECTED_DRIVE(channel).id_drive[82] = 1 << 14;
+  BX_SELECTED_DRIVE(channel).id_drive[82] = (1 << 14);
+  if (BX_SELECTED_DRIVE(channel).has_write_cache) {
+    BX_SELECTED_DRIVE(channel).id_drive[82] |= (1 << 5);
+  }
 
   // Word 83: 15 shall be ZERO
   //          14 shall be ONE
@@ -3082,8 +3145,14 @@ void bx_hard_drive_c::identify_drive(Bit8u channel)
   //           1 READ/WRITE DMA QUEUED commands supported
   //           0 Download MicroCode supported
   BX_SELECTED_DRIVE(channel).id_drive[83] = (1 << 14) | (1 << 13) | (1 << 12) | (1 << 10);
-  BX_SELECTED_DRIVE(channel).id_drive[84] = 1 << 14;
-  BX_SELECTED_DRIVE(channel).id_drive[85] = 1 << 14;
+  // Word 84: 14 shall be ONE
+  //           6 WRITE DMA FUA EXT and WRITE MULTIPLE FUA EXT supported
+  BX_SELECTED_DRIVE(channel).id_drive[84] = (1 << 14) | (1 << 6);
+  // Word 85: same as word 82, enabled features
+  BX_SELECTED_DRIVE(channel).id_drive[85] = (1 << 14);
+  if (BX_SELECTED_DRIVE(channel).write_cache) {
+    BX_SELECTED_DRIVE(channel).id_drive[85] |= (1 << 5);
+  }
 
   // Word 86: 15 shall be ZERO
   //          14 shall be ONE
@@ -3102,7 +3171,7 @@ void bx_hard_drive_c::identify_drive(Bit8u channel)
   //           1 READ/WRITE DMA QUEUED commands enabled
   //           0 Download MicroCode enabled
   BX_SELECTED_DRIVE(channel).id_drive[86] = (1 << 14) | (1 << 13) | (1 << 12) | (1 << 10);
-  BX_SELECTED_DRIVE(channel).id_drive[87] = 1 << 14;
+  BX_SELECTED_DRIVE(channel).id_drive[87] = (1 << 14) | (1 << 6);
 
   if (BX_HD_THIS bmdma_present()) {
     BX_SELECTED_DRIVE(channel).id_drive[88] = 0x3f | (BX_SELECTED_CONTROLLER(channel).udma_mode << 8);
@@ -3389,9 +3458,11 @@ bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *se
 
   if ((controller->current_command == 0xC8) ||
       (controller->current_command == 0x25)) {
-    *sector_size = BX_SELECTED_DRIVE(channel).hdimage->sect_size;
     if (controller->num_sectors == 0)
       return 0;
+    // read as many sectors as the current PRD can take
+    *sector_size = bmdma_sector_count(channel, *sector_size) *
+                   BX_SELECTED_DRIVE(channel).sect_size;
     if (!ide_read_sector(channel, buffer, *sector_size)) {
       return 0;
     }
@@ -3443,24 +3514,40 @@ bool bx_hard_drive_c::bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *se
   return 1;
 }
 
-bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer)
+bool bx_hard_drive_c::bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size)
 {
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
 
   if ((controller->current_command != 0xCA) &&
-      (controller->current_command != 0x35)) {
+      (controller->current_command != 0x35) &&
+      (controller->current_command != 0x3D)) {
     BX_ERROR(("DMA write not active"));
     command_aborted(channel, controller->current_command);
     return 0;
   }
   if (controller->num_sectors == 0)
     return 0;
-  if (!ide_write_sector(channel, buffer, BX_SELECTED_DRIVE(channel).sect_size)) {
+  *sector_size = bmdma_sector_count(channel, *sector_size) *
+                 BX_SELECTED_DRIVE(channel).sect_size;
+  if (!ide_write_sector(channel, buffer, *sector_size)) {
     return 0;
   }
   return 1;
 }
 
+Bit32u bx_hard_drive_c::bmdma_sector_count(Bit8u channel, Bit32u size)
+{
+  controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
+
+  Bit32u count = size / BX_SELECTED_DRIVE(channel).sect_size;
+  if (count == 0) {
+    count = 1;
+  } else if (count > controller->num_sectors) {
+    count = controller->num_sectors;
+  }
+  return count;
+}
+
 void bx_hard_drive_c::bmdma_complete(Bit8u channel)
 {
   controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
@@ -3478,6 +3565,11 @@ void bx_hard_drive_c::bmdma_complete(Bit8u channel)
     controller->status.seek_complete = 1;
     controller->status.corrected_data = 0;
     BX_SELECTED_DRIVE(channel).curr_lsector = BX_SELECTED_DRIVE(channel).next_lsector;
+    if ((controller->current_command == 0xCA) ||
+        (controller->current_command == 0x35) ||
+        (controller->current_command == 0x3D)) {
+      write_completed(channel);
+    }
   }
   raise_interrupt(channel);
 }
@@ -3508,30 +3600,34 @@ bool bx_hard_drive_c::ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u buffe
 
   unsigned sect_size = BX_SELECTED_DRIVE(channel).sect_size;
   int sector_count = (buffer_size / sect_size);
-  Bit8u *bufptr = buffer;
+  if (!calculate_logical_address(channel, &logical_sector)) {
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  // all sectors of the buffer are consecutive: transfer them at once
+  if ((logical_sector + sector_count) > (Bit64s)(BX_SELECTED_DRIVE(channel).hdimage->hd_size / sect_size)) {
+    BX_ERROR(("logical address out of bounds (" FMT_LL "d+%d) - aborting command", logical_sector, sector_count));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
+  if (ret < 0) {
+    BX_ERROR(("could not lseek() hard drive image file"));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  /* set status bar conditions for device */
+  bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
+  ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)buffer, sector_count * sect_size);
+  if (ret < (Bit64s)(sector_count * sect_size)) {
+    BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
   do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file"));
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->read((bx_ptr_t)bufptr, sect_size);
-    if (ret < sect_size) {
-      BX_ERROR(("could not read() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
     increment_address(channel, &logical_sector);
-    BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
-    bufptr += sect_size;
   } while (--sector_count > 0);
+  BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
 
   return 1;
 }
@@ -3545,34 +3641,61 @@ bool bx_hard_drive_c::ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u buff
 
   unsigned sect_size = BX_SELECTED_DRIVE(channel).sect_size;
   int sector_count = (buffer_size / sect_size);
-  Bit8u *bufptr = buffer;
+  if (!calculate_logical_address(channel, &logical_sector)) {
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  // all sectors of the buffer are consecutive: transfer them at once
+  if ((logical_sector + sector_count) > (Bit64s)(BX_SELECTED_DRIVE(channel).hdimage->hd_size / sect_size)) {
+    BX_ERROR(("logical address out of bounds (" FMT_LL "d+%d) - aborting command", logical_sector, sector_count));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
+  if (ret < 0) {
+    BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * sect_size));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
+  /* set status bar conditions for device */
+  bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
+  ret = BX_SELECTED_DRIVE(channel).hdimage->write((bx_ptr_t)buffer, sector_count * sect_size);
+  if (ret < (Bit64s)(sector_count * sect_size)) {
+    BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
+    command_aborted(channel, controller->current_command);
+    return 0;
+  }
   do {
-    if (!calculate_logical_address(channel, &logical_sector)) {
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
-    ret = BX_SELECTED_DRIVE(channel).hdimage->lseek(logical_sector * sect_size, SEEK_SET);
-    if (ret < 0) {
-      BX_ERROR(("could not lseek() hard drive image file at byte %lu", (unsigned long)logical_sector * sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
-    /* set status bar conditions for device */
-    bx_gui->statusbar_setitem(BX_SELECTED_DRIVE(channel).statusbar_id, 1, 1 /* write */);
-    ret = BX_SELECTED_DRIVE(channel).hdimage->write((bx_ptr_t)bufptr, sect_size);
-    if (ret < sect_size) {
-      BX_ERROR(("could not write() hard drive image file at byte %lu", (unsigned long)logical_sector*sect_size));
-      command_aborted(channel, controller->current_command);
-      return 0;
-    }
     increment_address(channel, &logical_sector);
-    BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
-    bufptr += sect_size;
   } while (--sector_count > 0);
+  BX_SELECTED_DRIVE(channel).next_lsector = logical_sector;
 
   return 1;
 }
 
+// Called when a write command has transferred all sectors. Forced unit
+// access and a disabled write cache require the data on stable storage.
+// Without cache=writeback the image is written like before (no syncs).
+void bx_hard_drive_c::write_completed(Bit8u channel)
+{
+  controller_t *controller = &BX_SELECTED_CONTROLLER(channel);
+
+  if (!BX_SELECTED_DRIVE(channel).has_write_cache) {
+    return;
+  }
+  if ((controller->current_command == 0x3D) ||
+      (controller->current_command == 0xCE) ||
+      !BX_SELECTED_DRIVE(channel).write_cache) {
+    if (BX_SELECTED_DRIVE(channel).hdimage->sync() < 0) {
+      BX_ERROR(("ata%d-%d: could not sync image to disk", channel,
+                BX_SLAVE_SELECTED(channel)));
+      controller->status.write_fault = 1;
+      controller->status.err = 1;
+      controller->error_register = 0x04; // command aborted
+    }
+  }
+}
+
 void bx_hard_drive_c::lba48_transform(controller_t *controller, bool lba48)
 {
   controller->lba48 = lba48;
@@ -172,7 +172,7 @@ public:
   virtual void     reset(unsigned type);
 #if BX_SUPPORT_PCI
   virtual bool     bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
-  virtual bool     bmdma_write_sector(Bit8u channel, Bit8u *buffer);
+  virtual bool     bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size);
   virtual void     bmdma_complete(Bit8u channel);
 #endif
   virtual void     register_state(void);
@@ -215,9 +215,13 @@ private:
   BX_HD_SMF void init_mode_sense_single(Bit8u channel, const void* src, int size);
   BX_HD_SMF void atapi_cmd_nop(controller_t *controller) BX_CPP_AttrRegparmN(1);
   BX_HD_SMF bool bmdma_present(void);
+#if BX_SUPPORT_PCI
+  BX_HD_SMF Bit32u bmdma_sector_count(Bit8u channel, Bit32u size);
+#endif
   BX_HD_SMF void set_signature(Bit8u channel, Bit8u id);
   BX_HD_SMF bool ide_read_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
   BX_HD_SMF bool ide_write_sector(Bit8u channel, Bit8u *buffer, Bit32u buffer_size);
+  BX_HD_SMF void write_completed(Bit8u channel);
   BX_HD_SMF void lba48_transform(controller_t *controller, bool lba48);
   BX_HD_SMF void start_seek(Bit8u channel);
 
@@ -239,6 +243,8 @@ private:
       // there's no need to keep them in x86 endian format.
       Bit16u id_drive[256];
       bool identify_set;
+      bool has_write_cache; // write cache reported (cache=writeback)
+      bool write_cache; // guest-visible write cache enabled
 
       controller_t controller;
       cdrom_t cdrom;
@@ -173,6 +173,11 @@ device_image_t* bx_hdimage_ctl_c::init_image(const char *image_mode, Bit64u disk
   return hdimage;
 }
 
+device_image_t* bx_hdimage_ctl_c::init_wbcache(device_image_t *image)
+{
+  return new wbcache_image_t(image);
+}
+
 cdrom_base_c* bx_hdimage_ctl_c::init_cdrom(const char *dev)
 {
 #if BX_SUPPORT_CDROM
@@ -320,6 +325,207 @@ int bx_close_image(int fd, const char *pathname)
   return ::close(fd);
 }
 
+int bx_sync_image(int fd)
+{
+#ifdef WIN32
+  return _commit(fd);
+#elif defined(_POSIX_SYNCHRONIZED_IO) && (_POSIX_SYNCHRONIZED_IO > 0)
+  return fdatasync(fd);
+#else
+  return fsync(fd);
+#endif
+}
+
+// Pool of aligned I/O buffers. Released buffers are kept for reuse, so the
+// bounce buffers of uncached images don't hit the allocator on every request.
+
+#define HDIMAGE_BUFFER_POOL_SIZE 16
+
+static struct {
+  Bit8u *buffer;
+  size_t size;
+  bool   in_use;
+} image_buffer_pool[HDIMAGE_BUFFER_POOL_SIZE];
+
+// The pointer returned by new is stored in front of the aligned buffer
+static Bit8u *alloc_aligned_buffer(size_t size)
+{
+  Bit8u *vector = new Bit8u[size + sizeof(Bit8u*) + HDIMAGE_BUFFER_ALIGN - 1];
+  Bit8u *buffer = (Bit8u*)(((bx_ptr_equiv_t)vector + sizeof(Bit8u*) + HDIMAGE_BUFFER_ALIGN - 1) &
+                           ~(bx_ptr_equiv_t)(HDIMAGE_BUFFER_ALIGN - 1));
+  ((Bit8u**)buffer)[-1] = vector;
+  return buffer;
+}
+
+static void free_aligned_buffer(Bit8u *buffer)
+{
+  delete [] ((Bit8u**)buffer)[-1];
+}
+
+Bit8u *bx_alloc_image_buffer(size_t size)
+{
+  int i, slot = -1;
+
+  size = (size + HDIMAGE_BUFFER_ALIGN - 1) & ~(size_t)(HDIMAGE_BUFFER_ALIGN - 1);
+  for (i = 0; i < HDIMAGE_BUFFER_POOL_SIZE; i++) {
+    if (image_buffer_pool[i].in_use) continue;
+    if (image_buffer_pool[i].buffer == NULL) {
+      if (slot < 0) slot = i;
+    } else if (image_buffer_pool[i].size >= size) {
+      image_buffer_pool[i].in_use = 1;
+      return image_buffer_pool[i].buffer;
+    } else if (slot < 0) {
+      slot = i;
+    }
+  }
+  Bit8u *buffer = alloc_aligned_buffer(size);
+  if (slot >= 0) {
+    // take a free slot or replace an unused buffer that is too small
+    if (image_buffer_pool[slot].buffer != NULL) {
+      free_aligned_buffer(image_buffer_pool[slot].buffer);
+    }
+    image_buffer_pool[slot].buffer = buffer;
+    image_buffer_pool[slot].size = size;
+    image_buffer_pool[slot].in_use = 1;
+  }
+  return buffer;
+}
+
+void bx_free_image_buffer(Bit8u *buf)
+{
+  if (buf == NULL) return;
+  for (int i = 0; i < HDIMAGE_BUFFER_POOL_SIZE; i++) {
+    if (image_buffer_pool[i].buffer == buf) {
+      image_buffer_pool[i].in_use = 0;
+      return;
+    }
+  }
+  free_aligned_buffer(buf);
+}
+
+// Uncached I/O at file offset 'offset' (the current position of 'fd').
+// The kernel only accepts offsets, sizes and buffer addresses aligned to the
+// logical block size 'align' (see direct_io_alignment()). Other requests are
+// done through a bounce buffer (read-modify-write of the partial blocks on
+// write).
+
+// Returns the uncached I/O granularity of 'fd' or 0 if it is not usable
+static unsigned direct_io_alignment(int fd)
+{
+  unsigned align = HDIMAGE_DIRECT_ALIGN;
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+  if ((statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0) &&
+      (stx.stx_mask & STATX_DIOALIGN)) {
+    if (stx.stx_dio_offset_align == 0) return 0; // not supported for this file
+    align = stx.stx_dio_offset_align;
+    if (stx.stx_dio_mem_align > align) align = stx.stx_dio_mem_align;
+  }
+#endif
+#if defined(linux) && defined(BLKSSZGET)
+  struct stat stat_buf;
+  int ssz = 0;
+  if ((fstat(fd, &stat_buf) == 0) && S_ISBLK(stat_buf.st_mode) &&
+      (ioctl(fd, BLKSSZGET, &ssz) == 0) && (ssz > (int)align)) {
+    align = (unsigned)ssz;
+  }
+#endif
+  // the bounce buffers are only HDIMAGE_BUFFER_ALIGN aligned
+  if ((align > HDIMAGE_BUFFER_ALIGN) || ((align & (align - 1)) != 0)) {
+    return 0;
+  }
+  return align;
+}
+
+// Switch 'fd' back to cached I/O (e.g. after the kernel rejected a request)
+static void direct_io_disable(int fd)
+{
+#ifdef O_DIRECT
+  int flags = fcntl(fd, F_GETFL);
+  if (flags != -1) {
+    fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+  }
+#endif
+}
+
+static inline bool direct_io_aligned(Bit64s offset, const void *buf, size_t count, unsigned align)
+{
+  return ((((bx_ptr_equiv_t)offset | (bx_ptr_equiv_t)buf | count) & (align - 1)) == 0);
+}
+
+static ssize_t direct_io_read(int fd, Bit64s offset, void *buf, size_t count, unsigned align)
+{
+  if (direct_io_aligned(offset, buf, count, align)) {
+    return ::read(fd, buf, count);
+  }
+  Bit64s start = offset & ~(Bit64s)(align - 1);
+  size_t head = (size_t)(offset - start);
+  size_t len = (head + count + align - 1) & ~(size_t)(align - 1);
+  Bit8u *bounce = bx_alloc_image_buffer(len);
+  ssize_t ret = bx_read_image(fd, start, bounce, (int)len);
+  if (ret >= 0) {
+    ret = (ret > (ssize_t)head) ? (ret - head) : 0;
+    if (ret > (ssize_t)count) ret = count;
+    memcpy(buf, bounce + head, ret);
+    ::lseek(fd, (off_t)(offset + ret), SEEK_SET);
+  }
+  bx_free_image_buffer(bounce);
+  return ret;
+}
+
+// Fetch the block at 'start' for a read-modify-write. Blocks at or beyond
+// the end of the file are not read, the part past EOF is zero-filled.
+static ssize_t direct_io_fetch_block(int fd, Bit64s start, Bit8u *block, unsigned align, Bit64s fsize)
+{
+  ssize_t ret = 0;
+  if (start < fsize) {
+    ret = bx_read_image(fd, start, block, align);
+    if (ret < 0) return ret;
+  }
+  if (ret < (ssize_t)align) {
+    memset(block + ret, 0, align - ret);
+  }
+  return align;
+}
+
+static ssize_t direct_io_write(int fd, Bit64s offset, const void *buf, size_t count, unsigned align)
+{
+  if (direct_io_aligned(offset, buf, count, align)) {
+    return ::write(fd, buf, count);
+  }
+  Bit64s start = offset & ~(Bit64s)(align - 1);
+  size_t head = (size_t)(offset - start);
+  size_t len = (head + count + align - 1) & ~(size_t)(align - 1);
+  size_t tail = (head + count) & (align - 1);
+  Bit8u *bounce = bx_alloc_image_buffer(len);
+  ssize_t ret = 0;
+  if ((head > 0) || (tail > 0)) {
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) < 0) {
+      ret = -1;
+    }
+    // fetch the partial first and last block
+    if ((ret >= 0) && (head > 0)) {
+      ret = direct_io_fetch_block(fd, start, bounce, align, stat_buf.st_size);
+    }
+    if ((ret >= 0) && (tail > 0) && ((head == 0) || (len > align))) {
+      ret = direct_io_fetch_block(fd, start + len - align, bounce + len - align,
+                                  align, stat_buf.st_size);
+    }
+  }
+  if (ret >= 0) {
+    memcpy(bounce + head, buf, count);
+    ret = bx_write_image(fd, start, bounce, (int)len);
+    if (ret >= 0) {
+      ret = (ret > (ssize_t)head) ? (ret - head) : 0;
+      if (ret > (ssize_t)count) ret = count;
+      ::lseek(fd, (off_t)(offset + ret), SEEK_SET);
+    }
+  }
+  bx_free_image_buffer(bounce);
+  return ret;
+}
+
 #ifndef WIN32
 int hdimage_open_file(const char *pathname, int flags, Bit64u *fsize, time_t *mtime)
 #else
@@ -510,7 +716,7 @@ void hdimage_restore_handler(void *class_ptr, bx_param_c *param, Bit64s value)
 
 bool hdimage_backup_file(int fd, const char *backup_fname)
 {
-  char *buf;
+  Bit8u *buf;
   off_t offset;
   int nread, size;
   bool ret = 1;
@@ -523,11 +729,8 @@ bool hdimage_backup_file(int fd, const char *backup_fname)
   if (backup_fd >= 0) {
     offset = 0;
     size = 0x20000;
-    buf = new char[size];
-    if (buf == NULL) {
-      ::close(backup_fd);
-      return 0;
-    }
+    // aligned buffer, the image may be opened for uncached I/O
+    buf = bx_alloc_image_buffer(size);
     while ((nread = bx_read_image(fd, offset, buf, size)) > 0) {
       if (bx_write_image(backup_fd, offset, buf, nread) < 0) {
         ret = 0;
@@ -541,7 +744,7 @@ bool hdimage_backup_file(int fd, const char *backup_fname)
     if (nread < 0) {
       ret = 0;
     }
-    delete [] buf;
+    bx_free_image_buffer(buf);
     ::close(backup_fd);
     return ret;
   }
@@ -656,9 +859,23 @@ void device_image_t::register_state(bx_list_c *parent)
 int flat_image_t::open(const char* _pathname, int flags)
 {
   pathname = _pathname;
+  direct = (HDIMAGE_OPEN_DIRECT != 0) && ((flags & HDIMAGE_OPEN_DIRECT) != 0);
   if ((fd = hdimage_open_file(pathname, flags, &hd_size, &mtime)) < 0) {
-    return -1;
+    if (!direct || (errno != EINVAL)) {
+      return -1;
+    }
+    BX_INFO(("'%s': uncached I/O not supported by host filesystem", pathname));
+    direct = 0;
+    if ((fd = hdimage_open_file(pathname, flags & ~HDIMAGE_OPEN_DIRECT, &hd_size, &mtime)) < 0) {
+      return -1;
+    }
+  }
+  if (direct && ((direct_align = direct_io_alignment(fd)) == 0)) {
+    BX_INFO(("'%s': uncached I/O granularity not supported", pathname));
+    direct_io_disable(fd);
+    direct = 0;
   }
+  curr_pos = 0;
   BX_INFO(("hd_size: " FMT_LL "u", hd_size));
   if (hd_size <= 0) BX_PANIC(("size of disk image not detected / invalid"));
   if ((hd_size % sect_size) != 0) {
@@ -676,17 +893,78 @@ void flat_image_t::close()
 
 Bit64s flat_image_t::lseek(Bit64s offset, int whence)
 {
-  return (Bit64s)::lseek(fd, (off_t)offset, whence);
+  curr_pos = (Bit64s)::lseek(fd, (off_t)offset, whence);
+  return curr_pos;
 }
 
 ssize_t flat_image_t::read(void* buf, size_t count)
 {
-  return ::read(fd, (char*) buf, count);
+  ssize_t ret;
+
+  if (direct) {
+    ret = direct_io_read(fd, curr_pos, buf, count, direct_align);
+    if ((ret < 0) && (errno == EINVAL)) {
+      disable_direct();
+      ret = bx_read_image(fd, curr_pos, buf, (int)count);
+    }
+  } else {
+    ret = ::read(fd, (char*) buf, count);
+  }
+  if (ret > 0) curr_pos += ret;
+  return ret;
 }
 
 ssize_t flat_image_t::write(const void* buf, size_t count)
 {
-  return ::write(fd, (char*) buf, count);
+  ssize_t ret;
+
+  if (direct) {
+    ret = direct_io_write(fd, curr_pos, buf, count, direct_align);
+    if ((ret < 0) && (errno == EINVAL)) {
+      disable_direct();
+      ret = bx_write_image(fd, curr_pos, (void*)buf, (int)count);
+    }
+  } else {
+    ret = ::write(fd, (char*) buf, count);
+  }
+  if (ret > 0) curr_pos += ret;
+  return ret;
+}
+
+void flat_image_t::disable_direct()
+{
+  BX_INFO(("'%s': uncached I/O rejected by host, using cached I/O", pathname));
+  direct_io_disable(fd);
+  direct = 0;
+}
+
+int flat_image_t::sync()
+{
+  return bx_sync_image(fd);
+}
+
+bool flat_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  Bit64s data, hole;
+  bool allocated = 1;
+
+  data = (Bit64s)::lseek(fd, (off_t)offset, SEEK_DATA);
+  if (data < 0) {
+    // ENXIO: only a hole up to the end of file follows
+    allocated = (errno != ENXIO);
+  } else if (data > offset) {
+    allocated = 0;
+    if ((data - offset) < *length) *length = data - offset;
+  } else {
+    hole = (Bit64s)::lseek(fd, (off_t)offset, SEEK_HOLE);
+    if ((hole > offset) && ((hole - offset) < *length)) *length = hole - offset;
+  }
+  ::lseek(fd, (off_t)curr_pos, SEEK_SET);
+  return allocated;
+#else
+  return 1;
+#endif
 }
 
 int flat_image_t::check_format(int fd, Bit64u imgsize)
@@ -715,7 +993,7 @@ void flat_image_t::restore_state(const char *backup_fname)
     BX_PANIC(("Failed to restore image '%s'", pathname));
     return;
   }
-  if (device_image_t::open(pathname) < 0) {
+  if (open(pathname, O_RDWR | (direct ? HDIMAGE_OPEN_DIRECT : 0)) < 0) {
     BX_PANIC(("Failed to open restored image '%s'", pathname));
   }
 }
@@ -749,14 +1027,27 @@ void concat_image_t::increment_string(char *str)
 
 int concat_image_t::open(const char* _pathname0, int flags)
 {
-  UNUSED(flags);
   pathname0 = _pathname0;
   char *pathname1 = new char[strlen(pathname0) + 1];
   strcpy(pathname1, pathname0);
   BX_DEBUG(("concat_image_t::open"));
+  direct = (HDIMAGE_OPEN_DIRECT != 0) && ((flags & HDIMAGE_OPEN_DIRECT) != 0);
   Bit64s start_offset = 0;
   for (int i=0; i<BX_CONCAT_MAX_IMAGES; i++) {
     fd_table[i] = hdimage_open_file(pathname1, flags, &length_table[i], NULL);
+    if ((fd_table[i] < 0) && (i == 0) && direct && (errno == EINVAL)) {
+      BX_INFO(("'%s': uncached I/O not supported by host filesystem", pathname1));
+      direct = 0;
+      flags &= ~HDIMAGE_OPEN_DIRECT;
+      fd_table[i] = hdimage_open_file(pathname1, flags, &length_table[i], NULL);
+    }
+    if ((fd_table[i] >= 0) && (i == 0) && direct &&
+        ((direct_align = direct_io_alignment(fd_table[i])) == 0)) {
+      BX_INFO(("'%s': uncached I/O granularity not supported", pathname1));
+      direct_io_disable(fd_table[i]);
+      direct = 0;
+      flags &= ~HDIMAGE_OPEN_DIRECT;
+    }
     if (fd_table[i] < 0) {
       // open failed.
       // if no FD was opened successfully, return -1 (fail).
@@ -863,6 +1154,41 @@ Bit64s concat_image_t::lseek(Bit64s offset, int whence)
   return (Bit64s)::lseek(curr_fd, (off_t)offset, SEEK_SET);
 }
 
+ssize_t concat_image_t::concat_read(void* buf, size_t count)
+{
+  if (direct) {
+    ssize_t ret = direct_io_read(curr_fd, total_offset - curr_min, buf, count, direct_align);
+    if ((ret >= 0) || (errno != EINVAL)) {
+      return ret;
+    }
+    disable_direct();
+    return bx_read_image(curr_fd, total_offset - curr_min, buf, (int)count);
+  }
+  return ::read(curr_fd, buf, count);
+}
+
+ssize_t concat_image_t::concat_write(const void* buf, size_t count)
+{
+  if (direct) {
+    ssize_t ret = direct_io_write(curr_fd, total_offset - curr_min, buf, count, direct_align);
+    if ((ret >= 0) || (errno != EINVAL)) {
+      return ret;
+    }
+    disable_direct();
+    return bx_write_image(curr_fd, total_offset - curr_min, (void*)buf, (int)count);
+  }
+  return ::write(curr_fd, buf, count);
+}
+
+void concat_image_t::disable_direct()
+{
+  BX_INFO(("'%s': uncached I/O rejected by host, using cached I/O", pathname0));
+  for (int i = 0; i < maxfd; i++) {
+    direct_io_disable(fd_table[i]);
+  }
+  direct = 0;
+}
+
 ssize_t concat_image_t::read(void* buf, size_t count)
 {
   size_t readmax, count1 = count;
@@ -873,20 +1199,20 @@ ssize_t concat_image_t::read(void* buf, size_t count)
   do {
     readmax = (size_t)(curr_max - total_offset + 1);
     if (count1 > readmax) {
-      ret = ::read(curr_fd, buf1, readmax);
+      ret = concat_read(buf1, readmax);
       if (ret >= 0) {
         buf1 += readmax;
         count1 -= readmax;
         ret = lseek(curr_max + 1, SEEK_SET);
       }
     } else {
-      ret = ::read(curr_fd, buf1, count1);
+      ret = concat_read(buf1, count1);
       if (ret >= 0) {
         ret = lseek(count1, SEEK_CUR);
       }
       break;
     }
-  } while (ret > 0);
+  } while (ret >= 0);
   return (ret < 0) ? ret : count;
 }
 
@@ -900,23 +1226,35 @@ ssize_t concat_image_t::write(const void* buf, size_t count)
   do {
     writemax = (size_t)(curr_max - total_offset + 1);
     if (count1 > writemax) {
-      ret = ::write(curr_fd, buf1, writemax);
+      ret = concat_write(buf1, writemax);
       if (ret >= 0) {
         buf1 += writemax;
         count1 -= writemax;
         ret = lseek(curr_max + 1, SEEK_SET);
       }
     } else {
-      ret = ::write(curr_fd, buf1, count1);
+      ret = concat_write(buf1, count1);
       if (ret >= 0) {
         ret = lseek(count1, SEEK_CUR);
       }
       break;
     }
-  } while (ret > 0);
+  } while (ret >= 0);
   return (ret < 0) ? ret : count;
 }
 
+int concat_image_t::sync()
+{
+  int ret = 0;
+
+  for (int index = 0; index < maxfd; index++) {
+    if (bx_sync_image(fd_table[index]) < 0) {
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
 #ifndef BXIMAGE
 bool concat_image_t::save_state(const char *backup_fname)
 {
@@ -948,7 +1286,7 @@ void concat_image_t::restore_state(const char *backup_fname)
     increment_string(image_name);
   }
   delete [] image_name;
-  device_image_t::open(pathname0);
+  open(pathname0, O_RDWR | (direct ? HDIMAGE_OPEN_DIRECT : 0));
 }
 #endif
 
@@ -1432,6 +1770,38 @@ ssize_t sparse_image_t::write(const void* buf, size_t count)
   return total_written;
 }
 
+int sparse_image_t::sync()
+{
+#ifdef _POSIX_MAPPED_FILES
+  if (mmap_header != NULL) {
+    if (msync(mmap_header, mmap_length, MS_SYNC) < 0) {
+      return -1;
+    }
+  }
+#endif
+  return bx_sync_image(fd);
+}
+
+bool sparse_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  Bit32u page = (Bit32u)(offset >> pagesize_shift);
+  Bit32u numpages = dtoh32(header.numpages);
+  Bit64s len = pagesize - (offset & pagesize_mask);
+  bool allocated;
+
+  if (page >= numpages) return 1;
+  allocated = (dtoh32(pagetable[page]) != SPARSE_PAGE_NOT_ALLOCATED);
+  if (!allocated && (parent_image != NULL)) {
+    return parent_image->is_allocated(offset, length);
+  }
+  while ((len < *length) && (++page < numpages) &&
+         ((dtoh32(pagetable[page]) != SPARSE_PAGE_NOT_ALLOCATED) == allocated)) {
+    len += pagesize;
+  }
+  if (len < *length) *length = len;
+  return allocated;
+}
+
 int sparse_image_t::check_format(int fd, Bit64u imgsize)
 {
   sparse_header_t temp_header;
@@ -1652,7 +2022,11 @@ redolog_t::redolog_t()
   fd = -1;
   pathname = NULL;
   catalog = NULL;
-  bitmap = NULL;
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    bitmap_cache[i].data = NULL;
+  }
+  bitmap_lru = 0;
+  bitmap_slot = 0;
   extent_index = (Bit32u)0;
   extent_offset = (Bit32u)0;
   extent_next = (Bit32u)0;
@@ -1720,21 +2094,138 @@ int redolog_t::make_header(const char* type, Bit64u size)
   print_header();
 
   catalog = new Bit32u[dtoh32(header.specific.catalog)];
-  bitmap =  new Bit8u[dtoh32(header.specific.bitmap)];
 
-  if ((catalog == NULL) || (bitmap==NULL))
-    BX_PANIC(("redolog : could not malloc catalog or bitmap"));
+  if (catalog == NULL)
+    BX_PANIC(("redolog : could not malloc catalog"));
 
   for (Bit32u i=0; i<dtoh32(header.specific.catalog); i++)
     catalog[i] = htod32(REDOLOG_PAGE_NOT_ALLOCATED);
 
+  init_bitmap_cache();
+
+  return 0;
+}
+
+void redolog_t::init_bitmap_cache()
+{
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].data == NULL) {
+      bitmap_cache[i].data = new Bit8u[dtoh32(header.specific.bitmap)];
+    }
+    bitmap_cache[i].index = REDOLOG_PAGE_NOT_ALLOCATED;
+    bitmap_cache[i].lru = 0;
+    bitmap_cache[i].dirty = 0;
+  }
+  bitmap_lru = 0;
+
   bitmap_blocks = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
   extent_blocks = 1 + (dtoh32(header.specific.extent) - 1) / 512;
 
   BX_DEBUG(("redolog : each bitmap is %d blocks", bitmap_blocks));
   BX_DEBUG(("redolog : each extent is %d blocks", extent_blocks));
+}
 
-  return 0;
+Bit64s redolog_t::get_bitmap_offset(Bit32u index)
+{
+  Bit64s bitmap_offset;
+
+  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
+  bitmap_offset += (Bit64s)512 * dtoh32(catalog[index]) * (extent_blocks + bitmap_blocks);
+  return bitmap_offset;
+}
+
+// Return the bitmap of an allocated extent. The bitmaps of the most recently
+// used extents are kept in memory, so that random access across several
+// extents doesn't reload them for every block. Modified bitmaps are written
+// back when evicted from the cache or on flush().
+Bit8u* redolog_t::get_bitmap(Bit32u index, bool is_new)
+{
+  int i, victim = 0;
+  Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+
+  bitmap_lru++;
+  for (i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].index == index) {
+      bitmap_cache[i].lru = bitmap_lru;
+      bitmap_slot = i;
+      return bitmap_cache[i].data;
+    }
+    if (bitmap_cache[i].index == REDOLOG_PAGE_NOT_ALLOCATED) {
+      if (bitmap_cache[victim].index != REDOLOG_PAGE_NOT_ALLOCATED) {
+        victim = i;
+      }
+    } else if ((bitmap_cache[victim].index != REDOLOG_PAGE_NOT_ALLOCATED) &&
+               (bitmap_cache[i].lru < bitmap_cache[victim].lru)) {
+      victim = i;
+    }
+  }
+
+  if (bitmap_cache[victim].dirty) {
+    Bit32u old_index = bitmap_cache[victim].index;
+    if (bx_write_image(fd, (off_t)get_bitmap_offset(old_index), bitmap_cache[victim].data, bitmap_size) != (ssize_t)bitmap_size) {
+      BX_PANIC(("redolog : failed to write bitmap for extent %d", old_index));
+    }
+    bitmap_cache[victim].dirty = 0;
+  }
+
+  BX_DEBUG(("redolog : loading bitmap for extent %d into cache slot %d", index, victim));
+
+  if (is_new) {
+    memset(bitmap_cache[victim].data, 0, bitmap_size);
+    bitmap_cache[victim].dirty = 1;
+  } else if (bx_read_image(fd, (off_t)get_bitmap_offset(index), bitmap_cache[victim].data, bitmap_size) != (ssize_t)bitmap_size) {
+    BX_PANIC(("redolog : failed to read bitmap for extent %d", index));
+    bitmap_cache[victim].index = REDOLOG_PAGE_NOT_ALLOCATED;
+    return NULL;
+  }
+  bitmap_cache[victim].index = index;
+  bitmap_cache[victim].lru = bitmap_lru;
+  bitmap_slot = victim;
+  return bitmap_cache[victim].data;
+}
+
+int redolog_t::sync()
+{
+  if (!flush()) {
+    return -1;
+  }
+  return bx_sync_image(fd);
+}
+
+bool redolog_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  Bit64s save_pos = imagepos;
+  size_t count = (*length > 0x40000000) ? 0x40000000 : (size_t)*length;
+  bool in_redolog = 1;
+  ssize_t ret;
+
+  if (((offset % 512) != 0) || (offset >= (Bit64s)dtoh64(header.specific.disk))) {
+    return 1;
+  }
+  lseek(offset, SEEK_SET);
+  ret = scan_run(count, &in_redolog);
+  lseek(save_pos, SEEK_SET);
+  if (ret <= 0) return 1;
+  if (ret < *length) *length = ret;
+  return in_redolog;
+}
+
+bool redolog_t::flush()
+{
+  Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+  bool ret = 1;
+
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if ((bitmap_cache[i].data != NULL) && bitmap_cache[i].dirty) {
+      if (bx_write_image(fd, (off_t)get_bitmap_offset(bitmap_cache[i].index), bitmap_cache[i].data, bitmap_size) != (ssize_t)bitmap_size) {
+        BX_ERROR(("redolog : failed to write bitmap for extent %d", bitmap_cache[i].index));
+        ret = 0;
+      } else {
+        bitmap_cache[i].dirty = 0;
+      }
+    }
+  }
+  return ret;
 }
 
 int redolog_t::create(const char* filename, const char* type, Bit64u size)
@@ -1865,33 +2356,37 @@ int redolog_t::open(const char* filename, const char *type, int flags)
   BX_INFO(("redolog : next extent will be at index %d",extent_next));
 
   // memory used for storing bitmaps
-  bitmap = new Bit8u[dtoh32(header.specific.bitmap)];
-
-  bitmap_blocks = 1 + (dtoh32(header.specific.bitmap) - 1) / 512;
-  extent_blocks = 1 + (dtoh32(header.specific.extent) - 1) / 512;
-
-  BX_DEBUG(("redolog : each bitmap is %d blocks", bitmap_blocks));
-  BX_DEBUG(("redolog : each extent is %d blocks", extent_blocks));
+  init_bitmap_cache();
 
   imagepos = 0;
-  bitmap_update = 1;
 
   return 0;
 }
 
 void redolog_t::close()
 {
-  if (fd >= 0)
+  if (fd >= 0) {
+    flush();
     bx_close_image(fd, pathname);
+    fd = -1;
+  }
 
-  if (pathname != NULL)
+  if (pathname != NULL) {
     delete [] pathname;
+    pathname = NULL;
+  }
 
-  if (catalog != NULL)
+  if (catalog != NULL) {
     delete [] catalog;
+    catalog = NULL;
+  }
 
-  if (bitmap != NULL)
-    delete [] bitmap;
+  for (int i = 0; i < REDOLOG_BITMAP_CACHE_SIZE; i++) {
+    if (bitmap_cache[i].data != NULL) {
+      delete [] bitmap_cache[i].data;
+      bitmap_cache[i].data = NULL;
+    }
+  }
 }
 
 Bit64u redolog_t::get_size()
@@ -1931,11 +2426,7 @@ Bit64s redolog_t::lseek(Bit64s offset, int whence)
     return -1;
   }
 
-  Bit32u old_extent_index = extent_index;
   extent_index = (Bit32u)(imagepos / dtoh32(header.specific.extent));
-  if (extent_index != old_extent_index) {
-    bitmap_update = 1;
-  }
   extent_offset = (Bit32u)((imagepos % dtoh32(header.specific.extent)) / 512);
 
   BX_DEBUG(("redolog : lseeking extent index %d, offset %d",extent_index, extent_offset));
@@ -1943,136 +2434,190 @@ Bit64s redolog_t::lseek(Bit64s offset, int whence)
   return imagepos;
 }
 
+ssize_t redolog_t::scan_run(size_t count, bool *in_redolog)
+{
+  Bit32u index = extent_index;
+  Bit32u offset = extent_offset;
+  Bit32u entries = dtoh32(header.specific.catalog);
+  Bit8u *bitmap = NULL;
+  size_t len = 0;
+  bool first, present;
+
+  if (index >= entries) {
+    *in_redolog = 0;
+    return 0;
+  }
+  if (dtoh32(catalog[index]) != REDOLOG_PAGE_NOT_ALLOCATED) {
+    bitmap = get_bitmap(index, 0);
+    if (bitmap == NULL) return -1;
+  }
+  first = (bitmap != NULL) && ((bitmap[offset/8] >> (offset%8)) & 0x01);
+  *in_redolog = first;
+
+  while (len < count) {
+    if (offset >= extent_blocks) {
+      // the next extent is not adjacent in the redolog file
+      if (first) break;
+      if (++index >= entries) break;
+      offset = 0;
+      bitmap = NULL;
+      if (dtoh32(catalog[index]) != REDOLOG_PAGE_NOT_ALLOCATED) {
+        bitmap = get_bitmap(index, 0);
+        if (bitmap == NULL) return -1;
+      }
+    }
+    if (bitmap == NULL) {
+      // whole extent not allocated
+      if (first) break;
+      len += (size_t)512 * (extent_blocks - offset);
+      offset = extent_blocks;
+      continue;
+    }
+    if (((offset % 8) == 0) && ((count - len) >= (8 * 512)) && ((offset + 8) <= extent_blocks) &&
+        (bitmap[offset/8] == (first ? 0xff : 0x00))) {
+      len += 8 * 512;
+      offset += 8;
+      continue;
+    }
+    present = (bitmap[offset/8] >> (offset%8)) & 0x01;
+    if (present != first) break;
+    len += 512;
+    offset++;
+  }
+  if (len > count) len = count;
+  return (ssize_t)len;
+}
+
 ssize_t redolog_t::read(void* buf, size_t count)
 {
-  Bit64s block_offset, bitmap_offset;
+  Bit64s block_offset;
   ssize_t ret;
+  bool in_redolog;
 
-  if (count != 512) {
-    BX_PANIC(("redolog : read() with count not 512"));
+  if ((count % 512) != 0) {
+    BX_PANIC(("redolog : read() with count not multiple of 512"));
     return -1;
   }
 
   BX_DEBUG(("redolog : reading index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
 
-  if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
-    // page not allocated
-    return 0;
-  }
-
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
-  block_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + extent_offset));
-
-  BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
-  BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
-
-  if (bitmap_update) {
-    if (bx_read_image(fd, (off_t)bitmap_offset, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap)) {
-      BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
-      return -1;
-    }
-    bitmap_update = 0;
-  }
-
-  if (((bitmap[extent_offset/8] >> (extent_offset%8)) & 0x01) == 0x00) {
+  ret = scan_run(count, &in_redolog);
+  if (ret <= 0) return ret;
+  if (!in_redolog) {
     BX_DEBUG(("read not in redolog"));
 
     // bitmap says block not in redolog
     return 0;
   }
 
-  ret = bx_read_image(fd, (off_t)block_offset, buf, count);
-  if (ret >= 0) lseek(512, SEEK_CUR);
+  block_offset = get_bitmap_offset(extent_index) + ((Bit64s)512 * (bitmap_blocks + extent_offset));
+
+  BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
+
+  // read the contiguous run of blocks present in this extent
+  ret = bx_read_image(fd, (off_t)block_offset, buf, (int)ret);
+  if (ret >= 0) lseek(ret, SEEK_CUR);
 
   return ret;
 }
 
 ssize_t redolog_t::write(const void* buf, size_t count)
 {
-  Bit32u i;
-  Bit64s block_offset, bitmap_offset, catalog_offset;
+  Bit8u *cbuf = (Bit8u*)buf;
+  Bit8u *bitmap;
+  Bit64s block_offset, catalog_offset;
   ssize_t written;
-  bool update_catalog = 0;
+  size_t n = 0, len;
+  Bit32u i, nblocks;
+  bool new_extent;
 
-  if (count != 512) {
-    BX_PANIC(("redolog : write() with count not 512"));
+  if ((count % 512) != 0) {
+    BX_PANIC(("redolog : write() with count not multiple of 512"));
     return -1;
   }
 
-  BX_DEBUG(("redolog : writing index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
-
-  if (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED) {
-    if (extent_next >= dtoh32(header.specific.catalog)) {
-      BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
-      return -1;
-    }
+  while (n < count) {
+    BX_DEBUG(("redolog : writing index %d, mapping to %d", extent_index, dtoh32(catalog[extent_index])));
 
-    BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
+    new_extent = (dtoh32(catalog[extent_index]) == REDOLOG_PAGE_NOT_ALLOCATED);
+    if (new_extent) {
+      if (extent_next >= dtoh32(header.specific.catalog)) {
+        BX_PANIC(("redolog : can't allocate new extent... catalog is full"));
+        return -1;
+      }
 
-    // Extent not allocated, allocate new
-    catalog[extent_index] = htod32(extent_next);
+      BX_DEBUG(("redolog : allocating new extent at %d", extent_next));
 
-    extent_next += 1;
+      // Extent not allocated, allocate new
+      catalog[extent_index] = htod32(extent_next);
 
-    char *zerobuffer = new char[512];
-    memset(zerobuffer, 0, 512);
+      extent_next += 1;
 
-    // Write bitmap
-    bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-    bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
-    ::lseek(fd, (off_t)bitmap_offset, SEEK_SET);
-    for (i=0; i<bitmap_blocks; i++) {
-      ::write(fd, zerobuffer, 512);
-    }
-    // Write extent
-    for (i=0; i<extent_blocks; i++) {
-      ::write(fd, zerobuffer, 512);
+      // The new bitmap is kept zeroed in the cache. Writing the last block of
+      // the extent reserves space for bitmap and extent in the redolog file.
+      Bit8u zerobuffer[512];
+      memset(zerobuffer, 0, 512);
+      block_offset = get_bitmap_offset(extent_index) + ((Bit64s)512 * (bitmap_blocks + extent_blocks - 1));
+      if (bx_write_image(fd, (off_t)block_offset, zerobuffer, 512) != 512) {
+        BX_PANIC(("redolog : failed to allocate extent %d", extent_index));
+        return -1;
+      }
+      bitmap = get_bitmap(extent_index, 1);
+    } else {
+      bitmap = get_bitmap(extent_index, 0);
     }
+    if (bitmap == NULL) return -1;
 
-    delete [] zerobuffer;
-
-    update_catalog = 1;
-  }
-
-  bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-  bitmap_offset += (Bit64s)512 * dtoh32(catalog[extent_index]) * (extent_blocks + bitmap_blocks);
-  block_offset    = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + extent_offset));
+    // Write the blocks of this extent at once
+    nblocks = extent_blocks - extent_offset;
+    len = count - n;
+    if (len > ((size_t)nblocks * 512)) {
+      len = (size_t)nblocks * 512;
+    }
+    nblocks = (Bit32u)(len / 512);
+    block_offset = get_bitmap_offset(extent_index) + ((Bit64s)512 * (bitmap_blocks + extent_offset));
 
-  BX_DEBUG(("redolog : bitmap offset is %x", (Bit32u)bitmap_offset));
-  BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
+    BX_DEBUG(("redolog : block offset is %x", (Bit32u)block_offset));
 
-  // Write block
-  written = bx_write_image(fd, (off_t)block_offset, (void*)buf, count);
+    written = bx_write_image(fd, (off_t)block_offset, cbuf, (int)len);
+    if (written < 0) {
+      return written;
+    }
 
-  // Write bitmap
-  if (bitmap_update) {
-    if (bx_read_image(fd, (off_t)bitmap_offset, bitmap,  dtoh32(header.specific.bitmap)) != (ssize_t)dtoh32(header.specific.bitmap)) {
-      BX_PANIC(("redolog : failed to read bitmap for extent %d", extent_index));
-      return 0;
+    // Update bitmap, written back on eviction or flush
+    for (i = extent_offset; i < (extent_offset + nblocks); i++) {
+      if (((bitmap[i/8] >> (i%8)) & 0x01) == 0x00) {
+        bitmap[i/8] |= 1 << (i%8);
+        bitmap_cache[bitmap_slot].dirty = 1;
+      }
     }
-    bitmap_update = 0;
-  }
 
-  // If bloc does not belong to extent yet
-  if (((bitmap[extent_offset/8] >> (extent_offset%8)) & 0x01) == 0x00) {
-    bitmap[extent_offset/8] |= 1 << (extent_offset%8);
-    bx_write_image(fd, (off_t)bitmap_offset, bitmap,  dtoh32(header.specific.bitmap));
-  }
+    if (new_extent) {
+      // The catalog entry must never point to a bitmap that is not on disk
+      // yet (a hole reading as all zero), so write the bitmap of a new extent
+      // first and its catalog entry after it.
+      Bit32u bitmap_size = dtoh32(header.specific.bitmap);
+      if (bx_write_image(fd, (off_t)get_bitmap_offset(extent_index), bitmap, bitmap_size) != (ssize_t)bitmap_size) {
+        BX_PANIC(("redolog : failed to write bitmap for extent %d", extent_index));
+        return -1;
+      }
+      bitmap_cache[bitmap_slot].dirty = 0;
 
-  // Write catalog
-  if (update_catalog) {
-    // FIXME if mmap
-    catalog_offset  = (Bit64s)STANDARD_HEADER_SIZE + (extent_index * sizeof(Bit32u));
+      // Write catalog
+      // FIXME if mmap
+      catalog_offset  = (Bit64s)STANDARD_HEADER_SIZE + (extent_index * sizeof(Bit32u));
 
-    BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
+      BX_DEBUG(("redolog : writing catalog at offset %x", (Bit32u)catalog_offset));
 
-    bx_write_image(fd, (off_t)catalog_offset, &catalog[extent_index], sizeof(Bit32u));
-  }
+      bx_write_image(fd, (off_t)catalog_offset, &catalog[extent_index], sizeof(Bit32u));
+    }
 
-  if (written >= 0) lseek(512, SEEK_CUR);
+    lseek(len, SEEK_CUR);
+    cbuf += len;
+    n += len;
+  }
 
-  return written;
+  return count;
 }
 
 int redolog_t::check_format(int fd, const char *subtype)
@@ -2102,70 +2647,10 @@ int redolog_t::check_format(int fd, const char *subtype)
   return HDIMAGE_FORMAT_OK;
 }
 
-#ifdef BXIMAGE
-int redolog_t::commit(device_image_t *base_image)
-{
-  int ret = 0;
-  Bit32u i;
-  Bit8u buffer[512];
-
-  printf("\nCommitting changes to base image file: [  0%%]");
-
-  for (i = 0; i < dtoh32(header.specific.catalog); i++) {
-    printf("\x8\x8\x8\x8\x8%3d%%]", (i+1)*100/dtoh32(header.specific.catalog));
-    fflush(stdout);
-
-    if (dtoh32(catalog[i]) != REDOLOG_PAGE_NOT_ALLOCATED) {
-      Bit64s bitmap_offset;
-      Bit32u bitmap_size, j;
-
-      bitmap_offset  = (Bit64s)STANDARD_HEADER_SIZE + (dtoh32(header.specific.catalog) * sizeof(Bit32u));
-      bitmap_offset += (Bit64s)512 * dtoh32(catalog[i]) * (extent_blocks + bitmap_blocks);
-
-      // Read bitmap
-      bitmap_size = dtoh32(header.specific.bitmap);
-      if ((Bit32u)bx_read_image(fd, (off_t)bitmap_offset, bitmap, bitmap_size) != bitmap_size) {
-        ret = -1;
-        break;
-      }
-
-      for (j = 0; j < dtoh32(header.specific.bitmap); j++) {
-        Bit32u bit;
-
-        for (bit = 0; bit < 8; bit++) {
-          if ( (bitmap[j] & (1 << bit)) != 0) {
-            Bit64s base_offset, block_offset;
-
-            block_offset = bitmap_offset + ((Bit64s)512 * (bitmap_blocks + ((j * 8) + bit)));
-
-            if (bx_read_image(fd, (off_t)block_offset, buffer, 512) != 512) {
-              ret = -1;
-              break;
-            }
-
-            base_offset  = (Bit64s)i * (dtoh32(header.specific.extent));
-            base_offset += (Bit64s)512 * ((j * 8) + bit);
-
-            if (base_image->lseek(base_offset, SEEK_SET) < 0) {
-              ret = -1;
-              break;
-            }
-            if (base_image->write(buffer, 512) < 0) {
-              ret = -1;
-              break;
-            }
-          }
-        }
-      }
-    }
-  }
-  return ret;
-}
-#endif
-
 #ifndef BXIMAGE
 bool redolog_t::save_state(const char *backup_fname)
 {
+  flush();
   return hdimage_backup_file(fd, backup_fname);
 }
 #endif
@@ -2207,29 +2692,41 @@ ssize_t growing_image_t::read(void* buf, size_t count)
   size_t n = 0;
   ssize_t ret = 0;
 
-  memset(buf, 0, count);
+  bool in_redolog;
+
   while (n < count) {
-    ret = redolog->read(cbuf, 512);
-    if (ret < 0) break;
-    cbuf += 512;
-    n += 512;
+    ret = redolog->scan_run(count - n, &in_redolog);
+    if (ret <= 0) {
+      ret = -1;
+      break;
+    }
+    if (in_redolog) {
+      ret = redolog->read(cbuf, ret);
+      if (ret < 0) break;
+    } else {
+      // blocks not yet written read as zero
+      memset(cbuf, 0, ret);
+      redolog->lseek(ret, SEEK_CUR);
+    }
+    cbuf += ret;
+    n += ret;
   }
   return (ret < 0) ? ret : count;
 }
 
 ssize_t growing_image_t::write(const void* buf, size_t count)
 {
-  char *cbuf = (char*)buf;
-  size_t n = 0;
-  ssize_t ret = 0;
+  return redolog->write(buf, count);
+}
 
-  while (n < count) {
-    ret = redolog->write(cbuf, 512);
-    if (ret < 0) break;
-    cbuf += 512;
-    n += 512;
-  }
-  return (ret < 0) ? ret : count;
+int growing_image_t::sync()
+{
+  return redolog->sync();
+}
+
+bool growing_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  return redolog->is_allocated(offset, length);
 }
 
 Bit32u growing_image_t::get_timestamp()
@@ -2317,6 +2814,7 @@ bool coherency_check(device_image_t *ro_disk, redolog_t *redolog)
 undoable_image_t::undoable_image_t(const char* _redolog_name)
 {
   redolog = new redolog_t();
+  ro_offset = -1;
   redolog_name = NULL;
   if (_redolog_name != NULL) {
     if ((strlen(_redolog_name) > 0) && (strcmp(_redolog_name,"none") != 0)) {
@@ -2397,8 +2895,8 @@ void undoable_image_t::close()
 
 Bit64s undoable_image_t::lseek(Bit64s offset, int whence)
 {
-  redolog->lseek(offset, whence);
-  return ro_disk->lseek(offset, whence);
+  // the r/o disk is only positioned when data must be read from it
+  return redolog->lseek(offset, whence);
 }
 
 ssize_t undoable_image_t::read(void* buf, size_t count)
@@ -2406,31 +2904,50 @@ ssize_t undoable_image_t::read(void* buf, size_t count)
   char *cbuf = (char*)buf;
   size_t n = 0;
   ssize_t ret = 0;
+  Bit64s offset;
+  bool in_redolog;
 
   while (n < count) {
-    if ((size_t)redolog->read(cbuf, 512) != 512) {
-      ret = ro_disk->read(cbuf, 512);
+    ret = redolog->scan_run(count - n, &in_redolog);
+    if (ret <= 0) {
+      ret = -1;
+      break;
+    }
+    if (in_redolog) {
+      ret = redolog->read(cbuf, ret);
       if (ret < 0) break;
+    } else {
+      offset = redolog->lseek(0, SEEK_CUR);
+      if (ro_offset != offset) {
+        if (ro_disk->lseek(offset, SEEK_SET) < 0) {
+          ro_offset = -1;
+          ret = -1;
+          break;
+        }
+      }
+      ret = ro_disk->read(cbuf, ret);
+      if (ret <= 0) {
+        ro_offset = -1;
+        ret = -1;
+        break;
+      }
+      ro_offset = offset + ret;
+      redolog->lseek(ret, SEEK_CUR);
     }
-    cbuf += 512;
-    n += 512;
+    cbuf += ret;
+    n += ret;
   }
   return (ret < 0) ? ret : count;
 }
 
 ssize_t undoable_image_t::write(const void* buf, size_t count)
 {
-  char *cbuf = (char*)buf;
-  size_t n = 0;
-  ssize_t ret = 0;
+  return redolog->write(buf, count);
+}
 
-  while (n < count) {
-    ret = redolog->write(cbuf, 512);
-    if (ret < 0) break;
-    cbuf += 512;
-    n += 512;
-  }
-  return (ret < 0) ? ret : count;
+int undoable_image_t::sync()
+{
+  return redolog->sync();
 }
 
 #ifndef BXIMAGE
@@ -2469,6 +2986,7 @@ void undoable_image_t::restore_state(const char *backup_fname)
 volatile_image_t::volatile_image_t(const char* _redolog_name)
 {
   redolog = new redolog_t();
+  ro_offset = -1;
   redolog_temp = NULL;
   redolog_name = NULL;
   if (_redolog_name != NULL) {
@@ -2571,8 +3089,8 @@ void volatile_image_t::close()
 
 Bit64s volatile_image_t::lseek(Bit64s offset, int whence)
 {
-  redolog->lseek(offset, whence);
-  return ro_disk->lseek(offset, whence);
+  // the r/o disk is only positioned when data must be read from it
+  return redolog->lseek(offset, whence);
 }
 
 ssize_t volatile_image_t::read(void* buf, size_t count)
@@ -2580,31 +3098,45 @@ ssize_t volatile_image_t::read(void* buf, size_t count)
   char *cbuf = (char*)buf;
   size_t n = 0;
   ssize_t ret = 0;
+  Bit64s offset;
+  bool in_redolog;
 
   while (n < count) {
-    if ((size_t)redolog->read(cbuf, 512) != 512) {
-      ret = ro_disk->read(cbuf, 512);
+    ret = redolog->scan_run(count - n, &in_redolog);
+    if (ret <= 0) {
+      ret = -1;
+      break;
+    }
+    if (in_redolog) {
+      ret = redolog->read(cbuf, ret);
       if (ret < 0) break;
+    } else {
+      offset = redolog->lseek(0, SEEK_CUR);
+      if (ro_offset != offset) {
+        if (ro_disk->lseek(offset, SEEK_SET) < 0) {
+          ro_offset = -1;
+          ret = -1;
+          break;
+        }
+      }
+      ret = ro_disk->read(cbuf, ret);
+      if (ret <= 0) {
+        ro_offset = -1;
+        ret = -1;
+        break;
+      }
+      ro_offset = offset + ret;
+      redolog->lseek(ret, SEEK_CUR);
     }
-    cbuf += 512;
-    n += 512;
+    cbuf += ret;
+    n += ret;
   }
   return (ret < 0) ? ret : count;
 }
 
 ssize_t volatile_image_t::write(const void* buf, size_t count)
 {
-  char *cbuf = (char*)buf;
-  size_t n = 0;
-  ssize_t ret = 0;
-
-  while (n < count) {
-    ret = redolog->write(cbuf, 512);
-    if (ret < 0) break;
-    cbuf += 512;
-    n += 512;
-  }
-  return (ret < 0) ? ret : count;
+  return redolog->write(buf, count);
 }
 
 #ifndef BXIMAGE
@@ -2642,3 +3174,366 @@ void volatile_image_t::restore_state(const char *backup_fname)
 #endif
 }
 #endif
+
+#ifndef BXIMAGE
+/*** wbcache_image_t function definitions ***/
+
+BX_THREAD_FUNC(wbcache_thread, indata)
+{
+  ((wbcache_image_t*)indata)->flush_thread();
+  BX_THREAD_EXIT;
+}
+
+static int wbcache_compare(const void *a, const void *b)
+{
+  Bit64s sa = (*(const wbcache_entry_t**)a)->sector;
+  Bit64s sb = (*(const wbcache_entry_t**)b)->sector;
+  return (sa < sb) ? -1 : (sa > sb);
+}
+
+wbcache_image_t::wbcache_image_t(device_image_t *_image)
+{
+  image = _image;
+  curr_pos = 0;
+  entries = NULL;
+  free_list = NULL;
+  cache_data = NULL;
+  flush_data = NULL;
+  flush_list = NULL;
+  flush_gen = NULL;
+  memset(hash, 0, sizeof(hash));
+  dirty_count = 0;
+  last_flush = 0;
+  flush_pending = 0;
+  thread_running = 0;
+  thread_stop = 0;
+  BX_INIT_MUTEX(cache_mutex);
+  BX_INIT_MUTEX(image_mutex);
+}
+
+wbcache_image_t::~wbcache_image_t()
+{
+  close();
+  delete image;
+  BX_FINI_MUTEX(cache_mutex);
+  BX_FINI_MUTEX(image_mutex);
+}
+
+int wbcache_image_t::open(const char* pathname, int flags)
+{
+  image->cylinders = cylinders;
+  image->heads = heads;
+  image->spt = spt;
+  image->sect_size = sect_size;
+  int ret = image->open(pathname, flags);
+  if (ret < 0) {
+    return ret;
+  }
+  cylinders = image->cylinders;
+  heads = image->heads;
+  spt = image->spt;
+  sect_size = image->sect_size;
+  hd_size = image->hd_size;
+
+  entries = new wbcache_entry_t[WBCACHE_MAX_SECTORS];
+  cache_data = new Bit8u[WBCACHE_MAX_SECTORS * sect_size];
+  flush_data = new Bit8u[WBCACHE_MAX_SECTORS * sect_size];
+  flush_list = new wbcache_entry_t*[WBCACHE_MAX_SECTORS];
+  flush_gen = new Bit32u[WBCACHE_MAX_SECTORS];
+  free_list = NULL;
+  for (int i = WBCACHE_MAX_SECTORS - 1; i >= 0; i--) {
+    entries[i].data = cache_data + i * sect_size;
+    entries[i].next = free_list;
+    free_list = &entries[i];
+  }
+  last_flush = time(NULL);
+  bx_create_sem(&flush_sem);
+  thread_stop = 0;
+  thread_running = 1;
+  BX_THREAD_CREATE(wbcache_thread, this, thread_var);
+  BX_INFO(("write-back cache enabled (%d sectors)", WBCACHE_MAX_SECTORS));
+  return ret;
+}
+
+void wbcache_image_t::close()
+{
+  bool running;
+
+  if (entries == NULL) {
+    return;
+  }
+  BX_LOCK(cache_mutex);
+  thread_stop = 1;
+  BX_UNLOCK(cache_mutex);
+  bx_set_sem(&flush_sem);
+  BX_THREAD_JOIN(thread_var);
+  // BX_THREAD_JOIN is a no-op on some hosts
+  do {
+    BX_LOCK(cache_mutex);
+    running = thread_running;
+    BX_UNLOCK(cache_mutex);
+    if (running) BX_MSLEEP(1);
+  } while (running);
+  bx_destroy_sem(&flush_sem);
+  if (!flush_dirty()) {
+    BX_ERROR(("write-back cache: data lost on close"));
+  }
+  delete [] entries;
+  delete [] cache_data;
+  delete [] flush_data;
+  delete [] flush_list;
+  delete [] flush_gen;
+  entries = NULL;
+  image->close();
+}
+
+void wbcache_image_t::flush_thread()
+{
+  bool stop, signaled, due;
+
+  while (1) {
+    // wake up periodically, so that the flush interval is also enforced
+    // while the guest does not write
+    signaled = bx_wait_sem_timeout(&flush_sem, WBCACHE_FLUSH_INTERVAL * 1000);
+    BX_LOCK(cache_mutex);
+    if (signaled) flush_pending = 0;
+    stop = thread_stop;
+    due = signaled || ((dirty_count > 0) &&
+                       ((time(NULL) - last_flush) >= WBCACHE_FLUSH_INTERVAL));
+    BX_UNLOCK(cache_mutex);
+    if (stop) break;
+    if (due) flush_dirty();
+  }
+  BX_LOCK(cache_mutex);
+  thread_running = 0;
+  BX_UNLOCK(cache_mutex);
+}
+
+// cache_mutex must be held
+wbcache_entry_t* wbcache_image_t::lookup(Bit64s sector)
+{
+  wbcache_entry_t *entry = hash[sector % WBCACHE_HASH_SIZE];
+
+  while ((entry != NULL) && (entry->sector != sector)) {
+    entry = entry->next;
+  }
+  return entry;
+}
+
+// Write all dirty sectors to the image. Entries rewritten by the guest
+// while the flush was in progress stay in the cache.
+bool wbcache_image_t::flush_dirty()
+{
+  wbcache_entry_t *entry, **link;
+  int i, n = 0, start, end;
+  bool okay = 1;
+
+  BX_LOCK(image_mutex);
+  BX_LOCK(cache_mutex);
+  for (i = 0; i < WBCACHE_HASH_SIZE; i++) {
+    for (entry = hash[i]; entry != NULL; entry = entry->next) {
+      flush_list[n++] = entry;
+    }
+  }
+  last_flush = time(NULL);
+  if (n == 0) {
+    BX_UNLOCK(cache_mutex);
+    BX_UNLOCK(image_mutex);
+    return 1;
+  }
+  qsort(flush_list, n, sizeof(wbcache_entry_t*), wbcache_compare);
+  for (i = 0; i < n; i++) {
+    memcpy(flush_data + i * sect_size, flush_list[i]->data, sect_size);
+    flush_gen[i] = flush_list[i]->gen;
+  }
+  BX_UNLOCK(cache_mutex);
+
+  // the entries can't be released while we hold the image lock
+  for (start = 0; start < n; start = end) {
+    for (end = start + 1; end < n; end++) {
+      if (flush_list[end]->sector != (flush_list[end - 1]->sector + 1)) break;
+    }
+    size_t len = (end - start) * sect_size;
+    if ((image->lseek(flush_list[start]->sector * sect_size, SEEK_SET) < 0) ||
+        (image->write(flush_data + start * sect_size, len) != (ssize_t)len)) {
+      BX_ERROR(("write-back cache: failed to write %d sector(s) at sector " FMT_LL "d",
+                end - start, flush_list[start]->sector));
+      for (i = start; i < end; i++) {
+        flush_list[i] = NULL;
+      }
+      okay = 0;
+    }
+  }
+
+  BX_LOCK(cache_mutex);
+  for (i = 0; i < n; i++) {
+    entry = flush_list[i];
+    if ((entry == NULL) || (entry->gen != flush_gen[i])) continue;
+    link = &hash[entry->sector % WBCACHE_HASH_SIZE];
+    while (*link != entry) {
+      link = &(*link)->next;
+    }
+    *link = entry->next;
+    entry->next = free_list;
+    free_list = entry;
+    dirty_count--;
+  }
+  BX_UNLOCK(cache_mutex);
+  BX_UNLOCK(image_mutex);
+  return okay;
+}
+
+Bit64s wbcache_image_t::lseek(Bit64s offset, int whence)
+{
+  if (whence == SEEK_SET) {
+    curr_pos = offset;
+  } else if (whence == SEEK_CUR) {
+    curr_pos += offset;
+  } else if (whence == SEEK_END) {
+    curr_pos = hd_size + offset;
+  } else {
+    return -1;
+  }
+  if ((curr_pos < 0) || (curr_pos > (Bit64s)hd_size)) {
+    BX_ERROR(("wbcache_image_t.lseek to byte " FMT_LL "d failed", curr_pos));
+    return -1;
+  }
+  return curr_pos;
+}
+
+ssize_t wbcache_image_t::read(void* buf, size_t count)
+{
+  Bit8u *dst = (Bit8u*)buf;
+  Bit64s sector = curr_pos / sect_size;
+  size_t i, nsect = count / sect_size, hits = 0;
+  wbcache_entry_t *entry;
+  ssize_t ret;
+
+  if (((curr_pos % sect_size) != 0) || ((count % sect_size) != 0)) {
+    // unaligned request: write back first and pass it through
+    flush_dirty();
+    BX_LOCK(image_mutex);
+    ret = image->lseek(curr_pos, SEEK_SET);
+    if (ret >= 0) ret = image->read(buf, count);
+    BX_UNLOCK(image_mutex);
+    if (ret > 0) curr_pos += ret;
+    return ret;
+  }
+  BX_LOCK(cache_mutex);
+  if (dirty_count > 0) {
+    for (i = 0; i < nsect; i++) {
+      if (lookup(sector + i) != NULL) hits++;
+    }
+  }
+  if ((nsect > 0) && (hits == nsect)) {
+    for (i = 0; i < nsect; i++) {
+      memcpy(dst + i * sect_size, lookup(sector + i)->data, sect_size);
+    }
+    BX_UNLOCK(cache_mutex);
+    curr_pos += count;
+    return count;
+  }
+  BX_UNLOCK(cache_mutex);
+
+  BX_LOCK(image_mutex);
+  ret = image->lseek(curr_pos, SEEK_SET);
+  if (ret >= 0) ret = image->read(buf, count);
+  if (ret == (ssize_t)count) {
+    // newer data may still be in the cache
+    BX_LOCK(cache_mutex);
+    if (dirty_count > 0) {
+      for (i = 0; i < nsect; i++) {
+        entry = lookup(sector + i);
+        if (entry != NULL) {
+          memcpy(dst + i * sect_size, entry->data, sect_size);
+        }
+      }
+    }
+    BX_UNLOCK(cache_mutex);
+  }
+  BX_UNLOCK(image_mutex);
+  if (ret > 0) curr_pos += ret;
+  return ret;
+}
+
+ssize_t wbcache_image_t::write(const void* buf, size_t count)
+{
+  const Bit8u *src = (const Bit8u*)buf;
+  Bit64s sector = curr_pos / sect_size;
+  size_t done = 0;
+  wbcache_entry_t *entry;
+  bool okay, wakeup;
+  ssize_t ret;
+
+  if (((curr_pos % sect_size) != 0) || ((count % sect_size) != 0)) {
+    flush_dirty();
+    BX_LOCK(image_mutex);
+    ret = image->lseek(curr_pos, SEEK_SET);
+    if (ret >= 0) ret = image->write(buf, count);
+    BX_UNLOCK(image_mutex);
+    if (ret > 0) curr_pos += ret;
+    return ret;
+  }
+  BX_LOCK(cache_mutex);
+  while (done < count) {
+    entry = lookup(sector);
+    if (entry == NULL) {
+      if (free_list == NULL) {
+        // cache full: write back synchronously
+        BX_UNLOCK(cache_mutex);
+        okay = flush_dirty();
+        BX_LOCK(cache_mutex);
+        if (!okay && (free_list == NULL)) {
+          BX_UNLOCK(cache_mutex);
+          return -1;
+        }
+        continue;
+      }
+      entry = free_list;
+      free_list = entry->next;
+      entry->sector = sector;
+      entry->gen = 0;
+      entry->next = hash[sector % WBCACHE_HASH_SIZE];
+      hash[sector % WBCACHE_HASH_SIZE] = entry;
+      dirty_count++;
+    }
+    memcpy(entry->data, src + done, sect_size);
+    entry->gen++;
+    done += sect_size;
+    sector++;
+  }
+  wakeup = !flush_pending && ((dirty_count >= WBCACHE_FLUSH_THRESHOLD) ||
+                              ((time(NULL) - last_flush) >= WBCACHE_FLUSH_INTERVAL));
+  if (wakeup) flush_pending = 1;
+  BX_UNLOCK(cache_mutex);
+  if (wakeup) bx_set_sem(&flush_sem);
+  curr_pos += count;
+  return count;
+}
+
+int wbcache_image_t::sync()
+{
+  bool okay = flush_dirty();
+  BX_LOCK(image_mutex);
+  int ret = image->sync();
+  BX_UNLOCK(image_mutex);
+  return okay ? ret : -1;
+}
+
+bool wbcache_image_t::save_state(const char *backup_fname)
+{
+  flush_dirty();
+  BX_LOCK(image_mutex);
+  bool ret = image->save_state(backup_fname);
+  BX_UNLOCK(image_mutex);
+  return ret;
+}
+
+void wbcache_image_t::restore_state(const char *backup_fname)
+{
+  flush_dirty();
+  BX_LOCK(image_mutex);
+  image->restore_state(backup_fname);
+  BX_UNLOCK(image_mutex);
+}
+#endif
@@ -21,6 +21,10 @@
 #ifndef BX_HDIMAGE_H
 #define BX_HDIMAGE_H
 
+#ifndef BXIMAGE
+#include "bxthread.h"
+#endif
+
 // required for access() checks
 #ifndef F_OK
 #define F_OK 0
@@ -31,6 +35,18 @@
 #define HDIMAGE_HAS_GEOMETRY  2
 #define HDIMAGE_AUTO_GEOMETRY 4
 
+// open() flag for flat and concat images: bypass the host page cache
+#ifdef O_DIRECT
+#define HDIMAGE_OPEN_DIRECT   O_DIRECT
+#else
+#define HDIMAGE_OPEN_DIRECT   0
+#endif
+// default offset / size / address granularity of uncached I/O, used if the
+// host does not report the logical block size of the image file
+#define HDIMAGE_DIRECT_ALIGN  512
+// alignment of buffers returned by bx_alloc_image_buffer()
+#define HDIMAGE_BUFFER_ALIGN  4096
+
 // hdimage format check return values
 #define HDIMAGE_FORMAT_OK      0
 #define HDIMAGE_SIZE_ERROR    -1
@@ -80,6 +96,9 @@
 
 #define REDOLOG_PAGE_NOT_ALLOCATED (0xffffffff)
 
+// number of extent bitmaps kept in memory by the redolog
+#define REDOLOG_BITMAP_CACHE_SIZE 16
+
 #define UNDOABLE_REDOLOG_EXTENSION ".redolog"
 #define UNDOABLE_REDOLOG_EXTENSION_LENGTH (strlen(UNDOABLE_REDOLOG_EXTENSION))
 #define VOLATILE_REDOLOG_EXTENSION ".XXXXXX"
@@ -148,6 +167,9 @@ int bx_create_image_file(const char *filename);
 BOCHSAPI_MSVCONLY int bx_read_image(int fd, Bit64s offset, void *buf, int count);
 BOCHSAPI_MSVCONLY int bx_write_image(int fd, Bit64s offset, void *buf, int count);
 BOCHSAPI_MSVCONLY int bx_close_image(int fd, const char *pathname);
+BOCHSAPI_MSVCONLY int bx_sync_image(int fd);
+BOCHSAPI_MSVCONLY Bit8u *bx_alloc_image_buffer(size_t size);
+BOCHSAPI_MSVCONLY void bx_free_image_buffer(Bit8u *buf);
 #ifndef WIN32
 int hdimage_open_file(const char *pathname, int flags, Bit64u *fsize, time_t *mtime);
 #else
@@ -198,6 +220,15 @@ class BOCHSAPI_MSVCONLY device_image_t
       // Get modification time in FAT format
       virtual Bit32u get_timestamp();
 
+      // Write cached data and metadata to the image file(s) and wait until
+      // the host has stored them. Returns 0 on success.
+      virtual int sync() {return 0;}
+
+      // Check whether the data at offset is stored in the image. On return
+      // *length is reduced to the size of the range with the same state.
+      // Data not stored in the image reads as zeros.
+      virtual bool is_allocated(Bit64s offset, Bit64s *length) {return 1;}
+
       // Check image format
       static int check_format(int fd, Bit64u imgsize) {return HDIMAGE_NO_SIGNATURE;}
 
@@ -246,6 +277,12 @@ class flat_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Write data to stable storage
+      int sync();
+
+      // Check whether data is stored in the image (SEEK_DATA / SEEK_HOLE)
+      bool is_allocated(Bit64s offset, Bit64s *length);
+
       // Check image format
       static int check_format(int fd, Bit64u imgsize);
 
@@ -258,6 +295,10 @@ class flat_image_t : public device_image_t
   private:
       int fd;
       const char *pathname;
+      Bit64s curr_pos;
+      bool direct;
+      unsigned direct_align;  // uncached I/O granularity of 'fd'
+      void disable_direct();
 };
 
 // CONCAT MODE
@@ -285,6 +326,9 @@ class concat_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Write data to stable storage
+      int sync();
+
 #ifndef BXIMAGE
       // Save/restore support
       bool save_state(const char *backup_fname);
@@ -297,7 +341,12 @@ class concat_image_t : public device_image_t
       Bit64u start_offset_table[BX_CONCAT_MAX_IMAGES];
       Bit64u length_table[BX_CONCAT_MAX_IMAGES];
       void increment_string(char *str);
+      ssize_t concat_read(void* buf, size_t count);
+      ssize_t concat_write(const void* buf, size_t count);
       int maxfd;  // number of entries in tables that are valid
+      bool direct;  // images opened with HDIMAGE_OPEN_DIRECT
+      unsigned direct_align;  // uncached I/O granularity of the images
+      void disable_direct();
 
       // notice if anyone does sequential read or write without seek in between.
       // This can be supported pretty easily, but needs additional checks.
@@ -345,6 +394,12 @@ class sparse_image_t : public device_image_t
     // written (count).
     ssize_t write(const void* buf, size_t count);
 
+    // Write data to stable storage
+    int sync();
+
+    // Check whether data is stored in the image
+    bool is_allocated(Bit64s offset, Bit64s *length);
+
     // Check image format
     static int check_format(int fd, Bit64u imgsize);
 
@@ -450,22 +505,40 @@ class BOCHSAPI_MSVCONLY redolog_t
       ssize_t read(void* buf, size_t count);
       ssize_t write(const void* buf, size_t count);
 
+      // Return the length in bytes (up to count) of the run of blocks at the
+      // current position that are either all present in the redolog or all
+      // absent (*in_redolog). Present runs never cross an extent boundary.
+      ssize_t scan_run(size_t count, bool *in_redolog);
+      // Write back all modified extent bitmaps
+      bool flush();
+      // Write back bitmaps and write data to stable storage
+      int sync();
+      // Check whether data is stored in the redolog
+      bool is_allocated(Bit64s offset, Bit64s *length);
+
       static int check_format(int fd, const char *subtype);
 
-#ifdef BXIMAGE
-      int commit(device_image_t *base_image);
-#else
+#ifndef BXIMAGE
       bool save_state(const char *backup_fname);
 #endif
 
   private:
       void             print_header();
+      void             init_bitmap_cache();
+      Bit64s           get_bitmap_offset(Bit32u index);
+      Bit8u           *get_bitmap(Bit32u index, bool is_new);
       char            *pathname;
       int              fd;
       redolog_header_t header;     // Header is kept in x86 (little) endianness
       Bit32u          *catalog;
-      Bit8u           *bitmap;
-      bool             bitmap_update;
+      struct {
+        Bit32u         index;      // catalog index or REDOLOG_PAGE_NOT_ALLOCATED
+        Bit32u         lru;
+        bool           dirty;
+        Bit8u         *data;
+      } bitmap_cache[REDOLOG_BITMAP_CACHE_SIZE];
+      Bit32u           bitmap_lru;
+      int              bitmap_slot;  // cache slot of the last bitmap returned
       Bit32u           extent_index;
       Bit32u           extent_offset;
       Bit32u           extent_next;
@@ -502,6 +575,12 @@ class growing_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Write data to stable storage
+      int sync();
+
+      // Check whether data is stored in the image
+      bool is_allocated(Bit64s offset, Bit64s *length);
+
       // Get modification time in FAT format
       virtual Bit32u get_timestamp();
 
@@ -548,6 +627,9 @@ class undoable_image_t : public device_image_t
       // written (count).
       ssize_t write(const void* buf, size_t count);
 
+      // Write data to stable storage
+      int sync();
+
       // Get image capabilities
       virtual Bit32u get_capabilities() {return caps;}
 
@@ -560,6 +642,7 @@ class undoable_image_t : public device_image_t
   private:
       redolog_t       *redolog;       // Redolog instance
       device_image_t  *ro_disk;       // Read-only base disk instance
+      Bit64s          ro_offset;      // Current offset of the base disk (-1 = unknown)
       char            *redolog_name;  // Redolog name
       Bit32u          caps;
 };
@@ -603,6 +686,7 @@ class volatile_image_t : public device_image_t
   private:
       redolog_t       *redolog;       // Redolog instance
       device_image_t  *ro_disk;       // Read-only base disk instance
+      Bit64s          ro_offset;      // Current offset of the base disk (-1 = unknown)
       char            *redolog_name;  // Redolog name
       char            *redolog_temp;  // Redolog temporary file name
       Bit32u          caps;
@@ -611,7 +695,88 @@ class volatile_image_t : public device_image_t
 
 #ifndef BXIMAGE
 
+// WRITE-BACK CACHE
+// Wraps another image and keeps written sectors in memory. A background
+// thread writes them to the image in sorted batches (adjacent sectors with
+// one host write). sync() drains the cache and then syncs the image, so the
+// guest's FLUSH CACHE still means the data is durable.
+
+#define WBCACHE_MAX_SECTORS     8192  // 4 MB with 512 byte sectors
+#define WBCACHE_HASH_SIZE       4096
+#define WBCACHE_FLUSH_THRESHOLD (WBCACHE_MAX_SECTORS / 4)
+#define WBCACHE_FLUSH_INTERVAL  2     // seconds
+
+typedef struct wbcache_entry {
+  Bit64s sector;
+  Bit32u gen;                  // incremented by every write
+  Bit8u  *data;
+  struct wbcache_entry *next;  // hash chain or free list
+} wbcache_entry_t;
+
+class wbcache_image_t : public device_image_t
+{
+  public:
+      // Contructor: takes ownership of the image
+      wbcache_image_t(device_image_t *image);
+      virtual ~wbcache_image_t();
+
+      // Open an image with specific flags. Returns non-negative if successful.
+      int open(const char* pathname, int flags);
+
+      // Close the image.
+      void close();
+
+      // Position ourselves. Return the resulting offset from the
+      // beginning of the file.
+      Bit64s lseek(Bit64s offset, int whence);
+
+      // Read count bytes to the buffer buf. Return the number of
+      // bytes read (count).
+      ssize_t read(void* buf, size_t count);
+
+      // Write count bytes from buf. Return the number of bytes
+      // written (count).
+      ssize_t write(const void* buf, size_t count);
+
+      // Write all cached sectors and sync the image
+      int sync();
+
+      Bit32u get_capabilities() {return image->get_capabilities();}
+      Bit32u get_timestamp() {return image->get_timestamp();}
+
+      // Save/restore support
+      bool save_state(const char *backup_fname);
+      void restore_state(const char *backup_fname);
+
+      // Background thread main loop
+      void flush_thread();
+
+  private:
+      wbcache_entry_t *lookup(Bit64s sector);
+      bool flush_dirty();
+
+      device_image_t  *image;
+      Bit64s          curr_pos;
+      wbcache_entry_t *entries;
+      wbcache_entry_t *hash[WBCACHE_HASH_SIZE];
+      wbcache_entry_t *free_list;
+      Bit8u           *cache_data;
+      Bit8u           *flush_data;
+      wbcache_entry_t **flush_list;
+      Bit32u          *flush_gen;
+      int             dirty_count;
+      time_t          last_flush;
+      bool            flush_pending;
+      bool            thread_running;
+      bool            thread_stop;
+      BX_MUTEX(cache_mutex);  // protects the entries
+      BX_MUTEX(image_mutex);  // serializes access to the image
+      bx_thread_sem_t flush_sem;
+      BX_THREAD_VAR(thread_var);
+};
+
 #define DEV_hdimage_init_image(a,b,c) bx_hdimage_ctl.init_image(a,b,c)
+#define DEV_hdimage_init_wbcache(a)   bx_hdimage_ctl.init_wbcache(a)
 #define DEV_hdimage_init_cdrom(a)     bx_hdimage_ctl.init_cdrom(a)
 
 class BOCHSAPI bx_hdimage_ctl_c : public logfunctions {
@@ -624,6 +789,7 @@ public:
   void list_modules(void);
   void exit(void);
   device_image_t *init_image(const char *image_mode, Bit64u disk_size, const char *journal);
+  device_image_t *init_wbcache(device_image_t *image);
   cdrom_base_c *init_cdrom(const char *dev);
 };
 
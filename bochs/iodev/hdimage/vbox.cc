@@ -181,21 +181,7 @@ void vbox_image_t::close()
     return;
 
   flush();
-
-  // write the map back to the disk
-  if (mtlb_dirty) {
-    if (bx_write_image(file_descriptor, header.offset_blocks, mtlb, (unsigned) header.blocks_in_hdd * sizeof(Bit32u))
-        != (ssize_t)(header.blocks_in_hdd * sizeof(Bit32u))) {
-        BX_PANIC(("did not write map table"));
-    }
-  }
-
-  // write header back to image
-  if (header_dirty) {
-    if (bx_write_image(file_descriptor, 0, &header, sizeof(VBOX_VDI_Header)) != sizeof(VBOX_VDI_Header)) {
-      BX_PANIC(("did not write header"));
-    }
-  }
+  flush_map();
 
   delete [] mtlb; mtlb = 0;
   delete [] block_data; block_data = 0;
@@ -227,20 +213,37 @@ ssize_t vbox_image_t::read(void *buf, size_t count)
   char *cbuf = (char*)buf;
   ssize_t total = 0;
   while (count > 0) {
-    off_t readable = perform_seek();
-    if (readable == INVALID_OFFSET) {
+    if ((current_offset == INVALID_OFFSET) || (current_offset >= (off_t)header.disk_size)) {
       BX_ERROR(("vbox disk image read failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
       return -1;
     }
 
-    off_t copysize = ((off_t)count > readable) ? readable : count;
+    Bit32u index = (Bit32u) (current_offset / header.block_size);
     off_t offset = current_offset & (header.block_size - 1);
-    memcpy(cbuf, block_data + (size_t) offset, (size_t) copysize);
+    size_t copysize = ((off_t)count > (header.block_size - offset)) ? (size_t)(header.block_size - offset) : count;
+
+    if (index == mtlb_sector) {
+      // the buffered block may contain data not yet written to the image
+      memcpy(cbuf, block_data + (size_t) offset, copysize);
+    } else {
+      Bit32s block = dtoh32(mtlb[index]);
+      copysize += contiguous_blocks(index, block, count - copysize);
+      if (block == -1) {
+        if (header.image_type == 2) {
+          BX_PANIC(("Found non-existing block in Static type image"));
+        }
+        memset(cbuf, 0, copysize);
+      } else if (bx_read_image(file_descriptor, header.offset_data + (off_t)block * header.block_size + offset,
+                               cbuf, (int)copysize) != (ssize_t)copysize) {
+        BX_ERROR(("vbox disk image read failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+        return -1;
+      }
+    }
 
     current_offset += copysize;
     total += (long) copysize;
     cbuf += copysize;
-    count -= (size_t) copysize;
+    count -= copysize;
   }
 
   return total;
@@ -251,25 +254,89 @@ ssize_t vbox_image_t::write(const void *buf, size_t count)
   char *cbuf = (char*)buf;
   ssize_t total = 0;
   while (count > 0) {
-    off_t writable = perform_seek();
-    if (writable == INVALID_OFFSET) {
+    if ((current_offset == INVALID_OFFSET) || (current_offset >= (off_t)header.disk_size)) {
       BX_ERROR(("vbox disk image write failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
       return -1;
     }
 
-    off_t writesize = ((off_t)count > writable) ? writable : count;
+    Bit32u index = (Bit32u) (current_offset / header.block_size);
+    Bit32s block = dtoh32(mtlb[index]);
     off_t offset = current_offset & (header.block_size - 1);
-    memcpy(block_data + offset, cbuf, (size_t) writesize);
+    size_t writesize = ((off_t)count > (header.block_size - offset)) ? (size_t)(header.block_size - offset) : count;
+
+    if ((index != mtlb_sector) && (block != -1)) {
+      // allocated block: write directly to the image
+      writesize += contiguous_blocks(index, block, count - writesize);
+      if (bx_write_image(file_descriptor, header.offset_data + (off_t)block * header.block_size + offset,
+                         cbuf, (int)writesize) != (ssize_t)writesize) {
+        BX_ERROR(("vbox disk image write failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+        return -1;
+      }
+    } else {
+      off_t writable = perform_seek();
+      if (writable == INVALID_OFFSET) {
+        BX_ERROR(("vbox disk image write failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+        return -1;
+      }
+      memcpy(block_data + offset, cbuf, writesize);
+      is_dirty = 1;
+    }
 
     current_offset += writesize;
     total += (long) writesize;
     cbuf += writesize;
-    count -= (size_t) writesize;
-    is_dirty = 1;
+    count -= writesize;
   }
   return total;
 }
 
+int vbox_image_t::sync()
+{
+  flush();
+  flush_map();
+  return bx_sync_image(file_descriptor);
+}
+
+bool vbox_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  Bit32u index = (Bit32u)(offset / header.block_size);
+  Bit64s len = header.block_size - (offset & (header.block_size - 1));
+  bool allocated;
+
+  if (index >= header.blocks_in_hdd) return 1;
+  allocated = (index == mtlb_sector) || (dtoh32(mtlb[index]) != -1);
+  while ((len < *length) && (++index < header.blocks_in_hdd) &&
+         (((index == mtlb_sector) || (dtoh32(mtlb[index]) != -1)) == allocated)) {
+    len += header.block_size;
+  }
+  if (len < *length) *length = len;
+  return allocated;
+}
+
+//
+// Returns the number of bytes (up to count) that can be accessed with the same
+// host I/O operation after the block at index, which is mapped to block. These
+// are the following blocks placed right after it in the image file, or the
+// following unallocated blocks if block is not allocated.
+//
+size_t vbox_image_t::contiguous_blocks(Bit32u index, Bit32s block, size_t count)
+{
+  size_t len = 0;
+  Bit32u next = index + 1;
+
+  while ((len < count) && (next < header.blocks_in_hdd) && (next != mtlb_sector)) {
+    Bit32s next_block = dtoh32(mtlb[next]);
+    if (block == -1) {
+      if (next_block != -1) break;
+    } else if (next_block != (Bit32s)(block + (next - index))) {
+      break;
+    }
+    len += ((count - len) > header.block_size) ? header.block_size : (count - len);
+    next++;
+  }
+  return len;
+}
+
 int vbox_image_t::check_format(int fd, Bit64u imgsize)
 {
   VBOX_VDI_Header temp_header;
@@ -345,16 +412,18 @@ off_t vbox_image_t::perform_seek()
 
   Bit32u index = (Bit32u) (current_offset / header.block_size);
 
-  if (mtlb_sector == index) {
-    return header.block_size - (current_offset & (header.block_size - 1));
-  } else {
+  if (index >= header.blocks_in_hdd) {
+    BX_ERROR(("offset out of range in vbox seek"));
+    return INVALID_OFFSET;
+  }
+
+  if (mtlb_sector != index) {
     flush();
 
     read_block(index);
     mtlb_sector = index;
-
-    return header.block_size;
   }
+  return header.block_size - (current_offset & (header.block_size - 1));
 }
 
 void vbox_image_t::flush()
@@ -369,6 +438,26 @@ void vbox_image_t::flush()
   is_dirty = 0;
 }
 
+void vbox_image_t::flush_map()
+{
+  // write the map back to the disk
+  if (mtlb_dirty) {
+    if (bx_write_image(file_descriptor, header.offset_blocks, mtlb, (unsigned) header.blocks_in_hdd * sizeof(Bit32u))
+        != (ssize_t)(header.blocks_in_hdd * sizeof(Bit32u))) {
+        BX_PANIC(("did not write map table"));
+    }
+    mtlb_dirty = 0;
+  }
+
+  // write header back to image
+  if (header_dirty) {
+    if (bx_write_image(file_descriptor, 0, &header, sizeof(VBOX_VDI_Header)) != sizeof(VBOX_VDI_Header)) {
+      BX_PANIC(("did not write header"));
+    }
+    header_dirty = 0;
+  }
+}
+
 void vbox_image_t::read_block(const Bit32u index)
 {
   off_t offset;
@@ -428,6 +517,8 @@ Bit32u vbox_image_t::get_capabilities(void)
 #ifndef BXIMAGE
 bool vbox_image_t::save_state(const char *backup_fname)
 {
+  flush();
+  flush_map();
   return hdimage_backup_file(file_descriptor, backup_fname);
 }
 
@@ -85,6 +85,8 @@ class vbox_image_t : public device_image_t
         Bit64s lseek(Bit64s offset, int whence);
         ssize_t read(void* buf, size_t count);
         ssize_t write(const void* buf, size_t count);
+        int sync();
+        bool is_allocated(Bit64s offset, Bit64s *length);
 
         Bit32u get_capabilities();
         static int check_format(int fd, Bit64u imgsize);
@@ -103,6 +105,8 @@ class vbox_image_t : public device_image_t
         bool read_header();
         off_t perform_seek();
         void flush();
+        void flush_map();
+        size_t contiguous_blocks(Bit32u index, Bit32s block, size_t count);
         void read_block(const Bit32u index);
         void write_block(const Bit32u index);
 
@@ -343,7 +343,7 @@ off_t vmware3_image_t::perform_seek()
 {
     if(requested_offset < current->min_offset || requested_offset >= current->max_offset)
     {
-        if(!sync())
+        if(!sync_tables())
         {
             BX_DEBUG(("could not sync before switching vmware3 COW files"));
             return INVALID_OFFSET;
@@ -360,7 +360,7 @@ off_t vmware3_image_t::perform_seek()
             && requested_offset < current->offset + tlb_size)
         return (requested_offset - current->offset);
 
-    if(!sync())
+    if(!sync_tables())
     {
         BX_DEBUG(("could not sync before seeking vmware3 COW file"));
         return INVALID_OFFSET;
@@ -415,7 +415,7 @@ ssize_t vmware3_image_t::read(void * buf, size_t count)
  * slb need to be re-written (most of the time) but that can be changed whenever
  * it becomes an issue... image I/O is not a bottleneck.
  */
-bool vmware3_image_t::sync()
+bool vmware3_image_t::sync_tables()
 {
     if(current->synced)
         return true;
@@ -485,6 +485,19 @@ bool vmware3_image_t::sync()
     return true;
 }
 
+int vmware3_image_t::sync()
+{
+  if (!sync_tables())
+    return -1;
+  unsigned count = current->header.number_of_chains;
+  if (count < 1) count = 1;
+  for (unsigned i = 0; i < count; ++i) {
+    if (bx_sync_image(images[i].fd) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 ssize_t vmware3_image_t::write(const void * buf, size_t count)
 {
   char *cbuf = (char*)buf;
@@ -501,7 +514,7 @@ ssize_t vmware3_image_t::write(const void * buf, size_t count)
       amount = count;
     } else {
       memcpy(current->tlb + offset, cbuf, bytes_remaining);
-      if (!sync()) {
+      if (!sync_tables()) {
         BX_DEBUG(("failed to sync when writing %u bytes", (unsigned)count));
         return -1;
       }
@@ -39,6 +39,7 @@ class vmware3_image_t : public device_image_t
       Bit64s lseek(Bit64s offset, int whence);
       ssize_t read(void* buf, size_t count);
       ssize_t write(const void* buf, size_t count);
+      int sync();
 
       Bit32u get_capabilities();
       static int check_format(int fd, Bit64u imgsize);
@@ -120,7 +121,7 @@ class vmware3_image_t : public device_image_t
 
       char * generate_cow_name(const char * filename, Bit32u   chain);
       off_t perform_seek();
-      bool sync();
+      bool sync_tables();
 
       const Bit32u   FL_SHIFT;
       const Bit32u   FL_MASK;
@@ -89,8 +89,14 @@ vmware4_image_t::vmware4_image_t()
   : file_descriptor(-1),
   tlb(0),
   tlb_offset(INVALID_OFFSET),
+  tlb_sector(0),
   current_offset(INVALID_OFFSET),
-  is_dirty(0)
+  is_dirty(0),
+  gd(0),
+  gd_copy(0),
+  gt_cache(0),
+  gt_cache_size(0),
+  gt_slot(0)
 {
   if (sizeof(_VM4_Header) != 77) {
     BX_FATAL(("system error: invalid header structure size"));
@@ -124,9 +130,41 @@ int vmware4_image_t::open(const char* _pathname, int flags)
     BX_PANIC(("unable to allocate " FMT_LL "d bytes for vmware4 image's tlb", header.tlb_size_sectors * SECTOR_SIZE));
 
   tlb_offset = INVALID_OFFSET;
+  tlb_sector = 0;
   current_offset = 0;
   is_dirty = 0;
 
+  // new grains are appended to the image file
+  next_grain_sector = (imgsize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+  // load the grain directory and its copy
+  Bit64u grains = (header.total_sectors + header.tlb_size_sectors - 1) / header.tlb_size_sectors;
+  gd_count = (Bit32u)((grains + header.slb_count - 1) / header.slb_count);
+  gd = new Bit32u[gd_count];
+  gd_copy = new Bit32u[gd_count];
+  if ((bx_read_image(file_descriptor, header.flb_offset_sectors * SECTOR_SIZE, gd, gd_count * sizeof(Bit32u))
+       != (ssize_t)(gd_count * sizeof(Bit32u))) ||
+      (bx_read_image(file_descriptor, header.flb_copy_offset_sectors * SECTOR_SIZE, gd_copy, gd_count * sizeof(Bit32u))
+       != (ssize_t)(gd_count * sizeof(Bit32u)))) {
+    BX_PANIC(("unable to read vmware4 grain directory from file '%s'", pathname));
+    return -1;
+  }
+
+  // set up the grain table cache
+  gt_cache_size = (gd_count < VMWARE4_GT_CACHE_MAX) ? (int)gd_count : VMWARE4_GT_CACHE_MAX;
+  gt_cache = new VM4_GT_Cache_Entry[gt_cache_size];
+  for (int i = 0; i < gt_cache_size; i++) {
+    gt_cache[i].index = 0xffffffff;
+    gt_cache[i].lru = 0;
+    gt_cache[i].dirty = 0;
+    gt_cache[i].data = new Bit32u[header.slb_count];
+  }
+  gt_slot = new int[gd_count];
+  for (Bit32u i = 0; i < gd_count; i++) {
+    gt_slot[i] = -1;
+  }
+  gt_lru = 0;
+
   sect_size = SECTOR_SIZE;
   hd_size = header.total_sectors * sect_size;
   cylinders = (unsigned)(header.total_sectors / (16 * 63));
@@ -148,8 +186,18 @@ void vmware4_image_t::close()
   if (file_descriptor == -1)
     return;
 
-  flush();
+  flush_tables();
   delete [] tlb; tlb = 0;
+  if (gt_cache != 0) {
+    for (int i = 0; i < gt_cache_size; i++) {
+      delete [] gt_cache[i].data;
+    }
+    delete [] gt_cache; gt_cache = 0;
+    gt_cache_size = 0;
+  }
+  delete [] gt_slot; gt_slot = 0;
+  delete [] gd; gd = 0;
+  delete [] gd_copy; gd_copy = 0;
 
   bx_close_image(file_descriptor, pathname);
   file_descriptor = -1;
@@ -177,20 +225,52 @@ ssize_t vmware4_image_t::read(void * buf, size_t count)
 {
   char *cbuf = (char*)buf;
   ssize_t total = 0;
+  off_t grain_size = (off_t)header.tlb_size_sectors * SECTOR_SIZE;
+  Bit32u sector, next_sector;
   while (count > 0) {
-    off_t readable = perform_seek();
-    if (readable == INVALID_OFFSET) {
-      BX_DEBUG(("vmware4 disk image read failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+    if (current_offset == INVALID_OFFSET) {
+      BX_DEBUG(("invalid offset specified in vmware4 read"));
       return -1;
     }
 
-    off_t copysize = ((off_t)count > readable) ? readable : count;
-    memcpy(cbuf, tlb + current_offset - tlb_offset, (size_t)copysize);
+    Bit64u grain = current_offset / grain_size;
+    off_t offset = current_offset % grain_size;
+    size_t copysize = ((off_t)count > (grain_size - offset)) ? (size_t)(grain_size - offset) : count;
+
+    if ((tlb_offset != INVALID_OFFSET) && (grain == (Bit64u)(tlb_offset / grain_size))) {
+      // the loaded grain may contain data not yet written to the image
+      memcpy(cbuf, tlb + offset, copysize);
+    } else {
+      if (!get_grain_sector(grain, &sector)) {
+        BX_DEBUG(("vmware4 disk image read failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+        return -1;
+      }
+      // read the following grains at once if they are adjacent in the image
+      // file or all not allocated
+      Bit64u next = grain + 1;
+      while ((copysize < count) &&
+             ((tlb_offset == INVALID_OFFSET) || (next != (Bit64u)(tlb_offset / grain_size))) &&
+             get_grain_sector(next, &next_sector)) {
+        if (sector == 0) {
+          if (next_sector != 0) break;
+        } else if (next_sector != (sector + (next - grain) * header.tlb_size_sectors)) {
+          break;
+        }
+        copysize += ((off_t)(count - copysize) > grain_size) ? (size_t)grain_size : (count - copysize);
+        next++;
+      }
+      if (sector == 0) {
+        memset(cbuf, 0, copysize);
+      } else if (bx_read_image(file_descriptor, (off_t)sector * SECTOR_SIZE + offset, cbuf, (int)copysize) != (ssize_t)copysize) {
+        BX_DEBUG(("vmware4 disk image read failed on %u bytes at " FMT_LL "d", (unsigned)count, current_offset));
+        return -1;
+      }
+    }
 
     current_offset += copysize;
     total += (long)copysize;
     cbuf += copysize;
-    count -= (size_t)copysize;
+    count -= copysize;
   }
   return total;
 }
@@ -218,6 +298,40 @@ ssize_t vmware4_image_t::write(const void * buf, size_t count)
   return total;
 }
 
+int vmware4_image_t::sync()
+{
+  flush_tables();
+  return bx_sync_image(file_descriptor);
+}
+
+bool vmware4_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  Bit64s grain_size = (Bit64s)header.tlb_size_sectors * SECTOR_SIZE;
+  Bit64u grain = offset / grain_size;
+  Bit64u grains = (hd_size + grain_size - 1) / grain_size;
+  Bit64s len = grain_size - (offset % grain_size);
+  Bit32u sector;
+  bool allocated;
+
+  if ((tlb_offset != INVALID_OFFSET) && (grain == (Bit64u)(tlb_offset / grain_size))) {
+    allocated = 1;
+  } else if (!get_grain_sector(grain, &sector)) {
+    return 1;
+  } else {
+    allocated = (sector != 0);
+  }
+  while ((len < *length) && (++grain < grains)) {
+    if ((tlb_offset != INVALID_OFFSET) && (grain == (Bit64u)(tlb_offset / grain_size))) {
+      if (!allocated) break;
+    } else if (!get_grain_sector(grain, &sector) || ((sector != 0) != allocated)) {
+      break;
+    }
+    len += grain_size;
+  }
+  if (len < *length) *length = len;
+  return allocated;
+}
+
 int vmware4_image_t::check_format(int fd, Bit64u imgsize)
 {
   VM4_Header temp_header;
@@ -293,11 +407,13 @@ bool vmware4_image_t::read_header()
 }
 
 //
-// Returns the number of bytes that can be read from the current offset before needing
-// to perform another seek.
+// Returns the number of bytes that can be written from the current offset before
+// needing to perform another seek.
 //
 off_t vmware4_image_t::perform_seek()
 {
+  off_t grain_size = (off_t)header.tlb_size_sectors * SECTOR_SIZE;
+
   if (current_offset == INVALID_OFFSET) {
     BX_DEBUG(("invalid offset specified in vmware4 seek"));
     return INVALID_OFFSET;
@@ -306,83 +422,145 @@ off_t vmware4_image_t::perform_seek()
   //
   // The currently loaded tlb can service the request.
   //
-  if (tlb_offset / (header.tlb_size_sectors * SECTOR_SIZE) == current_offset / (header.tlb_size_sectors * SECTOR_SIZE))
-    return (header.tlb_size_sectors * SECTOR_SIZE) - (current_offset - tlb_offset);
+  if ((tlb_offset != INVALID_OFFSET) && (tlb_offset / grain_size == current_offset / grain_size))
+    return grain_size - (current_offset - tlb_offset);
 
   flush();
 
-  Bit64u index = current_offset / (header.tlb_size_sectors * SECTOR_SIZE);
-  Bit32u slb_index = (Bit32u)(index % header.slb_count);
-  Bit32u flb_index = (Bit32u)(index / header.slb_count);
-
-  Bit32u slb_sector = read_block_index(header.flb_offset_sectors, flb_index);
-  Bit32u slb_copy_sector = read_block_index(header.flb_copy_offset_sectors, flb_index);
-
-  if (slb_sector == 0 && slb_copy_sector == 0) {
-    BX_DEBUG(("loaded vmware4 disk image requires un-implemented feature"));
+  Bit64u index = current_offset / grain_size;
+  if (!get_grain_sector(index, &tlb_sector)) {
+    tlb_offset = INVALID_OFFSET;
     return INVALID_OFFSET;
   }
-  if (slb_sector == 0)
-    slb_sector = slb_copy_sector;
-
-  Bit32u tlb_sector = read_block_index(slb_sector, slb_index);
-  tlb_offset = index * header.tlb_size_sectors * SECTOR_SIZE;
+  tlb_offset = index * grain_size;
   if (tlb_sector == 0) {
     //
-    // Allocate a new tlb
-    //
-    memset(tlb, 0, (size_t)header.tlb_size_sectors * SECTOR_SIZE);
-
+    // Not allocated yet, this is done when the grain is flushed
     //
-    // Instead of doing a write to increase the file size, we could use
-    // ftruncate but it is not portable.
-    //
-    off_t eof = ((::lseek(file_descriptor, 0, SEEK_END) + SECTOR_SIZE - 1) / SECTOR_SIZE) * SECTOR_SIZE;
-    ::write(file_descriptor, tlb, (unsigned)header.tlb_size_sectors * SECTOR_SIZE);
-    tlb_sector = (Bit32u)(eof / SECTOR_SIZE);
-
-    write_block_index(slb_sector, slb_index, tlb_sector);
-    write_block_index(slb_copy_sector, slb_index, tlb_sector);
-
-    ::lseek(file_descriptor, eof, SEEK_SET);
-  } else {
-    ::lseek(file_descriptor, (off_t)tlb_sector * SECTOR_SIZE, SEEK_SET);
-    ::read(file_descriptor, tlb, (unsigned)header.tlb_size_sectors * SECTOR_SIZE);
-    ::lseek(file_descriptor, (off_t)tlb_sector * SECTOR_SIZE, SEEK_SET);
+    memset(tlb, 0, (size_t)grain_size);
+  } else if (bx_read_image(file_descriptor, (off_t)tlb_sector * SECTOR_SIZE, tlb, (int)grain_size) != grain_size) {
+    tlb_offset = INVALID_OFFSET;
+    return INVALID_OFFSET;
   }
 
-  return (header.tlb_size_sectors * SECTOR_SIZE) - (current_offset - tlb_offset);
+  return grain_size - (current_offset - tlb_offset);
 }
 
 void vmware4_image_t::flush()
 {
+  off_t grain_size = (off_t)header.tlb_size_sectors * SECTOR_SIZE;
+
   if (!is_dirty)
     return;
 
-  //
-  // Write dirty sectors to disk first. Assume that the file is already at the
-  // position for the current tlb.
-  //
-  ::write(file_descriptor, tlb, (unsigned)header.tlb_size_sectors * SECTOR_SIZE);
+  if (tlb_sector == 0) {
+    //
+    // Allocate a new grain at the end of the image file. The grain table
+    // update is written back with the other table changes.
+    //
+    tlb_sector = (Bit32u)next_grain_sector;
+    next_grain_sector += header.tlb_size_sectors;
+    set_grain_sector(tlb_offset / grain_size, tlb_sector);
+  }
+  bx_write_image(file_descriptor, (off_t)tlb_sector * SECTOR_SIZE, tlb, (int)grain_size);
   is_dirty = 0;
 }
 
-Bit32u vmware4_image_t::read_block_index(Bit64u sector, Bit32u index)
+void vmware4_image_t::flush_tables()
+{
+  flush();
+  for (int i = 0; i < gt_cache_size; i++) {
+    if (gt_cache[i].dirty) {
+      write_grain_table(i);
+    }
+  }
+}
+
+//
+// Returns the grain table with the given index from the cache. On a cache miss
+// the least recently used table is replaced.
+//
+Bit32u* vmware4_image_t::get_grain_table(Bit32u index)
 {
-  Bit32u ret;
+  int i, slot;
 
-  bx_read_image(file_descriptor, sector * SECTOR_SIZE + index * sizeof(Bit32u),
-                &ret, sizeof(Bit32u));
+  if (index >= gd_count)
+    return 0;
 
-  return dtoh32(ret);
+  gt_lru++;
+  slot = gt_slot[index];
+  if (slot >= 0) {
+    gt_cache[slot].lru = gt_lru;
+    return gt_cache[slot].data;
+  }
+
+  Bit32u gt_sector = dtoh32(gd[index]);
+  if (gt_sector == 0)
+    gt_sector = dtoh32(gd_copy[index]);
+  if (gt_sector == 0) {
+    BX_DEBUG(("loaded vmware4 disk image requires un-implemented feature"));
+    return 0;
+  }
+
+  slot = 0;
+  for (i = 0; i < gt_cache_size; i++) {
+    if (gt_cache[i].index == 0xffffffff) {
+      slot = i;
+      break;
+    }
+    if (gt_cache[i].lru < gt_cache[slot].lru)
+      slot = i;
+  }
+  if (gt_cache[slot].index != 0xffffffff) {
+    if (gt_cache[slot].dirty)
+      write_grain_table(slot);
+    gt_slot[gt_cache[slot].index] = -1;
+    gt_cache[slot].index = 0xffffffff;
+  }
+
+  if (bx_read_image(file_descriptor, (off_t)gt_sector * SECTOR_SIZE, gt_cache[slot].data,
+                    header.slb_count * sizeof(Bit32u)) != (ssize_t)(header.slb_count * sizeof(Bit32u))) {
+    BX_ERROR(("unable to read vmware4 grain table %d", index));
+    return 0;
+  }
+  gt_cache[slot].index = index;
+  gt_cache[slot].lru = gt_lru;
+  gt_cache[slot].dirty = 0;
+  gt_slot[index] = slot;
+  return gt_cache[slot].data;
 }
 
-void vmware4_image_t::write_block_index(Bit64u sector, Bit32u index, Bit32u block_sector)
+void vmware4_image_t::write_grain_table(int slot)
 {
-  block_sector = htod32(block_sector);
+  Bit32u index = gt_cache[slot].index;
+  Bit32u size = header.slb_count * sizeof(Bit32u);
+
+  if (dtoh32(gd[index]) != 0)
+    bx_write_image(file_descriptor, (off_t)dtoh32(gd[index]) * SECTOR_SIZE, gt_cache[slot].data, size);
+  if (dtoh32(gd_copy[index]) != 0)
+    bx_write_image(file_descriptor, (off_t)dtoh32(gd_copy[index]) * SECTOR_SIZE, gt_cache[slot].data, size);
+  gt_cache[slot].dirty = 0;
+}
 
-  bx_write_image(file_descriptor, sector * SECTOR_SIZE + index * sizeof(Bit32u),
-                 &block_sector, sizeof(Bit32u));
+bool vmware4_image_t::get_grain_sector(Bit64u grain, Bit32u *sector)
+{
+  Bit32u *gt = get_grain_table((Bit32u)(grain / header.slb_count));
+
+  if (gt == 0)
+    return 0;
+  *sector = dtoh32(gt[grain % header.slb_count]);
+  return 1;
+}
+
+void vmware4_image_t::set_grain_sector(Bit64u grain, Bit32u sector)
+{
+  Bit32u index = (Bit32u)(grain / header.slb_count);
+  Bit32u *gt = get_grain_table(index);
+
+  if (gt != 0) {
+    gt[grain % header.slb_count] = htod32(sector);
+    gt_cache[gt_slot[index]].dirty = 1;
+  }
 }
 
 Bit32u vmware4_image_t::get_capabilities(void)
@@ -503,6 +681,7 @@ int vmware4_image_t::create_image(const char *pathname, Bit64u size)
 #else
 bool vmware4_image_t::save_state(const char *backup_fname)
 {
+  flush_tables();
   return hdimage_backup_file(file_descriptor, backup_fname);
 }
 
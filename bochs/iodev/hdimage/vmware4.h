@@ -30,6 +30,9 @@
 #ifndef _VMWARE4_H
 #define _VMWARE4_H 1
 
+// max. number of grain tables kept in memory (2 KB each with 512 entries)
+#define VMWARE4_GT_CACHE_MAX 1024
+
 #if defined(_MSC_VER)
 #pragma pack(push, 1)
 #elif defined(__MWERKS__) && defined(macintosh)
@@ -62,6 +65,14 @@ VM4_Header;
 #pragma options align=reset
 #endif
 
+typedef struct
+{
+    Bit32u  index;  // grain table index, 0xffffffff if unused
+    Bit32u  lru;
+    bool    dirty;
+    Bit32u *data;
+} VM4_GT_Cache_Entry;
+
 class vmware4_image_t : public device_image_t
 {
     public:
@@ -73,6 +84,8 @@ class vmware4_image_t : public device_image_t
         Bit64s lseek(Bit64s offset, int whence);
         ssize_t read(void* buf, size_t count);
         ssize_t write(const void* buf, size_t count);
+        int sync();
+        bool is_allocated(Bit64s offset, Bit64s *length);
 
         Bit32u get_capabilities();
         static int check_format(int fd, Bit64u imgsize);
@@ -93,15 +106,29 @@ class vmware4_image_t : public device_image_t
         bool read_header();
         off_t perform_seek();
         void flush();
-        Bit32u read_block_index(Bit64u sector, Bit32u index);
-        void write_block_index(Bit64u sector, Bit32u index, Bit32u block_sector);
+        void flush_tables();
+        Bit32u* get_grain_table(Bit32u index);
+        void write_grain_table(int slot);
+        bool get_grain_sector(Bit64u grain, Bit32u *sector);
+        void set_grain_sector(Bit64u grain, Bit32u sector);
 
         int file_descriptor;
         VM4_Header header;
         Bit8u* tlb;
         off_t tlb_offset;
+        Bit32u tlb_sector;
         off_t current_offset;
         bool is_dirty;
+        Bit64u next_grain_sector;
+        // grain directory and its redundant copy
+        Bit32u gd_count;
+        Bit32u *gd;
+        Bit32u *gd_copy;
+        // grain table cache (all tables of smaller disks fit in)
+        VM4_GT_Cache_Entry *gt_cache;
+        int gt_cache_size;
+        int *gt_slot;
+        Bit32u gt_lru;
         const char *pathname;
 };
 
@@ -127,6 +127,10 @@ int vpc_image_t::open(const char* _pathname, int flags)
   int disk_type;
 
   pathname = _pathname;
+  pagetable = NULL;
+  bitmap_full = NULL;
+  bat_dirty_first = -1;
+  bat_dirty_last = -1;
   if ((fd = hdimage_open_file(pathname, flags, &imgsize, &mtime)) < 0) {
     BX_ERROR(("VPC: cannot open hdimage file '%s'", pathname));
     return -1;
@@ -235,6 +239,9 @@ int vpc_image_t::open(const char* _pathname, int flags)
 
     free_data_block_offset = (bat_offset + (max_table_entries * 4) + 511) & ~511;
 
+    bitmap_full = new Bit8u[max_table_entries];
+    memset(bitmap_full, 0, max_table_entries);
+
     for (i = 0; i < max_table_entries; i++) {
       pagetable[i] = be32_to_cpu(pagetable[i]);
       if (pagetable[i] != 0xFFFFFFFF) {
@@ -245,8 +252,6 @@ int vpc_image_t::open(const char* _pathname, int flags)
         }
       }
     }
-
-    last_bitmap_offset = (Bit64s) -1;
   }
   cur_sector = 0;
 
@@ -258,8 +263,13 @@ int vpc_image_t::open(const char* _pathname, int flags)
 void vpc_image_t::close(void)
 {
   if (fd > -1) {
+    flush();
     delete [] pagetable;
+    delete [] bitmap_full;
+    pagetable = NULL;
+    bitmap_full = NULL;
     bx_close_image(fd, pathname);
+    fd = -1;
   }
 }
 
@@ -287,7 +297,9 @@ ssize_t vpc_image_t::read(void* buf, size_t count)
   int ret;
 
   if (cpu_to_be32(footer->type) == VHD_FIXED) {
-    return bx_read_image(fd, cur_sector * 512, buf, count);
+    ret = bx_read_image(fd, cur_sector * 512, buf, count);
+    if (ret > 0) cur_sector += (ret >> 9);
+    return ret;
   }
 
   while (scount > 0) {
@@ -300,10 +312,10 @@ ssize_t vpc_image_t::read(void* buf, size_t count)
     }
 
     if (offset == -1) {
-      memset(buf, 0, 512);
+      memset(cbuf, 0, (size_t)sectors * 512);
     } else {
       ret = bx_read_image(fd, offset, cbuf, (int)sectors * 512);
-      if (ret != 512) {
+      if (ret != sectors * 512) {
         return -1;
       }
     }
@@ -323,7 +335,9 @@ ssize_t vpc_image_t::write(const void* buf, size_t count)
   int ret;
 
   if (cpu_to_be32(footer->type) == VHD_FIXED) {
-    return bx_write_image(fd, cur_sector * 512, (void*)buf, count);
+    ret = bx_write_image(fd, cur_sector * 512, (void*)buf, count);
+    if (ret > 0) cur_sector += (ret >> 9);
+    return ret;
   }
 
   while (scount > 0) {
@@ -353,6 +367,33 @@ ssize_t vpc_image_t::write(const void* buf, size_t count)
   return count;
 }
 
+int vpc_image_t::sync()
+{
+  if (flush() < 0) {
+    return -1;
+  }
+  return bx_sync_image(fd);
+}
+
+bool vpc_image_t::is_allocated(Bit64s offset, Bit64s *length)
+{
+  vhd_footer_t *footer = (vhd_footer_t*)footer_buf;
+  int index = (int)(offset / block_size);
+  Bit64s len = block_size - (offset % block_size);
+  bool allocated;
+
+  if ((cpu_to_be32(footer->type) == VHD_FIXED) || (index >= max_table_entries)) {
+    return 1;
+  }
+  allocated = (pagetable[index] != 0xffffffff);
+  while ((len < *length) && (++index < max_table_entries) &&
+         ((pagetable[index] != 0xffffffff) == allocated)) {
+    len += block_size;
+  }
+  if (len < *length) *length = len;
+  return allocated;
+}
+
 Bit32u vpc_image_t::get_capabilities(void)
 {
   return HDIMAGE_HAS_GEOMETRY;
@@ -446,6 +487,7 @@ int vpc_image_t::create_image(const char *pathname, Bit64u size)
 #else
 bool vpc_image_t::save_state(const char *backup_fname)
 {
+  flush();
   return hdimage_backup_file(fd, backup_fname);
 }
 
@@ -499,15 +541,16 @@ Bit64s vpc_image_t::get_sector_offset(Bit64s sector_num, int write)
 
   // We must ensure that we don't write to any sectors which are marked as
   // unused in the bitmap. We get away with setting all bits in the block
-  // bitmap each time we write to a new block. This might cause Virtual PC to
+  // bitmap the first time we write to a block. This might cause Virtual PC to
   // miss sparse read optimization, but it's not a problem in terms of
   // correctness.
-  if (write && (last_bitmap_offset != bitmap_offset)) {
+  if (write && !bitmap_full[pagetable_index]) {
     Bit8u *bitmap = new Bit8u[bitmap_size];
 
-    last_bitmap_offset = bitmap_offset;
     memset(bitmap, 0xff, bitmap_size);
-    bx_write_image(fd, bitmap_offset, bitmap, bitmap_size);
+    if (bx_write_image(fd, bitmap_offset, bitmap, bitmap_size) == (int)bitmap_size) {
+      bitmap_full[pagetable_index] = 1;
+    }
     delete [] bitmap;
   }
 
@@ -532,18 +575,45 @@ int vpc_image_t::rewrite_footer()
   return 0;
 }
 
+/*
+ * Writes the modified part of the Block Allocation Table back to the image
+ * file.
+ *
+ * Returns 0 on success and < 0 on error
+ */
+int vpc_image_t::flush()
+{
+  int i, count, ret;
+
+  if ((pagetable == NULL) || (bat_dirty_first < 0))
+    return 0;
+
+  count = bat_dirty_last - bat_dirty_first + 1;
+  Bit32u *bat = new Bit32u[count];
+  for (i = 0; i < count; i++) {
+    bat[i] = cpu_to_be32(pagetable[bat_dirty_first + i]);
+  }
+  ret = bx_write_image(fd, bat_offset + (4 * bat_dirty_first), bat, count * 4);
+  delete [] bat;
+  if (ret != (count * 4))
+    return -1;
+  bat_dirty_first = -1;
+  bat_dirty_last = -1;
+
+  return 0;
+}
+
 /*
  * Allocates a new block. This involves writing a new footer and updating
  * the Block Allocation Table to use the space at the old end of the image
- * file (overwriting the old footer)
+ * file (overwriting the old footer). The BAT entry is written by flush().
  *
  * Returns the sectors' offset in the image file on success and < 0 on error
  */
 Bit64s vpc_image_t::alloc_block(Bit64s sector_num)
 {
-  Bit64s new_bat_offset;
   Bit64u old_fdbo;
-  Bit32u index, bat_value;
+  Bit32u index;
   int ret;
 
   // Check if sector_num is valid
@@ -574,15 +644,13 @@ Bit64s vpc_image_t::alloc_block(Bit64s sector_num)
     free_data_block_offset = old_fdbo;
     return -1;
   }
+  bitmap_full[index] = 1;
 
-  // Write BAT entry to disk
-  new_bat_offset = bat_offset + (4 * index);
-  bat_value = be32_to_cpu(pagetable[index]);
-  ret = bx_write_image(fd, new_bat_offset, &bat_value, 4);
-  if (ret < 0) {
-    free_data_block_offset = old_fdbo;
-    return -1;
-  }
+  // Remember BAT entry to write back
+  if ((bat_dirty_first < 0) || ((int)index < bat_dirty_first))
+    bat_dirty_first = (int)index;
+  if ((int)index > bat_dirty_last)
+    bat_dirty_last = (int)index;
 
   return get_sector_offset(sector_num, 0);
 }
@@ -161,6 +161,8 @@ class vpc_image_t : public device_image_t
     Bit64s lseek(Bit64s offset, int whence);
     ssize_t read(void* buf, size_t count);
     ssize_t write(const void* buf, size_t count);
+    int sync();
+    bool is_allocated(Bit64s offset, Bit64s *length);
 
     Bit32u get_capabilities();
     static int check_format(int fd, Bit64u imgsize);
@@ -176,6 +178,7 @@ class vpc_image_t : public device_image_t
     Bit64s get_sector_offset(Bit64s sector_num, int write);
     int rewrite_footer(void);
     Bit64s alloc_block(Bit64s sector_num);
+    int flush(void);
 
     int fd;
     Bit64s sector_count;
@@ -184,8 +187,12 @@ class vpc_image_t : public device_image_t
     Bit64u free_data_block_offset;
     int max_table_entries;
     Bit64u bat_offset;
-    Bit64u last_bitmap_offset;
     Bit32u *pagetable;
+    // blocks with all bitmap bits set, no need to update it on write
+    Bit8u *bitmap_full;
+    // range of BAT entries not yet written back
+    int bat_dirty_first;
+    int bat_dirty_last;
 
     Bit32u block_size;
     Bit32u bitmap_size;
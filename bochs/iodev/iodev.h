@@ -137,7 +137,7 @@ typedef struct {
     struct {
       memory_handler_t rh;
       memory_handler_t wh;
-      const Bit8u *dummy;
+      memory_direct_access_handler_t dah;
     } mem;
     struct {
       bx_read_handler_t rh;
@@ -165,7 +165,8 @@ public:
                      Bit8u headt, Bit8u intpin);
   void init_bar_io(Bit8u num, Bit16u size, bx_read_handler_t rh,
                    bx_write_handler_t wh, const Bit8u *mask);
-  void init_bar_mem(Bit8u num, Bit32u size, memory_handler_t rh, memory_handler_t wh);
+  void init_bar_mem(Bit8u num, Bit32u size, memory_handler_t rh, memory_handler_t wh,
+                    memory_direct_access_handler_t dah = NULL);
   void register_pci_state(bx_list_c *list);
   void after_restore_pci_state(memory_handler_t mem_read_handler);
   void load_pci_rom(const char *path);
@@ -201,7 +202,7 @@ public:
   virtual bool bmdma_read_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_read_sector); return 0;
   }
-  virtual bool bmdma_write_sector(Bit8u channel, Bit8u *buffer) {
+  virtual bool bmdma_write_sector(Bit8u channel, Bit8u *buffer, Bit32u *sector_size) {
     STUBFUNC(HD, bmdma_write_sector); return 0;
   }
   virtual void bmdma_complete(Bit8u channel) {
@@ -440,7 +441,8 @@ public:
   bool register_pci_handlers(bx_pci_device_c *device, Bit8u *devfunc,
                              const char *name, const char *descr, Bit8u bus = 0);
   bool pci_set_base_mem(void *this_ptr, memory_handler_t f1, memory_handler_t f2,
-                        Bit32u *addr, Bit8u *pci_conf, unsigned size);
+                        memory_direct_access_handler_t f3, Bit32u *addr,
+                        Bit8u *pci_conf, unsigned size);
   bool pci_set_base_io(void *this_ptr, bx_read_handler_t f1, bx_write_handler_t f2,
                        Bit32u *addr, Bit8u *pci_conf, unsigned size,
                        const Bit8u *iomask, const char *name);
@@ -55,6 +55,7 @@ const Bit8u e1000_iomask[32] = {4, 0, 0, 0, 7, 1, 3, 1, 0, 0, 0, 0, 0, 0, 0, 0,
 #define E1000_MDIC     0x00020  // MDI Control - RW
 #define E1000_VET      0x00038  // VLAN Ether Type - RW
 #define E1000_ICR      0x000C0  // Interrupt Cause Read - R/clr
+#define E1000_ITR      0x000C4  // Interrupt Throttling Rate - RW
 #define E1000_ICS      0x000C8  // Interrupt Cause Set - WO
 #define E1000_IMS      0x000D0  // Interrupt Mask Set - RW
 #define E1000_IMC      0x000D8  // Interrupt Mask Clear - WO
@@ -67,12 +68,16 @@ const Bit8u e1000_iomask[32] = {4, 0, 0, 0, 7, 1, 3, 1, 0, 0, 0, 0, 0, 0, 0, 0,
 #define E1000_RDLEN    0x02808  // RX Descriptor Length - RW
 #define E1000_RDH      0x02810  // RX Descriptor Head - RW
 #define E1000_RDT      0x02818  // RX Descriptor Tail - RW
+#define E1000_RDTR     0x02820  // RX Delay Timer - RW
+#define E1000_RADV     0x0282C  // RX Interrupt Absolute Delay Timer - RW
 #define E1000_TDBAL    0x03800  // TX Descriptor Base Address Low - RW
 #define E1000_TDBAH    0x03804  // TX Descriptor Base Address High - RW
 #define E1000_TDLEN    0x03808  // TX Descriptor Length - RW
 #define E1000_TDH      0x03810  // TX Descriptor Head - RW
 #define E1000_TDT      0x03818  // TX Descripotr Tail - RW
+#define E1000_TIDV     0x03820  // TX Interrupt Delay Value - RW
 #define E1000_TXDCTL   0x03828  // TX Descriptor Control - RW
+#define E1000_TADV     0x0382C  // TX Interrupt Absolute Delay Val - RW
 #define E1000_CRCERRS  0x04000  // CRC Error Count - R/clr
 #define E1000_MPC      0x04010  // Missed Packet Count - R/clr
 #define E1000_GPRC     0x04074  // Good Packets RX Count - R/clr
@@ -191,9 +196,18 @@ const Bit8u e1000_iomask[32] = {4, 0, 0, 0, 7, 1, 3, 1, 0, 0, 0, 0, 0, 0, 0, 0,
 #define E1000_TXD_CMD_TCP    0x01000000 // TCP packet
 #define E1000_TXD_CMD_IP     0x02000000 // IP packet
 #define E1000_TXD_CMD_TSE    0x04000000 // TCP Seg enable
+#define E1000_TXD_CMD_IDE    0x80000000 // Enable Tidv register
 
 #define E1000_TCTL_EN     0x00000002    // enable tx
 
+#define E1000_RDT_FPDB    0x80000000    // Flush pending receive interrupt
+
+// the delay timers count in units of 1.024 usec, ITR in units of 256 nsec
+#define E1000_DELAY_USEC(x) (((Bit64u)(x) * 1024 + 999) / 1000)
+#define E1000_ITR_USEC(x)   (((Bit64u)(x) * 256 + 999) / 1000)
+// time between the TDT write and the report of transmit completion (usec)
+#define E1000_TX_LATENCY  10
+
 struct e1000_rx_desc {
   Bit64u buffer_addr; // Address of the descriptor's data buffer
   Bit16u length;      // Length of data DMAed into data buffer
@@ -261,7 +275,8 @@ enum {
   defreg(TORH),  defreg(TORL),  defreg(TOTH),   defreg(TOTL),
   defreg(TPR),   defreg(TPT),   defreg(TXDCTL), defreg(WUFC),
   defreg(RA),    defreg(MTA),   defreg(CRCERRS),defreg(VFTA),
-  defreg(VET),
+  defreg(VET),   defreg(ITR),   defreg(RDTR),   defreg(RADV),
+  defreg(TIDV),  defreg(TADV),
 };
 
 enum { PHY_R = 1, PHY_W = 2, PHY_RW = PHY_R | PHY_W };
@@ -406,28 +421,6 @@ PLUGIN_ENTRY_FOR_MODULE(e1000)
 #define le32_to_cpu  cpu_to_le32
 #define le64_to_cpu  cpu_to_le64
 
-Bit32u net_checksum_add(Bit8u *buf, unsigned buf_len)
-{
-  Bit32u sum = 0;
-  unsigned i;
-
-  for (i = 0; i < buf_len; i++) {
-    if (i & 1)
-      sum += (Bit32u)buf[i];
-    else
-      sum += (Bit32u)buf[i] << 8;
-  }
-  return sum;
-}
-
-Bit16u net_checksum_finish(Bit32u sum)
-{
-  while (sum >> 16)
-    sum = (sum & 0xFFFF) + (sum >> 16);
-  return ~sum;
-}
-
-
 // the main object creates up to 4 device objects
 
 bx_e1000_main_c::bx_e1000_main_c()
@@ -506,7 +499,7 @@ void bx_e1000_main_c::after_restore_state()
 bx_e1000_c::bx_e1000_c()
 {
   memset(&s, 0, sizeof(bx_e1000_t));
-  s.tx_timer_index = BX_NULL_TIMER_HANDLE;
+  s.int_timer_index = BX_NULL_TIMER_HANDLE;
   ethdev = NULL;
 }
 
@@ -518,6 +511,12 @@ bx_e1000_c::~bx_e1000_c()
   if (s.tx.vlan != NULL) {
     delete [] s.tx.vlan;
   }
+  if (s.txb.iov != NULL) {
+    delete [] s.txb.iov;
+  }
+  if (s.txb.buf != NULL) {
+    delete [] s.txb.buf;
+  }
   if (ethdev != NULL) {
     delete ethdev;
   }
@@ -552,6 +551,8 @@ void bx_e1000_c::init_card(Bit8u card)
   BX_E1000_THIS s.mac_reg = new Bit32u[0x8000];
   BX_E1000_THIS s.tx.vlan = new Bit8u[0x10004];
   BX_E1000_THIS s.tx.data = BX_E1000_THIS s.tx.vlan + 4;
+  BX_E1000_THIS s.txb.iov = new bx_net_iov_t[BX_NET_BATCH_MAX * (E1000_TX_MAX_FRAGS + 1)];
+  BX_E1000_THIS s.txb.buf = new Bit8u[E1000_TX_BATCH_BUFSIZE];
 
   BX_E1000_THIS s.devfunc = 0x00;
   DEV_register_pci_handlers(this, &BX_E1000_THIS s.devfunc, BX_PLUGIN_E1000,
@@ -569,9 +570,9 @@ void bx_e1000_c::init_card(Bit8u card)
     BX_E1000_THIS load_pci_rom(bootrom->getptr());
   }
 
-  if (BX_E1000_THIS s.tx_timer_index == BX_NULL_TIMER_HANDLE) {
-    BX_E1000_THIS s.tx_timer_index =
-      DEV_register_timer(this, tx_timer_handler, 0, 0, 0, "e1000"); // one-shot, inactive
+  if (BX_E1000_THIS s.int_timer_index == BX_NULL_TIMER_HANDLE) {
+    BX_E1000_THIS s.int_timer_index =
+      DEV_register_timer(this, int_timer_handler, 0, 0, 0, "e1000"); // one-shot, inactive
   }
   BX_E1000_THIS s.statusbar_id = bx_gui->register_statusitem("E1000", 1);
 
@@ -634,7 +635,13 @@ void bx_e1000_c::reset(unsigned type)
   memset(&BX_E1000_THIS s.tx, 0, sizeof(BX_E1000_THIS s.tx));
   BX_E1000_THIS s.tx.vlan = saved_ptr;
   BX_E1000_THIS s.tx.data = BX_E1000_THIS s.tx.vlan + 4;
+  BX_E1000_THIS s.txb.nfrags = 0;
+  BX_E1000_THIS s.txb.count = 0;
+  BX_E1000_THIS s.txb.iovcnt = 0;
+  BX_E1000_THIS s.txb.buflen = 0;
   BX_E1000_THIS s.io_memaddr = 0;
+  memset(&BX_E1000_THIS s.mit, 0, sizeof(BX_E1000_THIS s.mit));
+  bx_pc_system.deactivate_timer(BX_E1000_THIS s.int_timer_index);
 
   // Deassert IRQ
   set_irq_level(0);
@@ -682,7 +689,18 @@ void bx_e1000_c::e1000_register_state(bx_list_c *parent, Bit8u card)
   BXRS_PARAM_BOOL(tx, ip, BX_E1000_THIS s.tx.ip);
   BXRS_PARAM_BOOL(tx, tcp, BX_E1000_THIS s.tx.tcp);
   BXRS_PARAM_BOOL(tx, cptse, BX_E1000_THIS s.tx.cptse);
-  BXRS_HEX_PARAM_FIELD(tx, int_cause, BX_E1000_THIS s.tx.int_cause);
+  bx_list_c *mit = new bx_list_c(list, "mit", "");
+  BXRS_HEX_PARAM_FIELD(mit, rx_cause, BX_E1000_THIS s.mit.rx_cause);
+  BXRS_DEC_PARAM_FIELD(mit, rx_pkt, BX_E1000_THIS s.mit.rx_pkt);
+  BXRS_DEC_PARAM_FIELD(mit, rx_abs, BX_E1000_THIS s.mit.rx_abs);
+  BXRS_HEX_PARAM_FIELD(mit, tx_cause, BX_E1000_THIS s.mit.tx_cause);
+  BXRS_DEC_PARAM_FIELD(mit, tx_pkt, BX_E1000_THIS s.mit.tx_pkt);
+  BXRS_DEC_PARAM_FIELD(mit, tx_abs, BX_E1000_THIS s.mit.tx_abs);
+  BXRS_HEX_PARAM_FIELD(mit, tx_imm, BX_E1000_THIS s.mit.tx_imm);
+  BXRS_DEC_PARAM_FIELD(mit, tx_imm_time, BX_E1000_THIS s.mit.tx_imm_time);
+  BXRS_DEC_PARAM_FIELD(mit, itr_next, BX_E1000_THIS s.mit.itr_next);
+  BXRS_PARAM_BOOL(mit, itr_pending, BX_E1000_THIS s.mit.itr_pending);
+  BXRS_PARAM_BOOL(mit, irq_level, BX_E1000_THIS s.mit.irq_level);
   bx_list_c *eecds = new bx_list_c(list, "eecd_state", "");
   BXRS_DEC_PARAM_FIELD(eecds, val_in, BX_E1000_THIS s.eecd_state.val_in);
   BXRS_DEC_PARAM_FIELD(eecds, bitnum_in, BX_E1000_THIS s.eecd_state.bitnum_in);
@@ -770,6 +788,11 @@ bool bx_e1000_c::mem_read(bx_phy_address addr, unsigned len, void *data)
       case E1000_RDBAL:
       case E1000_TDLEN:
       case E1000_RDLEN:
+      case E1000_ITR:
+      case E1000_RDTR:
+      case E1000_RADV:
+      case E1000_TIDV:
+      case E1000_TADV:
         value = BX_E1000_THIS s.mac_reg[index];
         break;
       case E1000_TOTH:
@@ -855,6 +878,19 @@ bool bx_e1000_c::mem_write(bx_phy_address addr, unsigned len, void *data)
       case E1000_RDLEN:
         BX_E1000_THIS s.mac_reg[index] = value & 0xfff80;
         break;
+      case E1000_ITR:
+      case E1000_RADV:
+      case E1000_TIDV:
+      case E1000_TADV:
+        BX_E1000_THIS s.mac_reg[index] = value & 0xffff;
+        break;
+      case E1000_RDTR:
+        BX_E1000_THIS s.mac_reg[index] = value & 0xffff;
+        if ((value & E1000_RDT_FPDB) && (BX_E1000_THIS s.mit.rx_cause != 0)) {
+          // flush partial descriptor block: report pending frames now
+          post_rx_cause(0);
+        }
+        break;
       case E1000_TCTL:
       case E1000_TDT:
         BX_E1000_THIS s.mac_reg[index] = value;
@@ -968,11 +1004,29 @@ void bx_e1000_c::set_irq_level(bool level)
 
 void bx_e1000_c::set_interrupt_cause(Bit32u value)
 {
+  bool level;
+  Bit64u now;
+
   if (value != 0)
     value |= E1000_ICR_INT_ASSERTED;
   BX_E1000_THIS s.mac_reg[ICR] = value;
   BX_E1000_THIS s.mac_reg[ICS] = value;
-  set_irq_level((BX_E1000_THIS s.mac_reg[IMS] & BX_E1000_THIS s.mac_reg[ICR]) != 0);
+  level = (BX_E1000_THIS s.mac_reg[IMS] & BX_E1000_THIS s.mac_reg[ICR]) != 0;
+  if (level && !BX_E1000_THIS s.mit.irq_level && (BX_E1000_THIS s.mac_reg[ITR] != 0)) {
+    // interrupt throttling: at most one interrupt per ITR interval
+    now = bx_pc_system.time_usec();
+    if (now < BX_E1000_THIS s.mit.itr_next) {
+      BX_E1000_THIS s.mit.itr_pending = 1;
+      update_int_timer(now);
+      return;
+    }
+    BX_E1000_THIS s.mit.itr_next = now + E1000_ITR_USEC(BX_E1000_THIS s.mac_reg[ITR]);
+  }
+  BX_E1000_THIS s.mit.itr_pending = 0;
+  if (level != BX_E1000_THIS s.mit.irq_level) {
+    BX_E1000_THIS s.mit.irq_level = level;
+    set_irq_level(level);
+  }
 }
 
 void bx_e1000_c::set_ics(Bit32u value)
@@ -982,6 +1036,77 @@ void bx_e1000_c::set_ics(Bit32u value)
   set_interrupt_cause(value | BX_E1000_THIS s.mac_reg[ICR]);
 }
 
+// Receive interrupts: RXT0 is held back by the packet timer (RDTR, restarted
+// with every frame) and the absolute timer (RADV, started with the first
+// frame). Any other cause is reported at once, together with a pending RXT0.
+void bx_e1000_c::post_rx_cause(Bit32u cause)
+{
+  Bit32u rdtr = BX_E1000_THIS s.mac_reg[RDTR], radv = BX_E1000_THIS s.mac_reg[RADV];
+  Bit64u now;
+
+  if ((cause == E1000_ICS_RXT0) && (rdtr != 0)) {
+    now = bx_pc_system.time_usec();
+    BX_E1000_THIS s.mit.rx_cause |= cause;
+    BX_E1000_THIS s.mit.rx_pkt = now + E1000_DELAY_USEC(rdtr);
+    if ((radv != 0) && (BX_E1000_THIS s.mit.rx_abs == 0))
+      BX_E1000_THIS s.mit.rx_abs = now + E1000_DELAY_USEC(radv);
+    update_int_timer(now);
+    return;
+  }
+  cause |= BX_E1000_THIS s.mit.rx_cause;
+  BX_E1000_THIS s.mit.rx_cause = 0;
+  BX_E1000_THIS s.mit.rx_pkt = 0;
+  BX_E1000_THIS s.mit.rx_abs = 0;
+  set_ics(cause);
+}
+
+// Transmit interrupts: causes of descriptors with the IDE bit set are held
+// back by the TIDV / TADV timers, the others are reported after the transmit
+// latency. An early TXDW also reports the completions still being delayed.
+void bx_e1000_c::post_tx_cause(Bit32u cause, Bit32u delayed)
+{
+  Bit32u tidv = BX_E1000_THIS s.mac_reg[TIDV], tadv = BX_E1000_THIS s.mac_reg[TADV];
+  Bit64u now = bx_pc_system.time_usec();
+
+  if ((delayed != 0) && (tidv != 0)) {
+    BX_E1000_THIS s.mit.tx_cause |= delayed;
+    BX_E1000_THIS s.mit.tx_pkt = now + E1000_DELAY_USEC(tidv);
+    if ((tadv != 0) && (BX_E1000_THIS s.mit.tx_abs == 0))
+      BX_E1000_THIS s.mit.tx_abs = now + E1000_DELAY_USEC(tadv);
+  } else {
+    cause |= delayed;
+  }
+  if ((cause != 0) && (BX_E1000_THIS s.mit.tx_imm == 0)) {
+    BX_E1000_THIS s.mit.tx_imm_time = now + E1000_TX_LATENCY;
+  }
+  BX_E1000_THIS s.mit.tx_imm |= cause;
+  update_int_timer(now);
+}
+
+// arm the interrupt timer for the earliest pending deadline
+void bx_e1000_c::update_int_timer(Bit64u now)
+{
+  Bit64u next = 0, t[6];
+  unsigned i;
+
+  t[0] = BX_E1000_THIS s.mit.rx_pkt;
+  t[1] = BX_E1000_THIS s.mit.rx_abs;
+  t[2] = BX_E1000_THIS s.mit.tx_pkt;
+  t[3] = BX_E1000_THIS s.mit.tx_abs;
+  t[4] = BX_E1000_THIS s.mit.tx_imm_time;
+  t[5] = BX_E1000_THIS s.mit.itr_pending ? BX_E1000_THIS s.mit.itr_next : 0;
+  for (i = 0; i < 6; i++) {
+    if ((t[i] != 0) && ((next == 0) || (t[i] < next)))
+      next = t[i];
+  }
+  if (next == 0) {
+    bx_pc_system.deactivate_timer(BX_E1000_THIS s.int_timer_index);
+  } else {
+    bx_pc_system.activate_timer(BX_E1000_THIS s.int_timer_index,
+                                (next > now) ? (Bit32u)(next - now) : 1, 0); // not continuous
+  }
+}
+
 int bx_e1000_c::rxbufsize(Bit32u v)
 {
   v &= E1000_RCTL_BSEX | E1000_RCTL_SZ_16384 | E1000_RCTL_SZ_8192 |
@@ -1101,15 +1226,16 @@ Bit32u bx_e1000_c::flash_eerd_read()
            E1000_EEPROM_RW_REG_DONE | r);
 }
 
-void bx_e1000_c::putsum(Bit8u *data, Bit32u n, Bit32u sloc, Bit32u css, Bit32u cse)
+void bx_e1000_c::putsum(Bit32u n, Bit32u sloc, Bit32u css, Bit32u cse)
 {
   Bit32u sum;
 
   if (cse && cse < n)
     n = cse + 1;
   if (sloc < n-1) {
-    sum = net_checksum_add(data+css, n-css);
-    put_net2(data + sloc, net_checksum_finish(sum));
+    // the checksum field is always part of the copied frame head
+    sum = tx_checksum_add(css, n);
+    put_net2(BX_E1000_THIS s.tx.data + sloc, bx_net_checksum_finish(sum));
   }
 }
 
@@ -1138,6 +1264,194 @@ int bx_e1000_c::fcs_len()
   return (BX_E1000_THIS s.mac_reg[RCTL] & E1000_RCTL_SECRC) ? 0 : 4;
 }
 
+// The transmit path does not copy frame data out of guest memory. Only the
+// frame head (headers and checksum fields modified by offloading) goes to
+// tx.data, the rest is passed to the pktmover as references to guest memory.
+// All frames found in one start_xmit() call are sent in one batch.
+
+unsigned bx_e1000_c::tx_copy_len()
+{
+  e1000_tx *tp = &BX_E1000_THIS s.tx;
+  unsigned len = E1000_TX_COPYBREAK;
+
+  if (tp->tse && tp->cptse && (tp->hdr_len > len))
+    len = tp->hdr_len;
+  if ((tp->sum_needed & E1000_TXD_POPTS_TXSM) && ((unsigned)tp->tucso + 2 > len))
+    len = tp->tucso + 2;
+  if ((tp->sum_needed & E1000_TXD_POPTS_IXSM) && ((unsigned)tp->ipcso + 2 > len))
+    len = tp->ipcso + 2;
+  return len;
+}
+
+// add guest memory to the frame being assembled
+void bx_e1000_c::tx_append(bx_phy_address addr, unsigned len)
+{
+  e1000_tx *tp = &BX_E1000_THIS s.tx;
+  e1000_tx_batch *tb = &BX_E1000_THIS s.txb;
+  unsigned copy = tx_copy_len(), n;
+  bx_net_iov_t *last;
+  Bit8u *host;
+
+  if (tp->size < copy) {
+    n = copy - tp->size;
+    if (n > len) n = len;
+    DEV_MEM_READ_PHYSICAL_DMA(addr, n, tp->data + tp->size);
+    tp->size += n;
+    addr += n;
+    len -= n;
+  }
+  while (len > 0) {
+    n = 0x1000 - (unsigned)(addr & 0xfff);
+    if (n > len) n = len;
+#if BX_LARGE_RAMFILE
+    // blocks of a swapped guest memory may move, so always copy
+    host = NULL;
+#else
+    host = BX_MEM(0)->getHostMemAddr(NULL, addr, BX_READ);
+#endif
+    if (host == NULL) {
+      // no direct access (e.g. MMIO): copy to the frame buffer
+      host = tp->data + tp->size;
+      DEV_MEM_READ_PHYSICAL_DMA(addr, n, host);
+    }
+    if (tb->nfrags == E1000_TX_MAX_FRAGS) {
+      tx_materialize();
+    }
+    if (tb->nfrags == 0) {
+      if (host == tp->data + tp->size) {
+        tp->size += n;
+        addr += n;
+        len -= n;
+        continue;
+      }
+      tb->frag_start = tp->size;
+    }
+    last = (tb->nfrags > 0) ? &tb->frag[tb->nfrags - 1] : NULL;
+    if ((last != NULL) && ((const Bit8u*)last->base + last->len == host)) {
+      last->len += n;
+    } else {
+      tb->frag[tb->nfrags].base = host;
+      tb->frag[tb->nfrags++].len = n;
+    }
+    tp->size += n;
+    addr += n;
+    len -= n;
+  }
+}
+
+// copy the fragments of the current frame to tx.data
+void bx_e1000_c::tx_materialize()
+{
+  e1000_tx *tp = &BX_E1000_THIS s.tx;
+  e1000_tx_batch *tb = &BX_E1000_THIS s.txb;
+  Bit32u off = tb->frag_start;
+
+  for (unsigned i = 0; i < tb->nfrags; i++) {
+    if (tb->frag[i].base != tp->data + off) {
+      memcpy(tp->data + off, tb->frag[i].base, tb->frag[i].len);
+    }
+    off += tb->frag[i].len;
+  }
+  tb->nfrags = 0;
+}
+
+// checksum over the bytes start ... end-1 of the current frame
+Bit32u bx_e1000_c::tx_checksum_add(unsigned start, unsigned end)
+{
+  e1000_tx *tp = &BX_E1000_THIS s.tx;
+  e1000_tx_batch *tb = &BX_E1000_THIS s.txb;
+  unsigned off, b, e;
+  Bit32u sum = 0, part;
+
+  off = (tb->nfrags > 0) ? tb->frag_start : tp->size;
+  if (start < off) {
+    sum = bx_net_checksum_add(tp->data + start, ((end < off) ? end : off) - start, 0);
+  }
+  for (unsigned i = 0; (i < tb->nfrags) && (off < end); i++) {
+    b = (start > off) ? start : off;
+    e = off + tb->frag[i].len;
+    if (e > end) e = end;
+    if (b < e) {
+      part = bx_net_checksum_add((Bit8u*)tb->frag[i].base + (b - off), e - b, 0);
+      if ((b - start) & 1) {
+        // odd position: the bytes are in the other half of the words
+        while (part >> 16)
+          part = (part & 0xffff) + (part >> 16);
+        part = ((part & 0xff) << 8) | (part >> 8);
+      }
+      sum += part;
+    }
+    off += tb->frag[i].len;
+  }
+  return sum;
+}
+
+// add the current frame to the batch (with the VLAN tag inserted)
+void bx_e1000_c::tx_queue_frame()
+{
+  e1000_tx *tp = &BX_E1000_THIS s.tx;
+  e1000_tx_batch *tb = &BX_E1000_THIS s.txb;
+  unsigned head = (tb->nfrags > 0) ? tb->frag_start : tp->size;
+  unsigned need = head + 4, i, n = 0;
+  const Bit8u *base;
+  bx_net_iov_t *iov;
+  Bit8u *dst;
+
+  for (i = 0; i < tb->nfrags; i++) {
+    base = (const Bit8u*)tb->frag[i].base;
+    if ((base >= tp->data) && (base < tp->data + 0x10000))
+      need += tb->frag[i].len;
+  }
+  if ((tb->count == BX_NET_BATCH_MAX) ||
+      ((tb->buflen + need) > E1000_TX_BATCH_BUFSIZE)) {
+    tx_flush();
+  }
+  iov = &tb->iov[tb->iovcnt];
+  dst = tb->buf + tb->buflen;
+  if (tp->vlan_needed && (head >= 12)) {
+    memcpy(dst, tp->data, 12);
+    memcpy(dst + 12, tp->vlan_header, 4);
+    memcpy(dst + 16, tp->data + 12, head - 12);
+    iov[n].len = head + 4;
+  } else {
+    memcpy(dst, tp->data, head);
+    iov[n].len = head;
+  }
+  iov[n++].base = dst;
+  tb->buflen += iov[0].len;
+  for (i = 0; i < tb->nfrags; i++) {
+    base = (const Bit8u*)tb->frag[i].base;
+    if ((base >= tp->data) && (base < tp->data + 0x10000)) {
+      // frame buffer contents are overwritten by the next frame
+      dst = tb->buf + tb->buflen;
+      memcpy(dst, base, tb->frag[i].len);
+      tb->buflen += tb->frag[i].len;
+      base = dst;
+    }
+    if ((const Bit8u*)iov[n-1].base + iov[n-1].len == base) {
+      iov[n-1].len += tb->frag[i].len;
+    } else {
+      iov[n].base = base;
+      iov[n++].len = tb->frag[i].len;
+    }
+  }
+  tb->pkt[tb->count].iov = iov;
+  tb->pkt[tb->count++].iovcnt = n;
+  tb->iovcnt += n;
+}
+
+void bx_e1000_c::tx_flush()
+{
+  e1000_tx_batch *tb = &BX_E1000_THIS s.txb;
+
+  if (tb->count > 0) {
+    BX_E1000_THIS ethdev->sendpkts(tb->pkt, tb->count);
+  }
+  tb->count = 0;
+  tb->iovcnt = 0;
+  tb->buflen = 0;
+}
+
 void bx_e1000_c::xmit_seg()
 {
   Bit16u len;
@@ -1176,16 +1490,10 @@ void bx_e1000_c::xmit_seg()
   }
 
   if (tp->sum_needed & E1000_TXD_POPTS_TXSM)
-    putsum(tp->data, tp->size, tp->tucso, tp->tucss, tp->tucse);
+    putsum(tp->size, tp->tucso, tp->tucss, tp->tucse);
   if (tp->sum_needed & E1000_TXD_POPTS_IXSM)
-    putsum(tp->data, tp->size, tp->ipcso, tp->ipcss, tp->ipcse);
-  if (tp->vlan_needed) {
-    memmove(tp->vlan, tp->data, 4);
-    memmove(tp->data, tp->data + 4, 8);
-    memcpy(tp->data + 8, tp->vlan_header, 4);
-    BX_E1000_THIS ethdev->sendpkt(tp->vlan, tp->size + 4);
-  } else
-    BX_E1000_THIS ethdev->sendpkt(tp->data, tp->size);
+    putsum(tp->size, tp->ipcso, tp->ipcss, tp->ipcse);
+  tx_queue_frame();
   BX_E1000_THIS s.mac_reg[TPT]++;
   BX_E1000_THIS s.mac_reg[GPTC]++;
   n = BX_E1000_THIS s.mac_reg[TOTL];
@@ -1249,23 +1557,25 @@ void bx_e1000_c::process_tx_desc(struct e1000_tx_desc *dp)
       bytes = split_size;
       if (tp->size + bytes > msh)
         bytes = msh - tp->size;
-      DEV_MEM_READ_PHYSICAL_DMA(addr, bytes, tp->data + tp->size);
-      if ((sz = tp->size + bytes) >= hdr && tp->size < hdr)
+      if ((sz = tp->size + bytes) >= hdr && tp->size < hdr) {
+        tx_append(addr, bytes);
         memmove(tp->header, tp->data, hdr);
-      tp->size = sz;
+      } else {
+        tx_append(addr, bytes);
+      }
       addr += bytes;
       if (sz == msh) {
         xmit_seg();
         memmove(tp->data, tp->header, hdr);
         tp->size = hdr;
+        BX_E1000_THIS s.txb.nfrags = 0;
       }
     } while (split_size -= bytes);
   } else if (!tp->tse && tp->cptse) {
     // context descriptor TSE is not set, while data descriptor TSE is set
     BX_DEBUG(("TCP segmentaion Error"));
   } else {
-    DEV_MEM_READ_PHYSICAL_DMA(addr, split_size, tp->data + tp->size);
-    tp->size += split_size;
+    tx_append(addr, split_size);
   }
 
   if (!(txd_lower & E1000_TXD_CMD_EOP))
@@ -1277,6 +1587,7 @@ void bx_e1000_c::process_tx_desc(struct e1000_tx_desc *dp)
   tp->vlan_needed = 0;
   tp->size = 0;
   tp->cptse = 0;
+  BX_E1000_THIS s.txb.nfrags = 0;
 }
 
 Bit32u bx_e1000_c::txdesc_writeback(bx_phy_address base, struct e1000_tx_desc *dp)
@@ -1306,6 +1617,7 @@ void bx_e1000_c::start_xmit()
   bx_phy_address base;
   struct e1000_tx_desc desc;
   Bit32u tdh_start = BX_E1000_THIS s.mac_reg[TDH], cause = E1000_ICS_TXQE;
+  Bit32u delayed = 0, wb;
 
   if (!(BX_E1000_THIS s.mac_reg[TCTL] & E1000_TCTL_EN)) {
     BX_DEBUG(("tx disabled"));
@@ -1321,7 +1633,12 @@ void bx_e1000_c::start_xmit()
                desc.upper.data));
 
     process_tx_desc(&desc);
-    cause |= txdesc_writeback(base, &desc);
+    wb = txdesc_writeback(base, &desc);
+    if (le32_to_cpu(desc.lower.data) & E1000_TXD_CMD_IDE) {
+      delayed |= wb;
+    } else {
+      cause |= wb;
+    }
 
     if (++BX_E1000_THIS s.mac_reg[TDH] * sizeof(desc) >= BX_E1000_THIS s.mac_reg[TDLEN])
         BX_E1000_THIS s.mac_reg[TDH] = 0;
@@ -1336,20 +1653,48 @@ void bx_e1000_c::start_xmit()
       break;
     }
   }
-  BX_E1000_THIS s.tx.int_cause = cause;
-  bx_pc_system.activate_timer(BX_E1000_THIS s.tx_timer_index, 10, 0); // not continuous
+  // an unfinished frame must not keep references to guest memory
+  tx_materialize();
+  tx_flush();
+  post_tx_cause(cause, delayed);
   bx_gui->statusbar_setitem(BX_E1000_THIS s.statusbar_id, 1, 1);
 }
 
-void bx_e1000_c::tx_timer_handler(void *this_ptr)
+void bx_e1000_c::int_timer_handler(void *this_ptr)
 {
   bx_e1000_c *class_ptr = (bx_e1000_c *) this_ptr;
-  class_ptr->tx_timer();
+  class_ptr->int_timer();
 }
 
-void bx_e1000_c::tx_timer(void)
+void bx_e1000_c::int_timer(void)
 {
-  set_ics(BX_E1000_THIS s.tx.int_cause);
+  Bit64u now = bx_pc_system.time_usec();
+  Bit32u cause = 0;
+
+  if (((BX_E1000_THIS s.mit.rx_pkt != 0) && (BX_E1000_THIS s.mit.rx_pkt <= now)) ||
+      ((BX_E1000_THIS s.mit.rx_abs != 0) && (BX_E1000_THIS s.mit.rx_abs <= now))) {
+    cause |= BX_E1000_THIS s.mit.rx_cause;
+    BX_E1000_THIS s.mit.rx_cause = 0;
+    BX_E1000_THIS s.mit.rx_pkt = 0;
+    BX_E1000_THIS s.mit.rx_abs = 0;
+  }
+  if ((BX_E1000_THIS s.mit.tx_imm_time != 0) && (BX_E1000_THIS s.mit.tx_imm_time <= now)) {
+    cause |= BX_E1000_THIS s.mit.tx_imm;
+    BX_E1000_THIS s.mit.tx_imm = 0;
+    BX_E1000_THIS s.mit.tx_imm_time = 0;
+  }
+  if (((BX_E1000_THIS s.mit.tx_pkt != 0) && (BX_E1000_THIS s.mit.tx_pkt <= now)) ||
+      ((BX_E1000_THIS s.mit.tx_abs != 0) && (BX_E1000_THIS s.mit.tx_abs <= now)) ||
+      ((cause & BX_E1000_THIS s.mit.tx_cause) != 0)) {
+    cause |= BX_E1000_THIS s.mit.tx_cause;
+    BX_E1000_THIS s.mit.tx_cause = 0;
+    BX_E1000_THIS s.mit.tx_pkt = 0;
+    BX_E1000_THIS s.mit.tx_abs = 0;
+  }
+  if ((cause != 0) || BX_E1000_THIS s.mit.itr_pending) {
+    set_ics(cause);
+  }
+  update_int_timer(now);
 }
 
 int bx_e1000_c::receive_filter(const Bit8u *buf, int size)
@@ -1495,7 +1840,7 @@ void bx_e1000_c::rx_frame(const void *buf, unsigned buf_size)
   desc_offset = 0;
   total_size = buf_size + fcs_len();
   if (!e1000_has_rxbufs(total_size)) {
-    set_ics(E1000_ICS_RXO);
+    post_rx_cause(E1000_ICS_RXO);
     return;
   }
   do {
@@ -1536,7 +1881,7 @@ void bx_e1000_c::rx_frame(const void *buf, unsigned buf_size)
     if (BX_E1000_THIS s.mac_reg[RDH] == rdh_start) {
         BX_DEBUG(("RDH wraparound @%x, RDT %x, RDLEN %x",
                   rdh_start, BX_E1000_THIS s.mac_reg[RDT], BX_E1000_THIS s.mac_reg[RDLEN]));
-        set_ics(E1000_ICS_RXO);
+        post_rx_cause(E1000_ICS_RXO);
         return;
     }
   } while (desc_offset < total_size);
@@ -1559,7 +1904,7 @@ void bx_e1000_c::rx_frame(const void *buf, unsigned buf_size)
       BX_E1000_THIS s.rxbuf_min_shift)
     n |= E1000_ICS_RXDMT0;
 
-  set_ics(n);
+  post_rx_cause(n);
 
   bx_gui->statusbar_setitem(BX_E1000_THIS s.statusbar_id, 1);
 }
@@ -79,9 +79,46 @@ typedef struct {
   bool    ip;
   bool    tcp;
   bool    cptse; // current packet tse bit
-  Bit32u  int_cause;
 } e1000_tx;
 
+// frame head copied from guest memory (may be modified by offloading)
+#define E1000_TX_COPYBREAK     64
+// guest memory fragments per frame / copy space for a batch of frames
+#define E1000_TX_MAX_FRAGS     32
+#define E1000_TX_BATCH_BUFSIZE 0x20000
+
+// Zero-copy transmit state (not saved, always empty outside start_xmit)
+typedef struct {
+  // the frame being assembled: tx.data holds the bytes before frag_start,
+  // the fragments (guest memory or tx.data) cover frag_start ... tx.size
+  unsigned nfrags;
+  Bit32u frag_start;
+  bx_net_iov_t frag[E1000_TX_MAX_FRAGS];
+  // frames waiting for the next sendpkts() call
+  unsigned count;
+  bx_net_pkt_t pkt[BX_NET_BATCH_MAX];
+  unsigned iovcnt;
+  bx_net_iov_t *iov;
+  unsigned buflen;
+  Bit8u *buf;
+} e1000_tx_batch;
+
+// Interrupt moderation state. Deadlines are in usec of emulated time,
+// 0 means the timer is not running.
+typedef struct {
+  Bit32u rx_cause;    // receive causes held back by the delay timers
+  Bit64u rx_pkt;      // packet delay timer (RDTR)
+  Bit64u rx_abs;      // absolute delay timer (RADV)
+  Bit32u tx_cause;    // transmit causes held back by the delay timers
+  Bit64u tx_pkt;      // packet delay timer (TIDV)
+  Bit64u tx_abs;      // absolute delay timer (TADV)
+  Bit32u tx_imm;      // other transmit causes ...
+  Bit64u tx_imm_time; // ... reported after the transmit latency
+  Bit64u itr_next;    // earliest time of the next interrupt (ITR)
+  bool   itr_pending; // interrupt held back by the throttling interval
+  bool   irq_level;   // current state of the interrupt line
+} e1000_mit;
+
 typedef struct {
   Bit32u *mac_reg;
   Bit16u phy_reg[0x20];
@@ -92,6 +129,8 @@ typedef struct {
   bool check_rxov;
 
   e1000_tx tx;
+  e1000_tx_batch txb;
+  e1000_mit mit;
 
   struct {
     Bit32u  val_in; // shifted in from guest driver
@@ -101,7 +140,7 @@ typedef struct {
     Bit32u  old_eecd;
   } eecd_state;
 
-  int tx_timer_index;
+  int int_timer_index;
   int statusbar_id;
 
   Bit8u devfunc;
@@ -131,26 +170,35 @@ private:
   void    set_irq_level(bool level);
   void    set_interrupt_cause(Bit32u val);
   void    set_ics(Bit32u value);
+  void    post_rx_cause(Bit32u cause);
+  void    post_tx_cause(Bit32u cause, Bit32u delayed);
+  void    update_int_timer(Bit64u now);
   int     rxbufsize(Bit32u v);
   void    set_rx_control(Bit32u value);
   void    set_mdic(Bit32u value);
   Bit32u  get_eecd(void);
   void    set_eecd(Bit32u value);
   Bit32u  flash_eerd_read(void);
-  void    putsum(Bit8u *data, Bit32u n, Bit32u sloc, Bit32u css, Bit32u cse);
+  void    putsum(Bit32u n, Bit32u sloc, Bit32u css, Bit32u cse);
   bool    vlan_enabled(void);
   bool    vlan_rx_filter_enabled(void);
   bool    is_vlan_packet(const Bit8u *buf);
   bool    is_vlan_txd(Bit32u txd_lower);
   int     fcs_len(void);
+  unsigned tx_copy_len(void);
+  void    tx_append(bx_phy_address addr, unsigned len);
+  void    tx_materialize(void);
+  Bit32u  tx_checksum_add(unsigned start, unsigned end);
+  void    tx_queue_frame(void);
+  void    tx_flush(void);
   void    xmit_seg(void);
   void    process_tx_desc(struct e1000_tx_desc *dp);
   Bit32u  txdesc_writeback(bx_phy_address base, struct e1000_tx_desc *dp);
   Bit64u  tx_desc_base(void);
   void    start_xmit(void);
 
-  static void tx_timer_handler(void *);
-  void tx_timer(void);
+  static void int_timer_handler(void *);
+  void int_timer(void);
 
   int     receive_filter(const Bit8u *buf, int size);
   bool    e1000_has_rxbufs(size_t total_size);
@@ -67,6 +67,7 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <netpacket/packet.h>
 #include <netinet/in.h>
 #include <net/ethernet.h>
@@ -75,8 +76,6 @@ extern "C" {
 #include <linux/filter.h>
 };
 
-#define BX_PACKET_POLL  1000    // Poll for a frame every 1000 usecs
-
 // template filter for a unicast mac address and all
 // multicast/broadcast frames
 static const struct sock_filter macfilter[] = {
@@ -101,7 +100,7 @@ static const struct sock_filter promiscfilter[] = {
 //
 //  Define the class. This is private to this module
 //
-class bx_linux_pktmover_c : public eth_pktmover_c {
+class bx_linux_pktmover_c : public eth_fd_pktmover_c {
 public:
   bx_linux_pktmover_c(const char *netif,
                       const char *macaddr,
@@ -109,15 +108,17 @@ public:
                       eth_rx_status_t rxstat,
                       logfunctions *netdev,
                       const char *script);
+  virtual ~bx_linux_pktmover_c();
   void sendpkt(void *buf, unsigned io_len);
+  void sendpkts(const bx_net_pkt_t *pkts, unsigned count);
+
+protected:
+  int rx_read(Bit8u *buf, unsigned size);
 
 private:
   unsigned char *linux_macaddr[6];
   int fd;
   int ifindex;
-  static void rx_timer_handler(void *);
-  void rx_timer(void);
-  int rx_timer_index;
   struct sock_filter filter[BX_LSF_ICNT];
 };
 
@@ -236,16 +237,19 @@ bx_linux_pktmover_c::bx_linux_pktmover_c(const char *netif,
     return;
   }
 
-  // Start the rx poll
-  this->rx_timer_index =
-    DEV_register_timer(this, this->rx_timer_handler, BX_PACKET_POLL, 1, 1,
-                       "eth_linux"); // continuous, active
-
   this->rxh    = rxh;
   this->rxstat = rxstat;
+
+  // Start the receive thread
+  start_rx(this->fd, "eth_linux");
   BX_INFO(("linux network driver initialized: using interface %s", netif));
 }
 
+bx_linux_pktmover_c::~bx_linux_pktmover_c()
+{
+  stop_rx();
+}
+
 // the output routine - called with pre-formatted ethernet frame.
 void
 bx_linux_pktmover_c::sendpkt(void *buf, unsigned io_len)
@@ -259,47 +263,68 @@ bx_linux_pktmover_c::sendpkt(void *buf, unsigned io_len)
   }
 }
 
-// The receive poll process
+// send a batch of frames with a single system call
 void
-bx_linux_pktmover_c::rx_timer_handler(void *this_ptr)
+bx_linux_pktmover_c::sendpkts(const bx_net_pkt_t *pkts, unsigned count)
 {
-  bx_linux_pktmover_c *class_ptr = (bx_linux_pktmover_c *) this_ptr;
-
-  class_ptr->rx_timer();
+  struct mmsghdr msgs[BX_NET_BATCH_MAX];
+  struct iovec vec[BX_NET_BATCH_MAX * 4];
+  unsigned i, j, n, nvec;
+  int ret;
+
+  if (this->fd == -1) return;
+  while (count > 0) {
+    memset(msgs, 0, sizeof(msgs));
+    nvec = 0;
+    for (n = 0; (n < count) && (n < BX_NET_BATCH_MAX); n++) {
+      if ((nvec + pkts[n].iovcnt) > (BX_NET_BATCH_MAX * 4)) break;
+      msgs[n].msg_hdr.msg_iov = &vec[nvec];
+      msgs[n].msg_hdr.msg_iovlen = pkts[n].iovcnt;
+      for (j = 0; j < pkts[n].iovcnt; j++, nvec++) {
+        vec[nvec].iov_base = (void*)pkts[n].iov[j].base;
+        vec[nvec].iov_len = pkts[n].iov[j].len;
+      }
+    }
+    if (n == 0) {
+      // too many buffers for one message
+      eth_pktmover_c::sendpkt_iov(pkts[0].iov, pkts[0].iovcnt);
+      n = 1;
+    } else {
+      for (i = 0; i < n; i += ret) {
+        ret = sendmmsg(this->fd, &msgs[i], n - i, 0);
+        if (ret <= 0) {
+          BX_INFO(("eth_linux: write failed: %s", strerror(errno)));
+          ret = 1;
+        }
+      }
+    }
+    pkts += n;
+    count -= n;
+  }
 }
 
-void
-bx_linux_pktmover_c::rx_timer(void)
+// receive one frame (called from the receive thread)
+int
+bx_linux_pktmover_c::rx_read(Bit8u *rxbuf, unsigned size)
 {
   int nbytes = 0;
-  Bit8u rxbuf[BX_PACKET_BUFSIZE];
   struct sockaddr_ll sll;
   socklen_t fromlen;
 
-  if (this->fd == -1)
-    return;
-
   fromlen = sizeof(sll);
-  nbytes = recvfrom(this->fd, rxbuf, sizeof(rxbuf), 0, (struct sockaddr *)&sll, &fromlen);
+  nbytes = recvfrom(this->fd, rxbuf, size, 0, (struct sockaddr *)&sll, &fromlen);
 
   if (nbytes == -1) {
-    if (errno != EAGAIN)
-      BX_INFO(("eth_linux: error receiving packet: %s\n", strerror(errno)));
-    return;
+    if ((errno != EAGAIN) && (errno != EINTR))
+      BX_INFO(("eth_linux: error receiving packet: %s", strerror(errno)));
+    return -1;
   }
 
   // this should be done with LSF someday
   // filter out packets sourced by us
   if (memcmp(sll.sll_addr, this->linux_macaddr, 6) == 0)
-    return;
-  // let through broadcast, multicast, and our mac address
-//  if ((memcmp(rxbuf, broadcast_macaddr, 6) == 0) || (memcmp(rxbuf, this->linux_macaddr, 6) == 0) || rxbuf[0] & 0x01) {
-    BX_DEBUG(("eth_linux: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x\n", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
-    if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-      this->rxh(this->netdev, rxbuf, nbytes);
-    } else {
-      BX_ERROR(("device not ready to receive data"));
-    }
-//  }
+    return 0;
+  BX_DEBUG(("eth_linux: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
+  return nbytes;
 }
 #endif /* if BX_NETWORKING && BX_NETMOD_LINUX */
@@ -0,0 +1,495 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+
+// eth_replay.cc  - pktmover that feeds the frames of a pcap-ng capture
+// file ('ethdev' option) to the guest.
+//
+// The received frames of the capture are passed to the device model at
+// the emulated time they were recorded. If the file was written by the
+// Bochs 'capture' option, the interface comment holds the IPS value and
+// the frames are injected at the exact CPU tick of the recording. For
+// other captures the time is relative to the first frame. Frames sent by
+// the guest are not forwarded, but compared with the recorded ones to
+// report the first point where the run diverges from the capture.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "bochs.h"
+#include "plugin.h"
+#include "pc_system.h"
+#include "gui/siminterface.h"
+#include "param_names.h"
+#include "netmod.h"
+#include "pcapng.h"
+
+#if BX_NETWORKING
+
+// network driver plugin entry point
+
+PLUGIN_ENTRY_FOR_NET_MODULE(replay)
+{
+  if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_NET;
+  }
+  return 0; // Success
+}
+
+// network driver implementation
+
+#define LOG_THIS netdev->
+
+// Maximum number of interfaces per section and size of a pcap-ng block
+#define REPLAY_MAX_IF     16
+#define REPLAY_MAX_BLOCK  (1 << 18)
+
+// Delay for retrying a frame while the device is not ready (usec)
+#define REPLAY_RETRY_USEC 10
+
+// Sequential reader for the packet blocks of a pcap-ng file
+typedef struct {
+  FILE *fd;
+  bool swapped;
+  unsigned if_count;
+  Bit64u if_tsunits[REPLAY_MAX_IF]; // timestamp units per second
+  Bit64u ips;                       // IPS of a Bochs capture or 0
+  Bit64u last_ns;
+  Bit8u *block;
+} replay_reader_t;
+
+class bx_replay_pktmover_c : public eth_pktmover_c {
+public:
+  bx_replay_pktmover_c(const char *netif, const char *macaddr,
+                       eth_rx_handler_t rxh,
+                       eth_rx_status_t rxstat,
+                       logfunctions *netdev, const char *script);
+  virtual ~bx_replay_pktmover_c();
+  void sendpkt(void *buf, unsigned io_len);
+private:
+  replay_reader_t rx_reader, tx_reader;
+  Bit8u guest_macaddr[6];
+  Bit64u ips;
+  Bit64u start_tick;
+  Bit64u start_ns;
+  bool start_valid;
+  // next frame for the guest
+  Bit8u rxbuf[REPLAY_MAX_BLOCK];
+  unsigned rx_len;
+  Bit64u rx_tick;
+  bool rx_pending;
+  bool rx_late;
+  bool rx_sync;         // recorded as reply to the preceding guest frame
+  Bit64u rx_need_tx;    // guest frames preceding it in the capture
+  Bit64u rx_tx_seen;
+  int rx_timer_index;
+  // frame expected from the guest
+  Bit8u txbuf[REPLAY_MAX_BLOCK];
+  unsigned tx_len;
+  bool tx_pending;
+  bool tx_diverged;
+  // statistics
+  Bit64u rx_count, rx_late_count, tx_count;
+
+  bool reader_open(replay_reader_t *r, const char *filename);
+  void reader_close(replay_reader_t *r);
+  Bit32u reader_get32(replay_reader_t *r, const Bit8u *p);
+  Bit16u reader_get16(replay_reader_t *r, const Bit8u *p);
+  void reader_parse_idb(replay_reader_t *r, const Bit8u *body, unsigned len);
+  bool reader_next(replay_reader_t *r, Bit8u *buf, unsigned *len,
+                   Bit64u *ns, bool *inbound);
+  bool next_tx_frame(replay_reader_t *r, Bit8u *buf, unsigned *len, Bit64u *ns);
+  void load_rx();
+  void load_tx();
+  static void rx_timer_handler(void *);
+  void rx_timer();
+};
+
+class bx_replay_locator_c : public eth_locator_c {
+public:
+  bx_replay_locator_c(void) : eth_locator_c("replay") {}
+protected:
+  eth_pktmover_c *allocate(const char *netif, const char *macaddr,
+                           eth_rx_handler_t rxh, eth_rx_status_t rxstat,
+                           logfunctions *netdev, const char *script) {
+    return (new bx_replay_pktmover_c(netif, macaddr, rxh, rxstat, netdev, script));
+  }
+} bx_replay_match;
+
+
+bx_replay_pktmover_c::bx_replay_pktmover_c(const char *netif,
+                                           const char *macaddr,
+                                           eth_rx_handler_t rxh,
+                                           eth_rx_status_t rxstat,
+                                           logfunctions *netdev,
+                                           const char *script)
+{
+  Bit64u now;
+
+  this->netdev = netdev;
+  this->rxh = rxh;
+  this->rxstat = rxstat;
+  memcpy(guest_macaddr, macaddr, 6);
+  ips = SIM->get_param_num(BXPN_IPS)->get();
+  start_tick = bx_pc_system.time_ticks();
+  start_ns = 0;
+  start_valid = 0;
+  rx_len = tx_len = 0;
+  rx_tick = 0;
+  rx_pending = rx_late = rx_sync = 0;
+  rx_need_tx = rx_tx_seen = 0;
+  tx_pending = tx_diverged = 0;
+  rx_count = rx_late_count = tx_count = 0;
+  memset(&rx_reader, 0, sizeof(rx_reader));
+  memset(&tx_reader, 0, sizeof(tx_reader));
+  rx_timer_index =
+    bx_pc_system.register_timer_ticks(this, rx_timer_handler, 1, 0, 0, "eth_replay");
+  if (!reader_open(&rx_reader, netif) || !reader_open(&tx_reader, netif)) {
+    BX_PANIC(("replay: cannot open capture file '%s'", netif));
+    return;
+  }
+  BX_INFO(("replay network driver: capture file '%s'", netif));
+  load_rx();
+  load_tx();
+  if ((rx_reader.ips > 0) && (rx_reader.ips != ips)) {
+    BX_ERROR(("replay: capture was made with ips=" FMT_LL "u, guest timing will differ",
+              rx_reader.ips));
+  }
+  if (rx_pending) {
+    now = bx_pc_system.time_ticks();
+    bx_pc_system.activate_timer_ticks(rx_timer_index,
+                                      (rx_tick > now) ? (rx_tick - now) : 1, 0);
+  }
+}
+
+bx_replay_pktmover_c::~bx_replay_pktmover_c()
+{
+  bx_pc_system.deactivate_timer(rx_timer_index);
+  BX_INFO(("replay: " FMT_LL "u frames injected (" FMT_LL "u delayed by the device), "
+           FMT_LL "u frames sent by the guest", rx_count, rx_late_count, tx_count));
+  reader_close(&rx_reader);
+  reader_close(&tx_reader);
+}
+
+// Compare the frame sent by the guest with the next outbound frame of the
+// capture. Only the first difference is reported.
+void bx_replay_pktmover_c::sendpkt(void *buf, unsigned io_len)
+{
+  tx_count++;
+  if (!tx_diverged) {
+    if (!tx_pending) {
+      BX_INFO(("replay: guest sends more frames than recorded (frame " FMT_LL "u)",
+               tx_count));
+      tx_diverged = 1;
+    } else if ((io_len != tx_len) || memcmp(buf, txbuf, io_len)) {
+      BX_ERROR(("replay: guest frame " FMT_LL "u differs from the capture (len=%u, expected %u)",
+                tx_count, io_len, tx_len));
+      tx_diverged = 1;
+    } else {
+      load_tx();
+    }
+  }
+  // a reply the networking module has passed back immediately
+  if (rx_pending && rx_sync && (tx_count >= rx_need_tx) &&
+      (rx_tick <= bx_pc_system.time_ticks())) {
+    rx_timer();
+  }
+}
+
+void bx_replay_pktmover_c::rx_timer_handler(void *this_ptr)
+{
+  ((bx_replay_pktmover_c*)this_ptr)->rx_timer();
+}
+
+// Pass all frames that are due to the device model and arm the timer for
+// the next one. A frame the device cannot take yet is retried shortly.
+// Timers expire before the instruction of their tick, so a frame recorded
+// as immediate reply to a guest frame is passed on by sendpkt() instead.
+// The timer one tick later only serves as fallback.
+void bx_replay_pktmover_c::rx_timer()
+{
+  Bit64u now, due;
+
+  while (rx_pending) {
+    now = bx_pc_system.time_ticks();
+    due = rx_tick;
+    if (rx_sync && (tx_count < rx_need_tx)) {
+      due++;
+    }
+    if (due > now) {
+      bx_pc_system.activate_timer_ticks(rx_timer_index, due - now, 0);
+      return;
+    }
+    if (!(this->rxstat(this->netdev) & BX_NETDEV_RXREADY)) {
+      if (!rx_late) {
+        rx_late = 1;
+        rx_late_count++;
+      }
+      bx_pc_system.activate_timer(rx_timer_index, REPLAY_RETRY_USEC, 0);
+      return;
+    }
+    this->rxh(this->netdev, rxbuf, rx_len);
+    rx_count++;
+    load_rx();
+  }
+  BX_INFO(("replay: end of capture reached, " FMT_LL "u frames injected", rx_count));
+}
+
+// fetch the next frame for the guest and compute its CPU tick
+void bx_replay_pktmover_c::load_rx()
+{
+  Bit64u ns, tx_ns = 0;
+  bool inbound, after_tx = 0;
+
+  rx_late = 0;
+  while ((rx_pending = reader_next(&rx_reader, rxbuf, &rx_len, &ns, &inbound)) &&
+         !inbound) {
+    rx_tx_seen++;
+    tx_ns = ns;
+    after_tx = 1;
+  }
+  if (!rx_pending) {
+    return;
+  }
+  rx_sync = after_tx && (ns == tx_ns);
+  rx_need_tx = rx_tx_seen;
+  if (rx_len < MIN_RX_PACKET_LEN) {
+    memset(rxbuf + rx_len, 0, MIN_RX_PACKET_LEN - rx_len);
+    rx_len = MIN_RX_PACKET_LEN;
+  }
+  if (rx_reader.ips > 0) {
+    rx_tick = pcapng_ns_to_ticks(ns, rx_reader.ips);
+  } else {
+    if (!start_valid) {
+      start_ns = ns;
+      start_valid = 1;
+    }
+    rx_tick = start_tick + pcapng_ns_to_ticks((ns > start_ns) ? (ns - start_ns) : 0, ips);
+  }
+}
+
+void bx_replay_pktmover_c::load_tx()
+{
+  Bit64u ns;
+
+  tx_pending = next_tx_frame(&tx_reader, txbuf, &tx_len, &ns);
+}
+
+// skip to the next frame sent by the guest
+bool bx_replay_pktmover_c::next_tx_frame(replay_reader_t *r, Bit8u *buf,
+                                         unsigned *len, Bit64u *ns)
+{
+  bool inbound;
+
+  while (reader_next(r, buf, len, ns, &inbound)) {
+    if (!inbound) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+bool bx_replay_pktmover_c::reader_open(replay_reader_t *r, const char *filename)
+{
+  r->fd = fopen(filename, "rb");
+  if (r->fd == NULL) {
+    return 0;
+  }
+  r->block = new Bit8u[REPLAY_MAX_BLOCK];
+  return 1;
+}
+
+void bx_replay_pktmover_c::reader_close(replay_reader_t *r)
+{
+  if (r->fd != NULL) {
+    fclose(r->fd);
+    r->fd = NULL;
+  }
+  delete [] r->block;
+  r->block = NULL;
+}
+
+Bit32u bx_replay_pktmover_c::reader_get32(replay_reader_t *r, const Bit8u *p)
+{
+  Bit32u val;
+
+  memcpy(&val, p, 4);
+  if (r->swapped) {
+    val = (val >> 24) | ((val >> 8) & 0xff00) | ((val << 8) & 0xff0000) | (val << 24);
+  }
+  return val;
+}
+
+Bit16u bx_replay_pktmover_c::reader_get16(replay_reader_t *r, const Bit8u *p)
+{
+  Bit16u val;
+
+  memcpy(&val, p, 2);
+  if (r->swapped) {
+    val = (val >> 8) | (val << 8);
+  }
+  return val;
+}
+
+// read the timestamp resolution and the Bochs IPS comment of an interface
+void bx_replay_pktmover_c::reader_parse_idb(replay_reader_t *r, const Bit8u *body, unsigned len)
+{
+  unsigned pos = 8, code, optlen, i;
+  Bit64u units = 1000000;
+  Bit8u tsresol;
+  char text[64];
+
+  if (reader_get16(r, body) != PCAPNG_LINKTYPE_ETHERNET) {
+    BX_ERROR(("replay: interface %u is not an ethernet interface", r->if_count));
+  }
+  while ((pos + 4) <= len) {
+    code = reader_get16(r, body + pos);
+    optlen = reader_get16(r, body + pos + 2);
+    pos += 4;
+    if ((code == PCAPNG_OPT_ENDOFOPT) || ((pos + optlen) > len))
+      break;
+    if ((code == PCAPNG_IF_TSRESOL) && (optlen == 1)) {
+      tsresol = body[pos];
+      // 10^19 and 2^63 are the largest units that fit in 64 bits
+      if ((tsresol & 0x7f) > ((tsresol & 0x80) ? 63 : 19)) {
+        BX_ERROR(("replay: interface %u timestamp resolution 0x%02x out of range, using microseconds",
+                  r->if_count, tsresol));
+      } else {
+        units = 1;
+        for (i = 0; i < (unsigned)(tsresol & 0x7f); i++) {
+          units *= (tsresol & 0x80) ? 2 : 10;
+        }
+      }
+    } else if ((code == PCAPNG_OPT_COMMENT) && (optlen < sizeof(text))) {
+      memcpy(text, body + pos, optlen);
+      text[optlen] = 0;
+      if (!strncmp(text, PCAPNG_BX_COMMENT, strlen(PCAPNG_BX_COMMENT))) {
+        r->ips = strtoull(text + strlen(PCAPNG_BX_COMMENT), NULL, 10);
+      }
+    }
+    pos += (optlen + 3) & ~3;
+  }
+  if (r->if_count < REPLAY_MAX_IF) {
+    r->if_tsunits[r->if_count] = units;
+  }
+  r->if_count++;
+}
+
+// Read blocks until the next packet block. Returns the frame, its time in
+// nanoseconds and whether it was received by the guest.
+bool bx_replay_pktmover_c::reader_next(replay_reader_t *r, Bit8u *buf, unsigned *len,
+                                       Bit64u *ns, bool *inbound)
+{
+  Bit8u hdr[12];
+  Bit32u type, blen, iface, caplen, flags = 0, pos;
+  Bit64u ts, units;
+  Bit8u *body = r->block;
+  bool report = (r == &rx_reader);
+
+  while (fread(hdr, 8, 1, r->fd) == 1) {
+    memcpy(&type, hdr, 4);
+    if (type == PCAPNG_BLOCK_SHB) {
+      // new section: the byte order magic follows the block length
+      if (fread(hdr + 8, 4, 1, r->fd) != 1)
+        break;
+      r->swapped = 0;
+      if (reader_get32(r, hdr + 8) != PCAPNG_BYTE_ORDER_MAGIC) {
+        r->swapped = 1;
+        if (reader_get32(r, hdr + 8) != PCAPNG_BYTE_ORDER_MAGIC) {
+          if (report) BX_ERROR(("replay: bad section header"));
+          break;
+        }
+      }
+      r->if_count = 0;
+      blen = reader_get32(r, hdr + 4);
+      if ((blen < 28) || (fseek(r->fd, blen - 12, SEEK_CUR) != 0))
+        break;
+      continue;
+    }
+    type = reader_get32(r, hdr);
+    blen = reader_get32(r, hdr + 4);
+    if ((blen < 12) || (blen > REPLAY_MAX_BLOCK) || (blen & 3)) {
+      if (report) BX_ERROR(("replay: bad block length %u", blen));
+      break;
+    }
+    blen -= 12;
+    if ((blen > 0) && (fread(body, blen, 1, r->fd) != 1))
+      break;
+    if (fread(hdr, 4, 1, r->fd) != 1)
+      break;
+    if (type == PCAPNG_BLOCK_IDB) {
+      if (blen >= 8) {
+        reader_parse_idb(r, body, blen);
+      }
+      continue;
+    } else if ((type == PCAPNG_BLOCK_EPB) && (blen >= 20)) {
+      iface = reader_get32(r, body);
+      ts = ((Bit64u)reader_get32(r, body + 4) << 32) | reader_get32(r, body + 8);
+      caplen = reader_get32(r, body + 12);
+      if (caplen > (blen - 20))
+        continue;
+      memcpy(buf, body + 20, caplen);
+      *len = caplen;
+      pos = 20 + ((caplen + 3) & ~3);
+      while ((pos + 4) <= blen) {
+        Bit16u code = reader_get16(r, body + pos);
+        Bit16u optlen = reader_get16(r, body + pos + 2);
+        pos += 4;
+        if ((code == PCAPNG_OPT_ENDOFOPT) || ((pos + optlen) > blen))
+          break;
+        if ((code == PCAPNG_EPB_FLAGS) && (optlen == 4)) {
+          flags = reader_get32(r, body + pos);
+        }
+        pos += (optlen + 3) & ~3;
+      }
+      units = ((iface < r->if_count) && (iface < REPLAY_MAX_IF)) ? r->if_tsunits[iface] : 1000000;
+      if ((units >= BX_CONST64(1000000000)) && ((units % BX_CONST64(1000000000)) == 0)) {
+        r->last_ns = ts / (units / BX_CONST64(1000000000));
+      } else {
+        r->last_ns = (ts / units) * BX_CONST64(1000000000) +
+                     ((ts % units) * BX_CONST64(1000000000)) / units;
+      }
+      *ns = r->last_ns;
+    } else if ((type == PCAPNG_BLOCK_SPB) && (blen >= 4)) {
+      // no timestamp: use the time of the previous frame
+      caplen = reader_get32(r, body);
+      if (caplen > (blen - 4)) {
+        caplen = blen - 4;
+      }
+      memcpy(buf, body + 4, caplen);
+      *len = caplen;
+      *ns = r->last_ns;
+    } else {
+      continue;
+    }
+    if ((flags & PCAPNG_EPB_DIR_MASK) != 0) {
+      *inbound = ((flags & PCAPNG_EPB_DIR_MASK) == PCAPNG_EPB_INBOUND);
+    } else {
+      // no direction recorded: frames not sent by the guest are inbound
+      *inbound = (*len < 12) || memcmp(buf + 6, guest_macaddr, 6);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+#endif /* if BX_NETWORKING */
@@ -0,0 +1,557 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+
+// eth_shm.cc  - shared memory link between two Bochs instances on one host
+//
+// The 'ethdev' value is the path of a unix domain socket used to set up the
+// link. The first instance creates the socket and a shared memory object
+// holding one frame ring per direction. The descriptor of the memory is
+// passed to the instance connecting to the socket (SCM_RIGHTS). After that
+// a frame is copied once into the ring of the peer and no system calls are
+// made: the receiving side checks its ring from a timer in the simulator
+// thread and passes the frames to the device model directly from the ring.
+// The socket connection is only used to detect when the peer goes away.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "bochs.h"
+#include "plugin.h"
+#include "pc_system.h"
+#include "netmod.h"
+
+#if BX_NETWORKING && BX_NETMOD_SHM
+
+// network driver plugin entry point
+
+PLUGIN_ENTRY_FOR_NET_MODULE(shm)
+{
+  if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_NET;
+  }
+  return 0; // Success
+}
+
+// network driver implementation
+
+#define LOG_THIS netdev->
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define SHM_LINK_MAGIC    0x4b4c5842 // "BXLK"
+#define SHM_LINK_VERSION  1
+#define SHM_RING_SLOTS    512        // power of 2
+#define SHM_SLOT_SIZE     2048
+#define SHM_FRAME_MAX     (SHM_SLOT_SIZE - 4)
+
+// Interval for accepting a peer and checking the connection (usec)
+#define SHM_CHECK_INTERVAL 100000
+
+// Ring indices are free running counters. The producer only writes 'head'
+// and the slots, the consumer only writes 'tail'. They are kept in
+// separate cache lines to avoid false sharing between the two processes.
+typedef struct {
+  Bit32u head;
+  Bit8u pad0[60];
+  Bit32u tail;
+  Bit8u pad1[60];
+} shm_ring_ctl_t;
+
+typedef struct {
+  Bit32u magic;
+  Bit32u version;
+  Bit32u slots;
+  Bit32u slot_size;
+  Bit8u pad[48];
+  shm_ring_ctl_t ring[2]; // 0: creator -> peer, 1: peer -> creator
+} shm_link_hdr_t;
+
+typedef struct {
+  Bit32u len;
+  Bit8u data[SHM_FRAME_MAX];
+} shm_slot_t;
+
+#define SHM_LINK_SIZE (sizeof(shm_link_hdr_t) + 2 * SHM_RING_SLOTS * sizeof(shm_slot_t))
+
+static BX_CPP_INLINE Bit32u shm_load_acquire(const Bit32u *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static BX_CPP_INLINE void shm_store_release(Bit32u *ptr, Bit32u val)
+{
+  __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+//
+//  Define the class. This is private to this module
+//
+class bx_shm_pktmover_c : public eth_pktmover_c {
+public:
+  bx_shm_pktmover_c(const char *netif, const char *macaddr,
+                    eth_rx_handler_t rxh, eth_rx_status_t rxstat,
+                    logfunctions *netdev, const char *script);
+  virtual ~bx_shm_pktmover_c();
+  void sendpkt(void *buf, unsigned io_len);
+  void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+  void sendpkts(const bx_net_pkt_t *pkts, unsigned count);
+private:
+  char path[BX_PATHNAME_LEN];
+  bool creator;
+  int listen_fd;
+  int peer_fd;
+  int conn_fd;
+  int mem_fd;
+  shm_link_hdr_t *link;
+  shm_slot_t *tx_slots, *rx_slots;
+  shm_ring_ctl_t *tx_ring, *rx_ring;
+  Bit32u tx_head, rx_tail;
+  Bit64u next_check;
+  Bit64u tx_dropped;
+  int rx_timer_index;
+
+  bool link_create();
+  int link_connect(int timeout);
+  bool link_map(int fd);
+  void link_attach();
+  void link_down();
+  void link_check();
+  static void rx_timer_handler(void *);
+  void rx_timer();
+};
+
+//
+//  Define the static class that registers the derived pktmover class,
+// and allocates one on request.
+//
+class bx_shm_locator_c : public eth_locator_c {
+public:
+  bx_shm_locator_c(void) : eth_locator_c("shm") {}
+protected:
+  eth_pktmover_c *allocate(const char *netif, const char *macaddr,
+                           eth_rx_handler_t rxh, eth_rx_status_t rxstat,
+                           logfunctions *netdev, const char *script) {
+    return (new bx_shm_pktmover_c(netif, macaddr, rxh, rxstat, netdev, script));
+  }
+} bx_shm_match;
+
+// pass a descriptor to the peer
+static bool shm_send_fd(int sock, int fd)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  Bit32u magic = SHM_LINK_MAGIC;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(cbuf, 0, sizeof(cbuf));
+  iov.iov_base = &magic;
+  iov.iov_len = sizeof(magic);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return (sendmsg(sock, &msg, 0) == (ssize_t)sizeof(magic));
+}
+
+// receive the descriptor of the shared memory
+static int shm_recv_fd(int sock)
+{
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE(sizeof(int))];
+  Bit32u magic = 0;
+  int fd = -1;
+
+  memset(&msg, 0, sizeof(msg));
+  iov.iov_base = &magic;
+  iov.iov_len = sizeof(magic);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf;
+  msg.msg_controllen = sizeof(cbuf);
+  if (recvmsg(sock, &msg, 0) != (ssize_t)sizeof(magic)) {
+    return -1;
+  }
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) &&
+      (cmsg->cmsg_type == SCM_RIGHTS)) {
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  }
+  if ((fd >= 0) && (magic != SHM_LINK_MAGIC)) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+// create an anonymous shared memory object
+static int shm_create_mem(size_t size)
+{
+  int fd;
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+  fd = memfd_create("bochs-shm-link", MFD_CLOEXEC);
+#else
+  char name[64];
+
+  sprintf(name, "/bochs-shm-link-%d", (int)getpid());
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd >= 0) {
+    shm_unlink(name);
+  }
+#endif
+  if ((fd >= 0) && (ftruncate(fd, size) < 0)) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+bx_shm_pktmover_c::bx_shm_pktmover_c(const char *netif,
+                                     const char *macaddr,
+                                     eth_rx_handler_t rxh,
+                                     eth_rx_status_t rxstat,
+                                     logfunctions *netdev,
+                                     const char *script)
+{
+  int ret;
+
+  this->netdev = netdev;
+  this->rxh = rxh;
+  this->rxstat = rxstat;
+  creator = 0;
+  listen_fd = peer_fd = conn_fd = mem_fd = -1;
+  link = NULL;
+  tx_slots = rx_slots = NULL;
+  tx_ring = rx_ring = NULL;
+  tx_head = rx_tail = 0;
+  next_check = 0;
+  tx_dropped = 0;
+  if ((netif == NULL) || (strlen(netif) == 0) ||
+      (strlen(netif) >= sizeof(((struct sockaddr_un*)0)->sun_path))) {
+    BX_PANIC(("eth_shm: invalid socket path '%s'", netif));
+    return;
+  }
+  strcpy(path, netif);
+  // connect to an existing link or create a new one
+  ret = link_connect(5000);
+  if (ret == 0) {
+    BX_PANIC(("eth_shm: cannot join link '%s'", path));
+    return;
+  } else if ((ret < 0) && !link_create()) {
+    return;
+  }
+  rx_timer_index =
+    DEV_register_timer(this, rx_timer_handler, BX_NETDEV_RXQ_TIMER, 1, 1,
+                       "eth_shm");
+  BX_INFO(("shm network driver: %s '%s'", creator ? "created link" : "connected to link",
+           path));
+}
+
+bx_shm_pktmover_c::~bx_shm_pktmover_c()
+{
+  link_down();
+  if (conn_fd >= 0) {
+    close(conn_fd);
+  }
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(path);
+  }
+  if (link != NULL) {
+    munmap(link, SHM_LINK_SIZE);
+  }
+  if (mem_fd >= 0) {
+    close(mem_fd);
+  }
+  if (tx_dropped > 0) {
+    BX_INFO(("eth_shm: " FMT_LL "u frames dropped (peer not ready)", tx_dropped));
+  }
+}
+
+// Create the listening socket and the shared memory. The peer is accepted
+// later by the timer handler.
+bool bx_shm_pktmover_c::link_create()
+{
+  struct sockaddr_un addr;
+
+  mem_fd = shm_create_mem(SHM_LINK_SIZE);
+  if ((mem_fd < 0) || !link_map(mem_fd)) {
+    BX_PANIC(("eth_shm: cannot create shared memory: %s", strerror(errno)));
+    return 0;
+  }
+  link->magic = SHM_LINK_MAGIC;
+  link->version = SHM_LINK_VERSION;
+  link->slots = SHM_RING_SLOTS;
+  link->slot_size = SHM_SLOT_SIZE;
+  creator = 1;
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    BX_PANIC(("eth_shm: cannot create socket: %s", strerror(errno)));
+    return 0;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  // remove a socket left over by an instance that has exited
+  unlink(path);
+  if ((bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+      (listen(listen_fd, 1) < 0)) {
+    BX_PANIC(("eth_shm: cannot listen on '%s': %s", path, strerror(errno)));
+    close(listen_fd);
+    listen_fd = -1;
+    return 0;
+  }
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+  return 1;
+}
+
+// Connect to the instance that created the link and map the memory.
+// Returns 1 on success, -1 if nobody listens on the socket and 0 if the
+// link could not be joined. With a timeout of 0 (msec) nothing blocks:
+// a connection that the creator has not accepted yet is kept in 'conn_fd'
+// and 0 is returned until the descriptor arrives on a later call.
+int bx_shm_pktmover_c::link_connect(int timeout)
+{
+  struct sockaddr_un addr;
+  struct pollfd pfd;
+  int ret, fd;
+
+  if (conn_fd < 0) {
+    conn_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn_fd < 0) {
+      return 0;
+    }
+    if (timeout == 0) {
+      fcntl(conn_fd, F_SETFL, fcntl(conn_fd, F_GETFL) | O_NONBLOCK);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(conn_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+      ret = (errno == EAGAIN) ? 0 : -1;
+      close(conn_fd);
+      conn_fd = -1;
+      return ret;
+    }
+  }
+  // the creator accepts the connection from its timer handler
+  pfd.fd = conn_fd;
+  pfd.events = POLLIN;
+  ret = poll(&pfd, 1, timeout);
+  if ((ret == 0) && (timeout == 0)) {
+    return 0;
+  }
+  fd = (ret > 0) ? shm_recv_fd(conn_fd) : -1;
+  if ((fd < 0) || !link_map(fd)) {
+    if (fd >= 0) close(fd);
+    close(conn_fd);
+    conn_fd = -1;
+    BX_ERROR(("eth_shm: no shared memory received from '%s'", path));
+    return 0;
+  }
+  if ((link->magic != SHM_LINK_MAGIC) || (link->version != SHM_LINK_VERSION) ||
+      (link->slots != SHM_RING_SLOTS) || (link->slot_size != SHM_SLOT_SIZE)) {
+    BX_ERROR(("eth_shm: incompatible link at '%s'", path));
+    munmap(link, SHM_LINK_SIZE);
+    link = NULL;
+    close(fd);
+    close(conn_fd);
+    conn_fd = -1;
+    return 0;
+  }
+  mem_fd = fd;
+  peer_fd = conn_fd;
+  conn_fd = -1;
+  link_attach();
+  return 1;
+}
+
+bool bx_shm_pktmover_c::link_map(int fd)
+{
+  void *ptr = mmap(NULL, SHM_LINK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (ptr == MAP_FAILED) {
+    return 0;
+  }
+  link = (shm_link_hdr_t*)ptr;
+  return 1;
+}
+
+// set up the ring pointers for this side of the link
+void bx_shm_pktmover_c::link_attach()
+{
+  shm_slot_t *slots = (shm_slot_t*)(link + 1);
+  unsigned tx = creator ? 0 : 1;
+
+  tx_ring = &link->ring[tx];
+  rx_ring = &link->ring[tx ^ 1];
+  tx_slots = slots + tx * SHM_RING_SLOTS;
+  rx_slots = slots + (tx ^ 1) * SHM_RING_SLOTS;
+  tx_head = tx_ring->head;
+  rx_tail = rx_ring->tail;
+}
+
+void bx_shm_pktmover_c::link_down()
+{
+  if (peer_fd >= 0) {
+    close(peer_fd);
+    peer_fd = -1;
+  }
+  tx_ring = rx_ring = NULL;
+  if (!creator && (link != NULL)) {
+    munmap(link, SHM_LINK_SIZE);
+    link = NULL;
+    close(mem_fd);
+    mem_fd = -1;
+  }
+}
+
+// Accept a new peer or find out if the current one has gone away
+void bx_shm_pktmover_c::link_check()
+{
+  struct pollfd pfd;
+  int sock;
+
+  if (peer_fd >= 0) {
+    pfd.fd = peer_fd;
+    pfd.events = POLLIN;
+    if ((poll(&pfd, 1, 0) > 0) && (pfd.revents != 0)) {
+      BX_INFO(("eth_shm: peer has left link '%s'", path));
+      link_down();
+    }
+  } else if (creator) {
+    sock = accept(listen_fd, NULL, NULL);
+    if (sock >= 0) {
+      // start with empty rings
+      memset(link->ring, 0, sizeof(link->ring));
+      if (!shm_send_fd(sock, mem_fd)) {
+        close(sock);
+        return;
+      }
+      peer_fd = sock;
+      link_attach();
+      BX_INFO(("eth_shm: peer has joined link '%s'", path));
+    }
+  } else if (link_connect(0) > 0) {
+    BX_INFO(("eth_shm: connected to link '%s'", path));
+  }
+}
+
+void bx_shm_pktmover_c::sendpkt(void *buf, unsigned io_len)
+{
+  bx_net_iov_t iov;
+
+  iov.base = buf;
+  iov.len = io_len;
+  sendpkt_iov(&iov, 1);
+}
+
+// Gather the frame into the next free slot of the peer's ring
+void bx_shm_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
+{
+  shm_slot_t *slot;
+  unsigned len = 0, i;
+
+  if (tx_ring == NULL) {
+    return; // no peer: the cable is unplugged
+  }
+  for (i = 0; i < iovcnt; i++) {
+    len += iov[i].len;
+  }
+  if (len > SHM_FRAME_MAX) {
+    BX_ERROR(("eth_shm: frame too long (%u), dropped", len));
+    return;
+  }
+  if ((tx_head - shm_load_acquire(&tx_ring->tail)) >= SHM_RING_SLOTS) {
+    tx_dropped++;
+    return;
+  }
+  slot = &tx_slots[tx_head & (SHM_RING_SLOTS - 1)];
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    memcpy(slot->data + len, iov[i].base, iov[i].len);
+    len += iov[i].len;
+  }
+  slot->len = len;
+  shm_store_release(&tx_ring->head, ++tx_head);
+}
+
+void bx_shm_pktmover_c::sendpkts(const bx_net_pkt_t *pkts, unsigned count)
+{
+  for (unsigned i = 0; i < count; i++) {
+    sendpkt_iov(pkts[i].iov, pkts[i].iovcnt);
+  }
+}
+
+void bx_shm_pktmover_c::rx_timer_handler(void *this_ptr)
+{
+  ((bx_shm_pktmover_c*)this_ptr)->rx_timer();
+}
+
+// Pass the frames of the receive ring to the device model while it is
+// ready. A frame is released only after the device has copied it.
+void bx_shm_pktmover_c::rx_timer()
+{
+  shm_slot_t *slot;
+  Bit32u head, len;
+  Bit64u now = bx_pc_system.time_usec();
+
+  if (now >= next_check) {
+    next_check = now + SHM_CHECK_INTERVAL;
+    link_check();
+  }
+  if (rx_ring == NULL) {
+    return;
+  }
+  head = shm_load_acquire(&rx_ring->head);
+  while ((rx_tail != head) && (this->rxstat(this->netdev) & BX_NETDEV_RXREADY)) {
+    slot = &rx_slots[rx_tail & (SHM_RING_SLOTS - 1)];
+    // the peer can rewrite the slot at any time: read the length only once
+    len = __atomic_load_n(&slot->len, __ATOMIC_RELAXED);
+    if (len <= SHM_FRAME_MAX) {
+      if (len < MIN_RX_PACKET_LEN) {
+        memset(slot->data + len, 0, MIN_RX_PACKET_LEN - len);
+        len = MIN_RX_PACKET_LEN;
+      }
+      this->rxh(this->netdev, slot->data, len);
+    }
+    shm_store_release(&rx_ring->tail, ++rx_tail);
+  }
+}
+
+#endif /* if BX_NETWORKING && BX_NETMOD_SHM */
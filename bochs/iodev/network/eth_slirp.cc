@@ -65,6 +65,12 @@ typedef ssize_t slirp_ssize_t;
 #include "slirp/libslirp.h"
 #endif
 #include <signal.h>
+#ifndef WIN32
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "bxthread.h"
+#endif
 
 static unsigned int bx_slirp_instances = 0;
 
@@ -84,9 +90,23 @@ PLUGIN_ENTRY_FOR_NET_MODULE(slirp)
 
 #define MAX_HOSTFWD 5
 
-static int rx_timer_index = BX_NULL_TIMER_HANDLE;
+// Number of guest-bound frames queued while the device is not ready
+#define SLIRP_RXQ_SIZE 512
+
+// Interval of the timer driving slirp (usec). With the host poll thread the
+// timer only checks flags and runs slirp when something is to do.
+#ifdef WIN32
+#define SLIRP_TIMER_INTERVAL 1000
 fd_set rfds, wfds, xfds;
 int nfds;
+#else
+#define SLIRP_TIMER_INTERVAL 100
+#endif
+
+typedef struct {
+  Bit8u data[BX_PACKET_BUFSIZE];
+  unsigned len;
+} slirp_rx_frame_t;
 
 class bx_slirp_pktmover_c : public eth_pktmover_c {
 public:
@@ -97,9 +117,39 @@ public:
   void sendpkt(void *buf, unsigned io_len);
   slirp_ssize_t receive(void *pkt, unsigned pkt_len);
   void slirp_msg(bool error, const char *msg);
+  void notify(void) {poll_pending = 1;}
+#ifndef WIN32
+  int add_poll(int fd, int events);
+  int get_revents(int idx);
+#endif
 private:
   Slirp *slirp;
   unsigned netdev_speed;
+  int rx_timer_index;
+
+  // guest-bound frames waiting for the device
+  slirp_rx_frame_t *rxq;
+  unsigned rxq_head, rxq_count;
+
+  // slirp needs to process guest data or its timers
+  bool poll_pending;
+  Bit64u poll_deadline;
+#ifndef WIN32
+  // descriptors polled by the simulator thread
+  struct pollfd *pfd;
+  unsigned npfd, pfd_size;
+  // copy of the set watched by the host thread
+  struct pollfd *wfd;
+  unsigned nwfd, wfd_size;
+  bool events_pending;
+  bool thread_stop;
+  int wakeup_pipe[2];
+  BX_MUTEX(poll_mutex);
+  BX_THREAD_VAR(poll_thread_var);
+
+  static BX_THREAD_FUNC(poll_thread_func, indata);
+  void poll_thread(void);
+#endif
 
   SlirpConfig config;
   char *hostfwd[MAX_HOSTFWD];
@@ -118,6 +168,8 @@ private:
   bool parse_slirp_conf(const char *conf);
   static void rx_timer_handler(void *);
   void rx_timer(void);
+  void slirp_poll(void);
+  void rx_deliver(void);
 
 #ifndef WIN32
   int slirp_smb(Slirp *s, char *smb_tmpdir, const char *exported_dir,
@@ -226,7 +278,7 @@ static void unregister_poll_fd(int fd, void *opaque)
 
 static void notify(void *opaque)
 {
-  // Nothing here yet
+  ((bx_slirp_pktmover_c*)opaque)->notify();
 }
 
 #if CPP_STD >= 201703
@@ -257,6 +309,21 @@ bx_slirp_pktmover_c::bx_slirp_pktmover_c(const char *netif,
   slirp = NULL;
   pktlog_fn = NULL;
   n_hostfwd = 0;
+  rx_timer_index = BX_NULL_TIMER_HANDLE;
+  rxq = new slirp_rx_frame_t[SLIRP_RXQ_SIZE];
+  rxq_head = 0;
+  rxq_count = 0;
+  poll_pending = 1;
+  poll_deadline = 0;
+#ifndef WIN32
+  pfd = wfd = NULL;
+  npfd = pfd_size = 0;
+  nwfd = wfd_size = 0;
+  events_pending = 0;
+  thread_stop = 0;
+  wakeup_pipe[0] = -1;
+  wakeup_pipe[1] = -1;
+#endif
 #if CPP_STD < 201703
   callbacks.send_packet = send_packet,
   callbacks.guest_error = guest_error,
@@ -305,14 +372,15 @@ bx_slirp_pktmover_c::bx_slirp_pktmover_c(const char *netif,
   Bit32u status = this->rxstat(this->netdev) & BX_NETDEV_SPEED;
   this->netdev_speed = (status == BX_NETDEV_1GBIT) ? 1000 :
                        (status == BX_NETDEV_100MBIT) ? 100 : 10;
-  if (bx_slirp_instances == 0) {
-    rx_timer_index =
-      DEV_register_timer(this, this->rx_timer_handler, 1000, 1, 1,
-                         "eth_slirp");
+  // every instance needs its own timer, slirp state is per instance
+  rx_timer_index =
+    DEV_register_timer(this, this->rx_timer_handler, SLIRP_TIMER_INTERVAL, 1, 1,
+                       "eth_slirp");
 #ifndef WIN32
+  if (bx_slirp_instances == 0) {
     signal(SIGPIPE, SIG_IGN);
-#endif
   }
+#endif
 
   if ((strlen(script) > 0) && (strcmp(script, "none"))) {
     if (!parse_slirp_conf(script)) {
@@ -371,11 +439,41 @@ bx_slirp_pktmover_c::bx_slirp_pktmover_c(const char *netif,
   } else {
     slirp_logging = 0;
   }
+#ifndef WIN32
+  // the host thread waits for socket events, so that the simulator thread
+  // only has to call into slirp when there is something to do
+  if (pipe(wakeup_pipe) < 0) {
+    BX_PANIC(("slirp: cannot create wakeup pipe: %s", strerror(errno)));
+  } else {
+    fcntl(wakeup_pipe[0], F_SETFL, fcntl(wakeup_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeup_pipe[1], F_SETFL, fcntl(wakeup_pipe[1], F_GETFL) | O_NONBLOCK);
+    BX_INIT_MUTEX(poll_mutex);
+    BX_THREAD_CREATE(poll_thread_func, this, poll_thread_var);
+  }
+#endif
   bx_slirp_instances++;
 }
 
 bx_slirp_pktmover_c::~bx_slirp_pktmover_c()
 {
+#ifndef WIN32
+  if (wakeup_pipe[0] >= 0) {
+    BX_LOCK(poll_mutex);
+    thread_stop = 1;
+    BX_UNLOCK(poll_mutex);
+    if (write(wakeup_pipe[1], "", 1) < 0) {
+      BX_ERROR(("cannot wake up slirp poll thread: %s", strerror(errno)));
+    }
+    BX_THREAD_JOIN(poll_thread_var);
+    close(wakeup_pipe[0]);
+    close(wakeup_pipe[1]);
+    BX_FINI_MUTEX(poll_mutex);
+  }
+  free(pfd);
+  free(wfd);
+#endif
+  bx_pc_system.deactivate_timer(rx_timer_index);
+  delete [] rxq;
   if (slirp != NULL) {
     slirp_cleanup(slirp);
 #ifndef WIN32
@@ -398,12 +496,13 @@ bx_slirp_pktmover_c::~bx_slirp_pktmover_c()
     while (n_hostfwd > 0) {
       free(hostfwd[--n_hostfwd]);
     }
-    if (--bx_slirp_instances == 0) {
-      bx_pc_system.deactivate_timer(rx_timer_index);
 #ifndef WIN32
+    if (--bx_slirp_instances == 0) {
       signal(SIGPIPE, SIG_DFL);
-#endif
     }
+#else
+    bx_slirp_instances--;
+#endif
     if (slirp_logging) {
       fclose(pktlog_txt);
     }
@@ -596,6 +695,9 @@ void bx_slirp_pktmover_c::sendpkt(void *buf, unsigned io_len)
     write_pktlog_txt(pktlog_txt, (const Bit8u*)buf, io_len, 0);
   }
   slirp_input(slirp, (Bit8u*)buf, io_len);
+  // data for the host sockets is written in the next poll cycle
+  poll_pending = 1;
+  rx_deliver();
 }
 
 void bx_slirp_pktmover_c::rx_timer_handler(void *this_ptr)
@@ -603,6 +705,7 @@ void bx_slirp_pktmover_c::rx_timer_handler(void *this_ptr)
   ((bx_slirp_pktmover_c*)this_ptr)->rx_timer();
 }
 
+#ifdef WIN32
 
 static int add_poll_cb(int fd, int events, void *opaque)
 {
@@ -629,40 +732,224 @@ static int get_revents_cb(int idx, void *opaque)
     return event;
 }
 
+#else
+
+static int add_poll_cb(int fd, int events, void *opaque)
+{
+  return ((bx_slirp_pktmover_c*)opaque)->add_poll(fd, events);
+}
+
+static int get_revents_cb(int idx, void *opaque)
+{
+  return ((bx_slirp_pktmover_c*)opaque)->get_revents(idx);
+}
+
+int bx_slirp_pktmover_c::add_poll(int fd, int events)
+{
+  int pevents = 0;
+
+  if (npfd == pfd_size) {
+    pfd_size = (pfd_size == 0) ? 16 : (pfd_size * 2);
+    pfd = (struct pollfd*)realloc(pfd, pfd_size * sizeof(struct pollfd));
+  }
+  if (events & SLIRP_POLL_IN)
+    pevents |= POLLIN;
+  if (events & SLIRP_POLL_OUT)
+    pevents |= POLLOUT;
+  if (events & SLIRP_POLL_PRI)
+    pevents |= POLLPRI;
+  pfd[npfd].fd = fd;
+  pfd[npfd].events = pevents;
+  pfd[npfd].revents = 0;
+  return npfd++;
+}
+
+int bx_slirp_pktmover_c::get_revents(int idx)
+{
+  int event = 0, revents;
+
+  if ((idx < 0) || ((unsigned)idx >= npfd))
+    return 0;
+  revents = pfd[idx].revents;
+  if (revents & POLLIN)
+    event |= SLIRP_POLL_IN;
+  if (revents & POLLOUT)
+    event |= SLIRP_POLL_OUT;
+  if (revents & POLLPRI)
+    event |= SLIRP_POLL_PRI;
+  if (revents & POLLERR)
+    event |= SLIRP_POLL_ERR;
+  if (revents & POLLHUP)
+    event |= SLIRP_POLL_HUP;
+  return event;
+}
+
+BX_THREAD_FUNC(bx_slirp_pktmover_c::poll_thread_func, indata)
+{
+  ((bx_slirp_pktmover_c*)indata)->poll_thread();
+  BX_THREAD_EXIT;
+}
+
+// Host thread: wait for events on the descriptors slirp is interested in.
+// After reporting an event it only waits for the wakeup pipe until the
+// simulator thread has run slirp and published the new descriptor set.
+void bx_slirp_pktmover_c::poll_thread(void)
+{
+  struct pollfd *fds = NULL;
+  unsigned size = 0, n, i;
+  char dummy[64];
+  bool stop;
+
+  while (1) {
+    BX_LOCK(poll_mutex);
+    stop = thread_stop;
+    if (size < (nwfd + 1)) {
+      size = nwfd + 1;
+      fds = (struct pollfd*)realloc(fds, size * sizeof(struct pollfd));
+    }
+    fds[0].fd = wakeup_pipe[0];
+    fds[0].events = POLLIN;
+    n = 1;
+    if (!events_pending) {
+      memcpy(&fds[1], wfd, nwfd * sizeof(struct pollfd));
+      n += nwfd;
+    }
+    BX_UNLOCK(poll_mutex);
+    if (stop) break;
+    if (poll(fds, n, -1) < 0) {
+      if (errno == EINTR) continue;
+      BX_ERROR(("slirp poll thread: poll failed: %s", strerror(errno)));
+      break;
+    }
+    if (fds[0].revents != 0) {
+      while (read(wakeup_pipe[0], dummy, sizeof(dummy)) > 0);
+    }
+    for (i = 1; i < n; i++) {
+      if (fds[i].revents != 0) {
+        BX_LOCK(poll_mutex);
+        events_pending = 1;
+        BX_UNLOCK(poll_mutex);
+        break;
+      }
+    }
+  }
+  free(fds);
+}
+
+#endif
+
 void bx_slirp_pktmover_c::rx_timer(void)
 {
-  Bit32u timeout = 0;
+  bool run;
+
+  rx_deliver();
+  // stop reading from the host while the guest does not take the frames
+  if (rxq_count > (SLIRP_RXQ_SIZE / 2))
+    return;
+  run = poll_pending || (bx_pc_system.time_usec() >= poll_deadline);
+#ifndef WIN32
+  if (!run) {
+    BX_LOCK(poll_mutex);
+    run = events_pending;
+    BX_UNLOCK(poll_mutex);
+  }
+#endif
+  if (run) {
+    slirp_poll();
+  }
+}
+
+// Run one slirp cycle: check the sockets, process timers and pass the
+// received data to the guest
+void bx_slirp_pktmover_c::slirp_poll(void)
+{
+  Bit32u timeout = 0xffffffff;
   int ret;
 #ifdef WIN32
   TIMEVAL tv;
-#else
-  struct timeval tv;
-#endif
 
   nfds = -1;
   FD_ZERO(&rfds);
   FD_ZERO(&wfds);
   FD_ZERO(&xfds);
+#else
+  npfd = 0;
+#endif
+  poll_pending = 0;
   slirp_pollfds_fill(slirp, &timeout, add_poll_cb, this);
+#ifdef WIN32
   tv.tv_sec = 0;
   tv.tv_usec = 0;
   ret = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+#else
+  ret = poll(pfd, npfd, 0);
+#endif
   slirp_pollfds_poll(slirp, (ret < 0), get_revents_cb, this);
+  // slirp returns the time (msec) until its next TCP / fragment timer
+  poll_deadline = bx_pc_system.time_usec() + (Bit64u)timeout * 1000;
+#ifndef WIN32
+  // hand the descriptor set over to the host thread
+  BX_LOCK(poll_mutex);
+  if (wfd_size < npfd) {
+    wfd_size = pfd_size;
+    wfd = (struct pollfd*)realloc(wfd, wfd_size * sizeof(struct pollfd));
+  }
+  for (unsigned i = 0; i < npfd; i++) {
+    wfd[i].fd = pfd[i].fd;
+    wfd[i].events = pfd[i].events;
+    wfd[i].revents = 0;
+  }
+  nwfd = npfd;
+  events_pending = 0;
+  BX_UNLOCK(poll_mutex);
+  // a full pipe means the thread has not yet picked up the previous wakeup
+  if ((write(wakeup_pipe[1], "", 1) < 0) && (errno != EAGAIN)) {
+    BX_ERROR(("cannot wake up slirp poll thread: %s", strerror(errno)));
+  }
+#endif
+}
+
+// Pass the queued frames to the device model
+void bx_slirp_pktmover_c::rx_deliver(void)
+{
+  while ((rxq_count > 0) && (this->rxstat(this->netdev) & BX_NETDEV_RXREADY)) {
+    this->rxh(this->netdev, rxq[rxq_head].data, rxq[rxq_head].len);
+    rxq_head = (rxq_head + 1) % SLIRP_RXQ_SIZE;
+    rxq_count--;
+  }
 }
 
 slirp_ssize_t bx_slirp_pktmover_c::receive(void *pkt, unsigned pkt_len)
 {
-  if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-    if (pkt_len < MIN_RX_PACKET_LEN) pkt_len = MIN_RX_PACKET_LEN;
-    if (slirp_logging) {
-      write_pktlog_txt(pktlog_txt, (const Bit8u*)pkt, pkt_len, 1);
-    }
+  slirp_rx_frame_t *frame;
+
+  if (pkt_len > BX_PACKET_BUFSIZE) {
+    BX_ERROR(("packet too long (%d), dropped", pkt_len));
+    return -1;
+  }
+  if (slirp_logging) {
+    write_pktlog_txt(pktlog_txt, (const Bit8u*)pkt, pkt_len, 1);
+  }
+  if ((rxq_count == 0) && (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) &&
+      (pkt_len >= MIN_RX_PACKET_LEN)) {
     this->rxh(this->netdev, pkt, pkt_len);
     return pkt_len;
-  } else {
-    BX_ERROR(("device not ready to receive data"));
+  }
+  // the device is busy (or the frame needs padding): keep it in the queue
+  if (rxq_count == SLIRP_RXQ_SIZE) {
+    BX_ERROR(("receive queue full, packet dropped"));
     return -1;
   }
+  frame = &rxq[(rxq_head + rxq_count) % SLIRP_RXQ_SIZE];
+  memcpy(frame->data, pkt, pkt_len);
+  if (pkt_len < MIN_RX_PACKET_LEN) {
+    memset(frame->data + pkt_len, 0, MIN_RX_PACKET_LEN - pkt_len);
+    pkt_len = MIN_RX_PACKET_LEN;
+  }
+  frame->len = pkt_len;
+  rxq_count++;
+  rx_deliver();
+  return pkt_len;
 }
 
 #if !defined(_WIN32) && !defined(__CYGWIN__)
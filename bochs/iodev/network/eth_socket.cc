@@ -99,6 +99,7 @@ extern "C" {
 #include <linux/types.h>
 #endif
 #include <netdb.h>
+#include <sys/uio.h>
 #define closesocket(s) close(s)
 typedef int SOCKET;
 #ifndef INVALID_SOCKET
@@ -116,12 +117,18 @@ typedef int SOCKET;
 #define MSG_DONTWAIT 0
 #endif
 
+#ifdef WIN32
 #define BX_PACKET_POLL  1000    // Poll for a frame every 1000 usecs
+#endif
 
 //
 //  Define the class. This is private to this module
 //
+#ifdef WIN32
 class bx_socket_pktmover_c : public eth_pktmover_c {
+#else
+class bx_socket_pktmover_c : public eth_fd_pktmover_c {
+#endif
 public:
   bx_socket_pktmover_c(const char *netif, const char *macaddr,
                        eth_rx_handler_t rxh,
@@ -130,14 +137,29 @@ public:
   virtual ~bx_socket_pktmover_c();
 
   void sendpkt(void *buf, unsigned io_len);
+#ifndef WIN32
+  void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+#ifdef __linux__
+  void sendpkts(const bx_net_pkt_t *pkts, unsigned count);
+#endif
+#endif
+
+protected:
+  int rx_read(Bit8u *buf, unsigned size);
+#ifdef __linux__
+  int rx_read_batch(Bit8u **bufs, unsigned *lens, unsigned size, unsigned count);
+#endif
+  bool rx_accept(const Bit8u *rxbuf, int nbytes);
 
 private:
   unsigned char *socket_macaddr[6];
   SOCKET fd;                               // socket we listen on
   struct sockaddr_in sin, sout;            // target address for RX / TX
+#ifdef WIN32
   static void rx_timer_handler(void *);
   void rx_timer(void);
   int rx_timer_index;
+#endif
 };
 
 
@@ -272,14 +294,18 @@ bx_socket_pktmover_c::bx_socket_pktmover_c(const char *netif,
   sout.sin_port = htons(port+1); // set TX to RX + 1
   memcpy((char*) &(sout.sin_addr), hp->h_addr, hp->h_length);
 
+  this->rxh    = rxh;
+  this->rxstat = rxstat;
+
   // Start the rx poll
   //
+#ifdef WIN32
   this->rx_timer_index =
     DEV_register_timer(this, this->rx_timer_handler, BX_PACKET_POLL, 1, 1,
                        "eth_socket"); // continuous, active
-
-  this->rxh    = rxh;
-  this->rxstat = rxstat;
+#else
+  start_rx(this->fd, "eth_socket");
+#endif
   BX_INFO(("socket network driver initialized: using socket '%s'", netif));
 }
 
@@ -290,6 +316,8 @@ bx_socket_pktmover_c::~bx_socket_pktmover_c()
 {
 #ifdef WIN32
   WSACleanup();
+#else
+  stop_rx();
 #endif
 }
 
@@ -310,8 +338,84 @@ void bx_socket_pktmover_c::sendpkt(void *buf, unsigned io_len)
 }
 
 
+#ifndef WIN32
+// send a frame given as a list of buffers without copying it
+void bx_socket_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
+{
+  struct iovec vec[BX_NET_IOV_MAX];
+  struct msghdr msg;
+  unsigned i;
+
+  if ((this->fd == INVALID_SOCKET) || (iovcnt > BX_NET_IOV_MAX)) {
+    eth_pktmover_c::sendpkt_iov(iov, iovcnt);
+    return;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    vec[i].iov_base = (void*)iov[i].base;
+    vec[i].iov_len = iov[i].len;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &sout;
+  msg.msg_namelen = sizeof(sout);
+  msg.msg_iov = vec;
+  msg.msg_iovlen = iovcnt;
+  if (sendmsg(this->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == -1) {
+    BX_INFO(("eth_socket: write failed: %s", strerror(errno)));
+  }
+}
+
+#ifdef __linux__
+// send a batch of frames with a single system call
+void bx_socket_pktmover_c::sendpkts(const bx_net_pkt_t *pkts, unsigned count)
+{
+  struct mmsghdr msgs[BX_NET_BATCH_MAX];
+  struct iovec vec[BX_NET_BATCH_MAX * 4];
+  unsigned i, j, n, nvec = 0;
+  int ret;
+
+  if (this->fd == INVALID_SOCKET) return;
+  while (count > 0) {
+    // collect as many frames as fit into the message and iovec arrays
+    memset(msgs, 0, sizeof(msgs));
+    nvec = 0;
+    for (n = 0; (n < count) && (n < BX_NET_BATCH_MAX); n++) {
+      if ((pkts[n].iovcnt > BX_NET_IOV_MAX) ||
+          ((nvec + pkts[n].iovcnt) > (BX_NET_BATCH_MAX * 4))) {
+        break;
+      }
+      msgs[n].msg_hdr.msg_name = &sout;
+      msgs[n].msg_hdr.msg_namelen = sizeof(sout);
+      msgs[n].msg_hdr.msg_iov = &vec[nvec];
+      msgs[n].msg_hdr.msg_iovlen = pkts[n].iovcnt;
+      for (j = 0; j < pkts[n].iovcnt; j++, nvec++) {
+        vec[nvec].iov_base = (void*)pkts[n].iov[j].base;
+        vec[nvec].iov_len = pkts[n].iov[j].len;
+      }
+    }
+    if (n == 0) {
+      // too many buffers for one message
+      sendpkt_iov(pkts[0].iov, pkts[0].iovcnt);
+      n = 1;
+    } else {
+      for (i = 0; i < n; i += ret) {
+        ret = sendmmsg(this->fd, &msgs[i], n - i, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (ret <= 0) {
+          // like sendto() above: the frame that failed is dropped
+          BX_INFO(("eth_socket: write failed: %s", strerror(errno)));
+          ret = 1;
+        }
+      }
+    }
+    pkts += n;
+    count -= n;
+  }
+}
+#endif
+#endif
+
 // The receive poll process
 //
+#ifdef WIN32
 void bx_socket_pktmover_c::rx_timer_handler(void *this_ptr)
 {
   bx_socket_pktmover_c *class_ptr = (bx_socket_pktmover_c *) this_ptr;
@@ -321,16 +425,27 @@ void bx_socket_pktmover_c::rx_timer_handler(void *this_ptr)
 
 void bx_socket_pktmover_c::rx_timer(void)
 {
-  int nbytes = 0;
-  socklen_t slen = sizeof(sin);
   Bit8u rxbuf[BX_PACKET_BUFSIZE];
 
   // is socket open and bound?
   if (this->fd == INVALID_SOCKET)
     return;
 
+  int nbytes = rx_read(rxbuf, sizeof(rxbuf));
+  if ((nbytes > 0) && (this->rxstat(this->netdev) & BX_NETDEV_RXREADY)) {
+    this->rxh(this->netdev, rxbuf, nbytes);
+  }
+}
+#endif
+
+// receive one frame (called from the receive thread on non-Windows hosts)
+int bx_socket_pktmover_c::rx_read(Bit8u *rxbuf, unsigned size)
+{
+  int nbytes = 0;
+  socklen_t slen = sizeof(sin);
+
   // receive packet
-  nbytes = recvfrom(this->fd, (char*)rxbuf, sizeof(rxbuf), MSG_NOSIGNAL,
+  nbytes = recvfrom(this->fd, (char*)rxbuf, size, MSG_NOSIGNAL,
                     (struct sockaddr*) &sin, &slen);
 
   if (nbytes == -1) {
@@ -338,21 +453,54 @@ void bx_socket_pktmover_c::rx_timer(void)
     if (WSAGetLastError() != WSAEWOULDBLOCK)
       BX_INFO(("eth_socket: error receiving packet: %d", WSAGetLastError()));
 #else
-    if (errno != EAGAIN)
+    if ((errno != EAGAIN) && (errno != EINTR))
       BX_INFO(("eth_socket: error receiving packet: %s", strerror(errno)));
 #endif
-    return;
+    return -1;
   }
 
+  return rx_accept(rxbuf, nbytes) ? nbytes : 0;
+}
+
+#ifdef __linux__
+// receive all queued frames with a single system call
+int bx_socket_pktmover_c::rx_read_batch(Bit8u **bufs, unsigned *lens, unsigned size,
+                                        unsigned count)
+{
+  struct mmsghdr msgs[BX_NET_BATCH_MAX];
+  struct iovec vec[BX_NET_BATCH_MAX];
+  int i, n;
+
+  if (count > BX_NET_BATCH_MAX) count = BX_NET_BATCH_MAX;
+  memset(msgs, 0, sizeof(struct mmsghdr) * count);
+  for (i = 0; i < (int)count; i++) {
+    vec[i].iov_base = bufs[i];
+    vec[i].iov_len = size;
+    msgs[i].msg_hdr.msg_iov = &vec[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  n = recvmmsg(this->fd, msgs, count, MSG_DONTWAIT, NULL);
+  if (n <= 0) {
+    if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+      BX_INFO(("eth_socket: error receiving packet: %s", strerror(errno)));
+    return -1;
+  }
+  for (i = 0; i < n; i++) {
+    lens[i] = rx_accept(bufs[i], msgs[i].msg_len) ? msgs[i].msg_len : 0;
+  }
+  return n;
+}
+#endif
+
+bool bx_socket_pktmover_c::rx_accept(const Bit8u *rxbuf, int nbytes)
+{
   // let through broadcast and our mac address
   if ((memcmp(rxbuf, this->socket_macaddr, 6) != 0) &&
       (memcmp(rxbuf, broadcast_macaddr, 6) != 0)) {
-    return;
+    return 0;
   }
 
-  if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-    BX_DEBUG(("eth_socket: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
-    this->rxh(this->netdev, rxbuf, nbytes);
-  }
+  BX_DEBUG(("eth_socket: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
+  return 1;
 }
 #endif /* if BX_NETWORKING && BX_NETMOD_SOCKET */
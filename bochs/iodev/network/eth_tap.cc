@@ -136,18 +136,20 @@ PLUGIN_ENTRY_FOR_NET_MODULE(tap)
 //
 //  Define the class. This is private to this module
 //
-class bx_tap_pktmover_c : public eth_pktmover_c {
+class bx_tap_pktmover_c : public eth_fd_pktmover_c {
 public:
   bx_tap_pktmover_c(const char *netif, const char *macaddr,
                     eth_rx_handler_t rxh, eth_rx_status_t rxstat,
                     logfunctions *netdev, const char *script);
   virtual ~bx_tap_pktmover_c();
   void sendpkt(void *buf, unsigned io_len);
+#if !defined(__sun__) && !BX_ETH_TAP_LOGGING
+  void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+#endif
+protected:
+  int rx_read(Bit8u *buf, unsigned size);
 private:
   int fd;
-  int rx_timer_index;
-  static void rx_timer_handler(void *);
-  void rx_timer ();
   Bit8u guest_macaddr[6];
 #if BX_ETH_TAP_LOGGING
   FILE *txlog, *txlog_txt, *rxlog, *rxlog_txt;
@@ -277,10 +279,6 @@ bx_tap_pktmover_c::bx_tap_pktmover_c(const char *netif,
       BX_ERROR(("execute script '%s' on %s failed", script, intname));
   }
 
-  // Start the rx poll
-  this->rx_timer_index =
-    DEV_register_timer(this, this->rx_timer_handler, 1000, 1, 1,
-                       "eth_tap"); // continuous, active
   this->rxh    = rxh;
   this->rxstat = rxstat;
   memcpy(&guest_macaddr[0], macaddr, 6);
@@ -312,10 +310,13 @@ bx_tap_pktmover_c::bx_tap_pktmover_c(const char *netif,
   fflush(rxlog_txt);
 
 #endif
+  // Start the receive thread
+  start_rx(fd, "eth_tap");
 }
 
 bx_tap_pktmover_c::~bx_tap_pktmover_c()
 {
+  stop_rx();
 #if BX_ETH_TAP_LOGGING
   fclose(txlog);
   fclose(txlog_txt);
@@ -371,34 +372,62 @@ void bx_tap_pktmover_c::sendpkt(void *buf, unsigned io_len)
 #endif
 }
 
-void bx_tap_pktmover_c::rx_timer_handler(void *this_ptr)
+#if !defined(__sun__) && !BX_ETH_TAP_LOGGING
+// write a frame given as a list of buffers without copying it
+void bx_tap_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
 {
-  bx_tap_pktmover_c *class_ptr = (bx_tap_pktmover_c *) this_ptr;
-  class_ptr->rx_timer();
+  struct iovec vec[BX_NET_IOV_MAX + 1];
+  unsigned i, n = 0, len = 0;
+#if !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && \
+    !defined(__APPLE__) && !defined(__OpenBSD__)
+  static const Bit8u pad[2] = {0, 0};
+
+  vec[n].iov_base = (void*)pad;
+  vec[n++].iov_len = 2;
+  len += 2;
+#endif
+  if (iovcnt > BX_NET_IOV_MAX) {
+    eth_pktmover_c::sendpkt_iov(iov, iovcnt);
+    return;
+  }
+  for (i = 0; i < iovcnt; i++, n++) {
+    vec[n].iov_base = (void*)iov[i].base;
+    vec[n].iov_len = iov[i].len;
+    len += iov[i].len;
+  }
+  unsigned int size = writev(fd, vec, n);
+  if (size != len) {
+    BX_PANIC(("write on tap device: %s", strerror(errno)));
+  } else {
+    BX_DEBUG(("wrote %d bytes + ev. 2 byte pad on tap", len));
+  }
 }
+#endif
 
-void bx_tap_pktmover_c::rx_timer()
+// called from the receive thread
+int bx_tap_pktmover_c::rx_read(Bit8u *rxbuf, unsigned size)
 {
   int nbytes;
-  Bit8u buf[BX_PACKET_BUFSIZE];
-  Bit8u *rxbuf;
-  if (fd<0) return;
 #if defined(__sun__)
   struct strbuf sbuf;
   int f = 0;
-  sbuf.maxlen = sizeof(buf);
-  sbuf.buf = (char *)buf;
+  sbuf.maxlen = size;
+  sbuf.buf = (char *)rxbuf;
   nbytes = getmsg(fd, NULL, &sbuf, &f) >=0 ? sbuf.len : -1;
 #else
-  nbytes = read (fd, buf, sizeof(buf));
+  nbytes = read(fd, rxbuf, size);
 #endif
+  if (nbytes < 0) {
+    if ((errno != EAGAIN) && (errno != EINTR))
+      BX_ERROR(("tap read error: %s", strerror(errno)));
+    return -1;
+  }
 
   // hack: discard first two bytes
-#if defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__APPLE__) || defined(__sun__) // Should be fixed for other *BSD
-  rxbuf = buf;
-#else
-  rxbuf = buf+2;
-  nbytes-=2;
+#if !defined(__FreeBSD__) && !defined(__FreeBSD_kernel__) && !defined(__APPLE__) && !defined(__sun__) // Should be fixed for other *BSD
+  if (nbytes < 2) return 0;
+  nbytes -= 2;
+  memmove(rxbuf, rxbuf+2, nbytes);
 #endif
 
 #if defined(__linux__)
@@ -410,13 +439,8 @@ void bx_tap_pktmover_c::rx_timer()
   }
 #endif
 
-  if (nbytes>0)
+  if (nbytes > 0)
     BX_DEBUG(("tap read returned %d bytes", nbytes));
-  if (nbytes<0) {
-    if (errno != EAGAIN)
-      BX_ERROR(("tap read error: %s", strerror(errno)));
-    return;
-  }
 #if BX_ETH_TAP_LOGGING
   if (nbytes > 0) {
     BX_DEBUG(("receive packet length %u", nbytes));
@@ -431,15 +455,7 @@ void bx_tap_pktmover_c::rx_timer()
   }
 #endif
   BX_DEBUG(("eth_tap: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x\n", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
-  if (nbytes < MIN_RX_PACKET_LEN) {
-    BX_INFO(("packet too short (%d), padding to %d", nbytes, MIN_RX_PACKET_LEN));
-    nbytes = MIN_RX_PACKET_LEN;
-  }
-  if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-    this->rxh(this->netdev, rxbuf, nbytes);
-  } else {
-    BX_ERROR(("device not ready to receive data"));
-  }
+  return nbytes;
 }
 
 #endif /* if BX_NETWORKING && BX_NETMOD_TAP */
@@ -85,18 +85,20 @@ int tun_alloc(char *dev);
 //
 //  Define the class. This is private to this module
 //
-class bx_tuntap_pktmover_c : public eth_pktmover_c {
+class bx_tuntap_pktmover_c : public eth_fd_pktmover_c {
 public:
   bx_tuntap_pktmover_c(const char *netif, const char *macaddr,
                        eth_rx_handler_t rxh, eth_rx_status_t rxstat,
                        logfunctions *netdev, const char *script);
   virtual ~bx_tuntap_pktmover_c();
   void sendpkt(void *buf, unsigned io_len);
+#if !defined(__APPLE__) && !BX_ETH_TUNTAP_LOGGING
+  void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+#endif
+protected:
+  int rx_read(Bit8u *buf, unsigned size);
 private:
   int fd;
-  int rx_timer_index;
-  static void rx_timer_handler(void *);
-  void rx_timer ();
   Bit8u guest_macaddr[6];
 #if BX_ETH_TUNTAP_LOGGING
   FILE *txlog, *txlog_txt, *rxlog, *rxlog_txt;
@@ -201,10 +203,6 @@ bx_tuntap_pktmover_c::bx_tuntap_pktmover_c(const char *netif,
       BX_ERROR(("execute script '%s' on %s failed", script, intname));
   }
 
-  // Start the rx poll
-  this->rx_timer_index =
-    DEV_register_timer(this, this->rx_timer_handler, 1000, 1, 1,
-                       "eth_tuntap"); // continuous, active
   this->rxh    = rxh;
   this->rxstat = rxstat;
   memcpy(&guest_macaddr[0], macaddr, 6);
@@ -236,10 +234,13 @@ bx_tuntap_pktmover_c::bx_tuntap_pktmover_c(const char *netif,
   fflush(rxlog_txt);
 
 #endif
+  // Start the receive thread
+  start_rx(fd, "eth_tuntap");
 }
 
 bx_tuntap_pktmover_c::~bx_tuntap_pktmover_c()
 {
+  stop_rx();
 #if BX_ETH_TUNTAP_LOGGING
   fclose(txlog);
   fclose(txlog_txt);
@@ -289,35 +290,60 @@ void bx_tuntap_pktmover_c::sendpkt(void *buf, unsigned io_len)
 #endif
 }
 
-void bx_tuntap_pktmover_c::rx_timer_handler (void *this_ptr)
+#if !defined(__APPLE__) && !BX_ETH_TUNTAP_LOGGING
+// write a frame given as a list of buffers without copying it
+void bx_tuntap_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
 {
-  bx_tuntap_pktmover_c *class_ptr = (bx_tuntap_pktmover_c *) this_ptr;
-  class_ptr->rx_timer();
+  struct iovec vec[BX_NET_IOV_MAX];
+  unsigned i, len = 0;
+
+  if (iovcnt > BX_NET_IOV_MAX) {
+    eth_pktmover_c::sendpkt_iov(iov, iovcnt);
+    return;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    vec[i].iov_base = (void*)iov[i].base;
+    vec[i].iov_len = iov[i].len;
+    len += iov[i].len;
+  }
+  unsigned int size = writev(fd, vec, iovcnt);
+  if (size != len) {
+    BX_PANIC(("write on tuntap device: %s", strerror (errno)));
+  } else {
+    BX_DEBUG(("wrote %d bytes on tuntap", len));
+  }
 }
+#endif
 
-void bx_tuntap_pktmover_c::rx_timer()
+// called from the receive thread
+int bx_tuntap_pktmover_c::rx_read(Bit8u *rxbuf, unsigned size)
 {
   int nbytes;
-  Bit8u buf[BX_PACKET_BUFSIZE];
-  Bit8u *rxbuf;
-  if (fd<0) return;
 
 #ifdef __APPLE__ //FIXME:hack
-  nbytes = 14;
-  bzero(buf, nbytes);
-  buf[0] = buf[6] = 0xFE;
-  buf[1] = buf[7] = 0xFD;
-  buf[12] = 8;
-  nbytes += read (fd, buf+nbytes, sizeof(buf)-nbytes);
-  rxbuf=buf;
+  nbytes = read(fd, rxbuf+14, size-14);
+  if (nbytes < 0) {
 #elif NEVERDEF
-  nbytes = read (fd, buf, sizeof(buf));
-  // hack: discard first two bytes
-  rxbuf = buf+2;
-  nbytes-=2;
+  nbytes = read(fd, rxbuf, size);
+  if (nbytes < 2) {
 #else
-  nbytes = read (fd, buf, sizeof(buf));
-  rxbuf=buf;
+  nbytes = read(fd, rxbuf, size);
+  if (nbytes < 0) {
+#endif
+    if ((nbytes < 0) && (errno != EAGAIN) && (errno != EINTR))
+      BX_ERROR(("tuntap read error: %s", strerror(errno)));
+    return -1;
+  }
+#ifdef __APPLE__ //FIXME:hack
+  bzero(rxbuf, 14);
+  rxbuf[0] = rxbuf[6] = 0xFE;
+  rxbuf[1] = rxbuf[7] = 0xFD;
+  rxbuf[12] = 8;
+  nbytes += 14;
+#elif NEVERDEF
+  // hack: discard first two bytes
+  nbytes -= 2;
+  memmove(rxbuf, rxbuf+2, nbytes);
 #endif
 
   // hack: TUN/TAP device likes to create an ethernet header which has
@@ -327,21 +353,8 @@ void bx_tuntap_pktmover_c::rx_timer()
     rxbuf[5] = guest_macaddr[5];
   }
 
-#ifdef __APPLE__ //FIXME:hack
-  if (nbytes>14)
-#else
-  if (nbytes>0)
-#endif
+  if (nbytes > 0)
     BX_DEBUG(("tuntap read returned %d bytes", nbytes));
-#ifdef __APPLE__ //FIXME:hack
-  if (nbytes<14) {
-#else
-  if (nbytes<0) {
-#endif
-    if (errno != EAGAIN)
-      BX_ERROR(("tuntap read error: %s", strerror(errno)));
-    return;
-  }
 #if BX_ETH_TUNTAP_LOGGING
   if (nbytes > 0) {
     BX_DEBUG(("receive packet length %u", nbytes));
@@ -356,15 +369,7 @@ void bx_tuntap_pktmover_c::rx_timer()
   }
 #endif
   BX_DEBUG(("eth_tuntap: got packet: %d bytes, dst=%02x:%02x:%02x:%02x:%02x:%02x, src=%02x:%02x:%02x:%02x:%02x:%02x", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
-  if (nbytes < MIN_RX_PACKET_LEN) {
-    BX_INFO(("packet too short (%d), padding to %d", nbytes, MIN_RX_PACKET_LEN));
-    nbytes = MIN_RX_PACKET_LEN;
-  }
-  if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-    this->rxh(this->netdev, rxbuf, nbytes);
-  } else {
-    BX_ERROR(("device not ready to receive data"));
-  }
+  return nbytes;
 }
 
 int tun_alloc(char *dev)
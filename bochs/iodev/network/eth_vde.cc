@@ -82,18 +82,17 @@ int vde_alloc(char *dev,int *fdp,struct sockaddr_un *pdataout);
 //
 //  Define the class. This is private to this module
 //
-class bx_vde_pktmover_c : public eth_pktmover_c {
+class bx_vde_pktmover_c : public eth_fd_pktmover_c {
 public:
   bx_vde_pktmover_c(const char *netif, const char *macaddr,
                     eth_rx_handler_t rxh, eth_rx_status_t rxstat,
                     logfunctions *netdev, const char *script);
   virtual ~bx_vde_pktmover_c();
   void sendpkt(void *buf, unsigned io_len);
+protected:
+  int rx_read(Bit8u *buf, unsigned size);
 private:
   int fd;
-  int rx_timer_index;
-  static void rx_timer_handler(void *);
-  void rx_timer();
 #if BX_ETH_VDE_LOGGING
   FILE *txlog, *txlog_txt, *rxlog, *rxlog_txt;
 #endif
@@ -165,10 +164,6 @@ bx_vde_pktmover_c::bx_vde_pktmover_c(const char *netif,
       BX_ERROR(("execute script '%s' on %s failed", script, intname));
   }
 
-  // Start the rx poll
-  this->rx_timer_index =
-    DEV_register_timer(this, this->rx_timer_handler, 1000, 1, 1,
-                       "eth_vde"); // continuous, active
   this->rxh    = rxh;
   this->rxstat = rxstat;
 #if BX_ETH_VDE_LOGGING
@@ -199,10 +194,13 @@ bx_vde_pktmover_c::bx_vde_pktmover_c(const char *netif,
   fflush(rxlog_txt);
 
 #endif
+  // Start the receive thread on the data socket
+  start_rx(fddata, "eth_vde");
 }
 
 bx_vde_pktmover_c::~bx_vde_pktmover_c()
 {
+  stop_rx();
 #if BX_ETH_VDE_LOGGING
   fclose(txlog);
   fclose(txlog_txt);
@@ -235,32 +233,22 @@ void bx_vde_pktmover_c::sendpkt(void *buf, unsigned io_len)
 #endif
 }
 
-void bx_vde_pktmover_c::rx_timer_handler(void *this_ptr)
-{
-  bx_vde_pktmover_c *class_ptr = (bx_vde_pktmover_c *) this_ptr;
-  class_ptr->rx_timer();
-}
-
-void bx_vde_pktmover_c::rx_timer()
+// called from the receive thread
+int bx_vde_pktmover_c::rx_read(Bit8u *rxbuf, unsigned size)
 {
   int nbytes;
-  Bit8u buf[BX_PACKET_BUFSIZE];
-  Bit8u *rxbuf;
   struct sockaddr_un datain;
-  socklen_t datainsize;
+  socklen_t datainsize = sizeof(datain);
 
-  if (fd<0) return;
   //nbytes = read (fd, buf, sizeof(buf));
-  nbytes=recvfrom(fddata,buf,sizeof(buf),MSG_DONTWAIT|MSG_WAITALL,(struct sockaddr *) &datain, &datainsize);
-
-  rxbuf=buf;
+  nbytes=recvfrom(fddata,rxbuf,size,MSG_DONTWAIT|MSG_WAITALL,(struct sockaddr *) &datain, &datainsize);
 
   if (nbytes>0)
-    BX_INFO(("vde read returned %d bytes", nbytes));
+    BX_DEBUG(("vde read returned %d bytes", nbytes));
   if (nbytes<0) {
-    if (errno != EAGAIN)
+    if ((errno != EAGAIN) && (errno != EINTR))
       BX_ERROR(("vde read error: %s", strerror(errno)));
-    return;
+    return -1;
   }
 #if BX_ETH_VDE_LOGGING
   if (nbytes > 0) {
@@ -277,15 +265,7 @@ void bx_vde_pktmover_c::rx_timer()
   }
 #endif
   BX_DEBUG(("eth_vde: got packet: %d bytes, dst=%x:%x:%x:%x:%x:%x, src=%x:%x:%x:%x:%x:%x\n", nbytes, rxbuf[0], rxbuf[1], rxbuf[2], rxbuf[3], rxbuf[4], rxbuf[5], rxbuf[6], rxbuf[7], rxbuf[8], rxbuf[9], rxbuf[10], rxbuf[11]));
-  if (nbytes < MIN_RX_PACKET_LEN) {
-    BX_INFO(("packet too short (%d), padding to %d", nbytes, MIN_RX_PACKET_LEN));
-    nbytes = MIN_RX_PACKET_LEN;
-  }
-  if (this->rxstat(this->netdev) & BX_NETDEV_RXREADY) {
-    this->rxh(this->netdev, rxbuf, nbytes);
-  } else {
-    BX_ERROR(("device not ready to receive data"));
-  }
+  return nbytes;
 }
 
 //enum request_type { REQ_NEW_CONTROL };
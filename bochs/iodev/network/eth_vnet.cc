@@ -92,7 +92,7 @@ public:
 private:
   bool parse_vnet_conf(const char *conf);
   void guest_to_host(const Bit8u *buf, unsigned io_len);
-  void host_to_guest(void);
+  void host_to_guest(bool reply);
 
   vnet_server_c vnet_server;
 
@@ -363,16 +363,25 @@ void bx_vnet_pktmover_c::guest_to_host(const Bit8u *buf, unsigned io_len)
   this->tx_time = (64 + 96 + 4 * 8 + io_len * 8) / this->netdev_speed;
   vnet_server.handle_packet(buf, io_len);
 
-  host_to_guest();
+  host_to_guest(1);
 }
 
-void bx_vnet_pktmover_c::host_to_guest(void)
+// A reply is delivered after the request has been sent. More frames queued
+// by the server (TFTP window, TCP segments) follow at the link speed.
+void bx_vnet_pktmover_c::host_to_guest(bool reply)
 {
+  unsigned delay;
+
   if (!rx_timer_pending) {
     packet_len = vnet_server.get_packet(packet_buffer);
     if (packet_len > 0) {
-      unsigned rx_time = (64 + 96 + 4 * 8 + packet_len * 8) / this->netdev_speed;
-      bx_pc_system.activate_timer(this->rx_timer_index, this->tx_time + rx_time + 100, 0);
+      delay = (64 + 96 + 4 * 8 + packet_len * 8) / this->netdev_speed;
+      if (reply) {
+        delay += this->tx_time + 100;
+      } else if (delay == 0) {
+        delay = 1;
+      }
+      bx_pc_system.activate_timer(this->rx_timer_index, delay, 0);
       rx_timer_pending = 1;
     }
   }
@@ -406,9 +415,11 @@ void bx_vnet_pktmover_c::rx_timer(void)
 #endif
     rx_timer_pending = 0;
     // check for another pending packet
-    host_to_guest();
+    host_to_guest(0);
   } else {
-    BX_ERROR(("device not ready to receive data"));
+    // try again later
+    BX_DEBUG(("device not ready to receive data"));
+    bx_pc_system.activate_timer(this->rx_timer_index, 100, 0);
   }
 }
 
@@ -0,0 +1,463 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+
+//  netcapture.cc  - packet capture for the 'capture' NIC option
+//
+//  The capture pktmover sits between the device model and the selected
+//  networking module and records the frames of both directions to a
+//  pcap-ng file. The timestamps are taken from the emulated time
+//  (bx_pc_system.time_ticks()), so a capture made with a fixed IPS value can
+//  be fed back with exact timing by the 'replay' module.
+//
+//  The simulator thread only copies the frames into a ring buffer. A host
+//  thread formats the pcap-ng blocks and writes the file. If the ring is
+//  full the frame is not recorded and the number of lost frames is stored
+//  in the next packet block (epb_dropcount).
+
+#include "bochs.h"
+#include "bxversion.h"
+#include "plugin.h"
+#include "pc_system.h"
+#include "gui/siminterface.h"
+#include "param_names.h"
+#include "bxthread.h"
+
+#if BX_NETWORKING
+
+#include "netmod.h"
+#include "pcapng.h"
+
+#define LOG_THIS netdev->
+
+// Size of the ring buffer between the simulator and the writer thread
+#define BX_CAPTURE_RING_SIZE  (4 << 20)
+// Marks the unused end of the ring before a wrap
+#define BX_CAPTURE_WRAP       0xffffffff
+
+#define BX_CAPTURE_ALIGN(x)   (((x) + 7) & ~7)
+
+// ring buffer entry, followed by the frame data
+typedef struct {
+  Bit64u ticks;
+  Bit32u len;
+  Bit32u flags;     // PCAPNG_EPB_INBOUND or PCAPNG_EPB_OUTBOUND
+  Bit32u dropped;   // frames lost since the previous entry
+  Bit32u reserved;
+} capture_entry_t;
+
+class bx_capture_pktmover_c : public eth_pktmover_c {
+public:
+  bx_capture_pktmover_c(logfunctions *netdev, eth_rx_handler_t rxh,
+                        eth_rx_status_t rxstat);
+  virtual ~bx_capture_pktmover_c();
+  bool open(const char *capfile, const char *modname);
+  void attach(eth_pktmover_c *ethmod) { this->ethmod = ethmod; }
+  void sendpkt(void *buf, unsigned io_len);
+  void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+  void sendpkts(const bx_net_pkt_t *pkts, unsigned count);
+
+  static void rx_handler(void *arg, const void *buf, unsigned len);
+private:
+  static bx_capture_pktmover_c *all;
+  bx_capture_pktmover_c *next;
+
+  eth_pktmover_c *ethmod;
+  FILE *capfd;
+  Bit64u ips;
+  Bit8u *ring;
+  unsigned ring_head, ring_tail, ring_used;
+  Bit32u dropped;
+  Bit64u dropped_total;
+  bool writer_idle;
+  bool thread_stop;
+  bool thread_running;
+  BX_MUTEX(ring_mutex);
+  bx_thread_sem_t ring_sem;
+  BX_THREAD_VAR(writer_thread_var);
+
+  void record(const bx_net_iov_t *iov, unsigned iovcnt, Bit32u flags);
+  bool write_block(Bit32u type, const Bit8u *body, unsigned len);
+  void write_epb(const capture_entry_t *entry, const Bit8u *data);
+  static BX_THREAD_FUNC(writer_thread_func, indata);
+  void writer_thread();
+};
+
+bx_capture_pktmover_c *bx_capture_pktmover_c::all = NULL;
+
+// append a pcap-ng option to 'buf' and return the new offset
+static unsigned capture_put_option(Bit8u *buf, unsigned pos, Bit16u code,
+                                   const void *data, unsigned len)
+{
+  Bit16u hdr[2];
+
+  hdr[0] = code;
+  hdr[1] = (Bit16u)len;
+  memcpy(buf + pos, hdr, 4);
+  pos += 4;
+  if (len > 0) {
+    memcpy(buf + pos, data, len);
+    memset(buf + pos + len, 0, ((len + 3) & ~3) - len);
+    pos += (len + 3) & ~3;
+  }
+  return pos;
+}
+
+bx_capture_pktmover_c::bx_capture_pktmover_c(logfunctions *netdev,
+                                             eth_rx_handler_t rxh,
+                                             eth_rx_status_t rxstat)
+{
+  this->netdev = netdev;
+  this->rxh = rxh;
+  this->rxstat = rxstat;
+  ethmod = NULL;
+  capfd = NULL;
+  ring = NULL;
+  ring_head = ring_tail = ring_used = 0;
+  dropped = 0;
+  dropped_total = 0;
+  writer_idle = 0;
+  thread_stop = 0;
+  thread_running = 0;
+  ips = SIM->get_param_num(BXPN_IPS)->get();
+  next = all;
+  all = this;
+}
+
+bx_capture_pktmover_c::~bx_capture_pktmover_c()
+{
+  bx_capture_pktmover_c **ptr;
+
+  // stop the networking module first, so that no more frames arrive
+  if (ethmod != NULL) {
+    delete ethmod;
+  }
+  if (thread_running) {
+    BX_LOCK(ring_mutex);
+    thread_stop = 1;
+    BX_UNLOCK(ring_mutex);
+    bx_set_sem(&ring_sem);
+    BX_THREAD_JOIN(writer_thread_var);
+    while (1) {
+      BX_LOCK(ring_mutex);
+      bool running = thread_running;
+      BX_UNLOCK(ring_mutex);
+      if (!running) break;
+      BX_MSLEEP(1);
+    }
+    bx_destroy_sem(&ring_sem);
+    BX_FINI_MUTEX(ring_mutex);
+  }
+  if (capfd != NULL) {
+    fclose(capfd);
+  }
+  if (dropped_total > 0) {
+    BX_ERROR(("capture: " FMT_LL "u frames not recorded (ring buffer full)",
+              dropped_total));
+  }
+  delete [] ring;
+  for (ptr = &all; *ptr != NULL; ptr = &(*ptr)->next) {
+    if (*ptr == this) {
+      *ptr = next;
+      break;
+    }
+  }
+}
+
+// Create the capture file and write the section header and the interface
+// description. The writer thread is started on success.
+bool bx_capture_pktmover_c::open(const char *capfile, const char *modname)
+{
+  Bit8u body[256];
+  Bit32u val32;
+  Bit16u val16;
+  Bit64s section_len = -1;
+  Bit8u tsresol = PCAPNG_BX_TSRESOL;
+  char text[128];
+  unsigned pos;
+
+  capfd = fopen(capfile, "wb");
+  if (capfd == NULL) {
+    BX_PANIC(("capture: cannot create file '%s'", capfile));
+    return 0;
+  }
+  setvbuf(capfd, NULL, _IOFBF, 1 << 20);
+  // section header block
+  val32 = PCAPNG_BYTE_ORDER_MAGIC;
+  memcpy(body, &val32, 4);
+  val16 = 1;
+  memcpy(body + 4, &val16, 2);
+  val16 = 0;
+  memcpy(body + 6, &val16, 2);
+  memcpy(body + 8, &section_len, 8);
+  sprintf(text, "Bochs %s", VERSION);
+  pos = capture_put_option(body, 16, PCAPNG_SHB_USERAPPL, text, strlen(text));
+  pos = capture_put_option(body, pos, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+  write_block(PCAPNG_BLOCK_SHB, body, pos);
+  // interface description block
+  val16 = PCAPNG_LINKTYPE_ETHERNET;
+  memcpy(body, &val16, 2);
+  val16 = 0;
+  memcpy(body + 2, &val16, 2);
+  val32 = 0; // no snapshot length limit
+  memcpy(body + 4, &val32, 4);
+  snprintf(text, sizeof(text), "%s/%s", netdev->get_name(), modname);
+  pos = capture_put_option(body, 8, PCAPNG_IF_NAME, text, strlen(text));
+  pos = capture_put_option(body, pos, PCAPNG_IF_TSRESOL, &tsresol, 1);
+  sprintf(text, PCAPNG_BX_COMMENT FMT_LL "u", ips);
+  pos = capture_put_option(body, pos, PCAPNG_OPT_COMMENT, text, strlen(text));
+  pos = capture_put_option(body, pos, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+  if (!write_block(PCAPNG_BLOCK_IDB, body, pos)) {
+    BX_PANIC(("capture: cannot write to file '%s'", capfile));
+    return 0;
+  }
+  ring = new Bit8u[BX_CAPTURE_RING_SIZE];
+  BX_INIT_MUTEX(ring_mutex);
+  bx_create_sem(&ring_sem);
+  thread_running = 1;
+  BX_THREAD_CREATE(writer_thread_func, this, writer_thread_var);
+  BX_INFO(("capture: recording frames to '%s'", capfile));
+  return 1;
+}
+
+void bx_capture_pktmover_c::sendpkt(void *buf, unsigned io_len)
+{
+  bx_net_iov_t iov;
+
+  iov.base = buf;
+  iov.len = io_len;
+  record(&iov, 1, PCAPNG_EPB_OUTBOUND);
+  ethmod->sendpkt(buf, io_len);
+}
+
+void bx_capture_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
+{
+  record(iov, iovcnt, PCAPNG_EPB_OUTBOUND);
+  ethmod->sendpkt_iov(iov, iovcnt);
+}
+
+void bx_capture_pktmover_c::sendpkts(const bx_net_pkt_t *pkts, unsigned count)
+{
+  for (unsigned i = 0; i < count; i++) {
+    record(pkts[i].iov, pkts[i].iovcnt, PCAPNG_EPB_OUTBOUND);
+  }
+  ethmod->sendpkts(pkts, count);
+}
+
+// The networking module calls this with the device as argument, so the
+// capture instance is looked up by the device before passing the frame on.
+void bx_capture_pktmover_c::rx_handler(void *arg, const void *buf, unsigned len)
+{
+  bx_capture_pktmover_c *cap;
+  bx_net_iov_t iov;
+
+  for (cap = all; cap != NULL; cap = cap->next) {
+    if (cap->netdev == (logfunctions*)arg) {
+      iov.base = buf;
+      iov.len = len;
+      cap->record(&iov, 1, PCAPNG_EPB_INBOUND);
+      cap->rxh(arg, buf, len);
+      return;
+    }
+  }
+}
+
+// Copy a frame into the ring buffer (simulator thread)
+void bx_capture_pktmover_c::record(const bx_net_iov_t *iov, unsigned iovcnt, Bit32u flags)
+{
+  capture_entry_t entry;
+  unsigned len = 0, need, pos, waste = 0, i;
+  bool wake;
+
+  for (i = 0; i < iovcnt; i++) {
+    len += iov[i].len;
+  }
+  need = sizeof(capture_entry_t) + BX_CAPTURE_ALIGN(len);
+  BX_LOCK(ring_mutex);
+  pos = ring_head;
+  if ((pos + need) > BX_CAPTURE_RING_SIZE) {
+    waste = BX_CAPTURE_RING_SIZE - pos;
+  }
+  if ((need + waste) > (BX_CAPTURE_RING_SIZE - ring_used)) {
+    if (dropped_total++ == 0) {
+      BX_ERROR(("capture: ring buffer full, frames not recorded"));
+    }
+    dropped++;
+    BX_UNLOCK(ring_mutex);
+    return;
+  }
+  entry.dropped = dropped;
+  dropped = 0;
+  BX_UNLOCK(ring_mutex);
+  // the writer thread does not access the free part of the ring
+  if (waste > 0) {
+    if (waste >= sizeof(capture_entry_t)) {
+      ((capture_entry_t*)(ring + pos))->len = BX_CAPTURE_WRAP;
+    }
+    pos = 0;
+  }
+  entry.ticks = bx_pc_system.time_ticks();
+  entry.len = len;
+  entry.flags = flags;
+  entry.reserved = 0;
+  memcpy(ring + pos, &entry, sizeof(capture_entry_t));
+  pos += sizeof(capture_entry_t);
+  for (i = 0; i < iovcnt; i++) {
+    memcpy(ring + pos, iov[i].base, iov[i].len);
+    pos += iov[i].len;
+  }
+  BX_LOCK(ring_mutex);
+  ring_head = (ring_head + waste + need) % BX_CAPTURE_RING_SIZE;
+  ring_used += waste + need;
+  wake = writer_idle;
+  writer_idle = 0;
+  BX_UNLOCK(ring_mutex);
+  if (wake) {
+    bx_set_sem(&ring_sem);
+  }
+}
+
+// write a block with the given body (padded to 32 bit by the caller)
+bool bx_capture_pktmover_c::write_block(Bit32u type, const Bit8u *body, unsigned len)
+{
+  Bit32u hdr[2];
+
+  hdr[0] = type;
+  hdr[1] = len + 12;
+  return (fwrite(hdr, 8, 1, capfd) == 1) &&
+         ((len == 0) || (fwrite(body, len, 1, capfd) == 1)) &&
+         (fwrite(&hdr[1], 4, 1, capfd) == 1);
+}
+
+// write an enhanced packet block (writer thread)
+void bx_capture_pktmover_c::write_epb(const capture_entry_t *entry, const Bit8u *data)
+{
+  Bit32u hdr[7], opt[7], total;
+  Bit64u ts = pcapng_ticks_to_ns(entry->ticks, ips);
+  unsigned pad = ((entry->len + 3) & ~3) - entry->len, optlen;
+  static const Bit8u zero[4] = {0, 0, 0, 0};
+
+  // epb_flags: direction
+  opt[0] = PCAPNG_EPB_FLAGS | (4 << 16);
+  opt[1] = entry->flags;
+  optlen = 8;
+  if (entry->dropped > 0) {
+    Bit64u count = entry->dropped;
+    opt[2] = PCAPNG_EPB_DROPCOUNT | (8 << 16);
+    memcpy(&opt[3], &count, 8);
+    optlen += 12;
+  }
+  opt[optlen / 4] = PCAPNG_OPT_ENDOFOPT;
+  optlen += 4;
+  total = 28 + entry->len + pad + optlen + 4;
+  hdr[0] = PCAPNG_BLOCK_EPB;
+  hdr[1] = total;
+  hdr[2] = 0; // interface id
+  hdr[3] = (Bit32u)(ts >> 32);
+  hdr[4] = (Bit32u)ts;
+  hdr[5] = entry->len;
+  hdr[6] = entry->len;
+  fwrite(hdr, 28, 1, capfd);
+  fwrite(data, entry->len, 1, capfd);
+  fwrite(zero, pad, 1, capfd);
+  fwrite(opt, optlen, 1, capfd);
+  fwrite(&total, 4, 1, capfd);
+}
+
+BX_THREAD_FUNC(bx_capture_pktmover_c::writer_thread_func, indata)
+{
+  ((bx_capture_pktmover_c*)indata)->writer_thread();
+  BX_THREAD_EXIT;
+}
+
+// Host thread: write the recorded frames to the file. The stdio buffer is
+// flushed when the ring is empty, then the thread sleeps until the
+// simulator thread adds a frame.
+void bx_capture_pktmover_c::writer_thread()
+{
+  const capture_entry_t *entry;
+  unsigned used, consumed, pos, step;
+  bool stop;
+
+  while (1) {
+    BX_LOCK(ring_mutex);
+    used = ring_used;
+    pos = ring_tail;
+    stop = thread_stop;
+    if ((used == 0) && !stop) {
+      writer_idle = 1;
+    }
+    BX_UNLOCK(ring_mutex);
+    if (used == 0) {
+      fflush(capfd);
+      if (stop) break;
+      bx_wait_sem(&ring_sem);
+      continue;
+    }
+    consumed = 0;
+    while (consumed < used) {
+      step = BX_CAPTURE_RING_SIZE - pos;
+      if (step >= sizeof(capture_entry_t)) {
+        entry = (const capture_entry_t*)(ring + pos);
+        if (entry->len != BX_CAPTURE_WRAP) {
+          write_epb(entry, ring + pos + sizeof(capture_entry_t));
+          step = sizeof(capture_entry_t) + BX_CAPTURE_ALIGN(entry->len);
+        }
+      }
+      pos = (pos + step) % BX_CAPTURE_RING_SIZE;
+      consumed += step;
+    }
+    BX_LOCK(ring_mutex);
+    ring_tail = pos;
+    ring_used -= consumed;
+    BX_UNLOCK(ring_mutex);
+  }
+  BX_LOCK(ring_mutex);
+  thread_running = 0;
+  BX_UNLOCK(ring_mutex);
+}
+
+eth_pktmover_c *eth_capture_create(const char *capfile, const char *modname,
+                                   const char *netif, const char *macaddr,
+                                   eth_rx_handler_t rxh, eth_rx_status_t rxstat,
+                                   logfunctions *netdev, const char *script)
+{
+  bx_capture_pktmover_c *cap;
+  eth_pktmover_c *ethmod;
+
+  cap = new bx_capture_pktmover_c(netdev, rxh, rxstat);
+  if (!cap->open(capfile, modname)) {
+    // continue without recording
+    delete cap;
+    return eth_locator_c::create(modname, netif, macaddr, rxh, rxstat,
+                                 netdev, script);
+  }
+  ethmod = eth_locator_c::create(modname, netif, macaddr,
+                                 bx_capture_pktmover_c::rx_handler, rxstat,
+                                 netdev, script);
+  if (ethmod == NULL) {
+    delete cap;
+    return NULL;
+  }
+  cap->attach(ethmod);
+  return cap;
+}
+
+#endif /* if BX_NETWORKING */
@@ -0,0 +1,178 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+
+//  netcsum.cc  - internet checksum (RFC 1071) shared by the network device
+//  models, the pktmover modules and bxhub
+
+#define BX_PLUGGABLE
+
+#ifdef BXHUB
+#include "config.h"
+#include "misc/bxcompat.h"
+#else
+#include "bochs.h"
+#endif
+
+#if BX_NETWORKING
+
+#include "netmod.h"
+
+// The ones' complement sum does not depend on the byte order: the words are
+// added in host order and the result is swapped once at the end. Since
+// 2^16 == 1 (mod 0xffff), 32-bit words can be added into a 64-bit
+// accumulator and folded afterwards, which lets the vector versions use
+// plain integer adds without carry handling.
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define BX_NET_CSUM_SSE2 1
+#define BX_NET_CSUM_AVX2 1
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BX_NET_CSUM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+typedef Bit64u (*bx_net_csum_fn_t)(const Bit8u *buf, unsigned len);
+
+static Bit64u csum_scalar(const Bit8u *buf, unsigned len)
+{
+  Bit64u sum = 0;
+  Bit32u w0, w1;
+  Bit16u w;
+
+  while (len >= 8) {
+    memcpy(&w0, buf, 4);
+    memcpy(&w1, buf + 4, 4);
+    sum += (Bit64u)w0 + w1;
+    buf += 8;
+    len -= 8;
+  }
+  while (len >= 2) {
+    memcpy(&w, buf, 2);
+    sum += w;
+    buf += 2;
+    len -= 2;
+  }
+  if (len) {
+    // the odd byte is the first (network order high) byte of a word
+    Bit8u tmp[2] = {*buf, 0};
+    memcpy(&w, tmp, 2);
+    sum += w;
+  }
+  return sum;
+}
+
+#if BX_NET_CSUM_SSE2
+
+static Bit64u csum_sse2(const Bit8u *buf, unsigned len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+  __m128i v0, v1;
+  Bit64u lanes[2];
+
+  while (len >= 32) {
+    v0 = _mm_loadu_si128((const __m128i*)buf);
+    v1 = _mm_loadu_si128((const __m128i*)(buf + 16));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+    acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+    acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+    buf += 32;
+    len -= 32;
+  }
+  _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1] + csum_scalar(buf, len);
+}
+
+#endif
+
+#if BX_NET_CSUM_AVX2
+
+__attribute__((target("avx2")))
+static Bit64u csum_avx2(const Bit8u *buf, unsigned len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+  __m256i v0, v1;
+  Bit64u lanes[4];
+
+  while (len >= 64) {
+    v0 = _mm256_loadu_si256((const __m256i*)buf);
+    v1 = _mm256_loadu_si256((const __m256i*)(buf + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+    buf += 64;
+    len -= 64;
+  }
+  _mm256_storeu_si256((__m256i*)lanes, _mm256_add_epi64(acc0, acc1));
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + csum_sse2(buf, len);
+}
+
+#endif
+
+static Bit64u csum_dispatch(const Bit8u *buf, unsigned len);
+
+static bx_net_csum_fn_t csum_fn = csum_dispatch;
+
+// select the kernel on the first call
+static Bit64u csum_dispatch(const Bit8u *buf, unsigned len)
+{
+  bx_net_csum_fn_t fn = csum_scalar;
+
+#if BX_NET_CSUM_SSE2
+  fn = csum_sse2;
+#endif
+#if BX_NET_CSUM_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    fn = csum_avx2;
+  }
+#endif
+  csum_fn = fn;
+  return fn(buf, len);
+}
+
+// Add the 16-bit words of 'buf' (network byte order, an odd last byte is
+// padded with zero) to 'sum'. The result is folded to 16 bits, so partial
+// sums can be added together before calling bx_net_checksum_finish().
+Bit32u bx_net_checksum_add(const Bit8u *buf, unsigned len, Bit32u sum)
+{
+  Bit64u s = csum_fn(buf, len);
+
+  s = (s & 0xffffffff) + (s >> 32);
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+#ifndef BX_BIG_ENDIAN
+  s = ((s & 0xff) << 8) | (s >> 8);
+#endif
+  s += sum;
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  s = (s & 0xffff) + (s >> 16);
+  return (Bit32u)s;
+}
+
+#endif /* if BX_NETWORKING */
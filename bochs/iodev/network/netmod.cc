@@ -26,6 +26,7 @@
 
 #include "bochs.h"
 #include "plugin.h"
+#include "pc_system.h"
 #include "gui/siminterface.h"
 
 #if BX_NETWORKING
@@ -114,11 +115,20 @@ void* bx_netmod_ctl_c::init_module(bx_list_c *base, void *rxh, void *rxstat, log
     BX_PANIC(("could not find networking module '%s'", modname));
 #endif
   }
-  ethmod = eth_locator_c::create(modname,
-                                 SIM->get_param_string("ethdev", base)->getptr(),
-                                 (const char *) SIM->get_param_string("mac", base)->getptr(),
-                                 (eth_rx_handler_t)rxh, (eth_rx_status_t)rxstat, netdev,
-                                 SIM->get_param_string("script", base)->getptr());
+  const char *capfile = SIM->get_param_string("capture", base)->getptr();
+  if (strlen(capfile) > 0) {
+    ethmod = eth_capture_create(capfile, modname,
+                                SIM->get_param_string("ethdev", base)->getptr(),
+                                (const char *) SIM->get_param_string("mac", base)->getptr(),
+                                (eth_rx_handler_t)rxh, (eth_rx_status_t)rxstat, netdev,
+                                SIM->get_param_string("script", base)->getptr());
+  } else {
+    ethmod = eth_locator_c::create(modname,
+                                   SIM->get_param_string("ethdev", base)->getptr(),
+                                   (const char *) SIM->get_param_string("mac", base)->getptr(),
+                                   (eth_rx_handler_t)rxh, (eth_rx_status_t)rxstat, netdev,
+                                   SIM->get_param_string("script", base)->getptr());
+  }
 
   if (ethmod == NULL) {
     BX_PANIC(("could not find networking module '%s'", modname));
@@ -288,6 +298,41 @@ void write_pktlog_txt(FILE *pktlog_txt, const Bit8u *buf, unsigned len, bool hos
   fflush(pktlog_txt);
 }
 
+// generic versions of the scatter-gather and batch send methods
+
+void eth_pktmover_c::sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt)
+{
+  Bit8u txbuf[BX_PACKET_BUFSIZE + 4], *buf = txbuf;
+  unsigned i, len = 0;
+
+  if (iovcnt == 1) {
+    sendpkt((void*)iov[0].base, iov[0].len);
+    return;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    len += iov[i].len;
+  }
+  if (len > sizeof(txbuf)) {
+    buf = new Bit8u[len];
+  }
+  len = 0;
+  for (i = 0; i < iovcnt; i++) {
+    memcpy(buf + len, iov[i].base, iov[i].len);
+    len += iov[i].len;
+  }
+  sendpkt(buf, len);
+  if (buf != txbuf) {
+    delete [] buf;
+  }
+}
+
+void eth_pktmover_c::sendpkts(const bx_net_pkt_t *pkts, unsigned count)
+{
+  for (unsigned i = 0; i < count; i++) {
+    sendpkt_iov(pkts[i].iov, pkts[i].iovcnt);
+  }
+}
+
 size_t strip_whitespace(char *s)
 {
   size_t ptr = 0;
@@ -303,4 +348,224 @@ size_t strip_whitespace(char *s)
   return ptr;
 }
 
+#ifndef WIN32
+
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#undef LOG_THIS
+#define LOG_THIS netdev->
+
+eth_fd_pktmover_c::eth_fd_pktmover_c()
+{
+  rxq_head = 0;
+  rxq_tail = 0;
+  rxq_full_wait = 0;
+  rx_stop = 0;
+  rx_fd = -1;
+  wakeup_pipe[0] = -1;
+  wakeup_pipe[1] = -1;
+  rx_timer_index = BX_NULL_TIMER_HANDLE;
+  rx_timer_fast = 0;
+}
+
+eth_fd_pktmover_c::~eth_fd_pktmover_c()
+{
+  stop_rx();
+}
+
+void eth_fd_pktmover_c::start_rx(int fd, const char *name)
+{
+  int flags;
+
+  if (fd < 0) return;
+  // the receive thread must never block in read()
+  if ((flags = fcntl(fd, F_GETFL)) < 0) {
+    BX_PANIC(("%s: getflags on rx descriptor: %s", name, strerror(errno)));
+    return;
+  }
+  if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    BX_PANIC(("%s: set rx descriptor flags: %s", name, strerror(errno)));
+    return;
+  }
+  if (pipe(wakeup_pipe) < 0) {
+    BX_PANIC(("%s: cannot create wakeup pipe: %s", name, strerror(errno)));
+    return;
+  }
+  rx_fd = fd;
+  rx_stop = 0;
+  rxq_head = rxq_tail = 0;
+  rxq_full_wait = 0;
+  BX_INIT_MUTEX(rxq_mutex);
+  bx_create_sem(&rxq_space);
+  BX_THREAD_CREATE(rx_thread_func, this, rx_thread_var);
+  rx_timer_fast = 0;
+  rx_timer_index =
+    DEV_register_timer(this, rx_timer_handler, BX_NETDEV_RXQ_IDLE, 1, 1,
+                       name); // continuous, active
+}
+
+void eth_fd_pktmover_c::stop_rx()
+{
+  if (rx_fd < 0) return;
+  BX_LOCK(rxq_mutex);
+  rx_stop = 1;
+  BX_UNLOCK(rxq_mutex);
+  // wake up the thread, whether it waits in poll() or for ring space
+  if (write(wakeup_pipe[1], "", 1) < 0) {
+    BX_ERROR(("cannot wake up receive thread: %s", strerror(errno)));
+  }
+  bx_set_sem(&rxq_space);
+  BX_THREAD_JOIN(rx_thread_var);
+  bx_pc_system.deactivate_timer(rx_timer_index);
+  close(wakeup_pipe[0]);
+  close(wakeup_pipe[1]);
+  bx_destroy_sem(&rxq_space);
+  BX_FINI_MUTEX(rxq_mutex);
+  rx_fd = -1;
+}
+
+void eth_fd_pktmover_c::rx_timer_handler(void *this_ptr)
+{
+  ((eth_fd_pktmover_c *)this_ptr)->rx_deliver();
+}
+
+// Pass the queued frames to the device model (simulator thread)
+void eth_fd_pktmover_c::rx_deliver()
+{
+  unsigned head, tail;
+  bool wakeup = 0;
+
+  BX_LOCK(rxq_mutex);
+  head = rxq_head;
+  tail = rxq_tail;
+  BX_UNLOCK(rxq_mutex);
+  if (head != tail) {
+    // frames stay in the ring while the device cannot take them
+    while ((tail != head) && (this->rxstat(this->netdev) & BX_NETDEV_RXREADY)) {
+      this->rxh(this->netdev, rxq[tail % BX_NETDEV_RXQ_SIZE].data,
+                rxq[tail % BX_NETDEV_RXQ_SIZE].len);
+      tail++;
+    }
+    BX_LOCK(rxq_mutex);
+    if (tail != rxq_tail) {
+      rxq_tail = tail;
+      wakeup = rxq_full_wait;
+      rxq_full_wait = 0;
+    }
+    head = rxq_head;
+    BX_UNLOCK(rxq_mutex);
+    if (wakeup) {
+      bx_set_sem(&rxq_space);
+    }
+  }
+  // poll at the short interval only while frames are pending
+  if ((head != tail) != rx_timer_fast) {
+    rx_timer_fast = (head != tail);
+    bx_pc_system.activate_timer(rx_timer_index,
+      rx_timer_fast ? BX_NETDEV_RXQ_TIMER : BX_NETDEV_RXQ_IDLE, 1);
+  }
+}
+
+BX_THREAD_FUNC(eth_fd_pktmover_c::rx_thread_func, indata)
+{
+  ((eth_fd_pktmover_c *)indata)->rx_thread();
+  BX_THREAD_EXIT;
+}
+
+// generic batch receive: read frames one by one
+int eth_fd_pktmover_c::rx_read_batch(Bit8u **bufs, unsigned *lens, unsigned size,
+                                     unsigned count)
+{
+  unsigned n = 0;
+  int len;
+
+  while (n < count) {
+    len = rx_read(bufs[n], size);
+    if (len < 0) break;
+    lens[n++] = len;
+  }
+  return (n > 0) ? (int)n : -1;
+}
+
+// Receive thread: wait for the descriptor and queue all available frames
+void eth_fd_pktmover_c::rx_thread()
+{
+  struct pollfd pfd[2];
+  Bit8u *bufs[BX_NET_BATCH_MAX];
+  unsigned lens[BX_NET_BATCH_MAX];
+  unsigned head, used, i, n, count;
+  bool stop;
+  int ret;
+
+  pfd[0].fd = rx_fd;
+  pfd[0].events = POLLIN;
+  pfd[1].fd = wakeup_pipe[0];
+  pfd[1].events = POLLIN;
+  while (1) {
+    BX_LOCK(rxq_mutex);
+    stop = rx_stop;
+    used = rxq_head - rxq_tail;
+    if (used == BX_NETDEV_RXQ_SIZE) {
+      rxq_full_wait = 1;
+    }
+    BX_UNLOCK(rxq_mutex);
+    if (stop) break;
+    if (used == BX_NETDEV_RXQ_SIZE) {
+      bx_wait_sem(&rxq_space);
+      continue;
+    }
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      BX_ERROR(("receive thread: poll failed: %s", strerror(errno)));
+      break;
+    }
+    if (pfd[1].revents != 0) continue;
+    if ((pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)) &&
+        !(pfd[0].revents & POLLIN)) {
+      BX_ERROR(("receive thread: descriptor closed or in error state"));
+      break;
+    }
+    // read until the descriptor is drained or the ring is full, using
+    // as many free ring slots as possible per call
+    do {
+      BX_LOCK(rxq_mutex);
+      head = rxq_head;
+      used = head - rxq_tail;
+      BX_UNLOCK(rxq_mutex);
+      if (used == BX_NETDEV_RXQ_SIZE) break;
+      count = BX_NETDEV_RXQ_SIZE - used;
+      if (count > BX_NET_BATCH_MAX) count = BX_NET_BATCH_MAX;
+      for (i = 0; i < count; i++) {
+        bufs[i] = rxq[(head + i) % BX_NETDEV_RXQ_SIZE].data;
+      }
+      ret = rx_read_batch(bufs, lens, BX_PACKET_BUFSIZE, count);
+      if (ret <= 0) break;
+      // discarded frames are dropped by moving the following ones down
+      n = 0;
+      for (i = 0; i < (unsigned)ret; i++) {
+        if (lens[i] == 0) continue;
+        if (lens[i] < MIN_RX_PACKET_LEN) {
+          BX_DEBUG(("packet too short (%d), padding to %d", lens[i], MIN_RX_PACKET_LEN));
+          memset(bufs[i] + lens[i], 0, MIN_RX_PACKET_LEN - lens[i]);
+          lens[i] = MIN_RX_PACKET_LEN;
+        }
+        if (n != i) {
+          memcpy(bufs[n], bufs[i], lens[i]);
+        }
+        rxq[(head + n) % BX_NETDEV_RXQ_SIZE].len = lens[i];
+        n++;
+      }
+      if (n > 0) {
+        BX_LOCK(rxq_mutex);
+        rxq_head += n;
+        BX_UNLOCK(rxq_mutex);
+      }
+    } while ((unsigned)ret == count);
+  }
+}
+
+#endif
+
 #endif /* if BX_NETWORKING */
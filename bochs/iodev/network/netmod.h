@@ -62,6 +62,20 @@ BX_CPP_INLINE void put_net4(Bit8u *buf,Bit32u data)
   *(buf+3) = (Bit8u)(data & 0xff);
 }
 
+// Internet checksum helpers (netcsum.cc), data in network byte order
+#ifndef BXHUB
+Bit32u BOCHSAPI_MSVCONLY bx_net_checksum_add(const Bit8u *buf, unsigned len, Bit32u sum);
+#else
+Bit32u bx_net_checksum_add(const Bit8u *buf, unsigned len, Bit32u sum);
+#endif
+
+BX_CPP_INLINE Bit16u bx_net_checksum_finish(Bit32u sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (Bit16u)~sum;
+}
+
 #ifndef BXHUB
 
 // Pseudo device that loads the lowlevel networking module
@@ -88,6 +102,23 @@ BOCHSAPI extern bx_netmod_ctl_c bx_netmod_ctl;
 typedef void (*eth_rx_handler_t)(void *arg, const void *buf, unsigned len);
 typedef Bit32u (*eth_rx_status_t)(void *arg);
 
+// scatter-gather element of a frame passed to sendpkt_iov() / sendpkts()
+typedef struct {
+  const void *base;
+  unsigned len;
+} bx_net_iov_t;
+
+// frame in a batch passed to sendpkts()
+typedef struct {
+  const bx_net_iov_t *iov;
+  unsigned iovcnt;
+} bx_net_pkt_t;
+
+// maximum number of frames passed to the host in one call and of
+// buffers making up one frame
+#define BX_NET_BATCH_MAX 64
+#define BX_NET_IOV_MAX   64
+
 int execute_script(logfunctions *netdev, const char *name, char* arg1);
 void BOCHSAPI_MSVCONLY write_pktlog_txt(FILE *pktlog_txt, const Bit8u *buf, unsigned len, bool host_to_guest);
 size_t BOCHSAPI_MSVCONLY strip_whitespace(char *s);
@@ -100,9 +131,16 @@ size_t BOCHSAPI_MSVCONLY strip_whitespace(char *s);
 // system, an NDIS driver in promisc mode on WinNT, or maybe
 // a simulated network that talks to another process.
 //
-class eth_pktmover_c {
+// The sendpkt_iov() and sendpkts() methods let a device model pass a frame
+// as a list of buffers (e.g. header plus guest memory) and a batch of frames
+// at once. Modules that can do this natively (writev, sendmmsg) override
+// them, the default versions copy the buffers and call sendpkt().
+//
+class BOCHSAPI_MSVCONLY eth_pktmover_c {
 public:
   virtual void sendpkt(void *buf, unsigned io_len) = 0;
+  virtual void sendpkt_iov(const bx_net_iov_t *iov, unsigned iovcnt);
+  virtual void sendpkts(const bx_net_pkt_t *pkts, unsigned count);
   virtual ~eth_pktmover_c () {}
 protected:
   logfunctions *netdev;
@@ -110,6 +148,67 @@ protected:
   eth_rx_status_t  rxstat; // receive status callback
 };
 
+#ifndef WIN32
+
+#include "bxthread.h"
+
+// Number of received frames that can be queued by the receive thread
+#define BX_NETDEV_RXQ_SIZE   128
+// Interval of the timer passing queued frames to the device model (usec)
+#define BX_NETDEV_RXQ_TIMER  100
+// Interval of the same timer while the ring is empty (usec)
+#define BX_NETDEV_RXQ_IDLE   1000
+
+//
+//  The eth_fd_pktmover class is the base for pktmovers that receive
+// frames from a host file descriptor (tap, tuntap, socket, vde, ...).
+// A host thread waits in poll() for the descriptor and reads all frames
+// available into a ring. The simulator thread only checks the ring from
+// a timer and passes the frames to the device model while it is ready
+// to receive. Timers can only be armed by the simulator thread, so the
+// timer runs at the short interval while frames are queued and falls back
+// to the idle interval when the ring drains. If the ring is full the
+// thread stops reading, so frames are held back by the host instead of
+// being dropped here.
+//
+class BOCHSAPI_MSVCONLY eth_fd_pktmover_c : public eth_pktmover_c {
+public:
+  eth_fd_pktmover_c();
+  virtual ~eth_fd_pktmover_c();
+protected:
+  void start_rx(int fd, const char *name);
+  void stop_rx();
+  // read one frame from the descriptor (receive thread context)
+  // returns frame length, 0 if the frame was discarded or < 0 if no
+  // more data is available
+  virtual int rx_read(Bit8u *buf, unsigned size) = 0;
+  // read up to 'count' frames into the buffers and store their lengths
+  // (0 = discarded), returns the number of entries used or < 0 if no data
+  // is available. Modules with a batched receive call (recvmmsg) override it.
+  virtual int rx_read_batch(Bit8u **bufs, unsigned *lens, unsigned size, unsigned count);
+private:
+  struct {
+    Bit8u data[BX_PACKET_BUFSIZE];
+    unsigned len;
+  } rxq[BX_NETDEV_RXQ_SIZE];
+  unsigned rxq_head, rxq_tail;
+  bool rxq_full_wait;
+  bool rx_stop;
+  int rx_fd;
+  int wakeup_pipe[2];
+  int rx_timer_index;
+  bool rx_timer_fast;
+  BX_MUTEX(rxq_mutex);
+  bx_thread_sem_t rxq_space;
+  BX_THREAD_VAR(rx_thread_var);
+
+  static void rx_timer_handler(void *);
+  void rx_deliver();
+  static BX_THREAD_FUNC(rx_thread_func, indata);
+  void rx_thread();
+};
+
+#endif
 
 //
 //  The eth_locator class is used by pktmover classes to register
@@ -141,6 +240,13 @@ private:
   const char *type;
 };
 
+// Create the pktmover 'type' with a recorder in front of it, that writes
+// the frames of both directions to the pcap-ng file 'capfile' (netcapture.cc)
+eth_pktmover_c *eth_capture_create(const char *capfile, const char *type,
+                                   const char *netif, const char *macaddr,
+                                   eth_rx_handler_t rxh, eth_rx_status_t rxstat,
+                                   logfunctions *netdev, const char *script);
+
 #endif
 
 #endif
@@ -53,6 +53,7 @@ typedef struct ftp_session {
   Bit16u client_data_port;
   bool   ascii_mode;
   int    data_xfer_fd;
+  vnet_file_t data_xfer_file;
   unsigned data_xfer_size;
   unsigned data_xfer_pos;
   unsigned cmdcode;
@@ -65,21 +66,61 @@ typedef struct ftp_session {
 
 Bit16u ip_checksum(const Bit8u *buf, unsigned buf_len)
 {
-  Bit32u sum = 0;
-  unsigned n;
+  return (Bit16u)bx_net_checksum_add(buf, buf_len, 0);
+}
 
-  for (n = 0; n < buf_len; n++) {
-    if (n & 1) {
-      sum += (Bit32u)(*buf++);
-    } else {
-      sum += (Bit32u)(*buf++) << 8;
-    }
+// Files sent by the TFTP and FTP servers are opened once per transfer and
+// read with pread() at the packet offset. They are not mapped into memory:
+// a host process truncating the file during a transfer would make the
+// access to the mapping raise SIGBUS, while a read only comes up short.
+
+static bool vnet_file_open(vnet_file_t *f, const char *path)
+{
+  struct stat stat_buf;
+
+  f->size = 0;
+  f->fd = open(path, O_RDONLY
+#ifdef O_BINARY
+               | O_BINARY
+#endif
+               );
+  if (f->fd < 0) {
+    return 0;
+  }
+  if (fstat(f->fd, &stat_buf) < 0) {
+    close(f->fd);
+    f->fd = -1;
+    return 0;
+  }
+  f->size = (Bit64u)stat_buf.st_size;
+  return 1;
+}
+
+// returns the number of bytes copied to 'buf' or -1 on error
+static int vnet_file_read(vnet_file_t *f, Bit64u offset, Bit8u *buf, unsigned len)
+{
+  if (offset >= f->size) {
+    return 0;
+  }
+  if (len > (f->size - offset)) {
+    len = (unsigned)(f->size - offset);
   }
-  while (sum > 0xffff) {
-    sum = (sum >> 16) + (sum & 0xffff);
+#ifndef WIN32
+  return pread(f->fd, buf, len, (off_t)offset);
+#else
+  if (lseek(f->fd, (off_t)offset, SEEK_SET) < 0) {
+    return -1;
   }
+  return read(f->fd, buf, len);
+#endif
+}
 
-  return (Bit16u)sum;
+static void vnet_file_close(vnet_file_t *f)
+{
+  if (f->fd >= 0) {
+    close(f->fd);
+    f->fd = -1;
+  }
 }
 
 // VNET server definitions
@@ -171,11 +212,15 @@ Bit16u ip_checksum(const Bit8u *buf, unsigned buf_len)
 #define TFTP_OPTION_BLKSIZE 0x2
 #define TFTP_OPTION_TSIZE   0x4
 #define TFTP_OPTION_TIMEOUT 0x8
+#define TFTP_OPTION_WINDOWSIZE 0x10
 
 #define TFTP_DEFAULT_BLKSIZE 512
 #define TFTP_DEFAULT_TIMEOUT   5
 
-#define TFTP_BUFFER_SIZE     1432
+// largest block fitting into an ethernet frame (RFC 2348)
+#define TFTP_BUFFER_SIZE     (BX_PACKET_BUFSIZE - 46)
+// maximum number of blocks sent without waiting for an ACK (RFC 7440)
+#define TFTP_MAX_WINDOWSIZE  64
 
 static const Bit8u mcast_ipv6_mac_prefix[2] = {0x33,0x33};
 
@@ -203,6 +248,7 @@ vnet_server_c::vnet_server_c()
   }
   packet_counter = 0;
   packets = NULL;
+  packets_tail = NULL;
 }
 
 vnet_server_c::~vnet_server_c()
@@ -324,13 +370,16 @@ unsigned vnet_server_c::get_packet(Bit8u *buf)
     delete [] packets->buffer;
     delete packets;
     packets = tmp;
+    if (packets == NULL) {
+      packets_tail = NULL;
+    }
   }
   return len;
 }
 
 void vnet_server_c::host_to_guest(Bit8u clientid, Bit8u *buf, unsigned len, unsigned l3type)
 {
-  packet_item_t *pitem, *tmp;
+  packet_item_t *pitem;
 
   if (len < 14) {
     BX_ERROR(("host_to_guest: io_len < 14!"));
@@ -356,12 +405,9 @@ void vnet_server_c::host_to_guest(Bit8u clientid, Bit8u *buf, unsigned len, unsi
   if (packets == NULL) {
     packets = pitem;
   } else {
-    tmp = packets;
-    while (tmp->next != NULL) {
-      tmp = tmp->next;
-    }
-    tmp->next = pitem;
+    packets_tail->next = pitem;
   }
+  packets_tail = pitem;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -690,7 +736,7 @@ void vnet_server_c::process_tcpipv4(Bit8u clientid, Bit8u srv_id,
   const Bit8u *tcp_data;
   tcp_handler_t func;
   tcp_conn_t *tcp_conn;
-  bool tcp_error = 1;
+  bool tcp_error = 1, tcp_acked;
   Bit8u option, optlen;
   Bit16u value16;
 
@@ -780,6 +826,7 @@ void vnet_server_c::process_tcpipv4(Bit8u clientid, Bit8u srv_id,
         if (tcp_conn->state == TCP_CONNECTING) {
           tcp_conn->guest_seq_num = tcp_seq_num;
           tcp_conn->host_seq_num = tcp_ack_num;
+          tcp_conn->host_ack_num = tcp_ack_num;
           tcp_conn->window = tcp_window;
           (*func)((void *)this, tcp_conn, tcp_data, tcpdata_len);
           tcp_conn->state = TCP_CONNECTED;
@@ -791,7 +838,15 @@ void vnet_server_c::process_tcpipv4(Bit8u clientid, Bit8u srv_id,
         } else {
           tcp_conn->guest_seq_num = tcp_seq_num;
           tcp_conn->window = tcp_window;
-          if ((tcpdata_len > 0) || (tcp_ack_num == tcp_conn->host_seq_num)) {
+          // the handler may send more data whenever the guest acknowledges
+          // a part of the data in flight
+          tcp_acked = ((Bit32s)(tcp_ack_num - tcp_conn->host_ack_num) > 0) &&
+                      ((Bit32s)(tcp_ack_num - tcp_conn->host_seq_num) <= 0);
+          if (tcp_acked) {
+            tcp_conn->host_ack_num = tcp_ack_num;
+          }
+          if ((tcpdata_len > 0) || tcp_acked ||
+              (tcp_ack_num == tcp_conn->host_seq_num)) {
             if (tcpdata_len > 0) {
               tcpipv4_send_ack(tcp_conn, tcpdata_len);
             }
@@ -861,7 +916,7 @@ unsigned vnet_server_c::tcpipv4_send_data(tcp_conn_t *tcp_conn, const Bit8u *dat
   tcp_header_t *tcphdr = (tcp_header_t *)&sendbuf[34];
   unsigned tcphdr_len = sizeof(tcp_header_t);
   Bit8u *tcp_data;
-  unsigned pos = 0, sendsize, total;
+  unsigned pos = 0, sendsize, total, in_flight;
 
   if (data_len > 0) {
     memset(tcphdr, 0, tcphdr_len);
@@ -879,7 +934,9 @@ unsigned vnet_server_c::tcpipv4_send_data(tcp_conn_t *tcp_conn, const Bit8u *dat
       } else {
         sendsize = total;
       }
-      if ((pos + sendsize) > tcp_conn->window)
+      // do not send more than the guest window beyond the last acknowledged byte
+      in_flight = tcp_conn->host_seq_num - tcp_conn->host_ack_num;
+      if ((in_flight + sendsize) > tcp_conn->window)
         break;
       tcphdr->seq_num = htonl(tcp_conn->host_seq_num);
       if (sendsize > 0) {
@@ -950,6 +1007,7 @@ ftp_session_t *ftp_new_session(tcp_conn_t *tcp_conn, Bit16u client_cmd_port)
   fs->client_cmd_port = client_cmd_port;
   fs->ascii_mode = 1;
   fs->data_xfer_fd = -1;
+  fs->data_xfer_file.fd = -1;
   fs->rel_path = new char[BX_PATHNAME_LEN];
   strcpy(fs->rel_path, "/");
   fs->next = ftp_sessions;
@@ -990,6 +1048,7 @@ void ftp_remove_session(ftp_session_t *fs)
   if (fs->data_xfer_fd >= 0) {
     close(fs->data_xfer_fd);
   }
+  vnet_file_close(&fs->data_xfer_file);
   delete [] fs->rel_path;
   delete fs;
 }
@@ -1166,9 +1225,12 @@ void vnet_server_c::tcpipv4_ftp_handler_ns(tcp_conn_t *tcp_conn, const Bit8u *da
         }
         switch (fs->cmdcode) {
           case FTPCMD_ABOR:
-            if (fs->data_xfer_fd >= 0) {
-              close(fs->data_xfer_fd);
-              fs->data_xfer_fd = -1;
+            if ((fs->data_xfer_fd >= 0) || (fs->data_xfer_file.fd >= 0)) {
+              if (fs->data_xfer_fd >= 0) {
+                close(fs->data_xfer_fd);
+                fs->data_xfer_fd = -1;
+              }
+              vnet_file_close(&fs->data_xfer_file);
               tcpipv4_send_fin(tcpc_data, 1);
               ftp_send_reply(tcpc_cmd, "426 Transfer aborted.");
               ftp_send_reply(tcpc_cmd, "226 Transfer abort complete.");
@@ -1274,7 +1336,9 @@ void vnet_server_c::tcpipv4_ftp_handler_ns(tcp_conn_t *tcp_conn, const Bit8u *da
             if (fs->pasv_port > 0) {
               if (fs->data_xfer_fd >= 0) {
                 close(fs->data_xfer_fd);
+                fs->data_xfer_fd = -1;
               }
+              vnet_file_close(&fs->data_xfer_file);
               unregister_tcp_handler(fs->pasv_port);
             }
             ftp_send_reply(tcpc_cmd, "221 Goodbye.");
@@ -1370,6 +1434,7 @@ void vnet_server_c::tcpipv4_ftp_handler_ns(tcp_conn_t *tcp_conn, const Bit8u *da
       fs->client_data_port = tcpc_data->src_port;
       tcpc_data->data = fs;
     } else if (tcpc_data->state == TCP_DISCONNECTING) {
+      vnet_file_close(&fs->data_xfer_file);
       if (fs->data_xfer_fd >= 0) {
         close(fs->data_xfer_fd);
         fs->data_xfer_fd = -1;
@@ -1393,9 +1458,9 @@ void vnet_server_c::tcpipv4_ftp_handler_ns(tcp_conn_t *tcp_conn, const Bit8u *da
           BX_ERROR(("FTP data port %d: unexpected data", fs->pasv_port));
         }
       } else {
-        if (fs->data_xfer_fd >= 0) {
+        if (fs->data_xfer_file.fd >= 0) {
           ftp_send_data(tcpc_cmd, tcpc_data);
-        } else {
+        } else if (fs->data_xfer_fd < 0) {
           tcpipv4_send_fin(tcpc_data, 1);
         }
       }
@@ -1569,11 +1634,14 @@ void vnet_server_c::ftp_send_data_prep(tcp_conn_t *tcpc_cmd, tcp_conn_t *tcpc_da
                                        const char *path, unsigned data_len)
 {
   ftp_session_t *fs = (ftp_session_t*)tcpc_cmd->data;
-  fs->data_xfer_fd = open(path, O_RDONLY
-#ifdef O_BINARY
-                          | O_BINARY
-#endif
-                          );
+  vnet_file_close(&fs->data_xfer_file);
+  if (!vnet_file_open(&fs->data_xfer_file, path)) {
+    ftp_send_reply(tcpc_cmd, "451 Cannot open file.");
+    return;
+  }
+  if (data_len > fs->data_xfer_file.size) {
+    data_len = (unsigned)fs->data_xfer_file.size;
+  }
   fs->data_xfer_size = data_len;
   fs->data_xfer_pos = 0;
   ftp_send_data(tcpc_cmd, tcpc_data);
@@ -1583,29 +1651,41 @@ void vnet_server_c::ftp_send_data(tcp_conn_t *tcpc_cmd, tcp_conn_t *tcpc_data)
 {
   ftp_session_t *fs = (ftp_session_t*)tcpc_cmd->data;
   Bit8u *buffer = NULL;
+  const Bit8u *data = NULL;
   unsigned data_len = fs->data_xfer_size - fs->data_xfer_pos;
+  unsigned in_flight = tcpc_data->host_seq_num - tcpc_data->host_ack_num;
+  int rd;
 
-  if (tcpc_data->window == 0)
+  // fill the part of the guest window not occupied by unacknowledged data
+  if (in_flight >= tcpc_data->window)
     return;
-  if (data_len > tcpc_data->window) {
-    data_len = tcpc_data->window;
+  if (data_len > (unsigned)(tcpc_data->window - in_flight)) {
+    data_len = tcpc_data->window - in_flight;
   }
   if (data_len > 0) {
     buffer = new Bit8u[data_len];
-    lseek(fs->data_xfer_fd, fs->data_xfer_pos, SEEK_SET);
-    read(fs->data_xfer_fd, buffer, data_len);
+    rd = vnet_file_read(&fs->data_xfer_file, fs->data_xfer_pos, buffer, data_len);
+    if (rd < (int)data_len) {
+      // the file has been truncated on the host
+      BX_ERROR(("FTP: cannot read file data"));
+      fs->data_xfer_size = fs->data_xfer_pos + ((rd > 0) ? rd : 0);
+      data_len = fs->data_xfer_size - fs->data_xfer_pos;
+    }
+    data = buffer;
+    fs->data_xfer_pos += tcpipv4_send_data(tcpc_data, data, data_len, 0);
+  } else {
+    // empty file: just close the connection
+    tcpipv4_send_data(tcpc_data, NULL, 0, 0);
   }
-  fs->data_xfer_pos += tcpipv4_send_data(tcpc_data, buffer, data_len, 0);
   if (fs->data_xfer_pos == fs->data_xfer_size) {
     ftp_send_reply(tcpc_cmd, "226 Transfer complete.");
-    close(fs->data_xfer_fd);
-    fs->data_xfer_fd = -1;
+    vnet_file_close(&fs->data_xfer_file);
     if (strlen(fs->dirlist_tmp) > 0) {
       unlink(fs->dirlist_tmp);
       fs->dirlist_tmp[0] = 0;
     }
   }
-  if (data_len > 0) {
+  if (buffer != NULL) {
     delete [] buffer;
   }
 }
@@ -1895,43 +1975,54 @@ void vnet_server_c::process_udpipv4(Bit8u clientid, Bit8u srv_id,
 
   func = get_layer4_handler(0x11, udp_dst_port);
   if (func != (layer4_handler_t)NULL) {
+    // handlers sending more than one reply need to know the destination
+    udp_clientid = clientid;
+    udp_srv_id = srv_id;
     udp_len = (*func)((void *)this,ipheader, ipheader_len,
               udp_src_port, udp_dst_port, &l4pkt[8], l4pkt_len-8, udpreply);
   } else {
     BX_ERROR(("udp - unhandled port %u", udp_dst_port));
   }
   if (udp_len > 0) {
-    if ((udp_len + 42U) > BX_PACKET_BUFSIZE) {
-      BX_ERROR(("generated udp data is too long"));
-      return;
-    }
-    // udp pseudo-header
-    replybuf[34U-12U] = 0;
-    replybuf[34U-11U] = 0x11; // UDP
-    put_net2(&replybuf[34U-10U], 8U+udp_len);
-    memcpy(&replybuf[34U-8U], dhcp->srv_ipv4addr[srv_id], 4);
-    memcpy(&replybuf[34U-4U], client[clientid].ipv4addr, 4);
-    // udp header
-    put_net2(&replybuf[34U+0], udp_dst_port);
-    put_net2(&replybuf[34U+2], udp_src_port);
-    put_net2(&replybuf[34U+4],8U+udp_len);
-    put_net2(&replybuf[34U+6],0);
-    put_net2(&replybuf[34U+6], ip_checksum(&replybuf[34U-12U],12U+8U+udp_len) ^ (Bit16u)0xffff);
-    // ip header
-    memset(&replybuf[14U], 0, 20U);
-    replybuf[14U+0] = 0x45;
-    replybuf[14U+1] = 0x00;
-    put_net2(&replybuf[14U+2], 20U+8U+udp_len);
-    put_net2(&replybuf[14U+4], 1);
-    replybuf[14U+6] = 0x00;
-    replybuf[14U+7] = 0x00;
-    replybuf[14U+8] = 0x07; // TTL
-    replybuf[14U+9] = 0x11; // UDP
-
-    host_to_guest_ipv4(clientid, srv_id, replybuf, udp_len + 42U);
+    host_to_guest_udpipv4(clientid, srv_id, udp_dst_port, udp_src_port,
+                          replybuf, udp_len);
   }
 }
 
+void vnet_server_c::host_to_guest_udpipv4(Bit8u clientid, Bit8u srv_id,
+                                          Bit16u src_port, Bit16u dst_port,
+                                          Bit8u *data, unsigned data_len)
+{
+  if ((data_len + 42U) > BX_PACKET_BUFSIZE) {
+    BX_ERROR(("generated udp data is too long"));
+    return;
+  }
+  // udp pseudo-header
+  data[34U-12U] = 0;
+  data[34U-11U] = 0x11; // UDP
+  put_net2(&data[34U-10U], 8U+data_len);
+  memcpy(&data[34U-8U], dhcp->srv_ipv4addr[srv_id], 4);
+  memcpy(&data[34U-4U], client[clientid].ipv4addr, 4);
+  // udp header
+  put_net2(&data[34U+0], src_port);
+  put_net2(&data[34U+2], dst_port);
+  put_net2(&data[34U+4],8U+data_len);
+  put_net2(&data[34U+6],0);
+  put_net2(&data[34U+6], ip_checksum(&data[34U-12U],12U+8U+data_len) ^ (Bit16u)0xffff);
+  // ip header
+  memset(&data[14U], 0, 20U);
+  data[14U+0] = 0x45;
+  data[14U+1] = 0x00;
+  put_net2(&data[14U+2], 20U+8U+data_len);
+  put_net2(&data[14U+4], 1);
+  data[14U+6] = 0x00;
+  data[14U+7] = 0x00;
+  data[14U+8] = 0x07; // TTL
+  data[14U+9] = 0x11; // UDP
+
+  host_to_guest_ipv4(clientid, srv_id, data, data_len + 42U);
+}
+
 int vnet_server_c::udpipv4_dhcp_handler(void *this_ptr, const Bit8u *ipheader,
   unsigned ipheader_len, unsigned sourceport, unsigned targetport,
   const Bit8u *l4pkt, unsigned l4pkt_len, Bit8u *reply)
@@ -2239,6 +2330,9 @@ tftp_session_t *tftp_new_session(Bit16u req_tid, bool mode, const char *tpath, c
   s->options = 0;
   s->blksize_val = TFTP_DEFAULT_BLKSIZE;
   s->timeout_val = TFTP_DEFAULT_TIMEOUT;
+  s->windowsize_val = 1;
+  s->last_ack = 0;
+  s->file.fd = -1;
   s->next = tftp_sessions;
   tftp_sessions = s;
   if ((strlen(tname) > 0) && ((strlen(tpath) + strlen(tname)) < BX_PATHNAME_LEN)) {
@@ -2279,6 +2373,7 @@ void tftp_remove_session(tftp_session_t *s)
       last->next = s->next;
     }
   }
+  vnet_file_close(&s->file);
   delete s;
 }
 
@@ -2322,36 +2417,22 @@ int tftp_send_error(Bit8u *buffer, unsigned code, const char *msg, tftp_session_
   return (strlen(msg) + 5);
 }
 
-int tftp_send_data(Bit8u *buffer, unsigned block_nr, tftp_session_t *s)
+// The block number is counted in 32 bits, so that files with more than
+// 65535 blocks can be sent (the 16-bit value in the packet rolls over).
+// The session is kept until the client has acknowledged the last block.
+int tftp_send_data(Bit8u *buffer, Bit32u block_nr, tftp_session_t *s)
 {
-  char msg[BX_PATHNAME_LEN + 16];
   int rd;
 
-  FILE *fp = fopen(s->filename, "rb");
-  if (!fp) {
-    sprintf(msg, "File not found: %s", s->filename);
-    return tftp_send_error(buffer, 1, msg, s);
-  }
-
-  if (fseek(fp, (block_nr - 1) * s->blksize_val, SEEK_SET) < 0) {
-    fclose(fp);
-    return tftp_send_error(buffer, 3, "Block not seekable", s);
-  }
-
-  rd = fread(buffer + 4, 1, s->blksize_val, fp);
-  fclose(fp);
-
+  rd = vnet_file_read(&s->file, (Bit64u)(block_nr - 1) * s->blksize_val,
+                      buffer + 4, s->blksize_val);
   if (rd < 0) {
     return tftp_send_error(buffer, 3, "Block not readable", s);
   }
 
   put_net2(buffer, TFTP_DATA);
-  put_net2(buffer + 2, block_nr);
-  if (rd < (int)s->blksize_val) {
-    tftp_remove_session(s);
-  } else {
-    tftp_update_timestamp(s);
-  }
+  put_net2(buffer + 2, (Bit16u)block_nr);
+  tftp_update_timestamp(s);
   return (rd + 4);
 }
 
@@ -2382,6 +2463,12 @@ int tftp_send_optack(Bit8u *buffer, tftp_session_t *s)
     sprintf((char *)p, "%u", s->timeout_val);
     p += strlen((const char *)p) + 1;
   }
+  if (s->options & TFTP_OPTION_WINDOWSIZE) {
+    strcpy((char *)p, "windowsize");
+    p += 11;
+    sprintf((char *)p, "%u", s->windowsize_val);
+    p += strlen((const char *)p) + 1;
+  }
   tftp_update_timestamp(s);
   return (p - buffer);
 }
@@ -2404,12 +2491,29 @@ void vnet_server_c::tftp_parse_options(const char *mode, const Bit8u *data,
       s->options |= TFTP_OPTION_BLKSIZE;
       mode += 8;
       s->blksize_val = atoi(mode);
-      if (s->blksize_val > TFTP_BUFFER_SIZE) {
+      if (s->blksize_val < 8) {
+        BX_ERROR(("tftp req: blksize value %d not supported - using %d instead",
+                  s->blksize_val, TFTP_DEFAULT_BLKSIZE));
+        s->blksize_val = TFTP_DEFAULT_BLKSIZE;
+      } else if (s->blksize_val > TFTP_BUFFER_SIZE) {
         BX_ERROR(("tftp req: blksize value %d not supported - using %d instead",
                   s->blksize_val, TFTP_BUFFER_SIZE));
         s->blksize_val = TFTP_BUFFER_SIZE;
       }
       mode += strlen(mode)+1;
+    } else if (memcmp(mode, "windowsize\0", 11) == 0) {
+      mode += 11;
+      // only supported for sending files (the receive path ACKs every block)
+      if (!s->iswrite) {
+        s->options |= TFTP_OPTION_WINDOWSIZE;
+        s->windowsize_val = atoi(mode);
+        if (s->windowsize_val < 1) {
+          s->windowsize_val = 1;
+        } else if (s->windowsize_val > TFTP_MAX_WINDOWSIZE) {
+          s->windowsize_val = TFTP_MAX_WINDOWSIZE;
+        }
+      }
+      mode += strlen(mode)+1;
     } else if (memcmp(mode, "timeout\0", 8) == 0) {
       s->options |= TFTP_OPTION_TIMEOUT;
       mode += 8;
@@ -2427,6 +2531,48 @@ void vnet_server_c::tftp_parse_options(const char *mode, const Bit8u *data,
   }
 }
 
+// Send the blocks following the acknowledged one, up to the window size.
+// All but the last block are passed to the guest directly, the last one
+// is returned as the reply of the UDP handler.
+int vnet_server_c::tftp_send_window(Bit8u *reply, unsigned sourceport,
+                                    unsigned targetport, Bit16u ack_nr,
+                                    tftp_session_t *s)
+{
+  Bit8u sendbuf[BX_PACKET_BUFSIZE];
+  Bit32u block_nr, last_block;
+  unsigned count, i;
+  int len;
+
+  // extend the 16-bit block number of the ACK relative to the last one
+  if ((Bit16s)(ack_nr - (Bit16u)s->last_ack) < 0) {
+    // stale ACK from an earlier window
+    return 0;
+  }
+  block_nr = s->last_ack + (Bit16u)(ack_nr - (Bit16u)s->last_ack);
+  last_block = (Bit32u)(s->file.size / s->blksize_val) + 1;
+  if (block_nr >= last_block) {
+    // transfer complete
+    tftp_remove_session(s);
+    return 0;
+  }
+  s->last_ack = block_nr;
+  count = last_block - block_nr;
+  if (count > s->windowsize_val) {
+    count = s->windowsize_val;
+  }
+  for (i = 1; i < count; i++) {
+    len = tftp_send_data(&sendbuf[42], block_nr + i, s);
+    if (get_net2(&sendbuf[42]) != TFTP_DATA) {
+      // the session has been removed
+      memcpy(reply, &sendbuf[42], len);
+      return len;
+    }
+    host_to_guest_udpipv4(udp_clientid, udp_srv_id, targetport, sourceport,
+                          sendbuf, len);
+  }
+  return tftp_send_data(reply, block_nr + count, s);
+}
+
 int vnet_server_c::udpipv4_tftp_handler(void *this_ptr, const Bit8u *ipheader,
   unsigned ipheader_len, unsigned sourceport, unsigned targetport,
   const Bit8u *data, unsigned data_len, Bit8u *reply)
@@ -2461,12 +2607,9 @@ int vnet_server_c::udpipv4_tftp_handler_ns(const Bit8u *ipheader,
         if (strlen(s->filename) == 0) {
           return tftp_send_error(reply, 1, "Illegal file name", s);
         }
-        fp = fopen(s->filename, "rb");
-        if (!fp) {
+        if (!vnet_file_open(&s->file, s->filename)) {
           sprintf(msg, "File not found: %s", s->filename);
           return tftp_send_error(reply, 1, msg, s);
-        } else {
-          fclose(fp);
         }
         // options
         if (strlen((char*)reply) < data_len - 2) {
@@ -2477,18 +2620,13 @@ int vnet_server_c::udpipv4_tftp_handler_ns(const Bit8u *ipheader,
           return tftp_send_error(reply, 4, "Unsupported transfer mode", NULL);
         }
         if (s->options & TFTP_OPTION_TSIZE) {
-          struct stat stbuf;
-          if (stat(s->filename, &stbuf) < 0) {
-            s->options &= ~TFTP_OPTION_TSIZE;
-          } else {
-            s->tsize_val = (size_t)stbuf.st_size;
-            BX_DEBUG(("TFTP RRQ: filesize=%lu", (unsigned long)s->tsize_val));
-          }
+          s->tsize_val = (size_t)s->file.size;
+          BX_DEBUG(("TFTP RRQ: filesize=%lu", (unsigned long)s->tsize_val));
         }
         if ((s->options & ~TFTP_OPTION_OCTET) > 0) {
           return tftp_send_optack(reply, s);
         } else {
-          return tftp_send_data(reply, 1, s);
+          return tftp_send_window(reply, sourceport, targetport, 0, s);
         }
       }
       break;
@@ -2546,7 +2684,7 @@ int vnet_server_c::udpipv4_tftp_handler_ns(const Bit8u *ipheader,
             if (!fp) {
               return tftp_send_error(reply, 2, "Access violation", s);
             }
-            if (fseek(fp, (block_nr - 1) * TFTP_BUFFER_SIZE, SEEK_SET) < 0) {
+            if (fseek(fp, (block_nr - 1) * s->blksize_val, SEEK_SET) < 0) {
               fclose(fp);
               return tftp_send_error(reply, 3, "Block not seekable", s);
             }
@@ -2572,7 +2710,8 @@ int vnet_server_c::udpipv4_tftp_handler_ns(const Bit8u *ipheader,
     case TFTP_ACK:
       if (s != NULL) {
         if (s->iswrite == 0) {
-          return tftp_send_data(reply, get_net2(data + 2) + 1, s);
+          return tftp_send_window(reply, sourceport, targetport,
+                                  get_net2(data + 2), s);
         } else {
           return tftp_send_error(reply, 4, "Illegal request", s);
         }
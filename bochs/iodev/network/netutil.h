@@ -175,6 +175,12 @@ typedef struct {
 #endif
 Bit16u ip_checksum(const Bit8u *buf, unsigned buf_len);
 
+// file sent by the TFTP / FTP server
+typedef struct {
+  int    fd;
+  Bit64u size;
+} vnet_file_t;
+
 typedef struct tftp_session {
   char     filename[BX_PATHNAME_LEN];
   Bit16u   tid;
@@ -183,13 +189,20 @@ typedef struct tftp_session {
   size_t   tsize_val;
   unsigned blksize_val;
   unsigned timeout_val;
+  unsigned windowsize_val;
   unsigned timestamp;
+  Bit32u   last_ack;
+  vnet_file_t file;
   struct tftp_session *next;
 } tftp_session_t;
 
 // VNET server
 
+#ifdef BXHUB
+#define VNET_MAX_CLIENTS 64
+#else
 #define VNET_MAX_CLIENTS 6
+#endif
 #define LAYER4_LISTEN_MAX  128
 
 typedef int (*layer4_handler_t)(
@@ -218,6 +231,7 @@ typedef struct tcp_conn {
   Bit16u src_port;
   Bit16u dst_port;
   Bit32u host_seq_num;
+  Bit32u host_ack_num;
   Bit32u guest_seq_num;
   Bit16u window;
   Bit8u  state;
@@ -276,6 +290,8 @@ private:
   void process_udpipv4(Bit8u clientid, Bit8u srv_id, const Bit8u *ipheader,
                        unsigned ipheader_len, const Bit8u *l4pkt, unsigned l4pkt_len);
 
+  void host_to_guest_udpipv4(Bit8u clientid, Bit8u srv_id, Bit16u src_port,
+                             Bit16u dst_port, Bit8u *data, unsigned data_len);
   void host_to_guest_tcpipv4(Bit8u clientid, Bit8u srv_id, Bit16u src_port,
                              Bit16u dst_port, Bit8u *data, unsigned data_len,
                              unsigned hdr_len);
@@ -326,6 +342,8 @@ private:
 
   void tftp_parse_options(const char *mode, const Bit8u *data, unsigned data_len,
                           tftp_session_t *s);
+  int tftp_send_window(Bit8u *reply, unsigned sourceport, unsigned targetport,
+                       Bit16u ack_nr, tftp_session_t *s);
 
 #ifdef BXHUB
   FILE *logfd;
@@ -358,6 +376,10 @@ private:
 
   Bit16u packet_counter;
   packet_item_t *packets;
+  packet_item_t *packets_tail;
+  // client and server of the UDP packet being processed
+  Bit8u udp_clientid;
+  Bit8u udp_srv_id;
 };
 
 #endif
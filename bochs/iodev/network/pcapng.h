@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+//
+
+//  pcapng.h  - pcap-ng file format definitions shared by the packet capture
+//  (netcapture.cc) and the 'replay' networking module (eth_replay.cc)
+//  Specification: https://ietf-opsawg-wg.github.io/draft-ietf-opsawg-pcap/
+
+#ifndef BX_PCAPNG_H
+#define BX_PCAPNG_H
+
+// block types
+#define PCAPNG_BLOCK_SHB  0x0A0D0D0A  // section header
+#define PCAPNG_BLOCK_IDB  0x00000001  // interface description
+#define PCAPNG_BLOCK_SPB  0x00000003  // simple packet
+#define PCAPNG_BLOCK_EPB  0x00000006  // enhanced packet
+
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+
+// option codes
+#define PCAPNG_OPT_ENDOFOPT   0
+#define PCAPNG_OPT_COMMENT    1
+#define PCAPNG_SHB_USERAPPL   4
+#define PCAPNG_IF_NAME        2
+#define PCAPNG_IF_TSRESOL     9
+#define PCAPNG_EPB_FLAGS      2
+#define PCAPNG_EPB_DROPCOUNT  4
+
+// direction bits of the EPB flags
+#define PCAPNG_EPB_DIR_MASK   0x3
+#define PCAPNG_EPB_INBOUND    0x1
+#define PCAPNG_EPB_OUTBOUND   0x2
+
+#define PCAPNG_LINKTYPE_ETHERNET 1
+
+// Bochs writes the emulated time in nanoseconds and stores the IPS value in
+// the interface comment ("bochs ips=N"), so that a replay can restore the
+// CPU tick of each frame. The conversion is exact for IPS values up to 10^9.
+#define PCAPNG_BX_TSRESOL  9
+#define PCAPNG_BX_COMMENT  "bochs ips="
+
+BX_CPP_INLINE Bit64u pcapng_ticks_to_ns(Bit64u ticks, Bit64u ips)
+{
+  return (ticks / ips) * BX_CONST64(1000000000) +
+         ((ticks % ips) * BX_CONST64(1000000000)) / ips;
+}
+
+BX_CPP_INLINE Bit64u pcapng_ns_to_ticks(Bit64u ns, Bit64u ips)
+{
+  return (ns / BX_CONST64(1000000000)) * ips +
+         ((ns % BX_CONST64(1000000000)) * ips + BX_CONST64(999999999)) /
+         BX_CONST64(1000000000);
+}
+
+#endif
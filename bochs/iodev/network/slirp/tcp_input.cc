@@ -59,6 +59,7 @@
 
 static void tcp_dooptions(struct tcpcb *tp, uint8_t *cp, int cnt,
                           struct tcpiphdr *ti);
+static void tcp_set_scale(struct tcpcb *tp);
 static void tcp_xmit_timer(struct tcpcb *tp, int rtt);
 
 static int tcp_reass(struct tcpcb *tp, struct tcpiphdr *ti,
@@ -214,6 +215,12 @@ void tcp_input(struct mbuf *m, int iphlen, struct socket *inso,
         ti = so->so_ti;
         tiwin = ti->ti_win;
         tiflags = ti->ti_flags;
+        /* The options of the SYN are still behind the saved header */
+        off = ti->ti_off << 2;
+        if (off > (int)sizeof(struct tcphdr)) {
+            optlen = off - sizeof(struct tcphdr);
+            optp = (char *)(ti + 1);
+        }
 
         goto cont_conn;
     }
@@ -444,7 +451,11 @@ findso:
     if (tp->t_state == TCPS_CLOSED)
         goto drop;
 
-    tiwin = ti->ti_win;
+    /* The window field of a SYN segment is never scaled */
+    if (tiflags & TH_SYN)
+        tiwin = ti->ti_win;
+    else
+        tiwin = (uint32_t)ti->ti_win << tp->snd_scale;
 
     /*
      * Segment received on connection.
@@ -769,6 +780,7 @@ findso:
         if (tiflags & TH_ACK && SEQ_GT(tp->snd_una, tp->iss)) {
             soisfconnected(so);
             tp->t_state = TCPS_ESTABLISHED;
+            tcp_set_scale(tp);
 
             tcp_reass(tp, (struct tcpiphdr *)0, (struct mbuf *)0);
             /*
@@ -947,6 +959,7 @@ trimthenstep6:
         if (SEQ_GT(tp->snd_una, ti->ti_ack) || SEQ_GT(ti->ti_ack, tp->snd_max))
             goto dropwithreset;
         tp->t_state = TCPS_ESTABLISHED;
+        tcp_set_scale(tp);
         /*
          * The sent SYN is ack'ed with our sequence number +1
          * The first data byte already in the buffer will get
@@ -1383,6 +1396,19 @@ drop:
     m_free(m);
 }
 
+/*
+ * Enable window scaling when entering ESTABLISHED state if both sides
+ * requested it.
+ */
+static void tcp_set_scale(struct tcpcb *tp)
+{
+    if ((tp->t_flags & (TF_RCVD_SCALE|TF_REQ_SCALE)) ==
+        (TF_RCVD_SCALE|TF_REQ_SCALE)) {
+        tp->snd_scale = tp->requested_s_scale;
+        tp->rcv_scale = tp->request_r_scale;
+    }
+}
+
 static void tcp_dooptions(struct tcpcb *tp, uint8_t *cp, int cnt,
                           struct tcpiphdr *ti)
 {
@@ -1416,6 +1442,15 @@ static void tcp_dooptions(struct tcpcb *tp, uint8_t *cp, int cnt,
             NTOHS(mss);
             tcp_mss(tp, mss);   /* sets t_maxseg */
             break;
+
+        case TCPOPT_WINDOW:
+            if (optlen != TCPOLEN_WINDOW)
+                continue;
+            if (!(ti->ti_flags & TH_SYN))
+                continue;
+            tp->t_flags |= TF_RCVD_SCALE;
+            tp->requested_s_scale = MIN(cp[2], TCP_MAX_WINSHIFT);
+            break;
         }
     }
 }
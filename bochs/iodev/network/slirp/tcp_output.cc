@@ -272,6 +272,18 @@ send:
             mss = htons((uint16_t) tcp_mss(tp, 0));
             memcpy((char *)(opt + 2), (char *)&mss, sizeof(mss));
             optlen = 4;
+
+            /*
+             * Request window scaling in a SYN, and in a SYN-ACK only if
+             * the peer requested it.
+             */
+            if ((tp->t_flags & TF_REQ_SCALE) &&
+                ((flags & TH_ACK) == 0 || (tp->t_flags & TF_RCVD_SCALE))) {
+                opt[optlen++] = TCPOPT_NOP;
+                opt[optlen++] = TCPOPT_WINDOW;
+                opt[optlen++] = TCPOLEN_WINDOW;
+                opt[optlen++] = tp->request_r_scale;
+            }
         }
     }
 
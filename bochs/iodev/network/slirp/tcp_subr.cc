@@ -43,6 +43,8 @@
 /* patchable/settable parameters for tcp */
 /* Don't do rfc1323 performance enhancements */
 #define TCP_DO_RFC1323 0
+/* Window scaling (RFC 7323) is supported without timestamps */
+#define TCP_DO_WSCALE 1
 
 /*
  * Tcp initialization
@@ -261,6 +263,12 @@ struct tcpcb *tcp_newtcpcb(struct socket *so)
             TCP_MAXSEG_MAX);
 
     tp->t_flags = TCP_DO_RFC1323 ? (TF_REQ_SCALE|TF_REQ_TSTMP) : 0;
+    if (TCP_DO_WSCALE)
+        tp->t_flags |= TF_REQ_SCALE;
+    /* Smallest window shift able to advertise the whole receive buffer */
+    while (tp->request_r_scale < TCP_MAX_WINSHIFT &&
+           ((long)TCP_MAXWIN << tp->request_r_scale) < TCP_RCVSPACE)
+        tp->request_r_scale++;
     tp->t_socket = so;
 
     /*
@@ -0,0 +1,1129 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Virtio network device (legacy virtio-pci interface)
+//  Specification:
+//  https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+// Paravirtual NIC for guests with a virtio-net driver. Frames are passed
+// in guest memory rings (virtqueues), so a whole batch of packets costs a
+// single I/O port write instead of many register accesses per packet.
+// The device supports mergeable receive buffers, checksum and TCP
+// segmentation offload on transmit and up to 4 receive/transmit queue
+// pairs. It uses the same host side pktmover modules as the other NICs.
+
+// Define BX_PLUGGABLE in files that can be compiled into plugins.  For
+// platforms that require a special tag on exported symbols, BX_PLUGGABLE
+// is used to know when we are exporting symbols and when we are importing.
+#define BX_PLUGGABLE
+
+#include "iodev.h"
+#if BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO_NET
+
+#include "pci.h"
+#include "netmod.h"
+#include "virtio_net.h"
+
+#define LOG_THIS theVirtioNetDevice->
+
+bx_virtio_net_c* theVirtioNetDevice = NULL;
+
+const Bit8u virtio_net_iomask[32] = {7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+                                     7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
+
+// legacy virtio-pci I/O registers
+#define VIRTIO_PCI_HOST_FEATURES  0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN      0x08
+#define VIRTIO_PCI_QUEUE_NUM      0x0c
+#define VIRTIO_PCI_QUEUE_SEL      0x0e
+#define VIRTIO_PCI_QUEUE_NOTIFY   0x10
+#define VIRTIO_PCI_STATUS         0x12
+#define VIRTIO_PCI_ISR            0x13
+#define VIRTIO_PCI_CONFIG         0x14
+
+#define VIRTIO_PCI_QUEUE_ADDR_SHIFT 12
+#define VIRTIO_PCI_VRING_ALIGN      4096
+
+// device status bits
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 0x01
+#define VIRTIO_CONFIG_S_DRIVER      0x02
+#define VIRTIO_CONFIG_S_DRIVER_OK   0x04
+#define VIRTIO_CONFIG_S_FAILED      0x80
+
+// feature bits
+#define VIRTIO_NET_F_CSUM           0
+#define VIRTIO_NET_F_MAC            5
+#define VIRTIO_NET_F_HOST_TSO4      11
+#define VIRTIO_NET_F_HOST_TSO6      12
+#define VIRTIO_NET_F_MRG_RXBUF      15
+#define VIRTIO_NET_F_STATUS         16
+#define VIRTIO_NET_F_CTRL_VQ        17
+#define VIRTIO_NET_F_CTRL_RX        18
+#define VIRTIO_NET_F_MQ             22
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX     29
+
+// virtqueue descriptor / ring flags
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2
+#define VRING_DESC_F_INDIRECT       4
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+
+// virtio_net_hdr fields
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_GSO_NONE     0
+#define VIRTIO_NET_HDR_GSO_TCPV4    1
+#define VIRTIO_NET_HDR_GSO_TCPV6    4
+#define VIRTIO_NET_HDR_GSO_ECN      0x80
+
+#define VIRTIO_NET_S_LINK_UP        1
+
+// control virtqueue commands
+#define VIRTIO_NET_OK               0
+#define VIRTIO_NET_ERR              1
+#define VIRTIO_NET_CTRL_RX          0
+#define VIRTIO_NET_CTRL_RX_PROMISC  0
+#define VIRTIO_NET_CTRL_RX_ALLMULTI 1
+#define VIRTIO_NET_CTRL_MAC         1
+#define VIRTIO_NET_CTRL_MAC_TABLE_SET 0
+#define VIRTIO_NET_CTRL_MQ          4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+// builtin configuration handling functions
+
+void virtio_net_init_options(void)
+{
+  bx_param_c *network = SIM->get_param("network");
+  bx_list_c *menu = new bx_list_c(network, "virtio_net", "Virtio Network Device");
+  menu->set_options(menu->SHOW_PARENT);
+  bx_param_bool_c *enabled = new bx_param_bool_c(menu,
+    "enabled",
+    "Enable virtio-net emulation",
+    "Enables the virtio network device emulation",
+    1);
+  SIM->init_std_nic_options("Virtio NIC", menu);
+  new bx_param_num_c(menu,
+    "queues",
+    "Queue pairs",
+    "Number of receive/transmit queue pairs offered to the guest",
+    1, VIRTIO_NET_MAX_QUEUE_PAIRS,
+    1);
+  enabled->set_dependent_list(menu->clone());
+}
+
+Bit32s virtio_net_options_parser(const char *context, int num_params, char *params[])
+{
+  int ret, valid = 0;
+
+  if (!strcmp(params[0], "virtio_net")) {
+    bx_list_c *base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET);
+    if (!SIM->get_param_bool("enabled", base)->get()) {
+      SIM->get_param_enum("ethmod", base)->set_by_name("null");
+    }
+    if (!SIM->get_param_string("mac", base)->isempty()) {
+      // MAC address is already initialized
+      valid |= 0x04;
+    }
+    for (int i = 1; i < num_params; i++) {
+      ret = SIM->parse_nic_params(context, params[i], base);
+      if (ret > 0) {
+        valid |= ret;
+      }
+    }
+    if (!SIM->get_param_bool("enabled", base)->get()) {
+      if (valid == 0x04) {
+        SIM->get_param_bool("enabled", base)->set(1);
+      }
+    }
+    if (valid < 0x80) {
+      if ((valid & 0x04) == 0) {
+        BX_PANIC(("%s: 'virtio_net' directive incomplete (mac is required)", context));
+      }
+    }
+  } else {
+    BX_PANIC(("%s: unknown directive '%s'", context, params[0]));
+  }
+  return 0;
+}
+
+Bit32s virtio_net_options_save(FILE *fp)
+{
+  return SIM->write_param_list(fp, (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET), NULL, 0);
+}
+
+// device plugin entry point
+
+PLUGIN_ENTRY_FOR_MODULE(virtio_net)
+{
+  if (mode == PLUGIN_INIT) {
+    theVirtioNetDevice = new bx_virtio_net_c();
+    BX_REGISTER_DEVICE_DEVMODEL(plugin, type, theVirtioNetDevice, BX_PLUGIN_VIRTIO_NET);
+    // add new configuration parameter for the config interface
+    virtio_net_init_options();
+    // register add-on option for bochsrc and command line
+    SIM->register_addon_option("virtio_net", virtio_net_options_parser, virtio_net_options_save);
+  } else if (mode == PLUGIN_FINI) {
+    SIM->unregister_addon_option("virtio_net");
+    bx_list_c *menu = (bx_list_c*)SIM->get_param("network");
+    menu->remove("virtio_net");
+    delete theVirtioNetDevice;
+  } else if (mode == PLUGIN_PROBE) {
+    return (int)PLUGTYPE_OPTIONAL;
+  } else if (mode == PLUGIN_FLAGS) {
+    return PLUGFLAG_PCI;
+  }
+  return 0; // Success
+}
+
+// macros and helper functions
+
+#if defined (BX_LITTLE_ENDIAN)
+#define cpu_to_le16(val) (val)
+#define cpu_to_le32(val) (val)
+#define cpu_to_le64(val) (val)
+#else
+#define cpu_to_le16(val) bx_bswap16(val)
+#define cpu_to_le32(val) bx_bswap32(val)
+#define cpu_to_le64(val) bx_bswap64(val)
+#endif
+
+#define le16_to_cpu  cpu_to_le16
+#define le32_to_cpu  cpu_to_le32
+#define le64_to_cpu  cpu_to_le64
+
+static Bit16u vring_read16(bx_phy_address addr)
+{
+  Bit16u val;
+  DEV_MEM_READ_PHYSICAL_DMA(addr, 2, (Bit8u*)&val);
+  return le16_to_cpu(val);
+}
+
+static void vring_write16(bx_phy_address addr, Bit16u val)
+{
+  val = cpu_to_le16(val);
+  DEV_MEM_WRITE_PHYSICAL_DMA(addr, 2, (Bit8u*)&val);
+}
+
+// the device object
+
+bx_virtio_net_c::bx_virtio_net_c()
+{
+  put("virtio_net", "VIONET");
+  memset(&s, 0, sizeof(bx_virtio_net_t));
+  ethdev = NULL;
+}
+
+bx_virtio_net_c::~bx_virtio_net_c()
+{
+  if (ethdev != NULL) {
+    delete ethdev;
+  }
+  if (s.tx_buf != NULL) {
+    delete [] s.tx_buf;
+  }
+  if (s.rx_dropped > 0) {
+    BX_INFO(("%u received frames dropped for lack of receive buffers", s.rx_dropped));
+  }
+  SIM->get_bochs_root()->remove("virtio_net");
+  BX_DEBUG(("Exit"));
+}
+
+void bx_virtio_net_c::init(void)
+{
+  bx_list_c *base;
+  bx_param_string_c *bootrom;
+
+  // Read in values from config interface
+  base = (bx_list_c*) SIM->get_param(BXPN_VIRTIO_NET);
+  // Check if the device is disabled or not configured
+  if (!SIM->get_param_bool("enabled", base)->get()) {
+    BX_INFO(("virtio-net disabled"));
+    // mark unused plugin for removal
+    ((bx_param_bool_c*)((bx_list_c*)SIM->get_param(BXPN_PLUGIN_CTRL))->get_by_name("virtio_net"))->set(0);
+    return;
+  }
+
+  memcpy(BX_VIRTIO_NET_THIS s.macaddr, SIM->get_param_string("mac", base)->getptr(), 6);
+  BX_VIRTIO_NET_THIS s.max_pairs = SIM->get_param_num("queues", base)->get();
+  BX_VIRTIO_NET_THIS s.host_features =
+    (1 << VIRTIO_NET_F_CSUM) | (1 << VIRTIO_NET_F_MAC) |
+    (1 << VIRTIO_NET_F_HOST_TSO4) | (1 << VIRTIO_NET_F_HOST_TSO6) |
+    (1 << VIRTIO_NET_F_MRG_RXBUF) | (1 << VIRTIO_NET_F_STATUS) |
+    (1 << VIRTIO_NET_F_CTRL_VQ) | (1 << VIRTIO_NET_F_CTRL_RX) |
+    (1 << VIRTIO_RING_F_INDIRECT_DESC) | (1 << VIRTIO_RING_F_EVENT_IDX);
+  if (BX_VIRTIO_NET_THIS s.max_pairs > 1) {
+    BX_VIRTIO_NET_THIS s.host_features |= (1 << VIRTIO_NET_F_MQ);
+  }
+  BX_VIRTIO_NET_THIS s.tx_buf = new Bit8u[VIRTIO_NET_TX_BUFSIZE];
+
+  BX_VIRTIO_NET_THIS s.devfunc = 0x00;
+  DEV_register_pci_handlers(this, &BX_VIRTIO_NET_THIS s.devfunc, BX_PLUGIN_VIRTIO_NET,
+                            "Virtio network device");
+
+  // initialize readonly registers (legacy virtio-pci network device)
+  init_pci_conf(0x1af4, 0x1000, 0x00, 0x020000, 0x00, BX_PCI_INTA);
+  BX_VIRTIO_NET_THIS pci_conf[0x2c] = 0xf4; // subsystem vendor
+  BX_VIRTIO_NET_THIS pci_conf[0x2d] = 0x1a;
+  BX_VIRTIO_NET_THIS pci_conf[0x2e] = 0x01; // subsystem id = virtio device type
+  BX_VIRTIO_NET_THIS pci_conf[0x2f] = 0x00;
+
+  BX_VIRTIO_NET_THIS init_bar_io(0, 32, read_handler, write_handler, &virtio_net_iomask[0]);
+  BX_VIRTIO_NET_THIS pci_rom_address = 0;
+  BX_VIRTIO_NET_THIS pci_rom_read_handler = mem_read_handler;
+  bootrom = SIM->get_param_string("bootrom", base);
+  if (!bootrom->isempty()) {
+    BX_VIRTIO_NET_THIS load_pci_rom(bootrom->getptr());
+  }
+
+  BX_VIRTIO_NET_THIS s.statusbar_id = bx_gui->register_statusitem("VIRTIO", 1);
+
+  // Attach to the selected ethernet module
+  BX_VIRTIO_NET_THIS ethdev = DEV_net_init_module(base, rx_handler, rx_status_handler, this);
+
+  BX_INFO(("virtio-net initialized (%d queue pair%s)", BX_VIRTIO_NET_THIS s.max_pairs,
+           (BX_VIRTIO_NET_THIS s.max_pairs > 1) ? "s":""));
+}
+
+void bx_virtio_net_c::reset(unsigned type)
+{
+  unsigned i;
+
+  static const struct reset_vals_t {
+    unsigned      addr;
+    unsigned char val;
+  } reset_vals[] = {
+    { 0x04, 0x01 }, { 0x05, 0x00 }, // command io
+    { 0x06, 0x00 }, { 0x07, 0x00 }, // status
+    // address space 0x10 - 0x13
+    { 0x10, 0x01 }, { 0x11, 0x00 },
+    { 0x12, 0x00 }, { 0x13, 0x00 },
+    { 0x3c, 0x00 },                 // IRQ
+  };
+  for (i = 0; i < sizeof(reset_vals) / sizeof(*reset_vals); ++i) {
+      BX_VIRTIO_NET_THIS pci_conf[reset_vals[i].addr] = reset_vals[i].val;
+  }
+
+  device_reset();
+}
+
+void bx_virtio_net_c::device_reset(void)
+{
+  BX_VIRTIO_NET_THIS s.guest_features = 0;
+  BX_VIRTIO_NET_THIS s.queue_sel = 0;
+  BX_VIRTIO_NET_THIS s.status = 0;
+  BX_VIRTIO_NET_THIS s.isr = 0;
+  BX_VIRTIO_NET_THIS s.curr_pairs = 1;
+  BX_VIRTIO_NET_THIS s.promisc = 1;
+  BX_VIRTIO_NET_THIS s.allmulti = 0;
+  BX_VIRTIO_NET_THIS s.alluni = 0;
+  memset(BX_VIRTIO_NET_THIS s.vq, 0, sizeof(BX_VIRTIO_NET_THIS s.vq));
+  for (unsigned i = 0; i < VIRTIO_NET_MAX_QUEUES; i++) {
+    BX_VIRTIO_NET_THIS s.vq[i].size = VIRTIO_NET_QUEUE_SIZE;
+  }
+
+  // Deassert IRQ
+  set_irq_level(0);
+}
+
+void bx_virtio_net_c::register_state(void)
+{
+  char name[6];
+
+  bx_list_c *list = new bx_list_c(SIM->get_bochs_root(), "virtio_net", "Virtio Network Device State");
+  BXRS_HEX_PARAM_FIELD(list, guest_features, BX_VIRTIO_NET_THIS s.guest_features);
+  BXRS_DEC_PARAM_FIELD(list, queue_sel, BX_VIRTIO_NET_THIS s.queue_sel);
+  BXRS_HEX_PARAM_FIELD(list, status, BX_VIRTIO_NET_THIS s.status);
+  BXRS_HEX_PARAM_FIELD(list, isr, BX_VIRTIO_NET_THIS s.isr);
+  BXRS_DEC_PARAM_FIELD(list, curr_pairs, BX_VIRTIO_NET_THIS s.curr_pairs);
+  BXRS_PARAM_BOOL(list, promisc, BX_VIRTIO_NET_THIS s.promisc);
+  BXRS_PARAM_BOOL(list, allmulti, BX_VIRTIO_NET_THIS s.allmulti);
+  BXRS_PARAM_BOOL(list, alluni, BX_VIRTIO_NET_THIS s.alluni);
+  new bx_shadow_data_c(list, "macaddr", BX_VIRTIO_NET_THIS s.macaddr, 6, 1);
+  bx_list_c *queues = new bx_list_c(list, "vq");
+  for (unsigned i = 0; i < VIRTIO_NET_MAX_QUEUES; i++) {
+    sprintf(name, "%d", i);
+    bx_list_c *vq = new bx_list_c(queues, name);
+    BXRS_HEX_PARAM_FIELD(vq, pfn, BX_VIRTIO_NET_THIS s.vq[i].pfn);
+    BXRS_DEC_PARAM_FIELD(vq, last_avail_idx, BX_VIRTIO_NET_THIS s.vq[i].last_avail_idx);
+    BXRS_DEC_PARAM_FIELD(vq, used_idx, BX_VIRTIO_NET_THIS s.vq[i].used_idx);
+    BXRS_DEC_PARAM_FIELD(vq, signalled_used, BX_VIRTIO_NET_THIS s.vq[i].signalled_used);
+    BXRS_PARAM_BOOL(vq, signalled_valid, BX_VIRTIO_NET_THIS s.vq[i].signalled_valid);
+  }
+  register_pci_state(list);
+}
+
+void bx_virtio_net_c::after_restore_state(void)
+{
+  bx_pci_device_c::after_restore_pci_state(mem_read_handler);
+  for (unsigned i = 0; i < VIRTIO_NET_MAX_QUEUES; i++) {
+    vq_set_addr(&BX_VIRTIO_NET_THIS s.vq[i]);
+  }
+}
+
+void bx_virtio_net_c::set_irq_level(bool level)
+{
+  DEV_pci_set_irq(BX_VIRTIO_NET_THIS s.devfunc, BX_VIRTIO_NET_THIS pci_conf[0x3d], level);
+}
+
+bool bx_virtio_net_c::mem_read_handler(bx_phy_address addr, unsigned len,
+                                       void *data, void *param)
+{
+  Bit8u  *data_ptr;
+
+  Bit32u mask = (theVirtioNetDevice->pci_rom_size - 1);
+#ifdef BX_LITTLE_ENDIAN
+  data_ptr = (Bit8u *) data;
+#else // BX_BIG_ENDIAN
+  data_ptr = (Bit8u *) data + (len - 1);
+#endif
+  for (unsigned i = 0; i < len; i++) {
+    if (theVirtioNetDevice->pci_conf[0x30] & 0x01) {
+      *data_ptr = theVirtioNetDevice->pci_rom[addr & mask];
+    } else {
+      *data_ptr = 0xff;
+    }
+    addr++;
+#ifdef BX_LITTLE_ENDIAN
+    data_ptr++;
+#else // BX_BIG_ENDIAN
+    data_ptr--;
+#endif
+  }
+  return 1;
+}
+
+// the virtio-net header is 12 bytes with mergeable receive buffers
+unsigned bx_virtio_net_c::hdr_len(void)
+{
+  return has_feature(VIRTIO_NET_F_MRG_RXBUF) ? 12 : 10;
+}
+
+unsigned bx_virtio_net_c::ctrl_vq_index(void)
+{
+  return has_feature(VIRTIO_NET_F_MQ) ? (2 * BX_VIRTIO_NET_THIS s.max_pairs) : 2;
+}
+
+// device specific configuration space
+Bit8u bx_virtio_net_c::config_read(unsigned offset)
+{
+  if (offset < 6) {
+    return BX_VIRTIO_NET_THIS s.macaddr[offset];
+  }
+  switch (offset) {
+    case 6:
+      return VIRTIO_NET_S_LINK_UP;
+    case 8:
+      return (Bit8u)BX_VIRTIO_NET_THIS s.max_pairs;
+    case 9:
+      return (Bit8u)(BX_VIRTIO_NET_THIS s.max_pairs >> 8);
+  }
+  return 0;
+}
+
+void bx_virtio_net_c::config_write(unsigned offset, Bit8u value)
+{
+  // legacy drivers may set the MAC address here
+  if (offset < 6) {
+    BX_VIRTIO_NET_THIS s.macaddr[offset] = value;
+  }
+}
+
+// static IO port read callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+Bit32u bx_virtio_net_c::read_handler(void *this_ptr, Bit32u address, unsigned io_len)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) this_ptr;
+  return class_ptr->read(address, io_len);
+}
+
+Bit32u bx_virtio_net_c::read(Bit32u address, unsigned io_len)
+{
+  Bit32u val = 0;
+  Bit8u  offset;
+
+  offset = address - BX_VIRTIO_NET_THIS pci_bar[0].addr;
+  if (offset >= VIRTIO_PCI_CONFIG) {
+    for (unsigned i = 0; i < io_len; i++) {
+      val |= config_read(offset - VIRTIO_PCI_CONFIG + i) << (i * 8);
+    }
+    return val;
+  }
+
+  switch (offset) {
+    case VIRTIO_PCI_HOST_FEATURES:
+      val = BX_VIRTIO_NET_THIS s.host_features;
+      break;
+    case VIRTIO_PCI_GUEST_FEATURES:
+      val = BX_VIRTIO_NET_THIS s.guest_features;
+      break;
+    case VIRTIO_PCI_QUEUE_PFN:
+      if (BX_VIRTIO_NET_THIS s.queue_sel < VIRTIO_NET_MAX_QUEUES) {
+        val = BX_VIRTIO_NET_THIS s.vq[BX_VIRTIO_NET_THIS s.queue_sel].pfn;
+      }
+      break;
+    case VIRTIO_PCI_QUEUE_NUM:
+      if (BX_VIRTIO_NET_THIS s.queue_sel <= (2 * BX_VIRTIO_NET_THIS s.max_pairs)) {
+        val = BX_VIRTIO_NET_THIS s.vq[BX_VIRTIO_NET_THIS s.queue_sel].size;
+      }
+      break;
+    case VIRTIO_PCI_QUEUE_SEL:
+      val = BX_VIRTIO_NET_THIS s.queue_sel;
+      break;
+    case VIRTIO_PCI_STATUS:
+      val = BX_VIRTIO_NET_THIS s.status;
+      break;
+    case VIRTIO_PCI_ISR:
+      // reading the ISR acknowledges the interrupt
+      val = BX_VIRTIO_NET_THIS s.isr;
+      BX_VIRTIO_NET_THIS s.isr = 0;
+      set_irq_level(0);
+      break;
+    default:
+      BX_ERROR(("unsupported io read from offset=0x%02x len=%d", offset, io_len));
+  }
+  BX_DEBUG(("io read from offset 0x%02x = 0x%08x", offset, val));
+  return val;
+}
+
+// static IO port write callback handler
+// redirects to non-static class handler to avoid virtual functions
+
+void bx_virtio_net_c::write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) this_ptr;
+  class_ptr->write(address, value, io_len);
+}
+
+void bx_virtio_net_c::write(Bit32u address, Bit32u value, unsigned io_len)
+{
+  Bit8u  offset;
+  bx_virtq_t *vq;
+
+  offset = address - BX_VIRTIO_NET_THIS pci_bar[0].addr;
+  BX_DEBUG(("io write to offset 0x%02x = 0x%08x", offset, value));
+  if (offset >= VIRTIO_PCI_CONFIG) {
+    for (unsigned i = 0; i < io_len; i++) {
+      config_write(offset - VIRTIO_PCI_CONFIG + i, (Bit8u)(value >> (i * 8)));
+    }
+    return;
+  }
+
+  switch (offset) {
+    case VIRTIO_PCI_GUEST_FEATURES:
+      BX_VIRTIO_NET_THIS s.guest_features = value & BX_VIRTIO_NET_THIS s.host_features;
+      break;
+    case VIRTIO_PCI_QUEUE_PFN:
+      if (BX_VIRTIO_NET_THIS s.queue_sel < VIRTIO_NET_MAX_QUEUES) {
+        vq = &BX_VIRTIO_NET_THIS s.vq[BX_VIRTIO_NET_THIS s.queue_sel];
+        vq->pfn = value;
+        vq->last_avail_idx = 0;
+        vq->used_idx = 0;
+        vq->used_pending = 0;
+        vq->signalled_used = 0;
+        vq->signalled_valid = 0;
+        vq_set_addr(vq);
+      }
+      break;
+    case VIRTIO_PCI_QUEUE_SEL:
+      BX_VIRTIO_NET_THIS s.queue_sel = value;
+      break;
+    case VIRTIO_PCI_QUEUE_NOTIFY:
+      if (!(BX_VIRTIO_NET_THIS s.status & VIRTIO_CONFIG_S_DRIVER_OK)) {
+        break;
+      }
+      if (has_feature(VIRTIO_NET_F_CTRL_VQ) && (value == ctrl_vq_index())) {
+        ctrl_queue();
+      } else if ((value & 1) && (value < (2U * BX_VIRTIO_NET_THIS s.max_pairs))) {
+        tx_queue(value);
+      }
+      // a notify on a receive queue only means new buffers are available
+      break;
+    case VIRTIO_PCI_STATUS:
+      BX_VIRTIO_NET_THIS s.status = value;
+      if (value == 0) {
+        device_reset();
+      }
+      break;
+    default:
+      BX_ERROR(("unsupported io write to offset=0x%02x len=%d", offset, io_len));
+  }
+}
+
+// pci configuration space write callback handler
+void bx_virtio_net_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len)
+{
+  Bit8u value8, oldval;
+
+  if ((address >= 0x14) && (address < 0x30))
+    return;
+
+  BX_DEBUG_PCI_WRITE(address, value, io_len);
+  for (unsigned i=0; i<io_len; i++) {
+    value8 = (value >> (i*8)) & 0xFF;
+    oldval = BX_VIRTIO_NET_THIS pci_conf[address+i];
+    switch (address+i) {
+      case 0x04:
+        value8 &= 0x05;
+        break;
+      default:
+        value8 = oldval;
+    }
+    BX_VIRTIO_NET_THIS pci_conf[address+i] = value8;
+  }
+}
+
+// virtqueue handling (split ring layout of the legacy interface)
+
+void bx_virtio_net_c::vq_set_addr(bx_virtq_t *vq)
+{
+  vq->desc = (bx_phy_address)vq->pfn << VIRTIO_PCI_QUEUE_ADDR_SHIFT;
+  vq->avail = vq->desc + 16 * vq->size;
+  vq->used = (vq->avail + 6 + 2 * vq->size + VIRTIO_PCI_VRING_ALIGN - 1) &
+             ~(bx_phy_address)(VIRTIO_PCI_VRING_ALIGN - 1);
+}
+
+Bit16u bx_virtio_net_c::vq_avail_idx(bx_virtq_t *vq)
+{
+  return vring_read16(vq->avail + 2);
+}
+
+bool bx_virtio_net_c::vq_has_buffers(bx_virtq_t *vq)
+{
+  return (vq->pfn != 0) && (vq_avail_idx(vq) != vq->last_avail_idx);
+}
+
+bool bx_virtio_net_c::vq_read_desc(bx_phy_address table, unsigned max, Bit16u idx,
+                                   bx_virtq_elem_t *elem, Bit16u *flags, Bit16u *next)
+{
+  Bit8u desc[16];
+  Bit64u addr;
+  Bit32u len;
+
+  if (idx >= max) {
+    BX_ERROR(("descriptor index %d out of range", idx));
+    return 0;
+  }
+  DEV_MEM_READ_PHYSICAL_DMA(table + 16 * idx, 16, desc);
+  addr = le64_to_cpu(*(Bit64u*)&desc[0]);
+  len = le32_to_cpu(*(Bit32u*)&desc[8]);
+  *flags = le16_to_cpu(*(Bit16u*)&desc[12]);
+  *next = le16_to_cpu(*(Bit16u*)&desc[14]);
+  if (*flags & VRING_DESC_F_INDIRECT) {
+    // the caller walks the indirect table itself
+    elem->out_addr[0] = addr;
+    elem->out_len[0] = len;
+    return 1;
+  }
+  if (*flags & VRING_DESC_F_WRITE) {
+    if (elem->in_num >= VIRTIO_NET_MAX_SG) {
+      BX_ERROR(("too many buffers in descriptor chain"));
+      return 0;
+    }
+    elem->in_addr[elem->in_num] = addr;
+    elem->in_len[elem->in_num++] = len;
+  } else {
+    if (elem->out_num >= VIRTIO_NET_MAX_SG) {
+      BX_ERROR(("too many buffers in descriptor chain"));
+      return 0;
+    }
+    elem->out_addr[elem->out_num] = addr;
+    elem->out_len[elem->out_num++] = len;
+  }
+  return 1;
+}
+
+// take the next descriptor chain from the available ring
+bool bx_virtio_net_c::vq_pop(bx_virtq_t *vq, bx_virtq_elem_t *elem)
+{
+  bx_phy_address table;
+  Bit16u avail_idx, idx, flags, next;
+  unsigned max, count = 0;
+  bool indirect = 0;
+
+  if (vq->pfn == 0) return 0;
+  avail_idx = vq_avail_idx(vq);
+  if (avail_idx == vq->last_avail_idx) return 0;
+  if ((Bit16u)(avail_idx - vq->last_avail_idx) > vq->size) {
+    BX_ERROR(("available ring index out of range (%d -> %d)", vq->last_avail_idx, avail_idx));
+    return 0;
+  }
+  idx = vring_read16(vq->avail + 4 + 2 * (vq->last_avail_idx % vq->size));
+  vq->last_avail_idx++;
+  if (has_feature(VIRTIO_RING_F_EVENT_IDX)) {
+    // ask for a notification once the guest adds more buffers
+    vring_write16(vq->used + 4 + 8 * vq->size, vq->last_avail_idx);
+  }
+
+  elem->head = idx;
+  elem->out_num = 0;
+  elem->in_num = 0;
+  table = vq->desc;
+  max = vq->size;
+  for (;;) {
+    if (!vq_read_desc(table, max, idx, elem, &flags, &next) || (++count > max)) {
+      elem->out_num = elem->in_num = 0;
+      break;
+    }
+    if (flags & VRING_DESC_F_INDIRECT) {
+      if (indirect || (elem->out_num > 0) || (elem->in_num > 0) ||
+          (elem->out_len[0] < 16)) {
+        BX_ERROR(("invalid indirect descriptor"));
+        elem->out_num = elem->in_num = 0;
+        break;
+      }
+      indirect = 1;
+      table = elem->out_addr[0];
+      max = elem->out_len[0] / 16;
+      idx = 0;
+      count = 0;
+      continue;
+    }
+    if (!(flags & VRING_DESC_F_NEXT)) break;
+    idx = next;
+  }
+  return 1;
+}
+
+// copy the device-readable part of a chain into a buffer
+unsigned bx_virtio_net_c::elem_read(const bx_virtq_elem_t *elem, Bit8u *buf, unsigned size)
+{
+  unsigned i, len, total = 0;
+
+  for (i = 0; (i < elem->out_num) && (total < size); i++) {
+    len = elem->out_len[i];
+    if (len > (size - total)) {
+      len = size - total;
+    }
+    DEV_MEM_READ_PHYSICAL_DMA(elem->out_addr[i], len, buf + total);
+    total += len;
+  }
+  return total;
+}
+
+// copy data into the device-writable part of a chain at the given offset
+unsigned bx_virtio_net_c::elem_write(const bx_virtq_elem_t *elem, unsigned offset,
+                                     const Bit8u *buf, unsigned size)
+{
+  unsigned i, len, done = 0;
+
+  for (i = 0; (i < elem->in_num) && (done < size); i++) {
+    if (offset >= elem->in_len[i]) {
+      offset -= elem->in_len[i];
+      continue;
+    }
+    len = elem->in_len[i] - offset;
+    if (len > (size - done)) {
+      len = size - done;
+    }
+    DEV_MEM_WRITE_PHYSICAL_DMA(elem->in_addr[i] + offset, len, (Bit8u*)buf + done);
+    done += len;
+    offset = 0;
+  }
+  return done;
+}
+
+void bx_virtio_net_c::vq_fill(bx_virtq_t *vq, Bit16u head, Bit32u len)
+{
+  Bit32u entry[2];
+  bx_phy_address addr;
+
+  addr = vq->used + 4 + 8 * ((Bit16u)(vq->used_idx + vq->used_pending) % vq->size);
+  entry[0] = cpu_to_le32((Bit32u)head);
+  entry[1] = cpu_to_le32(len);
+  DEV_MEM_WRITE_PHYSICAL_DMA(addr, 8, (Bit8u*)entry);
+  vq->used_pending++;
+}
+
+// make the filled used ring entries visible to the guest
+void bx_virtio_net_c::vq_flush(bx_virtq_t *vq)
+{
+  vq->used_idx += vq->used_pending;
+  vq->used_pending = 0;
+  vring_write16(vq->used + 2, vq->used_idx);
+}
+
+// raise the interrupt unless the guest has suppressed it
+void bx_virtio_net_c::vq_notify(bx_virtq_t *vq)
+{
+  Bit16u old_idx, new_idx, event;
+  bool need;
+
+  if (has_feature(VIRTIO_RING_F_EVENT_IDX)) {
+    old_idx = vq->signalled_used;
+    new_idx = vq->used_idx;
+    need = !vq->signalled_valid;
+    vq->signalled_used = new_idx;
+    vq->signalled_valid = 1;
+    event = vring_read16(vq->avail + 4 + 2 * vq->size);
+    need |= ((Bit16u)(new_idx - event - 1) < (Bit16u)(new_idx - old_idx));
+  } else {
+    need = !(vring_read16(vq->avail) & VRING_AVAIL_F_NO_INTERRUPT);
+  }
+  if (need) {
+    BX_VIRTIO_NET_THIS s.isr |= 1;
+    set_irq_level(1);
+  }
+}
+
+// transmit
+
+void bx_virtio_net_c::tx_queue(unsigned index)
+{
+  bx_virtq_t *vq = &BX_VIRTIO_NET_THIS s.vq[index];
+  bx_virtq_elem_t elem;
+  unsigned len, hlen = hdr_len(), count = 0;
+
+  while (vq_pop(vq, &elem)) {
+    len = elem_read(&elem, BX_VIRTIO_NET_THIS s.tx_buf, VIRTIO_NET_TX_BUFSIZE);
+    if (len > hlen) {
+      tx_frame(BX_VIRTIO_NET_THIS s.tx_buf + hlen, len - hlen, BX_VIRTIO_NET_THIS s.tx_buf);
+    } else {
+      BX_ERROR(("tx: descriptor chain too short (%d bytes)", len));
+    }
+    vq_fill(vq, elem.head, 0);
+    count++;
+  }
+  if (count > 0) {
+    vq_flush(vq);
+    vq_notify(vq);
+    bx_gui->statusbar_setitem(BX_VIRTIO_NET_THIS s.statusbar_id, 1, 1);
+  }
+}
+
+void bx_virtio_net_c::tx_frame(Bit8u *buf, unsigned len, const Bit8u *hdr)
+{
+  unsigned gso_type = hdr[1] & ~VIRTIO_NET_HDR_GSO_ECN;
+  unsigned csum_start, csum_offset;
+  Bit16u csum;
+
+  if (gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+    tx_gso(buf, len, gso_type, hdr[4] | (hdr[5] << 8));
+    return;
+  }
+  if (hdr[0] & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+    // the guest has stored the pseudo header sum in the checksum field
+    csum_start = hdr[6] | (hdr[7] << 8);
+    csum_offset = hdr[8] | (hdr[9] << 8);
+    if ((csum_start + csum_offset + 2) <= len) {
+      csum = bx_net_checksum_finish(
+               bx_net_checksum_add(buf + csum_start, len - csum_start, 0));
+      if ((csum == 0) && (csum_offset == 6)) {
+        csum = 0xffff; // UDP
+      }
+      put_net2(buf + csum_start + csum_offset, csum);
+    } else {
+      BX_ERROR(("tx: checksum offset out of range"));
+    }
+  }
+  if (len > BX_PACKET_BUFSIZE) {
+    BX_ERROR(("tx: frame too long (%d bytes), dropped", len));
+    return;
+  }
+  BX_VIRTIO_NET_THIS ethdev->sendpkt(buf, len);
+}
+
+// split a TCP segmentation offload frame into MSS sized frames
+void bx_virtio_net_c::tx_gso(Bit8u *buf, unsigned len, unsigned gso_type, unsigned mss)
+{
+  Bit8u pkt[BX_PACKET_BUFSIZE];
+  unsigned l3 = 14, l4, iphl, thl, hlen, payload, off = 0, seg, n = 0;
+  Bit16u proto, ip_id = 0;
+  Bit32u seq, sum;
+  Bit8u tcp_flags;
+  bool ipv4;
+
+  if (len < (l3 + 40)) {
+    BX_ERROR(("tx: GSO frame too short"));
+    return;
+  }
+  proto = get_net2(buf + 12);
+  if (proto == 0x8100) {
+    l3 = 18;
+    proto = get_net2(buf + 16);
+  }
+  if ((gso_type == VIRTIO_NET_HDR_GSO_TCPV4) && (proto == 0x0800) && (buf[l3 + 9] == 6)) {
+    ipv4 = 1;
+    iphl = (buf[l3] & 0x0f) * 4;
+    ip_id = get_net2(buf + l3 + 4);
+  } else if ((gso_type == VIRTIO_NET_HDR_GSO_TCPV6) && (proto == 0x86dd) && (buf[l3 + 6] == 6)) {
+    ipv4 = 0;
+    iphl = 40;
+  } else {
+    BX_ERROR(("tx: unsupported GSO frame (type %d, ethertype 0x%04x)", gso_type, proto));
+    return;
+  }
+  l4 = l3 + iphl;
+  if (len < (l4 + 20)) {
+    BX_ERROR(("tx: GSO frame too short"));
+    return;
+  }
+  thl = (buf[l4 + 12] >> 4) * 4;
+  hlen = l4 + thl;
+  if ((thl < 20) || (hlen > len) || (hlen >= BX_PACKET_BUFSIZE) || (mss == 0)) {
+    BX_ERROR(("tx: invalid GSO frame"));
+    return;
+  }
+  // the backends cannot send frames larger than an ethernet frame
+  if ((hlen + mss) > BX_PACKET_BUFSIZE) {
+    mss = BX_PACKET_BUFSIZE - hlen;
+  }
+  payload = len - hlen;
+  seq = get_net4(buf + l4 + 4);
+  tcp_flags = buf[l4 + 13];
+  do {
+    seg = payload - off;
+    if (seg > mss) seg = mss;
+    memcpy(pkt, buf, hlen);
+    memcpy(pkt + hlen, buf + hlen + off, seg);
+    if (ipv4) {
+      put_net2(pkt + l3 + 2, iphl + thl + seg);
+      put_net2(pkt + l3 + 4, ip_id + n);
+      put_net2(pkt + l3 + 10, 0);
+      put_net2(pkt + l3 + 10, bx_net_checksum_finish(
+                                bx_net_checksum_add(pkt + l3, iphl, 0)));
+      sum = bx_net_checksum_add(pkt + l3 + 12, 8, 0);
+    } else {
+      put_net2(pkt + l3 + 4, thl + seg);
+      sum = bx_net_checksum_add(pkt + l3 + 8, 32, 0);
+    }
+    put_net4(pkt + l4 + 4, seq + off);
+    // FIN and PSH only in the last segment, CWR only in the first one
+    pkt[l4 + 13] = tcp_flags;
+    if ((off + seg) < payload) pkt[l4 + 13] &= ~0x09;
+    if (off > 0) pkt[l4 + 13] &= ~0x80;
+    put_net2(pkt + l4 + 16, 0);
+    sum += 6 + thl + seg;
+    put_net2(pkt + l4 + 16, bx_net_checksum_finish(
+                              bx_net_checksum_add(pkt + l4, thl + seg, sum)));
+    BX_VIRTIO_NET_THIS ethdev->sendpkt(pkt, hlen + seg);
+    off += seg;
+    n++;
+  } while (off < payload);
+}
+
+// control queue
+
+void bx_virtio_net_c::ctrl_queue(void)
+{
+  bx_virtq_t *vq = &BX_VIRTIO_NET_THIS s.vq[ctrl_vq_index()];
+  bx_virtq_elem_t elem;
+  Bit8u cmd[64], ack;
+  unsigned len, count = 0;
+
+  while (vq_pop(vq, &elem)) {
+    len = elem_read(&elem, cmd, sizeof(cmd));
+    ack = ctrl_command(cmd, len);
+    elem_write(&elem, 0, &ack, 1);
+    vq_fill(vq, elem.head, 1);
+    count++;
+  }
+  if (count > 0) {
+    vq_flush(vq);
+    vq_notify(vq);
+  }
+}
+
+Bit8u bx_virtio_net_c::ctrl_command(const Bit8u *cmd, unsigned len)
+{
+  Bit16u pairs;
+
+  if (len < 2) {
+    return VIRTIO_NET_ERR;
+  }
+  switch (cmd[0]) {
+    case VIRTIO_NET_CTRL_RX:
+      if (len < 3) break;
+      if (cmd[1] == VIRTIO_NET_CTRL_RX_PROMISC) {
+        BX_VIRTIO_NET_THIS s.promisc = (cmd[2] != 0);
+        return VIRTIO_NET_OK;
+      } else if (cmd[1] == VIRTIO_NET_CTRL_RX_ALLMULTI) {
+        BX_VIRTIO_NET_THIS s.allmulti = (cmd[2] != 0);
+        return VIRTIO_NET_OK;
+      }
+      break;
+    case VIRTIO_NET_CTRL_MAC:
+      // extra unicast addresses are not filtered individually
+      if ((cmd[1] == VIRTIO_NET_CTRL_MAC_TABLE_SET) && (len >= 6)) {
+        BX_VIRTIO_NET_THIS s.alluni = (le32_to_cpu(*(Bit32u*)&cmd[2]) > 0);
+        return VIRTIO_NET_OK;
+      }
+      break;
+    case VIRTIO_NET_CTRL_MQ:
+      if ((cmd[1] == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET) && (len >= 4)) {
+        pairs = cmd[2] | (cmd[3] << 8);
+        if ((pairs >= 1) && (pairs <= BX_VIRTIO_NET_THIS s.max_pairs)) {
+          BX_VIRTIO_NET_THIS s.curr_pairs = pairs;
+          BX_DEBUG(("using %d queue pairs", pairs));
+          return VIRTIO_NET_OK;
+        }
+      }
+      break;
+  }
+  BX_DEBUG(("unsupported control command class=%d cmd=%d", cmd[0], cmd[1]));
+  return VIRTIO_NET_ERR;
+}
+
+// receive
+
+bool bx_virtio_net_c::rx_filter(const Bit8u *buf)
+{
+  if (BX_VIRTIO_NET_THIS s.promisc) {
+    return 1;
+  }
+  // the multicast table is not tracked, so all group addresses pass
+  if (buf[0] & 0x01) {
+    return 1;
+  }
+  return BX_VIRTIO_NET_THIS s.alluni || !memcmp(buf, BX_VIRTIO_NET_THIS s.macaddr, 6);
+}
+
+// pick the receive queue pair: hash IPv4 flows over the active pairs
+// and fall back to the next pair with free buffers
+unsigned bx_virtio_net_c::rx_select_queue(const Bit8u *buf, unsigned len)
+{
+  unsigned i, q = 0, pairs = 1, ihl;
+  Bit32u hash;
+
+  if (has_feature(VIRTIO_NET_F_MQ)) {
+    pairs = BX_VIRTIO_NET_THIS s.curr_pairs;
+  }
+  if ((pairs > 1) && (len >= 34) && (get_net2(buf + 12) == 0x0800)) {
+    hash = get_net4(buf + 26) ^ get_net4(buf + 30);
+    ihl = (buf[14] & 0x0f) * 4;
+    if (((buf[23] == 6) || (buf[23] == 17)) && (len >= (14 + ihl + 4))) {
+      hash ^= get_net4(buf + 14 + ihl);
+    }
+    hash ^= (hash >> 16);
+    hash ^= (hash >> 8);
+    q = hash % pairs;
+  }
+  for (i = 0; i < pairs; i++) {
+    if (vq_has_buffers(&BX_VIRTIO_NET_THIS s.vq[2 * ((q + i) % pairs)])) {
+      return (q + i) % pairs;
+    }
+  }
+  return pairs;
+}
+
+/*
+ * Callback from the eth system driver to check if the device can receive
+ */
+Bit32u bx_virtio_net_c::rx_status_handler(void *arg)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) arg;
+  return class_ptr->rx_status();
+}
+
+Bit32u bx_virtio_net_c::rx_status()
+{
+  Bit32u status = BX_NETDEV_1GBIT;
+  unsigned pairs = has_feature(VIRTIO_NET_F_MQ) ? BX_VIRTIO_NET_THIS s.curr_pairs : 1;
+
+  if (BX_VIRTIO_NET_THIS s.status & VIRTIO_CONFIG_S_DRIVER_OK) {
+    for (unsigned i = 0; i < pairs; i++) {
+      if (vq_has_buffers(&BX_VIRTIO_NET_THIS s.vq[2 * i])) {
+        status |= BX_NETDEV_RXREADY;
+        break;
+      }
+    }
+  }
+  return status;
+}
+
+/*
+ * Callback from the eth system driver when a frame has arrived
+ */
+void bx_virtio_net_c::rx_handler(void *arg, const void *buf, unsigned len)
+{
+  bx_virtio_net_c *class_ptr = (bx_virtio_net_c *) arg;
+  class_ptr->rx_frame(buf, len);
+}
+
+void bx_virtio_net_c::rx_frame(const void *buf, unsigned io_len)
+{
+  const Bit8u *frame = (const Bit8u*)buf;
+  bx_virtq_elem_t elem, first;
+  bx_virtq_t *vq;
+  Bit8u hdr[12], nbufs[2];
+  unsigned q, hlen = hdr_len(), pos, n, done = 0, bufs = 0;
+
+  if (!(BX_VIRTIO_NET_THIS s.status & VIRTIO_CONFIG_S_DRIVER_OK)) {
+    return;
+  }
+  if (!rx_filter(frame)) {
+    BX_DEBUG(("rx: frame for %02x:%02x:%02x:%02x:%02x:%02x rejected", frame[0],
+              frame[1], frame[2], frame[3], frame[4], frame[5]));
+    return;
+  }
+  q = rx_select_queue(frame, io_len);
+  if (q >= BX_VIRTIO_NET_THIS s.max_pairs) {
+    // normal backpressure, the guest has not refilled the ring yet
+    BX_VIRTIO_NET_THIS s.rx_dropped++;
+    BX_DEBUG(("rx: no receive buffers, frame dropped"));
+    return;
+  }
+  vq = &BX_VIRTIO_NET_THIS s.vq[2 * q];
+  memset(hdr, 0, sizeof(hdr));
+  hdr[10] = 1; // num_buffers
+  do {
+    if (!vq_pop(vq, &elem)) {
+      // give back the buffers already taken for this frame, including
+      // the avail_event update done by vq_pop()
+      BX_VIRTIO_NET_THIS s.rx_dropped++;
+      BX_DEBUG(("rx: out of receive buffers, frame dropped"));
+      if (bufs > 0) {
+        vq->last_avail_idx -= bufs;
+        vq->used_pending = 0;
+        if (has_feature(VIRTIO_RING_F_EVENT_IDX)) {
+          vring_write16(vq->used + 4 + 8 * vq->size, vq->last_avail_idx);
+        }
+      }
+      return;
+    }
+    pos = 0;
+    if (bufs == 0) {
+      first = elem;
+      pos = elem_write(&elem, 0, hdr, hlen);
+    }
+    n = elem_write(&elem, pos, frame + done, io_len - done);
+    done += n;
+    vq_fill(vq, elem.head, pos + n);
+    bufs++;
+    if (!has_feature(VIRTIO_NET_F_MRG_RXBUF)) {
+      if (done < io_len) {
+        BX_ERROR(("rx: receive buffer too small, frame truncated"));
+      }
+      break;
+    }
+  } while (done < io_len);
+  if (bufs > 1) {
+    nbufs[0] = (Bit8u)bufs;
+    nbufs[1] = (Bit8u)(bufs >> 8);
+    elem_write(&first, 10, nbufs, 2);
+  }
+  vq_flush(vq);
+  vq_notify(vq);
+  bx_gui->statusbar_setitem(BX_VIRTIO_NET_THIS s.statusbar_id, 1);
+}
+
+#endif // BX_SUPPORT_PCI && BX_SUPPORT_VIRTIO_NET
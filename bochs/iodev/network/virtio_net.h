@@ -0,0 +1,144 @@
+/////////////////////////////////////////////////////////////////////////
+// $Id$
+/////////////////////////////////////////////////////////////////////////
+//
+//  Virtio network device (legacy virtio-pci interface)
+//  Specification:
+//  https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html
+//
+//  Copyright (C) 2026  The Bochs Project
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef BX_IODEV_VIRTIO_NET_H
+#define BX_IODEV_VIRTIO_NET_H
+
+#define BX_VIRTIO_NET_THIS this->
+#define BX_VIRTIO_NET_THIS_PTR this
+
+#define VIRTIO_NET_MAX_QUEUE_PAIRS 4
+#define VIRTIO_NET_MAX_QUEUES      (2 * VIRTIO_NET_MAX_QUEUE_PAIRS + 1)
+#define VIRTIO_NET_QUEUE_SIZE      256
+// maximum number of buffers in one descriptor chain
+#define VIRTIO_NET_MAX_SG          64
+// largest TSO frame accepted from the guest (plus virtio header)
+#define VIRTIO_NET_TX_BUFSIZE      (65536 + 16)
+
+// virtqueue descriptor chain popped from the available ring
+typedef struct {
+  Bit16u head;
+  unsigned out_num, in_num;
+  bx_phy_address out_addr[VIRTIO_NET_MAX_SG];
+  Bit32u out_len[VIRTIO_NET_MAX_SG];
+  bx_phy_address in_addr[VIRTIO_NET_MAX_SG];
+  Bit32u in_len[VIRTIO_NET_MAX_SG];
+} bx_virtq_elem_t;
+
+typedef struct {
+  Bit32u pfn;             // guest page frame of the ring (0 = disabled)
+  Bit16u size;
+  Bit16u last_avail_idx;  // next available ring entry to process
+  Bit16u used_idx;        // shadow of the used ring index
+  Bit16u used_pending;    // entries filled but not yet published
+  Bit16u signalled_used;  // used index at the last interrupt
+  bool   signalled_valid;
+  // ring addresses derived from pfn
+  bx_phy_address desc, avail, used;
+} bx_virtq_t;
+
+typedef struct {
+  Bit8u  macaddr[6];
+  Bit32u host_features;
+  Bit32u guest_features;
+  Bit16u queue_sel;
+  Bit8u  status;
+  Bit8u  isr;
+  Bit16u max_pairs;
+  Bit16u curr_pairs;
+  bool   promisc;
+  bool   allmulti;
+  bool   alluni;
+  bx_virtq_t vq[VIRTIO_NET_MAX_QUEUES];
+
+  Bit8u  *tx_buf;
+  Bit32u rx_dropped;  // frames dropped for lack of receive buffers
+
+  Bit8u devfunc;
+  int statusbar_id;
+} bx_virtio_net_t;
+
+class bx_virtio_net_c : public bx_pci_device_c {
+public:
+  bx_virtio_net_c();
+  virtual ~bx_virtio_net_c();
+  virtual void init(void);
+  virtual void reset(unsigned type);
+  virtual void register_state(void);
+  virtual void after_restore_state(void);
+
+  virtual void pci_write_handler(Bit8u address, Bit32u value, unsigned io_len);
+
+private:
+  bx_virtio_net_t s;
+
+  eth_pktmover_c *ethdev;
+
+  void   set_irq_level(bool level);
+  void   device_reset(void);
+  bool   has_feature(unsigned bit) {return (BX_VIRTIO_NET_THIS s.guest_features >> bit) & 1;}
+  unsigned hdr_len(void);
+  unsigned ctrl_vq_index(void);
+  Bit8u  config_read(unsigned offset);
+  void   config_write(unsigned offset, Bit8u value);
+
+  // virtqueue helpers
+  void   vq_set_addr(bx_virtq_t *vq);
+  Bit16u vq_avail_idx(bx_virtq_t *vq);
+  bool   vq_has_buffers(bx_virtq_t *vq);
+  bool   vq_read_desc(bx_phy_address table, unsigned max, Bit16u idx,
+                      bx_virtq_elem_t *elem, Bit16u *flags, Bit16u *next);
+  bool   vq_pop(bx_virtq_t *vq, bx_virtq_elem_t *elem);
+  void   vq_fill(bx_virtq_t *vq, Bit16u head, Bit32u len);
+  void   vq_flush(bx_virtq_t *vq);
+  void   vq_notify(bx_virtq_t *vq);
+
+  unsigned elem_read(const bx_virtq_elem_t *elem, Bit8u *buf, unsigned size);
+  unsigned elem_write(const bx_virtq_elem_t *elem, unsigned offset,
+                      const Bit8u *buf, unsigned size);
+
+  void   tx_queue(unsigned index);
+  void   tx_frame(Bit8u *buf, unsigned len, const Bit8u *hdr);
+  void   tx_gso(Bit8u *buf, unsigned len, unsigned gso_type, unsigned mss);
+  void   ctrl_queue(void);
+  Bit8u  ctrl_command(const Bit8u *cmd, unsigned len);
+
+  bool   rx_filter(const Bit8u *buf);
+  unsigned rx_select_queue(const Bit8u *buf, unsigned len);
+
+  static Bit32u rx_status_handler(void *arg);
+  Bit32u rx_status(void);
+  static void rx_handler(void *arg, const void *buf, unsigned len);
+  void rx_frame(const void *buf, unsigned io_len);
+
+  static bool mem_read_handler(bx_phy_address addr, unsigned len, void *data, void *param);
+
+  static Bit32u read_handler(void *this_ptr, Bit32u address, unsigned io_len);
+  static void   write_handler(void *this_ptr, Bit32u address, Bit32u value, unsigned io_len);
+  Bit32u read(Bit32u address, unsigned io_len);
+  void   write(Bit32u address, Bit32u value, unsigned io_len);
+};
+
+#endif
@@ -34,6 +34,7 @@
 
 #include "pci.h"
 #include "pci_ide.h"
+#include "hdimage/hdimage.h"
 
 #define LOG_THIS thePciIdeController->
 
@@ -66,12 +67,8 @@ bx_pci_ide_c::bx_pci_ide_c()
 
 bx_pci_ide_c::~bx_pci_ide_c()
 {
-  if (s.bmdma[0].buffer != NULL) {
-    delete [] s.bmdma[0].buffer;
-  }
-  if (s.bmdma[1].buffer != NULL) {
-    delete [] s.bmdma[1].buffer;
-  }
+  bx_free_image_buffer(s.bmdma[0].buffer);
+  bx_free_image_buffer(s.bmdma[1].buffer);
   SIM->get_bochs_root()->remove("pci_ide");
   BX_DEBUG(("Exit"));
 }
@@ -99,8 +96,9 @@ void bx_pci_ide_c::init(void)
     }
   }
 
-  BX_PIDE_THIS s.bmdma[0].buffer = new Bit8u[0x20000];
-  BX_PIDE_THIS s.bmdma[1].buffer = new Bit8u[0x20000];
+  // aligned for disk images opened with uncached I/O
+  BX_PIDE_THIS s.bmdma[0].buffer = bx_alloc_image_buffer(0x20000);
+  BX_PIDE_THIS s.bmdma[1].buffer = bx_alloc_image_buffer(0x20000);
 
   // initialize readonly registers
   if (BX_PIDE_THIS s.chipset == BX_PCI_CHIPSET_I430FX) {
@@ -290,9 +288,10 @@ void bx_pci_ide_c::timer()
     BX_PIDE_THIS s.bmdma[channel].buffer_top += size;
     count = (int)(BX_PIDE_THIS s.bmdma[channel].buffer_top - BX_PIDE_THIS s.bmdma[channel].buffer_idx);
     while (count > 511) {
-      if (DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx)) {
-        BX_PIDE_THIS s.bmdma[channel].buffer_idx += 512;
-        count -= 512;
+      sector_size = count;
+      if (DEV_hd_bmdma_write_sector(channel, BX_PIDE_THIS s.bmdma[channel].buffer_idx, &sector_size)) {
+        BX_PIDE_THIS s.bmdma[channel].buffer_idx += sector_size;
+        count -= sector_size;
       } else {
         break;
       }
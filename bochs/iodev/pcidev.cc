@@ -431,7 +431,7 @@ void bx_pcidev_c::pci_write_handler(Bit8u address, Bit32u value, unsigned io_len
     if ((base & PCI_BASE_ADDRESS_SPACE) == PCI_BASE_ADDRESS_SPACE_MEMORY) {
       if (DEV_pci_set_base_mem(&(BX_PCIDEV_THIS regions[io_reg_idx]),
           pcidev_mem_read_handler,
-          pcidev_mem_write_handler,
+          pcidev_mem_write_handler, NULL,
           &BX_PCIDEV_THIS regions[io_reg_idx].start,
           (Bit8u*)&BX_PCIDEV_THIS regions[io_reg_idx].config_value,
           BX_PCIDEV_THIS regions[io_reg_idx].size)) {
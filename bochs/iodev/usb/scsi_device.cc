@@ -188,6 +188,7 @@ SCSIRequest* scsi_device_t::scsi_new_request(Bit32u tag)
   r->tag = tag;
   r->sector_count = 0;
   r->write_cmd = 0;
+  r->fua = 0;
   r->async_mode = 0;
   r->seek_pending = 0;
   r->buf_len = 0;
@@ -252,6 +253,7 @@ bool scsi_device_t::save_requests(const char *path)
         fprintf(fp, "  buf_len = %d\n", r->buf_len);
         fprintf(fp, "  status = %u\n", r->status);
         fprintf(fp, "  write_cmd = %u\n", r->write_cmd);
+        fprintf(fp, "  fua = %u\n", r->fua);
         fprintf(fp, "  async_mode = %u\n", r->async_mode);
         fprintf(fp, "  seek_pending = %u\n", r->seek_pending);
         fprintf(fp, "}\n");
@@ -347,6 +349,8 @@ void scsi_device_t::restore_requests(const char *path)
                   r->status = (Bit32u) value;
                 } else if (!strcmp(pname, "write_cmd")) {
                   r->write_cmd = (bool) value;
+                } else if (!strcmp(pname, "fua")) {
+                  r->fua = (bool) value;
                 } else if (!strcmp(pname, "async_mode")) {
                   r->async_mode = (bool) value;
                 } else if (!strcmp(pname, "seek_pending")) {
@@ -1104,6 +1108,8 @@ Bit32s scsi_device_t::scsi_send_command(Bit32u tag, Bit8u *buf, Bit8u cmd_len, i
       r->sector = lba;
       r->sector_count = len;
       r->write_cmd = 1;
+      // forced unit access (not defined for WRITE(6))
+      r->fua = (buf[0] != 0x0a) && ((buf[1] & 0x08) != 0);
       if (async) {
         r->seek_pending = 2;
       }
@@ -1112,7 +1118,12 @@ Bit32s scsi_device_t::scsi_send_command(Bit32u tag, Bit8u *buf, Bit8u cmd_len, i
     case 0x35:
     case 0x91:
       BX_DEBUG(("Synchronise cache (sector " FMT_LL "d, count %d)", lba, len));
-      // TODO: flush cache
+      if ((type == SCSIDEV_TYPE_DISK) && (hdimage->sync() < 0)) {
+        BX_ERROR(("could not sync hard drive image file"));
+        _sense = SENSE_MEDIUM_ERROR;
+        _asc = 0x0C; // Write Error
+        goto fail;
+      }
       break;
     case 0x43:
       if (type == SCSIDEV_TYPE_CDROM) {
@@ -1807,11 +1818,8 @@ void scsi_device_t::seek_complete(SCSIRequest *r)
         scsi_command_complete(r, STATUS_CHECK_CONDITION, SENSE_HARDWARE_ERROR, 0, 0);
         return;
       }
-      i = 0;
-      do {
-        ret = (int) hdimage->read((bx_ptr_t) (r->dma_buf + (i * block_size)), block_size);
-      } while ((++i < n) && (ret == block_size));
-      if (ret != block_size) {
+      ret = (int) hdimage->read((bx_ptr_t) r->dma_buf, n * block_size);
+      if (ret != (int)(n * block_size)) {
         BX_ERROR(("could not read() hard drive image file"));
         scsi_command_complete(r, STATUS_CHECK_CONDITION, SENSE_HARDWARE_ERROR, 0, 0);
         return;
@@ -1828,19 +1836,21 @@ void scsi_device_t::seek_complete(SCSIRequest *r)
       if (ret < 0) {
         BX_ERROR(("could not lseek() hard drive image file"));
         scsi_command_complete(r, STATUS_CHECK_CONDITION, SENSE_HARDWARE_ERROR, 0, 0);
+        return;
       }
-      i = 0;
-      do {
-        ret = (int) hdimage->write((bx_ptr_t) (r->dma_buf + (i * block_size)),
-                                  block_size);
-      } while ((++i < n) && (ret == block_size));
-      if (ret != block_size) {
+      ret = (int) hdimage->write((bx_ptr_t) r->dma_buf, n * block_size);
+      if (ret != (int)(n * block_size)) {
         BX_ERROR(("could not write() hard drive image file"));
         scsi_command_complete(r, STATUS_CHECK_CONDITION, SENSE_HARDWARE_ERROR, 0, 0);
         return;
       }
       r->sector += n;
       r->sector_count -= n;
+      if (r->fua && (r->sector_count == 0) && (hdimage->sync() < 0)) {
+        BX_ERROR(("could not sync hard drive image file"));
+        scsi_command_complete(r, STATUS_CHECK_CONDITION, SENSE_MEDIUM_ERROR, 0x0C, 0);
+        return;
+      }
       scsi_write_complete((void *) r, 0);
     }
   }
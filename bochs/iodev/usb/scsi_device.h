@@ -206,6 +206,7 @@ typedef struct SCSIRequest {
   Bit8u *dma_buf;
   Bit32u status;
   bool write_cmd;
+  bool fua;
   bool async_mode;
   Bit8u seek_pending;
   struct SCSIRequest *next;
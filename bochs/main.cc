@@ -662,6 +662,9 @@ int bx_init_main(int argc, char *argv[])
 #if BX_SUPPORT_E1000
           fprintf(stderr, "e1000\n");
 #endif
+#if BX_SUPPORT_VIRTIO_NET
+          fprintf(stderr, "virtio_net\n");
+#endif
 #if BX_SUPPORT_SB16
           fprintf(stderr, "sb16\n");
 #endif
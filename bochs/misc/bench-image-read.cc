@@ -0,0 +1,254 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// bench-image-read.cc
+// $Id$
+//
+// This program measures the read performance of the disk image code in
+// iodev/hdimage, mainly for the formats with allocation tables (vmware4,
+// vpc and vbox). It uses the same objects as bximage. If the image does
+// not exist, it is created in the given mode and size (default: vmware4,
+// 4096 MB) and filled completely. The image is then read sequentially in
+// 64 KB requests and with random 4 KB and 64 KB requests. Before each
+// pass the host page cache of the image file is dropped, so the figures
+// include the host reads. Every sector written by this program carries
+// its number, so all data read is checked as well.
+//
+// vbox images can't be created by Bochs. Create an empty dynamic VDI
+// image with VirtualBox and run the program with "-fill" to fill it first.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -DBXIMAGE -o bench-image-read misc/bench-image-read.cc iodev/hdimage/hdimage.cc iodev/hdimage/vmware3.cc iodev/hdimage/vmware4.cc iodev/hdimage/vpc.cc iodev/hdimage/vbox.cc
+// Then run "bench-image-read [-fill] <image> [mode [size in MB]]" and see
+// how it goes.  If mismatches=0, the data read back is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+#include "misc/bxcompat.h"
+#include "osdep.h"
+#include "iodev/hdimage/hdimage.h"
+#include "iodev/hdimage/vmware3.h"
+#include "iodev/hdimage/vmware4.h"
+#include "iodev/hdimage/vpc.h"
+#include "iodev/hdimage/vbox.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define SEQ_REQUEST    (64 * 1024)
+#define RANDOM_SMALL   20000
+#define RANDOM_LARGE   5000
+
+int bx_interactive = 0;
+static unsigned mismatches = 0;
+static bool checked;
+
+void myexit(int code)
+{
+  exit(code);
+}
+
+device_image_t* init_image(const char *imgmode)
+{
+  if (!strcmp(imgmode, "flat")) {
+    return new flat_image_t();
+  } else if (!strcmp(imgmode, "sparse")) {
+    return new sparse_image_t();
+  } else if (!strcmp(imgmode, "growing")) {
+    return new growing_image_t();
+  } else if (!strcmp(imgmode, "vmware3")) {
+    return new vmware3_image_t();
+  } else if (!strcmp(imgmode, "vmware4")) {
+    return new vmware4_image_t();
+  } else if (!strcmp(imgmode, "vpc")) {
+    return new vpc_image_t();
+  } else if (!strcmp(imgmode, "vbox")) {
+    return new vbox_image_t();
+  }
+  return NULL;
+}
+
+static Bit64u get_msec(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (Bit64u)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static Bit64u rand64(void)
+{
+  return ((Bit64u)rand() << 40) ^ ((Bit64u)rand() << 20) ^ (Bit64u)rand();
+}
+
+// sector contents written by this program
+static void fill_sectors(Bit8u *buf, Bit64u sector, unsigned count)
+{
+  Bit64u *words = (Bit64u *)buf;
+
+  for (unsigned i = 0; i < count; i++, sector++) {
+    words[0] = sector;
+    for (unsigned j = 1; j < 64; j++) {
+      words[j] = (sector * BX_CONST64(0x9e3779b97f4a7c15)) ^ j;
+    }
+    words += 64;
+  }
+}
+
+static void check_sectors(const Bit8u *buf, Bit64u sector, unsigned count)
+{
+  static Bit8u expect[SEQ_REQUEST];
+
+  if (!checked)
+    return;
+  fill_sectors(expect, sector, count);
+  if (memcmp(buf, expect, count * 512)) {
+    if (mismatches++ < 10)
+      printf("wrong data in sectors " FMT_LL "u-" FMT_LL "u\n", sector, sector + count - 1);
+  }
+}
+
+// let the next pass read from the host disk again
+static void drop_host_cache(const char *path)
+{
+#if defined(POSIX_FADV_DONTNEED)
+  int fd = ::open(path, O_RDONLY);
+
+  if (fd >= 0) {
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+#endif
+}
+
+static void report(const char *pass, Bit64u requests, Bit64u bytes, Bit64u msecs)
+{
+  if (msecs == 0) msecs = 1;
+  printf("%-16s " FMT_LL "u requests in %u.%03u s: %u MB/s, " FMT_LL "u requests/s\n", pass,
+         requests, (unsigned)(msecs / 1000), (unsigned)(msecs % 1000),
+         (unsigned)((bytes >> 20) * 1000 / msecs), requests * 1000 / msecs);
+}
+
+static void random_reads(device_image_t *image, const char *path, const char *pass,
+                         unsigned requests, unsigned size)
+{
+  static Bit8u buf[SEQ_REQUEST];
+  Bit64u sectors = image->hd_size / size * (size / 512), sector, start;
+
+  drop_host_cache(path);
+  start = get_msec();
+  for (unsigned i = 0; i < requests; i++) {
+    // aligned to the request size, like most guest file systems do
+    sector = (rand64() % (sectors / (size / 512))) * (size / 512);
+    if ((image->lseek((Bit64s)sector * 512, SEEK_SET) < 0) ||
+        (image->read(buf, size) != (ssize_t)size)) {
+      printf("read of sector " FMT_LL "u failed\n", sector);
+      exit(1);
+    }
+    check_sectors(buf, sector, size / 512);
+  }
+  report(pass, requests, (Bit64u)requests * size, get_msec() - start);
+}
+
+int main(int argc, char *argv[])
+{
+  static Bit8u buf[SEQ_REQUEST];
+  device_image_t *image;
+  const char *path, *mode = "vmware4";
+  Bit64u size = 4096, sector, sectors, start;
+  bool fill = 0;
+  int arg = 1;
+
+  if ((argc > arg) && !strcmp(argv[arg], "-fill")) {
+    fill = 1;
+    arg++;
+  }
+  if (argc <= arg) {
+    printf("usage: bench-image-read [-fill] <image> [mode [size in MB]]\n");
+    return 1;
+  }
+  path = argv[arg++];
+  if (argc > arg) mode = argv[arg++];
+  if (argc > arg) size = strtoull(argv[arg++], NULL, 10);
+
+  if (access(path, F_OK) < 0) {
+    image = init_image(mode);
+    if ((image == NULL) || !strcmp(mode, "vbox") || !strcmp(mode, "vmware3")) {
+      printf("cannot create images of mode '%s'\n", mode);
+      return 1;
+    }
+    if (!strcmp(mode, "flat")) {
+      int fd = bx_create_image_file(path);
+      if ((fd < 0) || (ftruncate(fd, size << 20) < 0)) {
+        printf("cannot create '%s'\n", path);
+        return 1;
+      }
+      ::close(fd);
+    } else if (image->create_image(path, size << 20) < 0) {
+      printf("cannot create '%s'\n", path);
+      return 1;
+    }
+    delete image;
+    fill = 1;
+  } else if (!hdimage_detect_image_mode(path, &mode)) {
+    printf("cannot detect the mode of '%s'\n", path);
+    return 1;
+  }
+  image = init_image(mode);
+  if ((image == NULL) || (image->open(path, O_RDWR) < 0)) {
+    printf("cannot open '%s' (mode %s)\n", path, mode);
+    return 1;
+  }
+  sectors = image->hd_size / SEQ_REQUEST * (SEQ_REQUEST / 512);
+  printf("%s: mode %s, " FMT_LL "u MB\n", path, mode, image->hd_size >> 20);
+
+  if (fill) {
+    start = get_msec();
+    for (sector = 0; sector < sectors; sector += SEQ_REQUEST / 512) {
+      fill_sectors(buf, sector, SEQ_REQUEST / 512);
+      if ((image->lseek((Bit64s)sector * 512, SEEK_SET) < 0) ||
+          (image->write(buf, SEQ_REQUEST) != SEQ_REQUEST)) {
+        printf("write of sector " FMT_LL "u failed\n", sector);
+        return 1;
+      }
+    }
+    // the next passes open the image like Bochs does
+    image->close();
+    report("fill", sectors / (SEQ_REQUEST / 512), sectors * 512, get_msec() - start);
+    delete image;
+    image = init_image(mode);
+    if (image->open(path, O_RDWR) < 0) {
+      printf("cannot reopen '%s'\n", path);
+      return 1;
+    }
+  }
+  image->lseek(0, SEEK_SET);
+  checked = (image->read(buf, 512) == 512) && (((Bit64u *)buf)[0] == 0) &&
+            (((Bit64u *)buf)[1] == 1);
+  if (!checked) {
+    printf("image not filled by this program, data is not checked\n");
+  }
+
+  drop_host_cache(path);
+  start = get_msec();
+  for (sector = 0; sector < sectors; sector += SEQ_REQUEST / 512) {
+    if ((image->lseek((Bit64s)sector * 512, SEEK_SET) < 0) ||
+        (image->read(buf, SEQ_REQUEST) != SEQ_REQUEST)) {
+      printf("read of sector " FMT_LL "u failed\n", sector);
+      return 1;
+    }
+    check_sectors(buf, sector, SEQ_REQUEST / 512);
+  }
+  report("sequential 64K", sectors / (SEQ_REQUEST / 512), sectors * 512, get_msec() - start);
+
+  srand(1);
+  random_reads(image, path, "random 4K", RANDOM_SMALL, 4096);
+  random_reads(image, path, "random 64K", RANDOM_LARGE, SEQ_REQUEST);
+
+  image->close();
+  delete image;
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
@@ -0,0 +1,479 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// bench-slirp-tcp.cc
+// $Id$
+//
+// This program measures the guest-to-host TCP throughput of the slirp
+// networking module (iodev/network/eth_slirp.cc). It takes the place of
+// the guest and its network card: a small TCP sender builds the Ethernet
+// frames and passes them to the slirp pktmover, which connects to a
+// listening socket of this program on the host loopback (10.0.2.2 seen
+// from the guest). A host thread reads and checks the stream. The slirp
+// timer is called every timer interval of host time, as it would be with
+// the emulated time synchronized to the host. Like a network card, the
+// guest has a receive ring of limited size (default 32 frames) that it
+// only empties between its bursts of segments, so frames for the guest
+// must wait while it is full. Since no CPU or device emulation takes time
+// here, the result is the upper limit slirp itself allows.
+//
+// Compile with (from the build directory, slirp support enabled):
+//   c++ -O2 -I. -Iiodev/network -o bench-slirp-tcp misc/bench-slirp-tcp.cc iodev/network/netcsum.cc iodev/network/slirp/*.cc -lpthread
+// Then run "bench-slirp-tcp [MB [ring size]]" and see how it goes.  If mismatches=0,
+// all data has arrived unchanged.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/network/netmod.cc"
+#undef LOG_THIS
+#include "iodev/network/eth_slirp.cc"
+#include "bxthread.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#if !BX_NETWORKING || !BX_NETMOD_SLIRP || defined(WIN32)
+#error slirp support on a POSIX host is required
+#endif
+
+#define GUEST_PORT  40000
+#define GUEST_MSS   1460
+#define MAX_INFLIGHT (4 * 1024 * 1024)
+#define RTO_USEC    200000
+#define MAX_RING    1024
+
+#define ETHERNET_TYPE_IPV4 0x0800
+#define ETHERNET_TYPE_ARP  0x0806
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_ACK 0x10
+
+static unsigned mismatches = 0;
+
+// just enough of the simulator to run the pktmover
+
+bx_simulator_interface_c *SIM = NULL;
+bx_pc_system_c bx_pc_system;
+
+static bx_timer_handler_t timer_handler = NULL;
+static void *timer_this = NULL;
+static Bit32u timer_interval = 0;
+
+static Bit64u host_usec(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (Bit64u)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+bx_pc_system_c::bx_pc_system_c() {}
+
+int bx_pc_system_c::register_timer(void *this_ptr, bx_timer_handler_t funct,
+  Bit32u useconds, bool continuous, bool active, const char *id)
+{
+  timer_handler = funct;
+  timer_this = this_ptr;
+  timer_interval = useconds;
+  return 0;
+}
+
+void bx_pc_system_c::activate_timer(unsigned timer_index, Bit32u useconds, bool continuous)
+{
+  timer_interval = useconds;
+}
+
+void bx_pc_system_c::deactivate_timer(unsigned timer_index)
+{
+  timer_interval = 0;
+}
+
+Bit64u bx_pc_system_c::time_usec()
+{
+  return host_usec();
+}
+
+logfunctions::logfunctions() {}
+logfunctions::~logfunctions() {}
+void logfunctions::put(const char *p) {}
+void logfunctions::put(const char *n, const char *p) {}
+void logfunctions::info(const char *fmt, ...) {}
+void logfunctions::ldebug(const char *fmt, ...) {}
+
+void logfunctions::error(const char *fmt, ...)
+{
+  static unsigned errors = 0;
+  va_list ap;
+
+  if (errors++ < 10) {
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+  }
+}
+
+void logfunctions::panic(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  exit(1);
+}
+
+Bit8u bx_get_plugins_count_np(Bit16u type)
+{
+  return 0;
+}
+
+const char* bx_get_plugin_name_np(Bit16u type, Bit8u index)
+{
+  return NULL;
+}
+
+eth_pktmover_c *eth_capture_create(const char *capfile, const char *type,
+  const char *netif, const char *macaddr, eth_rx_handler_t rxh,
+  eth_rx_status_t rxstat, logfunctions *netdev, const char *script)
+{
+  return NULL;
+}
+
+// the host side: read and check the stream
+
+static int listen_fd;
+static Bit64u host_bytes = 0;
+
+static Bit8u stream_byte(Bit64u offset)
+{
+  return (Bit8u)(offset % 251);
+}
+
+BX_THREAD_FUNC(host_thread, indata)
+{
+  static Bit8u buf[256 * 1024];
+  int fd = accept(listen_fd, NULL, NULL);
+  ssize_t ret;
+
+  if (fd < 0) {
+    printf("accept failed\n");
+    exit(1);
+  }
+  while ((ret = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    for (ssize_t i = 0; i < ret; i++) {
+      if (buf[i] != stream_byte(host_bytes + i)) {
+        if (mismatches++ < 10)
+          printf("wrong data at offset " FMT_LL "u\n", host_bytes + i);
+        break;
+      }
+    }
+    __atomic_add_fetch(&host_bytes, (Bit64u)ret, __ATOMIC_RELAXED);
+  }
+  close(fd);
+  BX_THREAD_EXIT;
+}
+
+// the guest side: a TCP sender without congestion control
+
+static const Bit8u guest_mac[6] = {0xb0, 0xc4, 0x20, 0x00, 0x00, 0x01};
+static const Bit8u guest_ip[4] = {10, 0, 2, 15};
+static const Bit8u host_ip[4] = {10, 0, 2, 2};
+
+static eth_pktmover_c *mover;
+static Bit8u gw_mac[6];
+static bool gw_known = 0;
+static Bit16u host_port, ip_id = 0;
+
+static enum {SYN_SENT, ESTABLISHED, FIN_SENT, CLOSED} state = SYN_SENT;
+static Bit32u snd_una, snd_nxt, rcv_nxt, iss = 1000;
+static Bit32u snd_wnd = GUEST_MSS, peer_mss = 536;
+static unsigned peer_wscale = 0;
+static Bit64u last_progress;
+
+// two rings: the guest fills one while processing the other
+static Bit8u rx_ring[2][MAX_RING][BX_PACKET_BUFSIZE];
+static unsigned rx_len[2][MAX_RING], rx_fill = 0, rx_count = 0, rx_size = 32;
+
+static Bit32u checksum_add(Bit32u sum, const Bit8u *buf, unsigned len)
+{
+  for (unsigned i = 0; i < (len & ~1); i += 2) {
+    sum += get_net2(buf + i);
+  }
+  if (len & 1) {
+    sum += buf[len - 1] << 8;
+  }
+  return sum;
+}
+
+static Bit16u checksum_fold(Bit32u sum)
+{
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (Bit16u)~sum;
+}
+
+static void send_arp(Bit16u op, const Bit8u *dst_mac, const Bit8u *dst_ip)
+{
+  Bit8u frame[60];
+
+  memset(frame, 0, sizeof(frame));
+  memcpy(frame, (op == 1) ? broadcast_macaddr : dst_mac, 6);
+  memcpy(frame + 6, guest_mac, 6);
+  put_net2(frame + 12, ETHERNET_TYPE_ARP);
+  put_net2(frame + 14, 1);
+  put_net2(frame + 16, ETHERNET_TYPE_IPV4);
+  frame[18] = 6;
+  frame[19] = 4;
+  put_net2(frame + 20, op);
+  memcpy(frame + 22, guest_mac, 6);
+  memcpy(frame + 28, guest_ip, 4);
+  if (op == 2) memcpy(frame + 32, dst_mac, 6);
+  memcpy(frame + 38, dst_ip, 4);
+  mover->sendpkt(frame, sizeof(frame));
+}
+
+static void send_segment(Bit8u flags, Bit32u seq, Bit64u offset, unsigned len)
+{
+  Bit8u frame[14 + 20 + 28 + GUEST_MSS], *ip = frame + 14, *tcp = ip + 20;
+  unsigned hlen = (flags & TCP_SYN) ? 28 : 20;
+  Bit32u sum;
+
+  memcpy(frame, gw_mac, 6);
+  memcpy(frame + 6, guest_mac, 6);
+  put_net2(frame + 12, ETHERNET_TYPE_IPV4);
+  ip[0] = 0x45;
+  ip[1] = 0;
+  put_net2(ip + 2, 20 + hlen + len);
+  put_net2(ip + 4, ip_id++);
+  put_net2(ip + 6, 0x4000);
+  ip[8] = 64;
+  ip[9] = 6;
+  put_net2(ip + 10, 0);
+  memcpy(ip + 12, guest_ip, 4);
+  memcpy(ip + 16, host_ip, 4);
+  put_net2(ip + 10, checksum_fold(checksum_add(0, ip, 20)));
+  put_net2(tcp, GUEST_PORT);
+  put_net2(tcp + 2, host_port);
+  put_net4(tcp + 4, seq);
+  put_net4(tcp + 8, (flags & TCP_ACK) ? rcv_nxt : 0);
+  tcp[12] = (hlen / 4) << 4;
+  tcp[13] = flags;
+  put_net2(tcp + 14, 0xffff);
+  put_net2(tcp + 16, 0);
+  put_net2(tcp + 18, 0);
+  if (flags & TCP_SYN) {
+    // MSS and window scale
+    const Bit8u options[8] = {2, 4, GUEST_MSS >> 8, GUEST_MSS & 0xff, 1, 3, 3, 7};
+    memcpy(tcp + 20, options, 8);
+  }
+  for (unsigned i = 0; i < len; i++) {
+    tcp[hlen + i] = stream_byte(offset + i);
+  }
+  sum = checksum_add(0, ip + 12, 8);
+  sum += 6 + hlen + len;
+  sum = checksum_add(sum, tcp, hlen + len);
+  put_net2(tcp + 16, checksum_fold(sum));
+  mover->sendpkt(frame, 14 + 20 + hlen + len);
+}
+
+static void guest_tcp_input(const Bit8u *tcp, unsigned len)
+{
+  Bit32u seq = get_net4(tcp + 4), ack = get_net4(tcp + 8);
+  unsigned hlen = (tcp[12] >> 4) * 4, i;
+  Bit8u flags = tcp[13];
+
+  if ((get_net2(tcp) != host_port) || (get_net2(tcp + 2) != GUEST_PORT))
+    return;
+  if ((state == SYN_SENT) && ((flags & (TCP_SYN | TCP_ACK)) == (TCP_SYN | TCP_ACK))) {
+    for (i = 20; i < hlen; ) {
+      if (tcp[i] == 0) break;
+      if (tcp[i] == 1) {
+        i++;
+        continue;
+      }
+      if ((tcp[i] == 2) && (tcp[i + 1] == 4)) peer_mss = get_net2(tcp + i + 2);
+      if ((tcp[i] == 3) && (tcp[i + 1] == 3)) peer_wscale = tcp[i + 2];
+      i += tcp[i + 1];
+    }
+    if (peer_mss > GUEST_MSS) peer_mss = GUEST_MSS;
+    rcv_nxt = seq + 1;
+    snd_una = snd_nxt = ack;
+    snd_wnd = get_net2(tcp + 14);
+    state = ESTABLISHED;
+    last_progress = host_usec();
+    send_segment(TCP_ACK, snd_nxt, 0, 0);
+    return;
+  }
+  if (flags & TCP_ACK) {
+    if ((Bit32s)(ack - snd_una) > 0) {
+      snd_una = ack;
+      last_progress = host_usec();
+      if ((Bit32s)(snd_nxt - snd_una) < 0) snd_nxt = snd_una;
+    }
+    snd_wnd = (Bit32u)get_net2(tcp + 14) << peer_wscale;
+  }
+  if (flags & TCP_FIN) {
+    rcv_nxt = seq + (len - hlen) + 1;
+    send_segment(TCP_ACK, snd_nxt, 0, 0);
+    if (state == FIN_SENT) state = CLOSED;
+  }
+}
+
+static void guest_rx_frame(const Bit8u *frame, unsigned len)
+{
+  const Bit8u *ip = frame + 14;
+
+  if (len < 42)
+    return;
+  if (get_net2(frame + 12) == ETHERNET_TYPE_ARP) {
+    if ((get_net2(frame + 20) == 2) && !memcmp(frame + 28, host_ip, 4)) {
+      memcpy(gw_mac, frame + 22, 6);
+      gw_known = 1;
+    } else if ((get_net2(frame + 20) == 1) && !memcmp(frame + 38, guest_ip, 4)) {
+      send_arp(2, frame + 22, frame + 28);
+    }
+  } else if ((get_net2(frame + 12) == ETHERNET_TYPE_IPV4) && (ip[9] == 6) &&
+             !memcmp(ip + 16, guest_ip, 4)) {
+    guest_tcp_input(ip + (ip[0] & 0x0f) * 4, get_net2(ip + 2) - (ip[0] & 0x0f) * 4);
+  }
+}
+
+static void guest_rx_handler(void *arg, const void *buf, unsigned len)
+{
+  if ((rx_count >= rx_size) || (len > BX_PACKET_BUFSIZE)) {
+    printf("frame received with the receive ring full\n");
+    mismatches++;
+    return;
+  }
+  memcpy(rx_ring[rx_fill][rx_count], buf, len);
+  rx_len[rx_fill][rx_count++] = len;
+}
+
+static Bit32u guest_rx_status(void *arg)
+{
+  return (rx_count < rx_size) ? (BX_NETDEV_RXREADY | BX_NETDEV_1GBIT) : BX_NETDEV_1GBIT;
+}
+
+static void guest_rx_process(void)
+{
+  // frames received meanwhile wait for the next call
+  unsigned ring = rx_fill, count = rx_count;
+
+  rx_fill ^= 1;
+  rx_count = 0;
+  for (unsigned i = 0; i < count; i++) {
+    guest_rx_frame(rx_ring[ring][i], rx_len[ring][i]);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  Bit64u total = (Bit64u)((argc > 1) ? atoi(argv[1]) : 1024) << 20;
+  Bit64u start, now, next_timer, offset, msecs;
+  logfunctions *netdev = new logfunctions();
+  struct sockaddr_in sa;
+  socklen_t salen = sizeof(sa);
+  unsigned retransmits = 0;
+  Bit32u inflight, limit, seglen;
+  BX_THREAD_VAR(thread_var);
+
+  if (argc > 2) {
+    rx_size = atoi(argv[2]);
+    if ((rx_size < 1) || (rx_size > MAX_RING)) {
+      printf("the ring size must be 1...%u frames\n", MAX_RING);
+      return 1;
+    }
+  }
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ((listen_fd < 0) || (bind(listen_fd, (struct sockaddr*)&sa, sizeof(sa)) < 0) ||
+      (listen(listen_fd, 1) < 0) ||
+      (getsockname(listen_fd, (struct sockaddr*)&sa, &salen) < 0)) {
+    printf("cannot create the host socket\n");
+    return 1;
+  }
+  host_port = ntohs(sa.sin_port);
+  BX_THREAD_CREATE(host_thread, NULL, thread_var);
+
+  mover = eth_locator_c::create("slirp", "", (const char*)guest_mac, guest_rx_handler,
+                                guest_rx_status, netdev, "");
+  if ((mover == NULL) || (timer_handler == NULL)) {
+    printf("cannot create the slirp pktmover\n");
+    return 1;
+  }
+  send_arp(1, NULL, host_ip);
+  guest_rx_process();
+  if (!gw_known) {
+    printf("no ARP reply from slirp\n");
+    return 1;
+  }
+  start = host_usec();
+  next_timer = start;
+  last_progress = start;
+  snd_una = snd_nxt = iss;
+  send_segment(TCP_SYN, iss, 0, 0);
+  while (state != CLOSED) {
+    guest_rx_process();
+    now = host_usec();
+    if ((now - start) > 60000000) {
+      // the host thread may still wait for data
+      printf("transfer not finished after 60 seconds, " FMT_LL "u bytes received\n", host_bytes);
+      printf("mismatches=%u\n", mismatches + 1);
+      return 1;
+    }
+    if ((state == SYN_SENT) && ((now - last_progress) > RTO_USEC)) {
+      send_segment(TCP_SYN, iss, 0, 0);
+      last_progress = now;
+    } else if (state != SYN_SENT) {
+      // go back to the first unacknowledged byte if nothing has arrived
+      if ((snd_nxt != snd_una) && ((now - last_progress) > RTO_USEC)) {
+        snd_nxt = snd_una;
+        last_progress = now;
+        retransmits++;
+      }
+      limit = (snd_wnd < MAX_INFLIGHT) ? snd_wnd : MAX_INFLIGHT;
+      while (1) {
+        offset = (Bit64u)(snd_nxt - iss - 1);
+        inflight = snd_nxt - snd_una;
+        if (offset >= total) break;
+        seglen = (total - offset < peer_mss) ? (Bit32u)(total - offset) : peer_mss;
+        if ((inflight + seglen) > limit) break;
+        // the ACK may already arrive while sending
+        snd_nxt += seglen;
+        send_segment(TCP_ACK, snd_nxt - seglen, offset, seglen);
+      }
+      // all data acknowledged: send the FIN (again after a timeout)
+      if (((Bit64u)(snd_una - iss - 1) == total) && (snd_nxt == snd_una)) {
+        state = FIN_SENT;
+        snd_nxt++;
+        send_segment(TCP_FIN | TCP_ACK, snd_nxt - 1, 0, 0);
+      }
+    }
+    if (now >= next_timer) {
+      timer_handler(timer_this);
+      next_timer = now + timer_interval;
+    }
+  }
+  msecs = (host_usec() - start) / 1000;
+  if (msecs == 0) msecs = 1;
+  BX_THREAD_JOIN(thread_var);
+  delete mover;
+  close(listen_fd);
+  if (host_bytes != total) {
+    printf(FMT_LL "u of " FMT_LL "u bytes received\n", host_bytes, total);
+    mismatches++;
+  }
+  printf("guest to host: " FMT_LL "u MB in %u.%03u s, %u MB/s (ring %u, window scale %u, %u retransmits)\n",
+         host_bytes >> 20, (unsigned)(msecs / 1000), (unsigned)(msecs % 1000),
+         (unsigned)((host_bytes >> 20) * 1000 / msecs), rx_size, peer_wscale, retransmits);
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
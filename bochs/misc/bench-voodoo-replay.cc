@@ -0,0 +1,374 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// bench-voodoo-replay.cc
+// $Id$
+//
+// This program measures the triangle rasterizers of the Voodoo emulation
+// (iodev/display/voodoo_func.h). It replays a command stream, the memory
+// writes a guest driver sends to a Voodoo 1 board, once with the table of
+// specialized rasterizers and once with the generic rasterizer only, and
+// prints the time of each run. The front buffer is hashed after every
+// buffer swap, both runs must produce the same frames.
+//
+// A stream file has one write per line: the offset in the memory range of
+// the board and the data, both in hex ("#" starts a comment). The stream
+// must not write fbiInit0 or the video timing registers, since there is no
+// display device here. Without a stream file, a built-in stream is used:
+// some frames with triangles of all sizes in every predefined pipeline
+// state and in a few states without one. "-save" writes it to a file.
+//
+// Compile with (from the build directory, Voodoo support enabled):
+//   c++ -O2 -I. -Iiodev -Iiodev/display -o bench-voodoo-replay misc/bench-voodoo-replay.cc -lpthread
+// Then run "bench-voodoo-replay [-save <file>] [stream file [threads]]" and
+// see how it goes.  If mismatches=0, both runs have drawn the same frames.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/iodev.h"
+
+#if !BX_SUPPORT_PCI || !BX_SUPPORT_VOODOO
+#error Voodoo support is required
+#endif
+
+#include "iodev/pci.h"
+#include "iodev/display/vgacore.h"
+#include "iodev/display/ddc.h"
+#include "iodev/display/voodoo.h"
+#include "virt_timer.h"
+#include "bxthread.h"
+#define BX_USE_BINARY_ROP
+#include "iodev/display/bitblt.h"
+
+#define LOG_THIS theVoodooDevice->
+
+bx_voodoo_base_c* theVoodooDevice = NULL;
+
+#include "iodev/display/voodoo_types.h"
+#include "iodev/display/voodoo_data.h"
+#include "iodev/display/voodoo_main.h"
+voodoo_state *v;
+#include "iodev/display/voodoo_func.h"
+
+#include "bxthread.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#define STREAM_FRAMES      8
+#define TRIANGLES_PER_STATE 96
+#define MAX_FRAMES         4096
+
+void logfunctions::info(const char *fmt, ...) {}
+void logfunctions::ldebug(const char *fmt, ...) {}
+
+void logfunctions::error(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+}
+
+void logfunctions::panic(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  exit(1);
+}
+
+// the command stream: pairs of offset and data
+
+static Bit32u *stream = NULL;
+static unsigned stream_len = 0, stream_size = 0;
+
+static void put(Bit32u offset, Bit32u data)
+{
+  if (stream_len + 2 > stream_size) {
+    stream_size = stream_size ? stream_size * 2 : 65536;
+    stream = (Bit32u *)realloc(stream, stream_size * sizeof(Bit32u));
+  }
+  stream[stream_len++] = offset;
+  stream[stream_len++] = data;
+}
+
+// register write to the given chips (0 = all)
+static void put_reg(unsigned chips, Bit32u regnum, Bit32u data)
+{
+  put(((chips << 8) | regnum) << 2, data);
+}
+
+static void put_float(Bit32u regnum, float value)
+{
+  union {
+    float f;
+    Bit32u u;
+  } data;
+
+  data.f = value;
+  put_reg(0, regnum, data.u);
+}
+
+static float rand_float(float min, float max)
+{
+  return min + (max - min) * (float)rand() / (float)RAND_MAX;
+}
+
+static void make_state(const raster_info *info)
+{
+  // the effective value has no texture enable bit
+  put_reg(0, fbzColorPath, info->eff_color_path |
+          ((info->eff_tex_mode_0 != 0xffffffff) ? (1 << 27) : 0));
+  put_reg(0, alphaMode, info->eff_alpha_mode);
+  put_reg(0, fogMode, info->eff_fog_mode);
+  put_reg(0, fbzMode, info->eff_fbz_mode);
+  // a TMU without texture mode is disabled through its LOD range
+  put_reg(2, textureMode, (info->eff_tex_mode_0 != 0xffffffff) ? info->eff_tex_mode_0 : 0);
+  put_reg(2, tLOD, 8 << 8);
+  put_reg(4, textureMode, (info->eff_tex_mode_1 != 0xffffffff) ? info->eff_tex_mode_1 : 0);
+  put_reg(4, tLOD, (info->eff_tex_mode_1 != 0xffffffff) ? (8 << 8) : ((8 << 8) | (8 << 2)));
+  put_reg(2, texBaseAddr, 0);
+  put_reg(4, texBaseAddr, 0x8000);
+}
+
+static void make_triangle(float size)
+{
+  float x = rand_float(0, 640 - size), y = rand_float(0, 480 - size);
+
+  put_float(fvertexAx, x + rand_float(0, size));
+  put_float(fvertexAy, y);
+  put_float(fvertexBx, x + size);
+  put_float(fvertexBy, y + rand_float(0, size));
+  put_float(fvertexCx, x);
+  put_float(fvertexCy, y + size);
+  put_float(fstartR, rand_float(0, 255));
+  put_float(fstartG, rand_float(0, 255));
+  put_float(fstartB, rand_float(0, 255));
+  put_float(fstartA, rand_float(0, 255));
+  put_float(fstartZ, rand_float(0, 65535));
+  put_float(fstartS, rand_float(0, 256));
+  put_float(fstartT, rand_float(0, 256));
+  put_float(fstartW, rand_float(0.5, 1));
+  put_float(fdRdX, rand_float(-1, 1));
+  put_float(fdGdX, rand_float(-1, 1));
+  put_float(fdBdX, rand_float(-1, 1));
+  put_float(fdAdX, rand_float(-1, 1));
+  put_float(fdZdX, rand_float(-64, 64));
+  put_float(fdSdX, rand_float(-2, 2));
+  put_float(fdTdX, rand_float(-2, 2));
+  put_float(fdWdX, rand_float(-0.0005f, 0.0005f));
+  put_float(fdRdY, rand_float(-1, 1));
+  put_float(fdGdY, rand_float(-1, 1));
+  put_float(fdBdY, rand_float(-1, 1));
+  put_float(fdAdY, rand_float(-1, 1));
+  put_float(fdZdY, rand_float(-64, 64));
+  put_float(fdSdY, rand_float(-2, 2));
+  put_float(fdTdY, rand_float(-2, 2));
+  put_float(fdWdY, rand_float(-0.0005f, 0.0005f));
+  put_float(ftriangleCMD, 0);
+}
+
+static void make_stream(void)
+{
+  // states without a predefined rasterizer
+  static const raster_info extra_states[] = {
+    { NULL, NULL, false, 0, 0, 0x0142610A, 0x00000000, 0x00000001, 0x00000739, 0xFFFFFFFF, 0xFFFFFFFF },
+    { NULL, NULL, false, 0, 0, 0x00482405, 0x00045119, 0x00000000, 0x00000331, 0x0C261A0F, 0xFFFFFFFF },
+    { NULL, NULL, false, 0, 0, 0x00000001, 0x00000000, 0x00000000, 0x00000301, 0x0C26100F, 0xFFFFFFFF },
+    { NULL, NULL, false, 0, 0, 0x00482405, 0x00000000, 0x00000005, 0x00000739, 0x04824A0F, 0x0C26100F },
+  };
+  const raster_info *info;
+  unsigned frame, i;
+
+  srand(1);
+  // video memory layout: 640x480, two color buffers and the depth buffer
+  put_reg(0, fbiInit1, 10 << 4);
+  put_reg(0, fbiInit2, 150 << 11);
+  put_reg(0, clipLeftRight, 640);
+  put_reg(0, clipLowYHighY, 480);
+  for (frame = 0; frame < STREAM_FRAMES; frame++) {
+    put_reg(0, fbzMode, 0x601);
+    put_reg(0, color1, 0x00204080 + frame);
+    put_reg(0, zaColor, 0xffff);
+    put_reg(0, fastfillCMD, 0);
+    for (info = predef_raster_table; info->callback; info++) {
+      make_state(info);
+      for (i = 0; i < TRIANGLES_PER_STATE; i++) {
+        // mostly small triangles, some large ones
+        make_triangle((i & 15) ? rand_float(4, 48) : rand_float(100, 400));
+      }
+    }
+    for (i = 0; i < sizeof(extra_states) / sizeof(extra_states[0]); i++) {
+      make_state(&extra_states[i]);
+      for (unsigned j = 0; j < TRIANGLES_PER_STATE; j++) {
+        make_triangle((j & 15) ? rand_float(4, 48) : rand_float(100, 400));
+      }
+    }
+    put_reg(0, swapbufferCMD, 0);
+  }
+}
+
+static bool load_stream(const char *path)
+{
+  char line[256];
+  Bit32u offset, data;
+  FILE *fp = fopen(path, "r");
+
+  if (fp == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if ((line[0] == '#') || (line[0] == '\n'))
+      continue;
+    if (sscanf(line, "%x %x", &offset, &data) != 2) {
+      printf("bad line in '%s': %s", path, line);
+      fclose(fp);
+      return 0;
+    }
+    put(offset, data);
+  }
+  fclose(fp);
+  return 1;
+}
+
+static bool save_stream(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+
+  if (fp == NULL)
+    return 0;
+  fprintf(fp, "# Voodoo 1 command stream: offset data\n");
+  for (unsigned i = 0; i < stream_len; i += 2) {
+    fprintf(fp, "%06x %08x\n", stream[i], stream[i + 1]);
+  }
+  fclose(fp);
+  return 1;
+}
+
+// the replay
+
+static Bit32u frame_hash[2][MAX_FRAMES];
+static unsigned frames[2];
+
+static Bit64u get_usec(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (Bit64u)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static Bit32u hash_front_buffer(void)
+{
+  const Bit16u *buf = (const Bit16u *)(v->fbi.ram + v->fbi.rgboffs[v->fbi.frontbuf]);
+  Bit32u hash = 2166136261u;
+
+  for (unsigned y = 0; y < v->fbi.height; y++) {
+    for (unsigned x = 0; x < v->fbi.width; x++) {
+      hash = (hash ^ buf[y * v->fbi.rowpixels + x]) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+static void replay(unsigned run, bool specialized, unsigned threads)
+{
+  Bit64u start, usecs, pixels[2] = {0, 0};
+  raster_info *info;
+  unsigned i, hash;
+
+  v = new voodoo_state;
+  memset(v, 0, sizeof(voodoo_state));
+  voodoo_init(VOODOO_1);
+  v->pci.init_enable = 1;
+  if (!specialized) {
+    // every state gets an entry using the generic rasterizer
+    memset(v->raster_hash, 0, sizeof(v->raster_hash));
+    v->next_rasterizer = 0;
+  }
+  // some texture data, the same in both runs
+  srand(2);
+  for (i = 0; i < (4 << 20); i++) {
+    v->tmu[0].ram[i] = (Bit8u)rand();
+    v->tmu[1].ram[i] = (Bit8u)rand();
+  }
+  raster_start_threads(threads);
+
+  frames[run] = 0;
+  start = get_usec();
+  for (i = 0; i < stream_len; i += 2) {
+    voodoo_w(stream[i] >> 2, stream[i + 1], 0xffffffff);
+    if ((((stream[i] >> 2) & 0xc000ff) == swapbufferCMD) && (frames[run] < MAX_FRAMES)) {
+      frame_hash[run][frames[run]++] = hash_front_buffer();
+    }
+  }
+  usecs = get_usec() - start;
+  raster_stop_threads();
+
+  for (hash = 0; hash < RASTER_HASH_SIZE; hash++) {
+    for (info = v->raster_hash[hash]; info; info = info->next) {
+      pixels[info->is_generic] += info->hits;
+    }
+  }
+  if (usecs == 0) usecs = 1;
+  printf("%-12s %u frames in %u.%03u s, " FMT_LL "u Mpixels/s (" FMT_LL "u%% of the pixels specialized)\n",
+         specialized ? "specialized" : "generic", frames[run], (unsigned)(usecs / 1000000),
+         (unsigned)(usecs / 1000 % 1000), (pixels[0] + pixels[1]) / usecs,
+         (pixels[0] + pixels[1]) ? pixels[0] * 100 / (pixels[0] + pixels[1]) : 0);
+  free(v->fbi.ram);
+  free(v->tmu[0].ram);
+  free(v->tmu[1].ram);
+  delete [] v->thread_stats;
+  delete v;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *save = NULL;
+  unsigned threads = 1, mismatches = 0, i;
+  int arg = 1;
+
+  if ((argc > arg + 1) && !strcmp(argv[arg], "-save")) {
+    save = argv[arg + 1];
+    arg += 2;
+  }
+  if (argc > arg) {
+    if (!load_stream(argv[arg])) {
+      printf("cannot read the stream file '%s'\n", argv[arg]);
+      return 1;
+    }
+    arg++;
+  } else {
+    make_stream();
+  }
+  if (argc > arg) threads = atoi(argv[arg]);
+  if (save != NULL) {
+    if (!save_stream(save)) {
+      printf("cannot write '%s'\n", save);
+      return 1;
+    }
+    return 0;
+  }
+  printf("%u writes, %u threads\n", stream_len / 2, threads);
+
+  replay(0, 1, threads);
+  replay(1, 0, threads);
+  if (frames[0] != frames[1]) {
+    printf("%u and %u frames drawn\n", frames[0], frames[1]);
+    mismatches++;
+  }
+  for (i = 0; (i < frames[0]) && (i < frames[1]); i++) {
+    if (frame_hash[0][i] != frame_hash[1][i]) {
+      if (mismatches++ < 10)
+        printf("frame %u differs\n", i);
+    }
+  }
+  free(stream);
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
@@ -32,6 +32,13 @@
 // - Support for connects from up to 6 Bochs sessions.
 // - Support for connecting from other machines.
 
+// Learning switch (2026):
+// - Frames are forwarded using a MAC address table learned from the source
+//   addresses. Broadcast, multicast and unknown unicast frames are flooded.
+// - Up to 64 ports, epoll() based event loop on Linux.
+// - Batched receive and transmit with recvmmsg() / sendmmsg() on Linux.
+// - Optional packet rate statistics.
+
 #ifdef __CYGWIN__
 #define __USE_W32_SOCKETS
 #endif
@@ -46,6 +53,9 @@ extern "C" {
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #define closesocket(s)    close(s)
 typedef int SOCKET;
 #endif
@@ -70,7 +80,13 @@ typedef int SOCKET;
 #include "iodev/network/netmod.h"
 #include "iodev/network/netutil.h"
 
-#define BXHUB_MAX_CLIENTS 6
+#define BXHUB_MAX_CLIENTS VNET_MAX_CLIENTS
+// number of frames received from or queued for one port at once
+#define BXHUB_BATCH 32
+// MAC address table: hash buckets, entries per bucket and aging time (sec)
+#define BXHUB_FDB_BUCKETS 1024
+#define BXHUB_FDB_WAYS    4
+#define BXHUB_FDB_AGE     300
 
 typedef struct {
   Bit8u      id;
@@ -81,8 +97,18 @@ typedef struct {
   Bit8u      default_ipv4addr[4];
   Bit8u      *reply_buffer;
   unsigned   pending_reply_size;
+  // frames queued for sending to this port
+  unsigned   txq_count;
+  const Bit8u *txq_buf[BXHUB_BATCH];
+  unsigned   txq_len[BXHUB_BATCH];
 } hub_client_t;
 
+typedef struct {
+  Bit8u  macaddr[6];
+  Bit8u  port;
+  time_t seen; // 0 = unused
+} hub_fdb_entry_t;
+
 const Bit8u default_host_macaddr[6] = {0xb0, 0xc4, 0x20, 0x00, 0x00, 0x0f};
 const Bit8u default_net_ipv4addr[4] = {10, 0, 2, 0};
 const Bit8u default_host_ipv4addr[4] = {10, 0, 2, 2};
@@ -97,13 +123,27 @@ static char dhcp_bootfile[128];
 static Bit8u host_macaddr[6];
 static int client_max;
 static Bit8u n_clients;
-static hub_client_t hclient[BXHUB_MAX_CLIENTS];
+static hub_client_t *hclient;
+static hub_fdb_entry_t fdb[BXHUB_FDB_BUCKETS][BXHUB_FDB_WAYS];
+static Bit8u rx_buffer[BXHUB_BATCH][BX_PACKET_BUFSIZE];
+static unsigned rx_len[BXHUB_BATCH];
+static int stats_interval;
+static struct {
+  Bit64u rx, tx, flooded;
+} stats;
 static dhcp_cfg_t dhcp;
 static vnet_server_c vnet_server;
 int bx_loglev;
 static char bx_logfname[BX_PATHNAME_LEN];
 
 
+void send_packet(hub_client_t *client, Bit8u *buf, unsigned len)
+{
+  sendto(client->so, (char*)buf, len, (MSG_NOSIGNAL|MSG_DONTWAIT),
+         (struct sockaddr*) &client->sout, sizeof(client->sout));
+  stats.tx++;
+}
+
 bool handle_packet(hub_client_t *client, Bit8u *buf, unsigned len)
 {
   ethernet_header_t *ethhdr = (ethernet_header_t *)buf;
@@ -122,40 +162,236 @@ bool handle_packet(hub_client_t *client, Bit8u *buf, unsigned len)
     }
   }
 
+  if (client->pending_reply_size > 0) {
+    // reply to the previous frame of a batch, the others stay queued
+    send_packet(client, client->reply_buffer, client->pending_reply_size);
+    client->pending_reply_size = 0;
+  }
   vnet_server.handle_packet(buf, len);
   client->pending_reply_size = vnet_server.get_packet(client->reply_buffer);
   return (client->pending_reply_size > 0);
 }
 
-void send_packet(hub_client_t *client, Bit8u *buf, unsigned len)
+void flush_packets(hub_client_t *client)
 {
-  sendto(client->so, (char*)buf, len, (MSG_NOSIGNAL|MSG_DONTWAIT),
-         (struct sockaddr*) &client->sout, sizeof(client->sout));
+  unsigned i;
+#ifdef __linux__
+  struct mmsghdr msgs[BXHUB_BATCH];
+  struct iovec iov[BXHUB_BATCH];
+  int ret;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < client->txq_count; i++) {
+    iov[i].iov_base = (void*)client->txq_buf[i];
+    iov[i].iov_len = client->txq_len[i];
+    msgs[i].msg_hdr.msg_name = &client->sout;
+    msgs[i].msg_hdr.msg_namelen = sizeof(client->sout);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  i = 0;
+  while (i < client->txq_count) {
+    ret = sendmmsg(client->so, &msgs[i], client->txq_count - i,
+                   MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (ret <= 0)
+      break;
+    i += ret;
+  }
+  stats.tx += i;
+#else
+  for (i = 0; i < client->txq_count; i++) {
+    send_packet(client, (Bit8u*)client->txq_buf[i], client->txq_len[i]);
+  }
+#endif
+  client->txq_count = 0;
+}
+
+void queue_packet(hub_client_t *client, const Bit8u *buf, unsigned len)
+{
+  if (client->txq_count == BXHUB_BATCH) {
+    flush_packets(client);
+  }
+  client->txq_buf[client->txq_count] = buf;
+  client->txq_len[client->txq_count++] = len;
+}
+
+void flood_packet(int clientid, const Bit8u *buf, unsigned len)
+{
+  for (int i = 0; i < client_max; i++) {
+    if (i != clientid) {
+      queue_packet(&hclient[i], buf, len);
+    }
+  }
+  stats.flooded++;
 }
 
 void broadcast_packet(int clientid, Bit8u *buf, unsigned len)
 {
   if (handle_packet(&hclient[clientid], buf, len))
     return;
-  for (int i = 0; i < client_max; i++) {
-    if (i != clientid) {
-      send_packet(&hclient[i], buf, len);
+  flood_packet(clientid, buf, len);
+}
+
+hub_fdb_entry_t *fdb_bucket(const Bit8u *macaddr)
+{
+  Bit32u hash = get_net4(&macaddr[2]) * 0x9e3779b1;
+
+  return fdb[(hash >> 16) % BXHUB_FDB_BUCKETS];
+}
+
+// remember the port a station is connected to
+void fdb_learn(const Bit8u *macaddr, int clientid, time_t now)
+{
+  hub_fdb_entry_t *bucket = fdb_bucket(macaddr), *e = &bucket[0];
+
+  for (int i = 0; i < BXHUB_FDB_WAYS; i++) {
+    if ((bucket[i].seen != 0) &&
+        (memcmp(bucket[i].macaddr, macaddr, ETHERNET_MAC_ADDR_LEN) == 0)) {
+      e = &bucket[i];
+      break;
+    }
+    // otherwise replace the oldest entry
+    if (bucket[i].seen < e->seen) {
+      e = &bucket[i];
     }
   }
+  memcpy(e->macaddr, macaddr, ETHERNET_MAC_ADDR_LEN);
+  e->port = (Bit8u)clientid;
+  e->seen = now;
 }
 
-bool find_client(Bit8u *dst_mac_addr, int *clientid)
+// returns the port of a known station or -1
+int fdb_lookup(const Bit8u *macaddr, time_t now)
 {
-  *clientid = -1;
-  for (int i = 0; i < client_max; i++) {
-    if (hclient[i].init) {
-      if (memcmp(dst_mac_addr, hclient[i].macaddr, ETHERNET_MAC_ADDR_LEN) == 0) {
-        *clientid = i;
+  hub_fdb_entry_t *bucket = fdb_bucket(macaddr);
+
+  for (int i = 0; i < BXHUB_FDB_WAYS; i++) {
+    if ((bucket[i].seen != 0) &&
+        (memcmp(bucket[i].macaddr, macaddr, ETHERNET_MAC_ADDR_LEN) == 0)) {
+      if ((now - bucket[i].seen) >= BXHUB_FDB_AGE) {
+        bucket[i].seen = 0;
         break;
       }
+      return bucket[i].port;
+    }
+  }
+  return -1;
+}
+
+void forward_packet(int clientid, Bit8u *buf, unsigned len, time_t now)
+{
+  ethernet_header_t *ethhdr = (ethernet_header_t *)buf;
+  int c;
+
+  if (len < sizeof(ethernet_header_t))
+    return;
+  if ((ethhdr->src_mac_addr[0] & 0x01) == 0) {
+    fdb_learn(ethhdr->src_mac_addr, clientid, now);
+  }
+  if (ethhdr->dst_mac_addr[0] & 0x01) {
+    // broadcast and multicast
+    broadcast_packet(clientid, buf, len);
+  } else if (memcmp(ethhdr->dst_mac_addr, host_macaddr, ETHERNET_MAC_ADDR_LEN) == 0) {
+    handle_packet(&hclient[clientid], buf, len);
+  } else if ((c = fdb_lookup(ethhdr->dst_mac_addr, now)) < 0) {
+    flood_packet(clientid, buf, len);
+  } else if ((c != clientid) && (c < client_max)) {
+    queue_packet(&hclient[c], buf, len);
+  }
+}
+
+// receive up to BXHUB_BATCH frames from a port, returns the number of frames
+int receive_packets(hub_client_t *client)
+{
+  socklen_t slen;
+  int n;
+#ifdef __linux__
+  struct mmsghdr msgs[BXHUB_BATCH];
+  struct iovec iov[BXHUB_BATCH];
+  struct sockaddr_in src[BXHUB_BATCH];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (n = 0; n < BXHUB_BATCH; n++) {
+    iov[n].iov_base = rx_buffer[n];
+    iov[n].iov_len = BX_PACKET_BUFSIZE;
+    msgs[n].msg_hdr.msg_name = &src[n];
+    msgs[n].msg_hdr.msg_namelen = sizeof(src[n]);
+    msgs[n].msg_hdr.msg_iov = &iov[n];
+    msgs[n].msg_hdr.msg_iovlen = 1;
+  }
+  n = recvmmsg(client->so, msgs, BXHUB_BATCH, MSG_DONTWAIT, NULL);
+  if (n <= 0)
+    return 0;
+  for (int i = 0; i < n; i++) {
+    rx_len[i] = msgs[i].msg_len;
+  }
+  slen = msgs[n - 1].msg_hdr.msg_namelen;
+  if (slen == sizeof(client->sin)) {
+    memcpy(&client->sin, &src[n - 1], sizeof(client->sin));
+  }
+#else
+  slen = sizeof(client->sin);
+  n = recvfrom(client->so, (char*)rx_buffer[0], BX_PACKET_BUFSIZE, 0,
+               (struct sockaddr*) &client->sin, &slen);
+  if (n <= 0)
+    return 0;
+  rx_len[0] = n;
+  n = 1;
+#endif
+  stats.rx += n;
+  return n;
+}
+
+void handle_port(int clientid)
+{
+  hub_client_t *client = &hclient[clientid];
+  time_t now;
+  int i, n;
+
+  do {
+    n = receive_packets(client);
+    now = time(NULL);
+    for (i = 0; i < n; i++) {
+      forward_packet(clientid, rx_buffer[i], rx_len[i], now);
+    }
+    // the queued frames point to the receive buffers
+    for (i = 0; i < client_max; i++) {
+      if (hclient[i].txq_count > 0) {
+        flush_packets(&hclient[i]);
+      }
     }
+    // send reply from builtin service
+    while (client->pending_reply_size > 0) {
+      send_packet(client, client->reply_buffer, client->pending_reply_size);
+      // check for another pending packet
+      client->pending_reply_size = vnet_server.get_packet(client->reply_buffer);
+    }
+  } while (n == BXHUB_BATCH);
+  // check MAC address of new client
+  if (client->init < 0) {
+    fprintf(stderr, "bxhub - wrong MAC address configuration\n");
+  }
+}
+
+void print_stats()
+{
+  static time_t last = 0;
+  static Bit64u last_rx = 0, last_tx = 0, last_flooded = 0;
+  time_t now = time(NULL);
+
+  if (last == 0) {
+    last = now;
+  } else if ((now - last) >= stats_interval) {
+    printf("%u rx pkt/s, %u tx pkt/s, %u flooded/s\n",
+           (unsigned)((stats.rx - last_rx) / (now - last)),
+           (unsigned)((stats.tx - last_tx) / (now - last)),
+           (unsigned)((stats.flooded - last_flooded) / (now - last)));
+    fflush(stdout);
+    last = now;
+    last_rx = stats.rx;
+    last_tx = stats.tx;
+    last_flooded = stats.flooded;
   }
-  return (*clientid >= 0);
 }
 
 void print_usage()
@@ -163,14 +399,15 @@ void print_usage()
   fprintf(stderr,
     "Usage: bxhub [options]\n\n"
     "Supported options:\n"
-    "  -ports=...    number of virtual ethernet ports (2 - 6)\n"
+    "  -ports=...    number of virtual ethernet ports (2 - %d)\n"
     "  -base=...     base UDP port (bxhub uses 2 ports per Bochs session)\n"
     "  -mac=...      host MAC address (default is b0:c4:20:00:00:0f)\n"
     "  -tftp=...     enable FTP and TFTP support using specified directory as root\n"
     "  -bootfile=... network bootfile reported by DHCP - located on TFTP server\n"
     "  -loglev=...   set log level (0 - 3, default 1)\n"
     "  -logfile=...  send log output to file\n"
-    "  --help        display this help and exit\n\n");
+    "  -stats=...    print packet rates every n seconds\n"
+    "  --help        display this help and exit\n\n", BXHUB_MAX_CLIENTS);
 }
 
 int parse_cmdline(int argc, char *argv[])
@@ -186,6 +423,7 @@ int parse_cmdline(int argc, char *argv[])
   tftp_root[0] = 0;
   dhcp_bootfile[0] = 0;
   bx_logfname[0] = 0;
+  stats_interval = 0;
   memcpy(host_macaddr, default_host_macaddr, ETHERNET_MAC_ADDR_LEN);
   while ((arg < argc) && (ret == 1)) {
     // parse next arg
@@ -195,7 +433,7 @@ int parse_cmdline(int argc, char *argv[])
     }
     else if (!strncmp("-ports=", argv[arg], 7)) {
       n = atoi(&argv[arg][7]);
-      if ((n > 1) && (n < BXHUB_MAX_CLIENTS)) {
+      if ((n > 1) && (n <= BXHUB_MAX_CLIENTS)) {
         client_max = n;
       } else {
         printf("Number of virtual ethernet ports out of range\n\n");
@@ -239,6 +477,15 @@ int parse_cmdline(int argc, char *argv[])
     else if (!strncmp("-logfile=", argv[arg], 9)) {
       strcpy(bx_logfname, &argv[arg][9]);
     }
+    else if (!strncmp("-stats=", argv[arg], 7)) {
+      n = atoi(&argv[arg][7]);
+      if (n > 0) {
+        stats_interval = n;
+      } else {
+        printf("Statistics interval must be at least 1 second\n\n");
+        ret = 0;
+      }
+    }
     else if (argv[arg][0] == '-') {
       printf("Unknown option: %s\n\n", argv[arg]);
       ret = 0;
@@ -247,6 +494,10 @@ int parse_cmdline(int argc, char *argv[])
     }
     arg++;
   }
+  if ((ret == 1) && ((port_base + client_max * 2) > 65536)) {
+    printf("UDP base port number out of range\n\n");
+    ret = 0;
+  }
   return ret;
 }
 
@@ -259,6 +510,7 @@ void CDECL intHandler(int sig)
       }
       closesocket(hclient[i].so);
     }
+    delete [] hclient;
 #ifdef WIN32
     WSACleanup();
 #endif
@@ -268,11 +520,15 @@ void CDECL intHandler(int sig)
 
 int CDECL main(int argc, char **argv)
 {
-  int c, i, n;
-  socklen_t slen;
+  int i, n;
+#ifdef __linux__
+  int epfd;
+  struct epoll_event ev, events[BXHUB_MAX_CLIENTS];
+#else
+  SOCKET maxfd = 0;
   fd_set rfds;
-  Bit8u buf[BX_PACKET_BUFSIZE];
-  ethernet_header_t *ethhdr = (ethernet_header_t *)buf;
+  struct timeval tv;
+#endif
 
   if (!parse_cmdline(argc, argv))
     exit(0);
@@ -292,6 +548,7 @@ int CDECL main(int argc, char **argv)
   signal(SIGINT, intHandler);
 
   n_clients = 0;
+  hclient = new hub_client_t[client_max];
   for (i = 0; i < client_max; i++) {
     memset(&hclient[i], 0, sizeof(hub_client_t));
 
@@ -319,6 +576,26 @@ int CDECL main(int argc, char **argv)
     printf("RX port #%d in use: %d\n", i + 1, ntohs(hclient[i].sin.sin_port));
   }
 
+#ifdef __linux__
+  if ((epfd = epoll_create(client_max)) < 0) {
+    perror("bxhub - cannot create epoll instance");
+    exit(1);
+  }
+  for (i = 0; i < client_max; i++) {
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, hclient[i].so, &ev) < 0) {
+      perror("bxhub - cannot add socket to epoll instance");
+      exit(1);
+    }
+  }
+#else
+  for (i = 0; i < client_max; i++) {
+    if (hclient[i].so > maxfd)
+      maxfd = hclient[i].so;
+  }
+#endif
+
   memcpy(dhcp.host_macaddr, host_macaddr, ETHERNET_MAC_ADDR_LEN);
   memcpy(dhcp.net_ipv4addr, default_net_ipv4addr, 4);
   memcpy(dhcp.srv_ipv4addr[VNET_SRV], default_host_ipv4addr, 4);
@@ -352,45 +629,36 @@ int CDECL main(int argc, char **argv)
 
     /* wait for input */
 
+#ifdef __linux__
+    n = epoll_wait(epfd, events, BXHUB_MAX_CLIENTS,
+                   (stats_interval > 0) ? 1000 : -1);
+
+    /* data is available somewhere */
+
+    for (i = 0; i < n; i++) {
+      handle_port(events[i].data.u32);
+    }
+#else
     FD_ZERO(&rfds);
     for (i = 0; i < client_max; i++) {
       FD_SET(hclient[i].so, &rfds);
     }
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
 
-    n = select(hclient[client_max-1].so+1, &rfds, NULL, NULL, NULL);
+    n = select(maxfd+1, &rfds, NULL, NULL, (stats_interval > 0) ? &tv : NULL);
 
     /* data is available somewhere */
 
-    for (i = 0; i < client_max; i++) {
-      // check input
+    for (i = 0; (n > 0) && (i < client_max); i++) {
       if (FD_ISSET(hclient[i].so, &rfds)) {
-        slen = sizeof(hclient[i].sin);
-        n = recvfrom(hclient[i].so, (char*)buf, sizeof(buf), 0,
-                     (struct sockaddr*) &hclient[i].sin, &slen);
-        if (n > 0) {
-          if (memcmp(ethhdr->dst_mac_addr, broadcast_macaddr, ETHERNET_MAC_ADDR_LEN) == 0) {
-            broadcast_packet(i, buf, n);
-          } else if (memcmp(ethhdr->dst_mac_addr, host_macaddr, ETHERNET_MAC_ADDR_LEN) == 0) {
-            handle_packet(&hclient[i], buf, n);
-          } else if (find_client(ethhdr->dst_mac_addr, &c)) {
-            send_packet(&hclient[c], buf, n);
-          }
-        }
-      }
-      // send reply from builtin service
-      while (hclient[i].pending_reply_size > 0) {
-        send_packet(&hclient[i], hclient[i].reply_buffer, hclient[i].pending_reply_size);
-        // check for another pending packet
-        hclient[i].pending_reply_size = vnet_server.get_packet(hclient[i].reply_buffer);
-      }
-      // check MAC address of new client
-      if (hclient[i].init != 0) {
-        if (hclient[i].init < 0) {
-          fprintf(stderr, "bxhub - wrong MAC address configuration\n");
-          break;
-        }
+        handle_port(i);
       }
     }
+#endif
+    if (stats_interval > 0) {
+      print_stats();
+    }
   }
   return 0;
 }
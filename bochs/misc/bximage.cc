@@ -45,6 +45,11 @@
 #include "iodev/hdimage/vmware4.h"
 #include "iodev/hdimage/vpc.h"
 #include "iodev/hdimage/vbox.h"
+#include "bxthread.h"
+
+#ifndef WIN32
+#include <sys/time.h>
+#endif
 
 #define BXIMAGE_FUNC_NULL            0
 #define BXIMAGE_FUNC_CREATE_IMAGE    1
@@ -403,6 +408,247 @@ void create_flat_image_win32(const char *filename, Bit64u size)
 }
 #endif
 
+// Image data is copied in large chunks. A reader thread fills the chunks and
+// finds the data to write while the main thread writes the previous ones.
+#define COPY_CHUNK_SIZE   (4 << 20)
+#define COPY_CHUNK_COUNT  4
+
+typedef struct {
+  Bit64u offset;
+  Bit32u size;
+  Bit8u  *data;
+  Bit32u *runs;   // start sector and sector count of the data to write
+  Bit32u nruns;
+  bool   failed;
+} copy_chunk_t;
+
+typedef struct {
+  device_image_t *source;
+  Bit64u size;
+  bool   skip_zero;
+  copy_chunk_t chunk[COPY_CHUNK_COUNT];
+  int    filled;
+  bool   stop;
+  bool   reader_done;
+  BX_MUTEX(mutex);
+  bx_thread_sem_t data_sem; // signalled when a chunk has been filled
+  bx_thread_sem_t free_sem; // signalled when a chunk has been written
+} image_copy_t;
+
+// Redolog adapter for commit: only the sectors present in the redolog are
+// reported as allocated.
+class redolog_source_t : public device_image_t
+{
+  public:
+    redolog_source_t(redolog_t *_redolog, Bit64u size) {redolog = _redolog; hd_size = size;}
+    int open(const char* pathname, int flags) {return 0;}
+    void close() {}
+    Bit64s lseek(Bit64s offset, int whence) {return redolog->lseek(offset, whence);}
+    ssize_t read(void* buf, size_t count) {return redolog->read(buf, count);}
+    ssize_t write(const void* buf, size_t count) {return -1;}
+    bool is_allocated(Bit64s offset, Bit64s *length) {return redolog->is_allocated(offset, length);}
+  private:
+    redolog_t *redolog;
+};
+
+Bit64u get_msec()
+{
+#ifdef WIN32
+  return (Bit64u)GetTickCount();
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (Bit64u)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
+bool is_zero_sector(const Bit8u *buf)
+{
+  const Bit64u *p = (const Bit64u*)buf;
+
+  for (int i = 0; i < (512 / 8); i += 4) {
+    if ((p[i] | p[i + 1] | p[i + 2] | p[i + 3]) != 0) return false;
+  }
+  return true;
+}
+
+void add_copy_run(copy_chunk_t *chunk, Bit32u start, Bit32u count)
+{
+  if ((chunk->nruns > 0) &&
+      ((chunk->runs[(chunk->nruns - 1) * 2] + chunk->runs[(chunk->nruns - 1) * 2 + 1]) == start)) {
+    chunk->runs[(chunk->nruns - 1) * 2 + 1] += count;
+  } else {
+    chunk->runs[chunk->nruns * 2] = start;
+    chunk->runs[chunk->nruns * 2 + 1] = count;
+    chunk->nruns++;
+  }
+}
+
+// Read the allocated parts of a chunk and build the list of sector runs
+// to write. Unallocated ranges are neither read nor written.
+void fill_copy_chunk(image_copy_t *cp, copy_chunk_t *chunk, Bit64u offset)
+{
+  Bit64s len;
+  Bit32u pos = 0, i, start, nsect;
+  bool allocated;
+
+  chunk->offset = offset;
+  chunk->size = ((cp->size - offset) > COPY_CHUNK_SIZE) ? COPY_CHUNK_SIZE : (Bit32u)(cp->size - offset);
+  chunk->nruns = 0;
+  chunk->failed = 0;
+  while (pos < chunk->size) {
+    len = chunk->size - pos;
+    allocated = cp->source->is_allocated(offset + pos, &len);
+    len = (len + 511) & ~511;
+    if ((len <= 0) || (len > (Bit64s)(chunk->size - pos))) {
+      len = chunk->size - pos;
+    }
+    if (allocated) {
+      if ((cp->source->lseek(offset + pos, SEEK_SET) < 0) ||
+          (cp->source->read(chunk->data + pos, (size_t)len) != (ssize_t)len)) {
+        chunk->failed = 1;
+        return;
+      }
+      start = pos / 512;
+      nsect = (Bit32u)(len / 512);
+      if (cp->skip_zero) {
+        for (i = 0; i < nsect; i++) {
+          if (!is_zero_sector(chunk->data + (start + i) * 512)) {
+            add_copy_run(chunk, start + i, 1);
+          }
+        }
+      } else {
+        add_copy_run(chunk, start, nsect);
+      }
+    }
+    pos += (Bit32u)len;
+  }
+}
+
+BX_THREAD_FUNC(copy_reader_thread, indata)
+{
+  image_copy_t *cp = (image_copy_t*)indata;
+  Bit64u offset = 0;
+  int next = 0;
+  bool stop = 0;
+
+  while ((offset < cp->size) && !stop) {
+    BX_LOCK(cp->mutex);
+    while ((cp->filled == COPY_CHUNK_COUNT) && !cp->stop) {
+      BX_UNLOCK(cp->mutex);
+      bx_wait_sem(&cp->free_sem);
+      BX_LOCK(cp->mutex);
+    }
+    stop = cp->stop;
+    BX_UNLOCK(cp->mutex);
+    if (stop) break;
+    fill_copy_chunk(cp, &cp->chunk[next], offset);
+    offset += cp->chunk[next].size;
+    next = (next + 1) % COPY_CHUNK_COUNT;
+    BX_LOCK(cp->mutex);
+    cp->filled++;
+    BX_UNLOCK(cp->mutex);
+    bx_set_sem(&cp->data_sem);
+  }
+  BX_LOCK(cp->mutex);
+  cp->reader_done = 1;
+  BX_UNLOCK(cp->mutex);
+  bx_set_sem(&cp->data_sem);
+  BX_THREAD_EXIT;
+}
+
+// Copy size bytes of the source image to the destination image. Ranges
+// not allocated in the source are skipped and with skip_zero set, sectors
+// containing only zeros are not written.
+bool copy_image_data(device_image_t *source, device_image_t *dest, Bit64u size,
+                     bool skip_zero, const char *msg)
+{
+  image_copy_t cp;
+  copy_chunk_t *chunk;
+  BX_THREAD_VAR(reader);
+  Bit64u written = 0, stored = 0, start_time, msecs;
+  Bit32u i, len;
+  int next = 0, percent = -1;
+  bool error = false, done;
+
+  memset(&cp, 0, sizeof(cp));
+  cp.source = source;
+  cp.size = size;
+  cp.skip_zero = skip_zero;
+  for (i = 0; i < COPY_CHUNK_COUNT; i++) {
+    cp.chunk[i].data = new Bit8u[COPY_CHUNK_SIZE];
+    cp.chunk[i].runs = new Bit32u[COPY_CHUNK_SIZE / 512 + 2];
+  }
+  BX_INIT_MUTEX(cp.mutex);
+  bx_create_sem(&cp.data_sem);
+  bx_create_sem(&cp.free_sem);
+
+  printf("\n%s: [  0%%]", msg);
+  fflush(stdout);
+  start_time = get_msec();
+  BX_THREAD_CREATE(copy_reader_thread, &cp, reader);
+
+  while (written < size) {
+    BX_LOCK(cp.mutex);
+    while (cp.filled == 0) {
+      BX_UNLOCK(cp.mutex);
+      bx_wait_sem(&cp.data_sem);
+      BX_LOCK(cp.mutex);
+    }
+    BX_UNLOCK(cp.mutex);
+    chunk = &cp.chunk[next];
+    next = (next + 1) % COPY_CHUNK_COUNT;
+    if (chunk->failed) {
+      error = true;
+    }
+    for (i = 0; (i < chunk->nruns) && !error; i++) {
+      len = chunk->runs[i * 2 + 1] * 512;
+      if ((dest->lseek(chunk->offset + (Bit64u)chunk->runs[i * 2] * 512, SEEK_SET) < 0) ||
+          (dest->write(chunk->data + chunk->runs[i * 2] * 512, len) != (ssize_t)len)) {
+        error = true;
+      }
+      stored += len;
+    }
+    written += chunk->size;
+    BX_LOCK(cp.mutex);
+    cp.filled--;
+    if (error) cp.stop = 1;
+    BX_UNLOCK(cp.mutex);
+    bx_set_sem(&cp.free_sem);
+    if (error) break;
+    if ((int)(written * 100 / size) != percent) {
+      percent = (int)(written * 100 / size);
+      printf("\x8\x8\x8\x8\x8%3d%%]", percent);
+      fflush(stdout);
+    }
+  }
+
+  // wait for the reader (BX_THREAD_JOIN is a no-op on some hosts)
+  do {
+    BX_LOCK(cp.mutex);
+    done = cp.reader_done;
+    BX_UNLOCK(cp.mutex);
+    if (!done) bx_wait_sem(&cp.data_sem);
+  } while (!done);
+  BX_THREAD_JOIN(reader);
+  bx_destroy_sem(&cp.data_sem);
+  bx_destroy_sem(&cp.free_sem);
+  BX_FINI_MUTEX(cp.mutex);
+  for (i = 0; i < COPY_CHUNK_COUNT; i++) {
+    delete [] cp.chunk[i].data;
+    delete [] cp.chunk[i].runs;
+  }
+
+  if (!error) {
+    msecs = get_msec() - start_time;
+    if (msecs == 0) msecs = 1;
+    printf(" " FMT_LL "u MB in %u.%03u s (%u MB/s, " FMT_LL "u MB written)",
+           size >> 20, (unsigned)(msecs / 1000), (unsigned)(msecs % 1000),
+           (unsigned)((size >> 20) * 1000 / msecs), stored >> 20);
+  }
+  return !error;
+}
+
 device_image_t* create_hard_disk_image(const char *filename, const char *imgmode, Bit64u size)
 {
   device_image_t *hdimage = init_image(imgmode);
@@ -429,13 +675,10 @@ device_image_t* create_hard_disk_image(const char *filename, const char *imgmode
 void convert_image(const char *newimgmode, Bit64u newsize)
 {
   device_image_t *source_image, *dest_image;
-  Bit64u i, sc, s;
-  char buffer[512], null_sector[512];
   const char *imgmode = NULL;
   bool error = false;
 
   printf("\n");
-  memset(null_sector, 0, 512);
   if (newsize == 0) {
     if (!strncmp(bx_filename_1, "concat:", 7)) {
       imgmode = "concat";
@@ -471,30 +714,8 @@ void convert_image(const char *newimgmode, Bit64u newsize)
   if (dest_image->open(bx_filename_2) < 0)
     fatal("cannot open destination disk image");
 
-  printf("\nConverting image file: [  0%%]");
-
-  sc = source_image->hd_size / 512;
-  s = 0;
-  for (i = 0; i < source_image->hd_size; i+=512) {
-    printf("\x8\x8\x8\x8\x8%3d%%]", (int)((s+1)*100/sc));
-    fflush(stdout);
-    if (source_image->lseek(i, SEEK_SET) < 0) {
-      error = true;
-      break;
-    }
-    if ((source_image->read(buffer, 512) == 512) &&
-        (memcmp(buffer, null_sector, 512) != 0)) {
-      if (dest_image->lseek(i, SEEK_SET) < 0) {
-        error = true;
-        break;
-      }
-      if (dest_image->write(buffer, 512) < 0) {
-        error = true;
-        break;
-      }
-    }
-    s++;
-  }
+  error = !copy_image_data(source_image, dest_image, source_image->hd_size, 1,
+                           "Converting image file");
 
   source_image->close();
   dest_image->close();
@@ -512,7 +733,8 @@ void commit_redolog()
 {
   device_image_t *base_image;
   redolog_t *redolog;
-  int ret;
+  redolog_source_t *source;
+  bool ret;
   const char *imgmode = NULL;
 
   printf("\n");
@@ -532,14 +754,17 @@ void commit_redolog()
   if (!coherency_check(base_image, redolog))
     fatal("coherency check failed");
 
-  ret = redolog->commit(base_image);
+  source = new redolog_source_t(redolog, base_image->hd_size);
+  ret = copy_image_data(source, base_image, base_image->hd_size, 0,
+                        "Committing changes to base image file");
 
   base_image->close();
   redolog->close();
+  delete source;
   delete base_image;
   delete redolog;
 
-  if (ret < 0) {
+  if (!ret) {
     fatal("redolog commit failed");
   } else {
     printf(" Done.\n\n");
@@ -0,0 +1,134 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-bitblt.cc
+// $Id$
+//
+// This program checks the binary ROP handlers in iodev/display/bitblt.h
+// (used by the Cirrus and Banshee emulations) against a plain byte loop,
+// which is what the handlers were before they processed the rows in
+// blocks. For all 16 ROPs, forward and backward, random blits with random
+// sizes and pitches (negative ones included) are done in two copies of the
+// same memory. Source and destination often overlap, since guests rely on
+// the result of the byte loop in that case.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -o test-bitblt misc/test-bitblt.cc
+// Then run "test-bitblt" and see how it goes.  If mismatches=0, the ROP
+// handlers are good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#define BX_USE_BINARY_ROP
+#include "iodev/display/bitblt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_SIZE  65536
+#define BLITS      200000
+
+static const struct {
+  const char *name;
+  bx_bitblt_rop_t fwd, bkwd;
+} rops[16] = {
+  {"0", bitblt_rop_fwd_0, bitblt_rop_bkwd_0},
+  {"src_and_dst", bitblt_rop_fwd_src_and_dst, bitblt_rop_bkwd_src_and_dst},
+  {"nop", bitblt_rop_fwd_nop, bitblt_rop_bkwd_nop},
+  {"src_and_notdst", bitblt_rop_fwd_src_and_notdst, bitblt_rop_bkwd_src_and_notdst},
+  {"notdst", bitblt_rop_fwd_notdst, bitblt_rop_bkwd_notdst},
+  {"src", bitblt_rop_fwd_src, bitblt_rop_bkwd_src},
+  {"1", bitblt_rop_fwd_1, bitblt_rop_bkwd_1},
+  {"notsrc_and_dst", bitblt_rop_fwd_notsrc_and_dst, bitblt_rop_bkwd_notsrc_and_dst},
+  {"src_xor_dst", bitblt_rop_fwd_src_xor_dst, bitblt_rop_bkwd_src_xor_dst},
+  {"src_or_dst", bitblt_rop_fwd_src_or_dst, bitblt_rop_bkwd_src_or_dst},
+  {"notsrc_or_notdst", bitblt_rop_fwd_notsrc_or_notdst, bitblt_rop_bkwd_notsrc_or_notdst},
+  {"src_notxor_dst", bitblt_rop_fwd_src_notxor_dst, bitblt_rop_bkwd_src_notxor_dst},
+  {"src_or_notdst", bitblt_rop_fwd_src_or_notdst, bitblt_rop_bkwd_src_or_notdst},
+  {"notsrc", bitblt_rop_fwd_notsrc, bitblt_rop_bkwd_notsrc},
+  {"notsrc_or_dst", bitblt_rop_fwd_notsrc_or_dst, bitblt_rop_bkwd_notsrc_or_dst},
+  {"notsrc_and_notdst", bitblt_rop_fwd_notsrc_and_notdst, bitblt_rop_bkwd_notsrc_and_notdst},
+};
+
+// one byte of the ROPs above, in the same order
+static Bit8u reference_rop(unsigned rop, Bit8u s, Bit8u d)
+{
+  switch (rop) {
+    case 0:  return 0;
+    case 1:  return s & d;
+    case 2:  return d;
+    case 3:  return s & ~d;
+    case 4:  return ~d;
+    case 5:  return s;
+    case 6:  return 0xff;
+    case 7:  return ~s & d;
+    case 8:  return s ^ d;
+    case 9:  return s | d;
+    case 10: return ~s | ~d;
+    case 11: return ~(s ^ d);
+    case 12: return s | ~d;
+    case 13: return ~s;
+    case 14: return ~s | d;
+    default: return ~s & ~d;
+  }
+}
+
+// the byte loop of the forward and backward blits
+static void reference_blit(unsigned rop, bool backward, Bit8u *dst, const Bit8u *src,
+                           int dstpitch, int srcpitch, int bltwidth, int bltheight)
+{
+  int x, y, step = backward ? -1 : 1;
+
+  dstpitch -= step * bltwidth;
+  srcpitch -= step * bltwidth;
+  for (y = 0; y < bltheight; y++) {
+    for (x = 0; x < bltwidth; x++) {
+      *dst = reference_rop(rop, *src, *dst);
+      dst += step;
+      src += step;
+    }
+    dst += dstpitch;
+    src += srcpitch;
+  }
+}
+
+static Bit8u mem_ref[TEST_SIZE], mem_test[TEST_SIZE], mem_init[TEST_SIZE];
+
+int main()
+{
+  unsigned t, rop, mismatches = 0;
+  int width, height, dstpitch, srcpitch, srcoff, dstoff;
+  bool backward;
+
+  srand(1);
+  for (t = 0; t < TEST_SIZE; t++) {
+    mem_init[t] = (Bit8u)rand();
+  }
+  for (t = 0; t < BLITS; t++) {
+    rop = rand() % 16;
+    backward = (rand() & 1);
+    width = 1 + rand() % 200;
+    height = 1 + rand() % 8;
+    dstpitch = width + rand() % 64;
+    if ((rand() % 3) == 0) dstpitch = -dstpitch;
+    srcpitch = (rand() & 1) ? dstpitch : (width + rand() % 64) * ((rand() & 1) ? 1 : -1);
+    srcoff = (TEST_SIZE / 2) + (rand() % 400) - 200;
+    dstoff = (TEST_SIZE / 2) + (rand() % 400) - 200;
+    // source and destination close together every fourth time
+    if ((rand() % 4) == 0) dstoff = srcoff + (rand() % 40) - 20;
+    memcpy(mem_ref, mem_init, TEST_SIZE);
+    memcpy(mem_test, mem_init, TEST_SIZE);
+    reference_blit(rop, backward, mem_ref + dstoff, mem_ref + srcoff, dstpitch, srcpitch,
+                   width, height);
+    (backward ? rops[rop].bkwd : rops[rop].fwd)(mem_test + dstoff, mem_test + srcoff,
+                                                dstpitch, srcpitch, width, height);
+    if (memcmp(mem_ref, mem_test, TEST_SIZE)) {
+      if (mismatches++ < 10)
+        printf("%s %s: %dx%d, dst-src %d, pitch %d/%d: wrong result\n", rops[rop].name,
+               backward ? "backward" : "forward", width, height, dstoff - srcoff,
+               dstpitch, srcpitch);
+    }
+  }
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
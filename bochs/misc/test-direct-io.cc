@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-direct-io.cc
+// $Id$
+//
+// This program checks the uncached I/O helpers in iodev/hdimage/hdimage.cc
+// (direct_io_read() and direct_io_write()) against a copy of the file kept
+// in memory. Random requests with unaligned offsets, sizes and buffers go
+// through the bounce buffer path, requests that are aligned go to the file
+// directly. The file size is not a multiple of the granularity, so that
+// writes around the end of the file must zero the part of the last block
+// past EOF. The test runs with the file opened normally for granularities
+// of 512 and 4096 bytes, and with O_DIRECT (if the filesystem supports it)
+// for the granularity reported by direct_io_alignment().
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -DBXIMAGE -o test-direct-io misc/test-direct-io.cc
+// Then run "test-direct-io [scratch file]" and see how it goes.  If
+// mismatches=0, the helpers are good.  Use a scratch file on the
+// filesystem of interest, /tmp is often a tmpfs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/hdimage/hdimage.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FILE_MAX  (1024 * 1024 + 65536)
+#define REQ_MAX   20000
+#define REQUESTS  10000
+
+int bx_interactive = 0;
+
+void myexit(int code)
+{
+  exit(code);
+}
+
+device_image_t* init_image(const char *imgmode)
+{
+  return NULL;
+}
+
+static Bit8u shadow[FILE_MAX];
+
+static unsigned run_test(const char *path, int flags, unsigned align)
+{
+  static Bit8u check[FILE_MAX];
+  Bit8u *vector, *buf;
+  Bit64s offset, size, end;
+  size_t count;
+  ssize_t ret, expect;
+  unsigned t, mismatches = 0;
+  int fd, rfd;
+
+  // a file size that is a multiple of 512 but not of 4096
+  size = 7 * 512;
+  memset(shadow, 0, sizeof(shadow));
+  for (t = 0; t < size; t++) {
+    shadow[t] = (Bit8u)rand();
+  }
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if ((fd < 0) || (::write(fd, shadow, size) != size)) {
+    printf("cannot create '%s'\n", path);
+    exit(1);
+  }
+  ::close(fd);
+  fd = ::open(path, O_RDWR | flags);
+  if (fd < 0) {
+    return 0;
+  }
+  if (align == 0) {
+    align = direct_io_alignment(fd);
+    if (align == 0) {
+      ::close(fd);
+      return 0;
+    }
+  }
+  printf("%s, granularity %u\n", (flags != 0) ? "O_DIRECT" : "cached", align);
+  vector = bx_alloc_image_buffer(REQ_MAX + 2 * HDIMAGE_BUFFER_ALIGN);
+  for (t = 0; t < REQUESTS; t++) {
+    // one request in four is aligned to the granularity
+    if ((t & 3) == 0) {
+      offset = (Bit64s)(rand() % (FILE_MAX - REQ_MAX - align)) & ~(Bit64s)(align - 1);
+      count = ((1 + rand() % REQ_MAX) + align - 1) & ~(size_t)(align - 1);
+      buf = vector;
+    } else {
+      offset = rand() % (FILE_MAX - REQ_MAX - align);
+      count = 1 + rand() % REQ_MAX;
+      buf = vector + (rand() % HDIMAGE_BUFFER_ALIGN);
+    }
+    // every other request near the end of the file, while it can grow
+    if ((t & 1) && (size > 8192) && ((size + REQ_MAX + align) < FILE_MAX)) {
+      offset = (offset % 8192) + size - 8192;
+    }
+    ::lseek(fd, (off_t)offset, SEEK_SET);
+    if (rand() & 1) {
+      ret = direct_io_read(fd, offset, buf, count, align);
+      expect = (offset >= size) ? 0 : (ssize_t)(size - offset);
+      if (expect > (ssize_t)count) expect = count;
+      if ((ret != expect) || memcmp(buf, shadow + offset, expect)) {
+        printf("read at " FMT_LL "d, %u bytes: wrong data\n", offset, (unsigned)count);
+        mismatches++;
+      }
+    } else {
+      for (size_t i = 0; i < count; i++) {
+        buf[i] = (Bit8u)rand();
+      }
+      ret = direct_io_write(fd, offset, buf, count, align);
+      expect = count;
+      if (ret != expect) {
+        printf("write at " FMT_LL "d, %u bytes: returned %d\n", offset, (unsigned)count, (int)ret);
+        mismatches++;
+      }
+      memcpy(shadow + offset, buf, count);
+      // unaligned writes extend the file to the end of the last block
+      end = offset + count;
+      if (!direct_io_aligned(offset, buf, count, align)) {
+        end = (end + align - 1) & ~(Bit64s)(align - 1);
+      }
+      if (end > size) size = end;
+    }
+    if (::lseek(fd, 0, SEEK_CUR) != (offset + ret)) {
+      printf("request at " FMT_LL "d: wrong file position\n", offset);
+      mismatches++;
+    }
+  }
+  bx_free_image_buffer(vector);
+  ::close(fd);
+  // the whole file must match, including the zero filled tail blocks
+  rfd = ::open(path, O_RDONLY);
+  ret = ::read(rfd, check, sizeof(check));
+  ::close(rfd);
+  if ((ret != size) || memcmp(check, shadow, size)) {
+    printf("file contents differ (size %d, expected " FMT_LL "d)\n", (int)ret, size);
+    mismatches++;
+  }
+  return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = (argc > 1) ? argv[1] : "test-direct-io.tmp";
+  unsigned mismatches = 0;
+
+  srand(1);
+  mismatches += run_test(path, 0, 512);
+  mismatches += run_test(path, 0, 4096);
+#ifdef O_DIRECT
+  mismatches += run_test(path, O_DIRECT, 0);
+#endif
+  unlink(path);
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
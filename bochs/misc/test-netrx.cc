@@ -0,0 +1,278 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-netrx.cc
+// $Id$
+//
+// This program checks the receive ring of eth_fd_pktmover_c in
+// iodev/network/netmod.cc. A small pktmover reads frames from one end of
+// a datagram socket pair, the other end is fed with numbered frames of
+// random size. The timer that passes the frames to the device is called
+// from the main loop here, with the device ready to receive most of the
+// time. Every frame must arrive once and in order, short frames padded
+// with zeros, and nothing must be passed while the device is not ready.
+// With frames queued the timer must run at the short interval, once the
+// ring is drained it must fall back to the idle interval.
+//
+// Compile with (from the build directory, networking enabled):
+//   c++ -O2 -I. -o test-netrx misc/test-netrx.cc -lpthread
+// Then run "test-netrx" and see how it goes.  If mismatches=0, the
+// receive ring is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/network/netmod.cc"
+#include "bxthread.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#if !BX_NETWORKING || defined(WIN32)
+#error networking support on a POSIX host is required
+#endif
+
+#define FRAMES 20000
+
+static unsigned mismatches = 0;
+
+// just enough of the simulator to run the pktmover
+
+bx_simulator_interface_c *SIM = NULL;
+bx_pc_system_c bx_pc_system;
+
+static bx_timer_handler_t timer_handler = NULL;
+static void *timer_this = NULL;
+static Bit32u timer_interval = 0;
+
+bx_pc_system_c::bx_pc_system_c() {}
+
+int bx_pc_system_c::register_timer(void *this_ptr, bx_timer_handler_t funct,
+  Bit32u useconds, bool continuous, bool active, const char *id)
+{
+  timer_handler = funct;
+  timer_this = this_ptr;
+  timer_interval = useconds;
+  return 0;
+}
+
+void bx_pc_system_c::activate_timer(unsigned timer_index, Bit32u useconds, bool continuous)
+{
+  timer_interval = useconds;
+}
+
+void bx_pc_system_c::deactivate_timer(unsigned timer_index)
+{
+  timer_interval = 0;
+}
+
+logfunctions::logfunctions() {}
+logfunctions::~logfunctions() {}
+void logfunctions::put(const char *n, const char *p) {}
+void logfunctions::info(const char *fmt, ...) {}
+void logfunctions::ldebug(const char *fmt, ...) {}
+
+void logfunctions::error(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  mismatches++;
+}
+
+void logfunctions::panic(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  exit(1);
+}
+
+Bit8u bx_get_plugins_count_np(Bit16u type)
+{
+  return 0;
+}
+
+const char* bx_get_plugin_name_np(Bit16u type, Bit8u index)
+{
+  return NULL;
+}
+
+eth_pktmover_c *eth_capture_create(const char *capfile, const char *type,
+  const char *netif, const char *macaddr, eth_rx_handler_t rxh,
+  eth_rx_status_t rxstat, logfunctions *netdev, const char *script)
+{
+  return NULL;
+}
+
+// the pktmover and the device side
+
+class test_pktmover_c : public eth_fd_pktmover_c {
+public:
+  test_pktmover_c(int _fd, eth_rx_handler_t _rxh, eth_rx_status_t _rxstat,
+                  logfunctions *_netdev) {
+    fd = _fd;
+    rxh = _rxh;
+    rxstat = _rxstat;
+    netdev = _netdev;
+    start_rx(fd, "test");
+  }
+  virtual ~test_pktmover_c() {
+    stop_rx();
+  }
+  void sendpkt(void *buf, unsigned io_len) {}
+protected:
+  int rx_read(Bit8u *buf, unsigned size) {
+    return (int)recv(fd, buf, size, 0);
+  }
+private:
+  int fd;
+};
+
+static unsigned frame_len[FRAMES];
+static unsigned received = 0;
+static bool device_ready = 1;
+
+static Bit8u frame_byte(unsigned seq, unsigned i)
+{
+  return (Bit8u)(seq * 7 + i);
+}
+
+static Bit32u test_rxstat(void *arg)
+{
+  return device_ready ? BX_NETDEV_RXREADY : 0;
+}
+
+static void test_rxh(void *arg, const void *buf, unsigned len)
+{
+  const Bit8u *data = (const Bit8u*)buf;
+  unsigned seq, i, expect;
+
+  if (!device_ready) {
+    printf("frame passed while the device is not ready\n");
+    mismatches++;
+  }
+  seq = get_net4(data);
+  if (seq != received) {
+    printf("frame %u received, expected %u\n", seq, received);
+    mismatches++;
+    received = seq;
+  }
+  if (seq >= FRAMES) {
+    exit(1);
+  }
+  expect = frame_len[seq];
+  if (expect < MIN_RX_PACKET_LEN) expect = MIN_RX_PACKET_LEN;
+  if (len != expect) {
+    printf("frame %u: length %u, expected %u\n", seq, len, expect);
+    mismatches++;
+  }
+  for (i = 4; i < len; i++) {
+    if (data[i] != ((i < frame_len[seq]) ? frame_byte(seq, i) : 0)) {
+      printf("frame %u: wrong data at byte %u\n", seq, i);
+      mismatches++;
+      break;
+    }
+  }
+  received++;
+}
+
+// wait until the receive thread has read everything from the socket
+static void wait_drained(int fd)
+{
+  int pending;
+
+  do {
+    BX_MSLEEP(1);
+    if (ioctl(fd, FIONREAD, &pending) < 0) break;
+  } while (pending > 0);
+  BX_MSLEEP(10);
+}
+
+int main()
+{
+  static Bit8u buf[BX_PACKET_BUFSIZE];
+  logfunctions *netdev = new logfunctions();
+  test_pktmover_c *mover;
+  unsigned sent = 0, burst, i, last, loops;
+  int sv[2];
+
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) {
+    printf("cannot create socket pair\n");
+    return 1;
+  }
+  fcntl(sv[1], F_SETFL, fcntl(sv[1], F_GETFL) | O_NONBLOCK);
+  mover = new test_pktmover_c(sv[0], test_rxh, test_rxstat, netdev);
+  if ((timer_handler == NULL) || (timer_interval != BX_NETDEV_RXQ_IDLE)) {
+    printf("receive timer not registered at the idle interval\n");
+    mismatches++;
+  }
+
+  srand(1);
+  for (i = 0; i < FRAMES; i++) {
+    frame_len[i] = 4 + rand() % (1514 - 4 + 1);
+  }
+  // random bursts, the device not ready every fourth timer call
+  for (loops = 0; (received < FRAMES) && (loops < 10000000); loops++) {
+    burst = rand() % 40;
+    while ((burst-- > 0) && (sent < FRAMES)) {
+      put_net4(buf, sent);
+      for (i = 4; i < frame_len[sent]; i++) {
+        buf[i] = frame_byte(sent, i);
+      }
+      if (send(sv[1], buf, frame_len[sent], 0) < 0) break;
+      sent++;
+    }
+    device_ready = ((rand() & 3) != 0);
+    last = received;
+    timer_handler(timer_this);
+    if (!device_ready && (received != last)) {
+      mismatches++;
+    }
+    // every now and then let the ring fill up while the device is busy
+    if ((loops % 1000) == 999) {
+      device_ready = 0;
+      for (burst = 0; (burst < (2 * BX_NETDEV_RXQ_SIZE)) && (sent < FRAMES); burst++) {
+        put_net4(buf, sent);
+        for (i = 4; i < frame_len[sent]; i++) {
+          buf[i] = frame_byte(sent, i);
+        }
+        if (send(sv[1], buf, frame_len[sent], 0) < 0) {
+          BX_MSLEEP(1);
+          continue;
+        }
+        sent++;
+      }
+      wait_drained(sv[1]);
+      if (received < sent) {
+        timer_handler(timer_this);
+        if (timer_interval != BX_NETDEV_RXQ_TIMER) {
+          printf("frames queued, timer interval %u usec\n", timer_interval);
+          mismatches++;
+        }
+      }
+    }
+  }
+  if (received != FRAMES) {
+    printf("%u of %u frames received\n", received, FRAMES);
+    mismatches++;
+  }
+  // the ring is empty now
+  device_ready = 1;
+  timer_handler(timer_this);
+  if (timer_interval != BX_NETDEV_RXQ_IDLE) {
+    printf("ring drained, timer interval %u usec\n", timer_interval);
+    mismatches++;
+  }
+  delete mover;
+  close(sv[0]);
+  close(sv[1]);
+  printf("frames=%u mismatches=%u\n", received, mismatches);
+  return (mismatches > 0);
+}
@@ -0,0 +1,220 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-nogui-shm.cc
+// $Id$
+//
+// This program checks the shared memory frame export of the nogui display
+// library (gui/nogui.cc). It maps the export file of a running Bochs with
+// "display_library: nogui, options="shm=<file>"" and reads the frames the
+// way an outside tool would: take the current buffer, copy it and accept
+// the copy if its frame number has not changed meanwhile. The header and
+// buffer fields must be consistent, frame numbers must increase, and if
+// two frames in a row are read, the second one must be the same as the
+// first one with only the rectangles listed in it updated. A guest that
+// changes the screen a lot (scrolling text or a graphics demo) gives the
+// best coverage.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -o test-nogui-shm misc/test-nogui-shm.cc
+// Then run "test-nogui-shm <file> [seconds]" while Bochs is running and see
+// how it goes.  If mismatches=0, the frame export is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// the file layout, as in gui/nogui.cc
+
+#define NOGUI_SHM_MAGIC     "BXSHMFB1"
+#define NOGUI_SHM_VERSION   1
+#define NOGUI_SHM_MAX_RECTS 64
+#define NOGUI_SHM_FULL      0x01
+
+typedef struct {
+  Bit16u x, y, w, h;
+} nogui_rect_t;
+
+typedef struct {
+  Bit32u seq;
+  Bit32u width;
+  Bit32u height;
+  Bit32u pitch;
+  Bit32u guest_bpp;
+  Bit32u textmode;
+  Bit32u flags;
+  Bit32u nrects;
+  Bit32u data_offset;
+  Bit32u reserved[7];
+  nogui_rect_t rect[NOGUI_SHM_MAX_RECTS];
+  Bit32u palette[256];
+} nogui_shm_buffer_t;
+
+typedef struct {
+  char magic[8];
+  Bit32u version;
+  Bit32u header_size;
+  Bit32u buffer_size;
+  Bit32u max_xres;
+  Bit32u max_yres;
+  Bit32u active;
+  Bit32u current;
+  Bit32u frame;
+  Bit32u reserved[6];
+  nogui_shm_buffer_t buffer[2];
+} nogui_shm_header_t;
+
+static unsigned mismatches = 0;
+
+static void report(Bit32u seq, const char *msg)
+{
+  if (mismatches++ < 10)
+    printf("frame %u: %s\n", seq, msg);
+}
+
+static Bit32u load_acquire(const Bit32u *ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+// copy the latest frame, returns 0 if it was replaced while copying
+static bool read_frame(const nogui_shm_header_t *hdr, size_t size,
+                       nogui_shm_buffer_t *info, Bit8u *data)
+{
+  const nogui_shm_buffer_t *buf = &hdr->buffer[load_acquire(&hdr->current) & 1];
+  Bit32u seq = load_acquire(&buf->seq);
+  size_t len;
+
+  if (seq == 0)
+    return 0;
+  memcpy(info, buf, sizeof(nogui_shm_buffer_t));
+  len = (size_t)info->pitch * info->height;
+  if ((info->data_offset < hdr->header_size) || (len > hdr->buffer_size) ||
+      ((size_t)info->data_offset + len > size)) {
+    // only an error if the fields were read completely
+    if (load_acquire(&buf->seq) == seq)
+      report(seq, "pixel data outside of the file");
+    return 0;
+  }
+  memcpy(data, (const Bit8u *)hdr + info->data_offset, len);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return (__atomic_load_n(&buf->seq, __ATOMIC_RELAXED) == seq) && (info->seq == seq);
+}
+
+int main(int argc, char *argv[])
+{
+  const nogui_shm_header_t *hdr = NULL;
+  nogui_shm_buffer_t info, last_info;
+  Bit8u *data, *last, *tmp;
+  unsigned frames = 0, checked = 0, skipped = 0, i, y;
+  Bit32u last_seq = 0;
+  struct stat st;
+  time_t stop;
+  int fd = -1;
+
+  if (argc < 2) {
+    printf("usage: test-nogui-shm <file> [seconds]\n");
+    return 1;
+  }
+  stop = time(NULL) + ((argc > 2) ? atoi(argv[2]) : 10);
+  // Bochs may still be starting
+  while (time(NULL) < stop) {
+    fd = open(argv[1], O_RDONLY);
+    if ((fd >= 0) && (fstat(fd, &st) == 0) && ((size_t)st.st_size > sizeof(nogui_shm_header_t))) {
+      hdr = (const nogui_shm_header_t *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (hdr == MAP_FAILED) {
+        printf("cannot map '%s'\n", argv[1]);
+        return 1;
+      }
+      break;
+    }
+    if (fd >= 0) close(fd);
+    usleep(50000);
+  }
+  if (hdr == NULL) {
+    printf("no frame export file '%s'\n", argv[1]);
+    return 1;
+  }
+  close(fd);
+  while (memcmp(hdr->magic, NOGUI_SHM_MAGIC, 8)) {
+    if (time(NULL) >= stop) {
+      printf("no frame export header in '%s'\n", argv[1]);
+      return 1;
+    }
+    usleep(10000);
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if ((hdr->version != NOGUI_SHM_VERSION) || (hdr->header_size < sizeof(nogui_shm_header_t)) ||
+      ((size_t)hdr->header_size + 2 * (size_t)hdr->buffer_size > (size_t)st.st_size) ||
+      ((size_t)hdr->max_xres * hdr->max_yres * 4 > hdr->buffer_size)) {
+    printf("bad frame export header\n");
+    return 1;
+  }
+  data = new Bit8u[hdr->buffer_size];
+  last = new Bit8u[hdr->buffer_size];
+  memset(&last_info, 0, sizeof(last_info));
+
+  while (time(NULL) < stop) {
+    bool active = (load_acquire(&hdr->active) != 0);
+    if (read_frame(hdr, st.st_size, &info, data) && (info.seq != last_seq)) {
+      frames++;
+      if (info.seq < last_seq) {
+        report(info.seq, "older than the frame before");
+      }
+      if ((info.width > hdr->max_xres) || (info.height > hdr->max_yres) ||
+          (info.pitch != info.width * 4) || (info.nrects > NOGUI_SHM_MAX_RECTS)) {
+        report(info.seq, "bad buffer fields");
+        info.nrects = 0;
+        info.flags = NOGUI_SHM_FULL;
+      }
+      for (i = 0; i < info.nrects; i++) {
+        if (((unsigned)info.rect[i].x + info.rect[i].w > info.width) ||
+            ((unsigned)info.rect[i].y + info.rect[i].h > info.height)) {
+          report(info.seq, "rectangle outside of the frame");
+          info.flags = NOGUI_SHM_FULL;
+        }
+      }
+      if ((last_seq == 0) || (info.seq != last_seq + 1)) {
+        if (last_seq != 0) skipped++;
+      } else if (!(info.flags & NOGUI_SHM_FULL) && (info.width == last_info.width) &&
+                 (info.height == last_info.height)) {
+        // the frame before with the listed changes applied
+        for (i = 0; i < info.nrects; i++) {
+          for (y = info.rect[i].y; y < (unsigned)(info.rect[i].y + info.rect[i].h); y++) {
+            size_t offset = (size_t)y * info.pitch + info.rect[i].x * 4;
+            memcpy(last + offset, data + offset, info.rect[i].w * 4);
+          }
+        }
+        if (memcmp(last, data, (size_t)info.pitch * info.height)) {
+          report(info.seq, "changes outside of the listed rectangles");
+        }
+        checked++;
+      }
+      tmp = last;
+      last = data;
+      data = tmp;
+      last_info = info;
+      last_seq = info.seq;
+    }
+    if (!active) break;
+    usleep(2000);
+  }
+  if (frames == 0) {
+    printf("no frames published\n");
+    mismatches++;
+  }
+  printf("frames=%u checked=%u skipped=%u last=%u (%ux%u, %u bpp)\n", frames, checked,
+         skipped, last_seq, last_info.width, last_info.height, last_info.guest_bpp);
+  printf("mismatches=%u\n", mismatches);
+  delete [] data;
+  delete [] last;
+  return (mismatches > 0);
+}
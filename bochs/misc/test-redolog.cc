@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-redolog.cc
+// $Id$
+//
+// This program checks the write order of the redolog in
+// iodev/hdimage/hdimage.cc. It writes random sectors into a new growing
+// image and, after every write, reads the image file back through a
+// separate descriptor, the way it would be found after a crash. Every
+// extent with a catalog entry on disk must have a bitmap that is not all
+// zero, otherwise the data of that extent would be lost. At the end the
+// image is closed and all written data is compared with a copy kept in
+// memory.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -DBXIMAGE -o test-redolog misc/test-redolog.cc
+// Then run "test-redolog [image file]" and see how it goes.  If
+// mismatches=0, the redolog is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/hdimage/hdimage.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DISK_SIZE  (256 * 1024 * 1024)
+#define WRITES     3000
+#define MAX_SECTORS 64
+
+int bx_interactive = 0;
+
+void myexit(int code)
+{
+  exit(code);
+}
+
+// only growing images are used here
+device_image_t* init_image(const char *imgmode)
+{
+  return NULL;
+}
+
+// count the extents of the image file whose bitmap is all zero
+static unsigned zero_bitmaps(const char *path, unsigned *allocated)
+{
+  redolog_header_t header;
+  Bit32u *catalog, entries, bitmap_size, bitmap_blocks, extent_blocks, i, j;
+  Bit8u *bitmap;
+  Bit64s offset;
+  unsigned bad = 0;
+  int fd;
+
+  *allocated = 0;
+  fd = ::open(path, O_RDONLY);
+  if ((fd < 0) || (bx_read_image(fd, 0, &header, sizeof(header)) != sizeof(header))) {
+    printf("cannot read header of '%s'\n", path);
+    exit(1);
+  }
+  entries = dtoh32(header.specific.catalog);
+  bitmap_size = dtoh32(header.specific.bitmap);
+  bitmap_blocks = 1 + (bitmap_size - 1) / 512;
+  extent_blocks = 1 + (dtoh32(header.specific.extent) - 1) / 512;
+  catalog = new Bit32u[entries];
+  bitmap = new Bit8u[bitmap_size];
+  bx_read_image(fd, STANDARD_HEADER_SIZE, catalog, entries * sizeof(Bit32u));
+  for (i = 0; i < entries; i++) {
+    if (dtoh32(catalog[i]) == REDOLOG_PAGE_NOT_ALLOCATED)
+      continue;
+    (*allocated)++;
+    offset = (Bit64s)STANDARD_HEADER_SIZE + (entries * sizeof(Bit32u));
+    offset += (Bit64s)512 * dtoh32(catalog[i]) * (extent_blocks + bitmap_blocks);
+    memset(bitmap, 0, bitmap_size);
+    bx_read_image(fd, offset, bitmap, bitmap_size);
+    for (j = 0; (j < bitmap_size) && (bitmap[j] == 0); j++);
+    if (j == bitmap_size) {
+      printf("extent %u: catalog entry without bitmap\n", i);
+      bad++;
+    }
+  }
+  delete [] catalog;
+  delete [] bitmap;
+  ::close(fd);
+  return bad;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = (argc > 1) ? argv[1] : "test-redolog.img";
+  static Bit8u shadow[DISK_SIZE];
+  static Bit8u buf[MAX_SECTORS * 512];
+  growing_image_t *image = new growing_image_t();
+  unsigned t, sector, count, allocated = 0, mismatches = 0;
+
+  unlink(path);
+  if (image->create_image(path, DISK_SIZE) < 0) {
+    printf("cannot create '%s'\n", path);
+    return 1;
+  }
+  if (image->open(path, O_RDWR) < 0) {
+    printf("cannot open '%s'\n", path);
+    return 1;
+  }
+  srand(1);
+  for (t = 0; t < WRITES; t++) {
+    count = 1 + rand() % MAX_SECTORS;
+    // mostly clustered writes, so that extents are written more than once
+    if (t & 3) {
+      sector = rand() % (DISK_SIZE / 512 / 16);
+    } else {
+      sector = rand() % (DISK_SIZE / 512);
+    }
+    if ((sector + count) > (DISK_SIZE / 512)) {
+      sector = (DISK_SIZE / 512) - count;
+    }
+    for (unsigned i = 0; i < (count * 512); i++) {
+      buf[i] = (Bit8u)rand();
+    }
+    memcpy(shadow + (Bit64u)sector * 512, buf, count * 512);
+    image->lseek((Bit64s)sector * 512, SEEK_SET);
+    if (image->write(buf, count * 512) != (ssize_t)(count * 512)) {
+      printf("write of %u sectors at %u failed\n", count, sector);
+      mismatches++;
+    }
+    mismatches += zero_bitmaps(path, &allocated);
+  }
+  image->close();
+  if (image->open(path, O_RDONLY) < 0) {
+    printf("cannot reopen '%s'\n", path);
+    return 1;
+  }
+  for (sector = 0; sector < (DISK_SIZE / 512); sector += MAX_SECTORS) {
+    image->lseek((Bit64s)sector * 512, SEEK_SET);
+    image->read(buf, MAX_SECTORS * 512);
+    if (memcmp(buf, shadow + (Bit64u)sector * 512, MAX_SECTORS * 512)) {
+      printf("data mismatch at sector %u\n", sector);
+      mismatches++;
+    }
+  }
+  image->close();
+  delete image;
+  unlink(path);
+  printf("extents=%u mismatches=%u\n", allocated, mismatches);
+  return (mismatches > 0);
+}
@@ -0,0 +1,421 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-rfb.cc
+// $Id$
+//
+// This program checks the update encoders of the RFB display library
+// (gui/rfb.cc). It connects to a running Bochs with "display_library: rfb"
+// once for every encoding (Raw, Hextile and ZRLE), requests a full update
+// and decodes it. Every message must decode without errors and cover the
+// whole screen, and the frames received with Hextile and ZRLE must be the
+// same as the one received with Raw. The screen must not change while the
+// program runs, so use the "hideIPS" display library option and let the
+// guest wait with the text cursor turned off (or stop it in the debugger).
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -o test-rfb misc/test-rfb.cc -lz
+// Then run "test-rfb [host [port]]" and see how it goes.  If mismatches=0,
+// the encoders are good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+#define ENC_RAW          0
+#define ENC_HEXTILE      5
+#define ENC_ZRLE         16
+#define ENC_DESKTOPSIZE  -223
+
+#define READ_TIMEOUT     10000 // msec
+
+static int sock = -1;
+static z_stream zs;
+static unsigned width, height;
+static Bit8u *frame, *covered;
+
+static void fail(const char *msg)
+{
+  printf("%s\n", msg);
+  exit(1);
+}
+
+static void read_exact(void *buf, unsigned len)
+{
+  struct pollfd pfd;
+  ssize_t ret;
+
+  while (len > 0) {
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, READ_TIMEOUT) <= 0) fail("timeout waiting for the server");
+    ret = recv(sock, buf, len, 0);
+    if (ret <= 0) fail("connection closed by the server");
+    buf = (Bit8u*)buf + ret;
+    len -= ret;
+  }
+}
+
+static Bit8u read8(void)
+{
+  Bit8u val;
+  read_exact(&val, 1);
+  return val;
+}
+
+static Bit16u read16(void)
+{
+  Bit8u buf[2];
+  read_exact(buf, 2);
+  return (buf[0] << 8) | buf[1];
+}
+
+static Bit32u read32(void)
+{
+  Bit8u buf[4];
+  read_exact(buf, 4);
+  return ((Bit32u)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static void write_exact(const void *buf, unsigned len)
+{
+  if (send(sock, buf, len, 0) != (ssize_t)len) fail("cannot send to the server");
+}
+
+static void fill(unsigned x, unsigned y, unsigned w, unsigned h, Bit8u color)
+{
+  if (((x + w) > width) || ((y + h) > height)) fail("rectangle out of the screen");
+  for (unsigned r = 0; r < h; r++) {
+    memset(frame + (y + r) * width + x, color, w);
+    memset(covered + (y + r) * width + x, 1, w);
+  }
+}
+
+static void put(unsigned x, unsigned y, unsigned w, unsigned h, const Bit8u *data)
+{
+  if (((x + w) > width) || ((y + h) > height)) fail("rectangle out of the screen");
+  for (unsigned r = 0; r < h; r++) {
+    memcpy(frame + (y + r) * width + x, data + r * w, w);
+    memset(covered + (y + r) * width + x, 1, w);
+  }
+}
+
+static void decode_raw(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u *data = new Bit8u[w * h];
+
+  read_exact(data, w * h);
+  put(x, y, w, h, data);
+  delete [] data;
+}
+
+static void decode_hextile(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u tile[16 * 16], se, bg = 0, fg = 0, color, xy, wh, n;
+  bool have_bg = 0, have_fg = 0;
+  unsigned tx, ty, tw, th, sx, sy, sw, sh;
+
+  for (ty = y; ty < (y + h); ty += 16) {
+    th = ((y + h - ty) < 16) ? (y + h - ty) : 16;
+    for (tx = x; tx < (x + w); tx += 16) {
+      tw = ((x + w - tx) < 16) ? (x + w - tx) : 16;
+      se = read8();
+      if (se & 0x01) {
+        read_exact(tile, tw * th);
+        put(tx, ty, tw, th, tile);
+        have_bg = have_fg = 0;
+        continue;
+      }
+      if (se & 0x02) {
+        bg = read8();
+        have_bg = 1;
+      }
+      if (se & 0x04) {
+        fg = read8();
+        have_fg = 1;
+      }
+      if (!have_bg) fail("hextile: tile without background color");
+      fill(tx, ty, tw, th, bg);
+      if (se & 0x08) {
+        n = read8();
+        while (n-- > 0) {
+          if (se & 0x10) {
+            color = read8();
+          } else {
+            if (!have_fg) fail("hextile: subrect without foreground color");
+            color = fg;
+          }
+          xy = read8();
+          wh = read8();
+          sx = xy >> 4;
+          sy = xy & 15;
+          sw = (wh >> 4) + 1;
+          sh = (wh & 15) + 1;
+          if (((sx + sw) > tw) || ((sy + sh) > th))
+            fail("hextile: subrect out of the tile");
+          fill(tx + sx, ty + sy, sw, sh, color);
+        }
+      }
+    }
+  }
+}
+
+// ZRLE tile data (zlib decompressed)
+static Bit8u *zdata;
+static unsigned zlen, zpos;
+
+static Bit8u zread8(void)
+{
+  if (zpos >= zlen) fail("zrle: tile data overrun");
+  return zdata[zpos++];
+}
+
+static unsigned zread_runlength(void)
+{
+  unsigned len = 1;
+  Bit8u b;
+
+  do {
+    b = zread8();
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+static void decode_zrle(unsigned x, unsigned y, unsigned w, unsigned h)
+{
+  Bit8u tile[64 * 64], palette[128], se;
+  unsigned len, tx, ty, tw, th, i, n, bpp, bit, run, psize;
+  Bit8u *cdata;
+
+  len = read32();
+  cdata = new Bit8u[len];
+  read_exact(cdata, len);
+  // a full screen at 8 bpp is the worst case, plus a byte per tile
+  zlen = 0;
+  zdata = new Bit8u[2 * width * height + 65536];
+  zs.next_in = cdata;
+  zs.avail_in = len;
+  zs.next_out = zdata;
+  zs.avail_out = 2 * width * height + 65536;
+  if (inflate(&zs, Z_SYNC_FLUSH) != Z_OK) fail("zrle: inflate failed");
+  if (zs.avail_in != 0) fail("zrle: compressed data left over");
+  zlen = (2 * width * height + 65536) - zs.avail_out;
+  zpos = 0;
+  delete [] cdata;
+
+  for (ty = y; ty < (y + h); ty += 64) {
+    th = ((y + h - ty) < 64) ? (y + h - ty) : 64;
+    for (tx = x; tx < (x + w); tx += 64) {
+      tw = ((x + w - tx) < 64) ? (x + w - tx) : 64;
+      se = zread8();
+      if (se == 0) {
+        for (i = 0; i < (tw * th); i++) tile[i] = zread8();
+      } else if (se == 1) {
+        memset(tile, zread8(), tw * th);
+      } else if (se <= 16) {
+        for (i = 0; i < se; i++) palette[i] = zread8();
+        bpp = (se <= 2) ? 1 : ((se <= 4) ? 2 : 4);
+        for (unsigned r = 0; r < th; r++) {
+          Bit8u byte = 0;
+          for (i = 0, bit = 8; i < tw; i++) {
+            if (bit == 8) {
+              byte = zread8();
+              bit = 0;
+            }
+            n = (byte >> (8 - bpp - bit)) & ((1 << bpp) - 1);
+            if (n >= se) fail("zrle: palette index out of range");
+            tile[r * tw + i] = palette[n];
+            bit += bpp;
+          }
+        }
+      } else if (se == 128) {
+        for (i = 0; i < (tw * th); i += run) {
+          Bit8u color = zread8();
+          run = zread_runlength();
+          if ((i + run) > (tw * th)) fail("zrle: run out of the tile");
+          memset(tile + i, color, run);
+        }
+      } else if (se >= 130) {
+        psize = se - 128;
+        for (i = 0; i < psize; i++) palette[i] = zread8();
+        for (i = 0; i < (tw * th); i += run) {
+          n = zread8();
+          run = (n & 0x80) ? zread_runlength() : 1;
+          if ((n & 0x7f) >= psize) fail("zrle: palette index out of range");
+          if ((i + run) > (tw * th)) fail("zrle: run out of the tile");
+          memset(tile + i, palette[n & 0x7f], run);
+        }
+      } else {
+        fail("zrle: reserved subencoding");
+      }
+      put(tx, ty, tw, th, tile);
+    }
+  }
+  if (zpos != zlen) fail("zrle: tile data left over");
+  delete [] zdata;
+}
+
+// connect, receive a full frame with the given encoding and disconnect
+static Bit8u *receive_frame(const char *host, const char *port, Bit32s encoding)
+{
+  struct addrinfo hints, *res;
+  Bit8u buf[20], *result;
+  unsigned i, x, y, w, h, rects;
+  Bit32s enc;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &res) != 0) fail("cannot resolve the host name");
+  sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if ((sock < 0) || (connect(sock, res->ai_addr, res->ai_addrlen) < 0))
+    fail("cannot connect to the server");
+  freeaddrinfo(res);
+
+  read_exact(buf, 12);
+  write_exact("RFB 003.003\n", 12);
+  if (read32() != 1) fail("server requires authentication");
+  write_exact("\x01", 1); // shared
+  width = read16();
+  height = read16();
+  read_exact(buf, 16);    // pixel format, 8 bpp BGR233
+  read_exact(buf, 4);
+  for (i = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3]; i > 0; i--) {
+    read8();              // name
+  }
+  // SetEncodings
+  Bit8u se[12] = {2, 0, 0, 2};
+  se[4] = (Bit8u)(encoding >> 24); se[5] = (Bit8u)(encoding >> 16);
+  se[6] = (Bit8u)(encoding >> 8); se[7] = (Bit8u)encoding;
+  se[8] = 0xff; se[9] = 0xff; se[10] = 0xff; se[11] = 0x21; // DesktopSize
+  write_exact(se, sizeof(se));
+  // FramebufferUpdateRequest, not incremental
+  Bit8u fur[10] = {3, 0, 0, 0, 0, 0, (Bit8u)(width >> 8), (Bit8u)width,
+                   (Bit8u)(height >> 8), (Bit8u)height};
+  write_exact(fur, sizeof(fur));
+
+  frame = new Bit8u[width * height];
+  covered = new Bit8u[width * height];
+  memset(covered, 0, width * height);
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit(&zs) != Z_OK) fail("cannot initialize zlib");
+  while (memchr(covered, 0, width * height) != NULL) {
+    switch (read8()) {
+      case 0: // FramebufferUpdate
+        read8();
+        rects = read16();
+        while (rects-- > 0) {
+          x = read16();
+          y = read16();
+          w = read16();
+          h = read16();
+          enc = (Bit32s)read32();
+          if (enc == ENC_DESKTOPSIZE) {
+            delete [] frame;
+            delete [] covered;
+            width = w;
+            height = h;
+            frame = new Bit8u[width * height];
+            covered = new Bit8u[width * height];
+            memset(covered, 0, width * height);
+          } else if (enc != encoding) {
+            fail("rectangle with an encoding that was not requested");
+          } else if (enc == ENC_RAW) {
+            decode_raw(x, y, w, h);
+          } else if (enc == ENC_HEXTILE) {
+            decode_hextile(x, y, w, h);
+          } else {
+            decode_zrle(x, y, w, h);
+          }
+        }
+        // ask for more until the whole screen has been sent
+        fur[1] = 1;
+        write_exact(fur, sizeof(fur));
+        break;
+      case 2: // Bell
+        break;
+      case 3: // ServerCutText
+        read_exact(buf, 3);
+        for (i = read32(); i > 0; i--) read8();
+        break;
+      default:
+        fail("unknown server message");
+    }
+  }
+  inflateEnd(&zs);
+  close(sock);
+  result = frame;
+  delete [] covered;
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *host = (argc > 1) ? argv[1] : "127.0.0.1";
+  const char *port = (argc > 2) ? argv[2] : "5900";
+  static const struct {
+    const char *name;
+    Bit32s id;
+  } encodings[] = {{"Hextile", ENC_HEXTILE}, {"ZRLE", ENC_ZRLE}};
+  Bit8u *before, *after, *test[2];
+  unsigned ref_width, ref_height, size[2][2], e, i, diff, tries, mismatches = 0;
+
+  // a Raw frame before and after the others, to make sure that the screen
+  // didn't change in between
+  for (tries = 0; tries < 5; tries++) {
+    if (tries > 0) printf("screen changed during the check, trying again\n");
+    before = receive_frame(host, port, ENC_RAW);
+    ref_width = width;
+    ref_height = height;
+    for (e = 0; e < 2; e++) {
+      // the server needs a moment to notice the closed connection
+      usleep(200000);
+      test[e] = receive_frame(host, port, encodings[e].id);
+      size[e][0] = width;
+      size[e][1] = height;
+    }
+    usleep(200000);
+    after = receive_frame(host, port, ENC_RAW);
+    if ((width == ref_width) && (height == ref_height) &&
+        !memcmp(before, after, width * height))
+      break;
+    delete [] before;
+    delete [] after;
+    delete [] test[0];
+    delete [] test[1];
+    usleep(200000);
+  }
+  if (tries == 5) {
+    printf("the screen doesn't stay the same, hide the IPS and the text cursor\n");
+    return 1;
+  }
+  printf("screen %ux%u\n", ref_width, ref_height);
+  for (e = 0; e < 2; e++) {
+    if ((size[e][0] != ref_width) || (size[e][1] != ref_height)) {
+      printf("%s: screen size differs\n", encodings[e].name);
+      mismatches++;
+    } else {
+      for (i = 0, diff = 0; i < (ref_width * ref_height); i++) {
+        if (test[e][i] != before[i]) diff++;
+      }
+      if (diff > 0) {
+        printf("%s: %u pixels differ from the Raw frame\n", encodings[e].name, diff);
+        mismatches++;
+      }
+    }
+    delete [] test[e];
+  }
+  delete [] before;
+  delete [] after;
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
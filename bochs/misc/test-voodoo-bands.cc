@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-voodoo-bands.cc
+// $Id$
+//
+// This program checks the band split of the multi-threaded rasterizer in
+// iodev/display/voodoo_func.h. raster_dispatch() is called for random
+// scanline ranges with a band function that only counts the scanlines it
+// gets. When raster_dispatch() returns, every scanline of the range must
+// have been visited exactly once, no scanline outside of it, and the sum
+// of the pixel counts must be returned. Ranges taller than the Y clip mask
+// must be rendered by the issuing thread alone. The check runs for several
+// pool sizes.
+//
+// Compile with (from the build directory, Voodoo support enabled):
+//   c++ -O2 -I. -Iiodev -Iiodev/display -o test-voodoo-bands misc/test-voodoo-bands.cc -lpthread
+// Then run "test-voodoo-bands" and see how it goes.  If mismatches=0,
+// the band split is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/iodev.h"
+
+#if !BX_SUPPORT_PCI || !BX_SUPPORT_VOODOO
+#error Voodoo support is required
+#endif
+
+#include "iodev/pci.h"
+#include "iodev/display/vgacore.h"
+#include "iodev/display/ddc.h"
+#include "iodev/display/voodoo.h"
+#include "virt_timer.h"
+#include "bxthread.h"
+#define BX_USE_BINARY_ROP
+#include "iodev/display/bitblt.h"
+
+#define LOG_THIS theVoodooDevice->
+
+bx_voodoo_base_c* theVoodooDevice = NULL;
+
+#include "iodev/display/voodoo_types.h"
+#include "iodev/display/voodoo_data.h"
+#include "iodev/display/voodoo_main.h"
+voodoo_state *v;
+#include "iodev/display/voodoo_func.h"
+
+#include "bxthread.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LINES  4096
+#define DISPATCHES 20000
+
+void logfunctions::info(const char *fmt, ...) {}
+void logfunctions::ldebug(const char *fmt, ...) {}
+
+void logfunctions::error(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+}
+
+void logfunctions::panic(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  exit(1);
+}
+
+// scanline -MAX_LINES...MAX_LINES-1 is counted in visits[MAX_LINES + y]
+static Bit32u visits[2 * MAX_LINES];
+static Bit32u bad_bands, other_threads;
+
+static Bit32s count_band(const void *param, Bit32s starty, Bit32s stopy, int threadid)
+{
+  for (Bit32s y = starty; y < stopy; y++) {
+    __atomic_add_fetch(&visits[MAX_LINES + y], 1, __ATOMIC_RELAXED);
+  }
+  if ((threadid != 0) && ((stopy - starty) > RASTER_BAND_SCANLINES)) {
+    __atomic_add_fetch(&bad_bands, 1, __ATOMIC_RELAXED);
+  }
+  if (threadid != 0) {
+    __atomic_add_fetch(&other_threads, 1, __ATOMIC_RELAXED);
+  }
+  // two "pixels" per scanline
+  return 2 * (stopy - starty);
+}
+
+static unsigned run_test(unsigned threads)
+{
+  static const Bit16u clip_masks[] = {0x3ff, 0xfff};
+  unsigned t, mismatches = 0;
+  Bit32s starty, stopy, y;
+  Bit32u pixels, expect;
+
+  raster_start_threads(threads);
+  for (t = 0; t < DISPATCHES; t++) {
+    v->fbi.clip_mask = clip_masks[t & 1];
+    starty = (rand() % (2 * MAX_LINES)) - MAX_LINES;
+    // mostly small primitives, some of them taller than the clip mask
+    stopy = starty + rand() % ((t & 7) ? 64 : (2 * MAX_LINES));
+    if (stopy > MAX_LINES) stopy = MAX_LINES;
+    memset(visits, 0, sizeof(visits));
+    other_threads = 0;
+    pixels = raster_dispatch(count_band, NULL, starty, stopy);
+    for (y = -MAX_LINES; y < MAX_LINES; y++) {
+      expect = ((y >= starty) && (y < stopy)) ? 1 : 0;
+      if (visits[MAX_LINES + y] != expect) {
+        printf("%u threads: range %d...%d: scanline %d visited %u times\n",
+               threads, starty, stopy, y, visits[MAX_LINES + y]);
+        mismatches++;
+        break;
+      }
+    }
+    if (pixels != (Bit32u)(2 * (stopy - starty))) {
+      printf("%u threads: range %d...%d: %u pixels returned\n", threads, starty, stopy, pixels);
+      mismatches++;
+    }
+    if ((other_threads > 0) && ((Bit32u)(stopy - starty) > (Bit32u)v->fbi.clip_mask + 1)) {
+      printf("%u threads: range %d...%d taller than the clip mask split\n", threads, starty, stopy);
+      mismatches++;
+    }
+  }
+  raster_stop_threads();
+  if (bad_bands > 0) {
+    printf("%u threads: %u bands of more than %u scanlines\n", threads, bad_bands,
+           RASTER_BAND_SCANLINES);
+    mismatches++;
+    bad_bands = 0;
+  }
+  return mismatches;
+}
+
+int main()
+{
+  static const unsigned pool_sizes[] = {1, 2, 4, WORK_MAX_THREADS};
+  unsigned mismatches = 0;
+
+  v = new voodoo_state;
+  memset(v, 0, sizeof(voodoo_state));
+  srand(1);
+  for (unsigned i = 0; i < sizeof(pool_sizes) / sizeof(pool_sizes[0]); i++) {
+    mismatches += run_test(pool_sizes[i]);
+  }
+  delete v;
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
@@ -0,0 +1,185 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-voodoo-simd.cc
+// $Id$
+//
+// This program checks the pixel pipeline helpers of the Voodoo emulation
+// that have an SSE2 version (rgba_bilinear_filter() in voodoo_types.h and
+// alpha_blend_rgb() in voodoo_data.h) against the scalar code, which is
+// copied here as the reference. The results must be bit-exact. The filter
+// is checked with random texels and weights and with a sweep over all
+// channel values and weights, the blend with random colors and factors
+// for every source and dest blend mode. It also prints the time per call
+// of the filter.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -o test-voodoo-simd misc/test-voodoo-simd.cc
+// Then run "test-voodoo-simd" and see how it goes.  If mismatches=0, the
+// helpers are good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "bochs.h"
+#include "bxthread.h"
+#include "iodev/display/bitblt.h"
+#include "iodev/display/voodoo_types.h"
+#include "iodev/display/voodoo_data.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static rgb_t reference_filter(rgb_t rgb00, rgb_t rgb01, rgb_t rgb10, rgb_t rgb11, Bit8u u, Bit8u v)
+{
+  Bit32u ag0, ag1, rb0, rb1;
+
+  rb0 = (rgb00 & 0x00ff00ff) + ((((rgb01 & 0x00ff00ff) - (rgb00 & 0x00ff00ff)) * u) >> 8);
+  rb1 = (rgb10 & 0x00ff00ff) + ((((rgb11 & 0x00ff00ff) - (rgb10 & 0x00ff00ff)) * u) >> 8);
+  rgb00 >>= 8;
+  rgb01 >>= 8;
+  rgb10 >>= 8;
+  rgb11 >>= 8;
+  ag0 = (rgb00 & 0x00ff00ff) + ((((rgb01 & 0x00ff00ff) - (rgb00 & 0x00ff00ff)) * u) >> 8);
+  ag1 = (rgb10 & 0x00ff00ff) + ((((rgb11 & 0x00ff00ff) - (rgb10 & 0x00ff00ff)) * u) >> 8);
+
+  rb0 = (rb0 & 0x00ff00ff) + ((((rb1 & 0x00ff00ff) - (rb0 & 0x00ff00ff)) * v) >> 8);
+  ag0 = (ag0 & 0x00ff00ff) + ((((ag1 & 0x00ff00ff) - (ag0 & 0x00ff00ff)) * v) >> 8);
+
+  return ((ag0 << 8) & 0xff00ff00) | (rb0 & 0x00ff00ff);
+}
+
+// source (or dest) blend factor of a channel for the scalar code
+static int reference_factor(int mode, bool dest, int sc, int dc, int sa, int da, int prefog)
+{
+  int ta;
+
+  switch (mode) {
+    default:  /* reserved */
+    case 0:   /* AZERO */
+      return 0;
+    case 1:   /* ASRC_ALPHA */
+      return sa + 1;
+    case 2:   /* A_COLOR */
+      return (dest ? sc : dc) + 1;
+    case 3:   /* ADST_ALPHA */
+      return da + 1;
+    case 4:   /* AONE */
+      return 0x100;
+    case 5:   /* AOMSRC_ALPHA */
+      return 0x100 - sa;
+    case 6:   /* AOM_COLOR */
+      return 0x100 - (dest ? sc : dc);
+    case 7:   /* AOMDST_ALPHA */
+      return 0x100 - da;
+    case 15:  /* ASATURATE or A_COLORBEFOREFOG */
+      if (dest) return prefog + 1;
+      ta = (sa < (0x100 - da)) ? sa : (0x100 - da);
+      return ta + 1;
+  }
+}
+
+static int reference_blend(Bit32u alphamode, int sc, int dc, int sa, int da, int prefog)
+{
+  int result;
+
+  result = (sc * reference_factor(ALPHAMODE_SRCRGBBLEND(alphamode), 0, sc, dc, sa, da, prefog)) >> 8;
+  result += (dc * reference_factor(ALPHAMODE_DSTRGBBLEND(alphamode), 1, sc, dc, sa, da, prefog)) >> 8;
+  // done by the caller of alpha_blend_rgb()
+  CLAMP(result, 0x00, 0xff);
+  return result;
+}
+
+static Bit32u rand32(void)
+{
+  return ((Bit32u)rand() << 16) ^ (Bit32u)rand();
+}
+
+int main()
+{
+  static rgb_t texels[4096];
+  unsigned mismatches = 0, i, t;
+  rgb_t a, b, c, d, r1, r2;
+  Bit8u u, v;
+
+  srand(1);
+  printf("SSE2 helpers %s\n", BX_VOODOO_SSE2 ? "enabled" : "disabled");
+  for (t = 0; t < 20000000; t++) {
+    a = rand32(); b = rand32(); c = rand32(); d = rand32();
+    // large differences between neighbours every other time
+    if (t & 1) {
+      a &= 0x0f0f0f0f;
+      b |= 0xf0f0f0f0;
+    }
+    u = (Bit8u)rand();
+    v = (Bit8u)rand();
+    r1 = rgba_bilinear_filter(a, b, c, d, u, v);
+    r2 = reference_filter(a, b, c, d, u, v);
+    if (r1 != r2) {
+      if (mismatches++ < 10)
+        printf("filter %08x %08x %08x %08x u=%u v=%u: %08x != %08x\n", a, b, c, d, u, v, r1, r2);
+    }
+  }
+  // every channel value pair for every weight
+  for (i = 0; i < 256 * 256; i++) {
+    a = (i & 0xff) * 0x01010101;
+    b = (i >> 8) * 0x01010101;
+    for (t = 0; t < 256; t++) {
+      r1 = rgba_bilinear_filter(a, b, b, a, (Bit8u)t, (Bit8u)(255 - t));
+      r2 = reference_filter(a, b, b, a, (Bit8u)t, (Bit8u)(255 - t));
+      if (r1 != r2) {
+        if (mismatches++ < 10)
+          printf("filter %08x %08x u=%u: %08x != %08x\n", a, b, t, r1, r2);
+      }
+    }
+  }
+
+  for (t = 0; t < 20000000; t++) {
+    Bit32u mode = (Bit32u)(t & 0xff) << 8;
+    int col[3], dst[3], fog[3], sa = rand() & 0xff, da = rand() & 0xff;
+    Bit32s rr, gg, bb;
+
+    // fully transparent and opaque alpha values every other time
+    if (t & 0x100) {
+      sa = (t & 0x200) ? 0xff : 0;
+      da = (t & 0x400) ? 0xff : 0;
+    }
+    for (i = 0; i < 3; i++) {
+      col[i] = rand() & 0xff;
+      dst[i] = rand() & 0xff;
+      fog[i] = rand() & 0xff;
+    }
+    rr = col[0]; gg = col[1]; bb = col[2];
+    alpha_blend_rgb(mode, rr, gg, bb, sa, da, dst[0], dst[1], dst[2], fog[0], fog[1], fog[2]);
+    CLAMP(rr, 0x00, 0xff);
+    CLAMP(gg, 0x00, 0xff);
+    CLAMP(bb, 0x00, 0xff);
+    if ((rr != reference_blend(mode, col[0], dst[0], sa, da, fog[0])) ||
+        (gg != reference_blend(mode, col[1], dst[1], sa, da, fog[1])) ||
+        (bb != reference_blend(mode, col[2], dst[2], sa, da, fog[2]))) {
+      if (mismatches++ < 10)
+        printf("blend mode %04x: src %02x%02x%02x/%02x dst %02x%02x%02x/%02x\n", mode,
+               col[0], col[1], col[2], sa, dst[0], dst[1], dst[2], da);
+    }
+  }
+  printf("mismatches=%u\n", mismatches);
+
+  for (i = 0; i < 4096; i++) {
+    texels[i] = rand32();
+  }
+  for (unsigned k = 0; k < 2; k++) {
+    volatile rgb_t sink = 0;
+    clock_t start = clock();
+    for (t = 0; t < 10000; t++) {
+      for (i = 0; i < 4092; i++) {
+        if (k == 0) {
+          sink += rgba_bilinear_filter(texels[i], texels[i + 1], texels[i + 2], texels[i + 3], i, t);
+        } else {
+          sink += reference_filter(texels[i], texels[i + 1], texels[i + 2], texels[i + 3], i, t);
+        }
+      }
+    }
+    double ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / (10000.0 * 4092);
+    printf("filter %s: %.2f ns\n", (k == 0) ? "in use" : "scalar", ns);
+  }
+  return (mismatches > 0);
+}
@@ -0,0 +1,178 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// test-wbcache.cc
+// $Id$
+//
+// This program checks the write-back cache in iodev/hdimage/hdimage.cc.
+// A flat image is opened through wbcache_image_t and some sectors are
+// written without a sync. While nothing else happens, the image file
+// (read back through a separate descriptor) must be up to date within
+// two flush intervals. Then random reads and writes of up to 256 sectors,
+// enough to reach the flush threshold, are compared with a copy kept in
+// memory. At the end the image is closed and the whole file is compared.
+//
+// Compile with (from the build directory):
+//   c++ -O2 -I. -o test-wbcache misc/test-wbcache.cc iodev/hdimage/cdrom.cc iodev/hdimage/cdrom_misc.cc gui/paramtree.cc -lpthread
+// Then run "test-wbcache [image file]" and see how it goes.  If
+// mismatches=0, the cache is good.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "iodev/hdimage/hdimage.cc"
+#include "bxthread.cc"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DISK_SIZE   (32 * 1024 * 1024)
+#define REQUESTS    20000
+#define MAX_SECTORS 256
+
+// just enough of the simulator to link the image code
+
+bx_simulator_interface_c *SIM = NULL;
+bx_list_c *root_param = NULL;
+logfunctions *siminterface_log = NULL;
+
+logfunctions::logfunctions() {}
+logfunctions::~logfunctions() {}
+void logfunctions::put(const char *p) {}
+void logfunctions::put(const char *n, const char *p) {}
+void logfunctions::info(const char *fmt, ...) {}
+void logfunctions::ldebug(const char *fmt, ...) {}
+
+void logfunctions::error(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+}
+
+void logfunctions::panic(const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  exit(1);
+}
+
+Bit8u bx_get_plugins_count_np(Bit16u type)
+{
+  return 0;
+}
+
+const char* bx_get_plugin_name_np(Bit16u type, Bit8u index)
+{
+  return NULL;
+}
+
+static Bit8u shadow[DISK_SIZE];
+
+// compare the image file with the copy in memory
+static bool file_matches(const char *path)
+{
+  static Bit8u check[DISK_SIZE];
+  int fd = ::open(path, O_RDONLY);
+  ssize_t ret = bx_read_image(fd, 0, check, DISK_SIZE);
+
+  ::close(fd);
+  return (ret == DISK_SIZE) && !memcmp(check, shadow, DISK_SIZE);
+}
+
+static void random_sectors(Bit8u *buf, unsigned count)
+{
+  for (unsigned i = 0; i < (count * 512); i++) {
+    buf[i] = (Bit8u)rand();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = (argc > 1) ? argv[1] : "test-wbcache.img";
+  static Bit8u buf[MAX_SECTORS * 512];
+  wbcache_image_t *image;
+  unsigned t, sector, count, waited, mismatches = 0;
+  int fd;
+
+  srand(1);
+  memset(shadow, 0, sizeof(shadow));
+  fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if ((fd < 0) || (bx_write_image(fd, 0, shadow, DISK_SIZE) != DISK_SIZE)) {
+    printf("cannot create '%s'\n", path);
+    return 1;
+  }
+  ::close(fd);
+  image = new wbcache_image_t(new flat_image_t());
+  if (image->open(path, O_RDWR) < 0) {
+    printf("cannot open '%s'\n", path);
+    return 1;
+  }
+
+  // a few writes, then nothing: the idle flush must write them back
+  for (t = 0; t < 16; t++) {
+    sector = rand() % (DISK_SIZE / 512);
+    random_sectors(buf, 1);
+    memcpy(shadow + (Bit64u)sector * 512, buf, 512);
+    image->lseek((Bit64s)sector * 512, SEEK_SET);
+    image->write(buf, 512);
+  }
+  for (waited = 0; waited <= (2 * WBCACHE_FLUSH_INTERVAL * 10); waited++) {
+    if (file_matches(path)) break;
+    BX_MSLEEP(100);
+  }
+  if (waited > (2 * WBCACHE_FLUSH_INTERVAL * 10)) {
+    printf("idle cache not written back after %u seconds\n", 2 * WBCACHE_FLUSH_INTERVAL);
+    mismatches++;
+  } else {
+    printf("idle cache written back after %u.%u seconds\n", waited / 10, waited % 10);
+  }
+
+  // random requests, clustered so that cached sectors are hit
+  for (t = 0; t < REQUESTS; t++) {
+    count = 1 + rand() % ((t & 15) ? 16 : MAX_SECTORS);
+    if (t & 3) {
+      sector = rand() % (DISK_SIZE / 512 / 16);
+    } else {
+      sector = rand() % (DISK_SIZE / 512);
+    }
+    if ((sector + count) > (DISK_SIZE / 512)) {
+      sector = (DISK_SIZE / 512) - count;
+    }
+    image->lseek((Bit64s)sector * 512, SEEK_SET);
+    if (rand() & 1) {
+      if ((image->read(buf, count * 512) != (ssize_t)(count * 512)) ||
+          memcmp(buf, shadow + (Bit64u)sector * 512, count * 512)) {
+        printf("read of %u sectors at %u: wrong data\n", count, sector);
+        mismatches++;
+      }
+    } else {
+      random_sectors(buf, count);
+      memcpy(shadow + (Bit64u)sector * 512, buf, count * 512);
+      if (image->write(buf, count * 512) != (ssize_t)(count * 512)) {
+        printf("write of %u sectors at %u failed\n", count, sector);
+        mismatches++;
+      }
+    }
+    if ((t % 5000) == 4999) {
+      image->sync();
+      if (!file_matches(path)) {
+        printf("image file differs after sync\n");
+        mismatches++;
+      }
+    }
+  }
+  delete image;
+  if (!file_matches(path)) {
+    printf("image file differs after close\n");
+    mismatches++;
+  }
+  unlink(path);
+  printf("mismatches=%u\n", mismatches);
+  return (mismatches > 0);
+}
@@ -81,6 +81,8 @@
 #define BXPN_VGA_EXTENSION               "display.vga_extension"
 #define BXPN_VGA_UPDATE_FREQUENCY        "display.vga_update_frequency"
 #define BXPN_VGA_REALTIME                "display.vga_realtime"
+#define BXPN_VGA_RENDER_THREAD           "display.vga_render_thread"
+#define BXPN_VGA_UPDATE_DAMAGE           "display.vga_update_damage"
 #define BXPN_DDC_MODE                    "display.ddc_mode"
 #define BXPN_DDC_FILE                    "display.ddc_file"
 #define BXPN_VBE_MEMSIZE                 "display.vbe_memsize"
@@ -146,6 +148,7 @@
 #define BXPN_NE2K                        "network.ne2k"
 #define BXPN_PNIC                        "network.pcipnic"
 #define BXPN_E1000                       "network.e1000"
+#define BXPN_VIRTIO_NET                  "network.virtio_net"
 #define BXPN_SOUNDLOW                    "sound.lowlevel"
 #define BXPN_SOUND_WAVEOUT_DRV           "sound.lowlevel.waveoutdrv"
 #define BXPN_SOUND_WAVEOUT               "sound.lowlevel.waveout"
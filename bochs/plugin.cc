@@ -1078,6 +1078,9 @@ plugin_t bx_builtin_plugins[] = {
 #if BX_SUPPORT_USB_XHCI
   BUILTIN_OPTPCI_PLUGIN_ENTRY(usb_xhci),
 #endif
+#if BX_SUPPORT_VIRTIO_NET
+  BUILTIN_OPTPCI_PLUGIN_ENTRY(virtio_net),
+#endif
 #if BX_SUPPORT_SOUNDLOW
   BUILTIN_SND_PLUGIN_ENTRY(dummy),
   BUILTIN_SND_PLUGIN_ENTRY(file),
@@ -1102,6 +1105,7 @@ plugin_t bx_builtin_plugins[] = {
 #endif
 #if BX_NETWORKING
   BUILTIN_NET_PLUGIN_ENTRY(null),
+  BUILTIN_NET_PLUGIN_ENTRY(replay),
   BUILTIN_NET_PLUGIN_ENTRY(vnet),
 #if BX_NETMOD_FBSD
   BUILTIN_NET_PLUGIN_ENTRY(fbsd),
@@ -1109,6 +1113,9 @@ plugin_t bx_builtin_plugins[] = {
 #if BX_NETMOD_LINUX
   BUILTIN_NET_PLUGIN_ENTRY(linux),
 #endif
+#if BX_NETMOD_SHM
+  BUILTIN_NET_PLUGIN_ENTRY(shm),
+#endif
 #if BX_NETMOD_SLIRP
   BUILTIN_NET_PLUGIN_ENTRY(slirp),
 #endif
@@ -68,6 +68,7 @@ extern "C" {
 #define BX_PLUGIN_USB_XHCI  "usb_xhci"
 #define BX_PLUGIN_PCIPNIC   "pcipnic"
 #define BX_PLUGIN_E1000     "e1000"
+#define BX_PLUGIN_VIRTIO_NET "virtio_net"
 #define BX_PLUGIN_GAMEPORT  "gameport"
 #define BX_PLUGIN_SPEAKER   "speaker"
 #define BX_PLUGIN_ACPI      "acpi"
@@ -181,7 +182,7 @@ extern "C" {
 #define DEV_hd_write_handler(a, b, c, d) \
     (bx_devices.pluginHardDrive->virt_write_handler(b, c, d))
 #define DEV_hd_bmdma_read_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_read_sector(a,b,c)
-#define DEV_hd_bmdma_write_sector(a,b) bx_devices.pluginHardDrive->bmdma_write_sector(a,b)
+#define DEV_hd_bmdma_write_sector(a,b,c) bx_devices.pluginHardDrive->bmdma_write_sector(a,b,c)
 #define DEV_hd_bmdma_complete(a) bx_devices.pluginHardDrive->bmdma_complete(a)
 
 #define DEV_bulk_io_quantum_requested() (bx_devices.bulkIOQuantumsRequested)
@@ -225,8 +226,8 @@ extern "C" {
 #define DEV_pci_get_slot_mapping() bx_devices.pci_get_slot_mapping()
 #define DEV_pci_get_confAddr() bx_devices.pci_get_confAddr()
 #define DEV_pci_set_irq(a,b,c) bx_devices.pluginPci2IsaBridge->pci_set_irq(a,b,c)
-#define DEV_pci_set_base_mem(a,b,c,d,e,f) \
-  (bx_devices.pci_set_base_mem(a,b,c,d,e,f))
+#define DEV_pci_set_base_mem(a,b,c,d,e,f,g) \
+  (bx_devices.pci_set_base_mem(a,b,c,d,e,f,g))
 #define DEV_pci_set_base_io(a,b,c,d,e,f,g,h) \
   (bx_devices.pci_set_base_io(a,b,c,d,e,f,g,h))
 #define DEV_ide_bmdma_present() bx_devices.pluginPciIdeController->bmdma_present()
@@ -244,6 +245,8 @@ extern "C" {
 ///////// Memory macros
 #define DEV_register_memory_handlers(param,rh,wh,b,e) \
     bx_devices.mem->registerMemoryHandlers(param,rh,wh,b,e)
+#define DEV_register_memory_handlers_da(param,rh,wh,dah,b,e) \
+    bx_devices.mem->registerMemoryHandlers(param,rh,wh,dah,b,e)
 #define DEV_unregister_memory_handlers(param,b,e) \
     bx_devices.mem->unregisterMemoryHandlers(param,b,e)
 #define DEV_mem_set_memory_type(a,b,c) \
@@ -433,6 +436,7 @@ PLUGIN_ENTRY_FOR_MODULE(netmod);
 PLUGIN_ENTRY_FOR_MODULE(ne2k);
 PLUGIN_ENTRY_FOR_MODULE(pcipnic);
 PLUGIN_ENTRY_FOR_MODULE(e1000);
+PLUGIN_ENTRY_FOR_MODULE(virtio_net);
 PLUGIN_ENTRY_FOR_MODULE(extfpuirq);
 PLUGIN_ENTRY_FOR_MODULE(gameport);
 PLUGIN_ENTRY_FOR_MODULE(speaker);
@@ -470,6 +474,8 @@ PLUGIN_ENTRY_FOR_SND_MODULE(win);
 PLUGIN_ENTRY_FOR_NET_MODULE(fbsd);
 PLUGIN_ENTRY_FOR_NET_MODULE(linux);
 PLUGIN_ENTRY_FOR_NET_MODULE(null);
+PLUGIN_ENTRY_FOR_NET_MODULE(replay);
+PLUGIN_ENTRY_FOR_NET_MODULE(shm);
 PLUGIN_ENTRY_FOR_NET_MODULE(slirp);
 PLUGIN_ENTRY_FOR_NET_MODULE(socket);
 PLUGIN_ENTRY_FOR_NET_MODULE(tap);